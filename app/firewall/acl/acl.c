@@ -1,16 +1,30 @@
+#include <inttypes.h>
+#include <strings.h>
 #include <arpa/inet.h>
 #include <rte_acl.h>
 #include <rte_ip.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
 
 #include "../config.h"
 #include "../module.h"
 #include "../packet.h"
 #include "../json.h"
 #include "../cli.h"
+#include "../capture/capture.h"
+#include "../interface/interface.h"
+#include "../qos/qos.h"
+#include "../geo/geo.h"
+#include "../hot.h"
 
 #include "acl.h"
+#include "group.h"
 
-struct rte_acl_field_def acl_field_def[5] = {
+/** Geo tags follow the tuple in packet_t, the key is the tuple
+ * */
+#define ACL_GEO_OFFSET(f)   (offsetof(packet_t, f) - offsetof(packet_t, tuple))
+
+struct rte_acl_field_def acl_field_def[ACL_FIELD_NUM] = {
     {
         .type = RTE_ACL_FIELD_TYPE_BITMASK,
         .size = sizeof(uint8_t),
@@ -50,12 +64,38 @@ struct rte_acl_field_def acl_field_def[5] = {
         .input_index = 3,
         .offset = offsetof(ip4_tuple_t, dp),
     },
-};
-
-struct rte_acl_config acl_cfg = {
-    .num_categories = 1,
-    .num_fields = RTE_DIM(acl_field_def),
-    .max_size = 100000000,
+    /*
+     * Geo fields, built only when a rule matches a country or an asn.
+     * The countries form 4 consecutive bytes and share an input index.
+     */
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint16_t),
+        .field_index = 5,
+        .input_index = 4,
+        .offset = ACL_GEO_OFFSET(scountry),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint16_t),
+        .field_index = 6,
+        .input_index = 4,
+        .offset = ACL_GEO_OFFSET(dcountry),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint32_t),
+        .field_index = 7,
+        .input_index = 5,
+        .offset = ACL_GEO_OFFSET(sasn),
+    },
+    {
+        .type = RTE_ACL_FIELD_TYPE_BITMASK,
+        .size = sizeof(uint32_t),
+        .field_index = 8,
+        .input_index = 6,
+        .offset = ACL_GEO_OFFSET(dasn),
+    },
 };
 
 RTE_ACL_RULE_DEF(acl_rule, RTE_DIM(acl_field_def));
@@ -76,6 +116,11 @@ struct rte_acl_param acl_param_B = {
 
 struct rte_acl_param *acl_param;
 
+/** Every packet is classified for all tenants in one pass and takes
+ * the result of the tenant of its ingress port, see acl_context_t
+ * */
+static acl_context_t acl_context_A, acl_context_B;
+
 MODULE_DECLARE(acl) = {
     .name = "acl",
     .id = MOD_ID_ACL,
@@ -87,19 +132,127 @@ MODULE_DECLARE(acl) = {
     .priv = NULL
 };
 
+typedef struct {
+    uint32_t rules;             /** enabled rules of acl.json */
+    uint32_t expanded;          /** rules given to rte_acl */
+    size_t memory;              /** bytes of the built tries */
+    uint64_t build_us;
+    uint32_t geo;               /** rules matching a country or an asn */
+} acl_stats_t;
+
+static acl_stats_t acl_stats;
+
 static int
-acl_rule_load(config_t *config)
+acl_asn_parse(const char *s, uint32_t *asn)
+{
+    unsigned long v;
+    char *end;
+
+    if (!strncasecmp(s, "AS", 2)) {
+        s += 2;
+    }
+
+    v = strtoul(s, &end, 10);
+    if (*end || end == s || !v || v > UINT32_MAX) {
+        return -1;
+    }
+
+    *asn = v;
+    return 0;
+}
+
+/** Categories for the tenants of itfc, tenant 0 always exists
+ * */
+static uint32_t
+acl_tenants(interface_config_t *itfc)
+{
+    return (itfc && itfc->tenant_num > 1) ? itfc->tenant_num : 1;
+}
+
+static uint32_t
+acl_categories(uint32_t tenants)
+{
+    return (tenants > 1) ? RTE_ALIGN(tenants, RTE_ACL_RESULTS_MULTIPLIER) : 1;
+}
+
+/** Groups of one kind from the acl json root, a missing list is empty
+ * */
+static int
+acl_groups_kind(acl_groups_t *g, json_object *jr, const char *tag, int is_addr)
+{
+    json_object *ja, *jo, *jv, *jm;
+    const char **members;
+    int i, k, n, m, ret;
+
+    n = JA(jr, tag, &ja);
+    if (n <= 0) {
+        return 0;
+    }
+
+    if (n > ACL_GROUP_MAX) {
+        printf("too many %s %d\n", tag, n);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        jo = JO(ja, i);
+        jv = JV(jo, "name");
+        m = JA(jo, "members", &jm);
+        if (!jv || m <= 0) {
+            printf("invalid group %d of %s\n", i, tag);
+            return -1;
+        }
+
+        members = malloc(sizeof(*members) * m);
+        if (!members) {
+            return -1;
+        }
+
+        for (k = 0; k < m; k++) {
+            members[k] = JV_S(JO(jm, k));
+        }
+
+        ret = acl_group_add(g, is_addr, JV_S(jv), members, m);
+        free(members);
+        if (ret) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+acl_groups_load(acl_groups_t *g, json_object *jr)
+{
+    if (acl_groups_kind(g, jr, "address_groups", 1) ||
+        acl_groups_kind(g, jr, "service_groups", 0)) {
+        return -1;
+    }
+
+    return acl_groups_normalize(g);
+}
+
+/** Compile acl.json into ac, each rule expands to the cross product of
+ * its normalized address and port sets, see group.h, rte_acl rules are
+ * kept by position so the expanded ones point back to the table of
+ * acl_rule_info_t through their userdata
+ * */
+static int
+acl_rule_build(acl_context_t *ac, uint32_t tenants, acl_stats_t *st)
 {
-    struct rte_acl_ctx *acl_ctx;
-    char *p = NULL;
     json_object *jr = NULL, *ja;
+    struct rte_acl_config cfg;
+    struct acl_rule *r = NULL, base;
+    acl_rule_info_t *rules = NULL;
+    acl_groups_t *groups = NULL;
+    acl_sets_t sets;
     int i, rule_num;
+    uint64_t start;
+    uint32_t n = 0, m = 0;
     int ret = 0;
 
-    acl_ctx = config->acl_ctx;
-    if (!acl_ctx) {
-        return -1;
-    }
+    memset(st, 0, sizeof(*st));
 
     jr = JR(CONFIG_PATH, "acl.json");
     if (!jr) {
@@ -112,7 +265,27 @@ acl_rule_load(config_t *config)
         return -1;
     }
 
-    struct acl_rule r[rule_num];
+    memset(&sets, 0, sizeof(sets));
+    sets.sips = malloc(sizeof(*sets.sips) * ACL_SET_MAX);
+    sets.dips = malloc(sizeof(*sets.dips) * ACL_SET_MAX);
+    sets.sps = malloc(sizeof(*sets.sps) * ACL_SET_MAX);
+    sets.dps = malloc(sizeof(*sets.dps) * ACL_SET_MAX);
+    r = malloc(sizeof(*r) * MAX_ACL_RULE_NUM);
+    rules = rte_zmalloc("acl_rules", sizeof(*rules) * RTE_MAX(rule_num, 1), 0);
+    /** a build of its own, the cli may compile while acl_conf runs
+     * */
+    groups = calloc(1, sizeof(*groups));
+    if (!sets.sips || !sets.dips || !sets.sps || !sets.dps || !r || !rules || !groups) {
+        printf("alloc acl rule buffers failed\n");
+        ret = -1;
+        goto done;
+    }
+
+    if (acl_groups_load(groups, jr)) {
+        printf("acl groups load failed\n");
+        ret = -1;
+        goto done;
+    }
 
     #define ACL_JV(item) \
         jv = JV(jo, item); \
@@ -121,9 +294,34 @@ acl_rule_load(config_t *config)
             goto done; \
         }
 
+    #define ACL_SET(item, fn, out, num) \
+        ACL_JV(item); \
+        num = fn(groups, JV_S(jv), out, ACL_SET_MAX); \
+        if (num <= 0) { \
+            printf("invalid %s of acl rule %u\n", item, base.data.priority); \
+            ret = -1; \
+            goto done; \
+        }
+
+    /** a geo field of a rule is a wildcard unless given
+     * */
+    #define ACL_GEO(item, f, u, fn, type) \
+        jv = JV(jo, item); \
+        if (jv) { \
+            type v; \
+            if (fn(JV_S(jv), &v)) { \
+                printf("invalid %s of acl rule %u\n", item, base.data.priority); \
+                ret = -1; \
+                goto done; \
+            } \
+            base.field[f].value.u = v; \
+            base.field[f].mask_range.u = (type)~0; \
+            geo = 1; \
+        }
+
     for (i = 0; i < rule_num; i++) {
         json_object *jo, *jv;
-        char ip[16], mask[4];
+        int geo = 0;
 
         jo = JO(ja, i);
         
@@ -132,77 +330,184 @@ acl_rule_load(config_t *config)
             continue;
         }
 
+        memset(&base, 0, sizeof(base));
+
         ACL_JV("id");
-        r[i].data.priority = JV_I(jv);
-        r[i].data.userdata = r[i].data.priority;
+        base.data.priority = JV_I(jv);
+        base.data.userdata = m + 1;
 
-        memset(ip, 0, 16);
-        memset(mask, 0, 4);
-        
-        ACL_JV("sip");
-        if ((p = strstr(JV_S(jv), "/")) != NULL) {
-            *p = ' ';
-            sscanf(JV_S(jv), "%s %s", ip, mask);
-            r[i].field[1].value.u32 = ntohl(inet_addr(ip));
-            r[i].field[1].mask_range.u32 = atoi(mask);
+        ACL_SET("sip", acl_addr_set, sets.sips, sets.nsip);
+        ACL_SET("dip", acl_addr_set, sets.dips, sets.ndip);
+        ACL_SET("sp", acl_port_set, sets.sps, sets.nsp);
+        ACL_SET("dp", acl_port_set, sets.dps, sets.ndp);
+
+        ACL_JV("proto");
+        base.field[0].value.u8 = JV_I(jv);
+        base.field[0].mask_range.u8 = 0xff;
+
+        ACL_JV("action");
+        base.data.action = JV_I(jv);
+
+        /** rules without a tenant are shared by all tenants
+         * */
+        jv = JV(jo, "tenant");
+        if (!jv) {
+            base.data.category_mask = RTE_LEN2MASK(ac->categories, uint32_t);
+        } else if ((uint32_t)JV_I(jv) < tenants) {
+            base.data.category_mask = 1U << JV_I(jv);
         } else {
-            r[i].field[1].value.u32 = ntohl(inet_addr(JV_S(jv)));
-            r[i].field[1].mask_range.u32 = 32;
+            printf("tenant %d of acl rule %u has no vwire pair or bridge\n", JV_I(jv), base.data.priority);
+            ret = -1;
+            goto done;
         }
 
-        memset(ip, 0, 16);
-        memset(mask, 0, 4);
+        ACL_GEO("scountry", 5, u16, geo_country_parse, uint16_t);
+        ACL_GEO("dcountry", 6, u16, geo_country_parse, uint16_t);
+        ACL_GEO("sasn", 7, u32, acl_asn_parse, uint32_t);
+        ACL_GEO("dasn", 8, u32, acl_asn_parse, uint32_t);
 
-        ACL_JV("dip");
-        if ((p = strstr(JV_S(jv), "/")) != NULL) {
-            *p = ' ';
-            sscanf(JV_S(jv), "%s %s", ip, mask);
-            r[i].field[2].value.u32 = ntohl(inet_addr(ip));
-            r[i].field[2].mask_range.u32 = atoi(mask);
-        } else {
-            r[i].field[2].value.u32 = ntohl(inet_addr(JV_S(jv)));
-            r[i].field[2].mask_range.u32 = 32;
+        /** traffic class of the rule on qos ports
+         * */
+        jv = JV(jo, "tc");
+        if (jv) {
+            if ((uint32_t)JV_I(jv) >= QOS_TC_NUM) {
+                printf("tc %d of acl rule %u over %u\n", JV_I(jv), base.data.priority, QOS_TC_NUM - 1);
+                ret = -1;
+                goto done;
+            }
+            base.data.action |= (JV_I(jv) + 1) << 8;
         }
 
-        ACL_JV("sp");
-        r[i].field[3].value.u16 = JV_I(jv);
-        r[i].field[3].mask_range.u16 = 0xffff;
+        if (n + (uint64_t)sets.nsip * sets.ndip * sets.nsp * sets.ndp > MAX_ACL_RULE_NUM) {
+            printf("acl rule %u expands to %"PRIu64" rules, over %u in total\n", base.data.priority,
+                (uint64_t)sets.nsip * sets.ndip * sets.nsp * sets.ndp, MAX_ACL_RULE_NUM);
+            ret = -1;
+            goto done;
+        }
 
-        ACL_JV("dp");
-        r[i].field[4].value.u16 = JV_I(jv);
-        r[i].field[4].mask_range.u16 = 0xffff;
+        n += acl_rule_expand(&sets, (const struct rte_acl_rule *)&base, sizeof(base), &r[n]);
 
-        ACL_JV("proto");
-        r[i].field[0].value.u8 = JV_I(jv);
-        r[i].field[0].mask_range.u8 = 0xff;
+        rules[m].id = base.data.priority;
+        rules[m].action = base.data.action;
+        m++;
 
-        ACL_JV("action");
-        r[i].data.category_mask = 1;
-        r[i].data.action = JV_I(jv);
+        st->rules ++;
+        st->geo += geo;
     }
 
+    #undef ACL_GEO
+    #undef ACL_SET
     #undef ACL_JV
 
-    if (rule_num) {
-        if (rte_acl_add_rules(acl_ctx, (const struct rte_acl_rule *)r, rule_num)) {
+    st->expanded = n;
+
+    /** rte_acl_create hands back a used context as it is
+     * */
+    rte_acl_reset_rules(ac->ctx);
+
+    if (n) {
+        if (rte_acl_add_rules(ac->ctx, (const struct rte_acl_rule *)r, n)) {
             printf("add acl rules failed\n");
             ret = -1;
             goto done;
         }
 
-        memcpy(acl_cfg.defs, acl_field_def, sizeof(struct rte_acl_field_def) * RTE_DIM(acl_field_def));
-        if (rte_acl_build(acl_ctx, &acl_cfg)) {
+        /** on the stack, the cli may compile while acl_conf runs
+         * */
+        memset(&cfg, 0, sizeof(cfg));
+        memcpy(cfg.defs, acl_field_def, sizeof(struct rte_acl_field_def) * RTE_DIM(acl_field_def));
+        cfg.num_categories = ac->categories;
+        /** rules hold all fields, the trie only walks the geo tags
+         * when a rule matches them
+         * */
+        cfg.num_fields = st->geo ? ACL_FIELD_NUM : ACL_FIELD_GEO;
+        cfg.max_size = 100000000;
+        start = rte_get_timer_cycles();
+        if (rte_acl_build(ac->ctx, &cfg)) {
             printf("build acl rules failed\n");
             ret = -1;
             goto done;
         }
+        st->build_us = (rte_get_timer_cycles() - start) * 1000000 / rte_get_timer_hz();
+        st->memory = _rte_acl_mem_size(ac->ctx);
     }
 
+    /** the table of this buffer is idle as its trie, see acl_conf
+     * */
+    rte_free(ac->rules);
+    ac->rules = rules;
+    ac->rule_num = m;
+    rules = NULL;
+
 done:
+    rte_free(rules);
+    free(sets.sips);
+    free(sets.dips);
+    free(sets.sps);
+    free(sets.dps);
+    free(r);
+    if (groups) {
+        acl_groups_free(groups);
+        free(groups);
+    }
     if (jr) JR_FREE(jr);
     return ret;
 }
 
+static int
+acl_rule_load(config_t *config, acl_context_t *ac)
+{
+    if (acl_rule_build(ac, acl_tenants(config->itf_cfg), &acl_stats)) {
+        return -1;
+    }
+
+    printf("acl %u rules expand to %u, trie memory %zu bytes, built in %"PRIu64" us\n",
+        acl_stats.rules, acl_stats.expanded, acl_stats.memory, acl_stats.build_us);
+    return 0;
+}
+
+/** Build acl.json into a scratch context and report its size, nothing
+ * is committed
+ * */
+static int
+acl_compile(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+    struct rte_acl_param param = acl_param_A;
+    char name[RTE_ACL_NAMESIZE];
+    acl_context_t ac;
+    acl_stats_t st;
+    int ret;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    param.name = hot_name(name, sizeof(name), "param_compile");
+    ac.ctx = rte_acl_create(&param);
+    if (!ac.ctx) {
+        CLI_PRINT(cli, "create acl ctx failed");
+        return -1;
+    }
+
+    ac.categories = acl_categories(acl_tenants(c->itf_cfg));
+    ac.rules = NULL;
+    ret = acl_rule_build(&ac, acl_tenants(c->itf_cfg), &st);
+    rte_acl_free(ac.ctx);
+    rte_free(ac.rules);
+
+    if (ret) {
+        CLI_PRINT(cli, "compile acl.json failed, see the log");
+        return -1;
+    }
+
+    CLI_PRINT(cli, "rules          %u", st.rules);
+    CLI_PRINT(cli, "expanded rules %u", st.expanded);
+    CLI_PRINT(cli, "trie memory    %zu", st.memory);
+    CLI_PRINT(cli, "geo rules      %u", st.geo);
+    CLI_PRINT(cli, "build time us  %"PRIu64, st.build_us);
+    CLI_PRINT(cli, "working        %u rules, %u expanded, %zu bytes", acl_stats.rules, acl_stats.expanded, acl_stats.memory);
+    return 0;
+}
+
 static int 
 acl_show(struct cli_def *cli, const char *command, char *argv[], int argc) 
 {
@@ -234,6 +539,12 @@ acl_show(struct cli_def *cli, const char *command, char *argv[], int argc)
         jv = JV(jo, item); \
         CLI_PRINT(cli, "%s: %s", item, JV_S(jv));
 
+    #define ACL_PRINT_OPT(item) \
+        jv = JV(jo, item); \
+        if (jv) { \
+            CLI_PRINT(cli, "%s: %s", item, JV_S(jv)); \
+        }
+
     for (i = 0; i < rule_num; i++) {
         json_object *jo, *jv;
         jo = JO(ja, i);
@@ -255,9 +566,16 @@ acl_show(struct cli_def *cli, const char *command, char *argv[], int argc)
         ACL_PRINT("dp");
         ACL_PRINT("proto");
         ACL_PRINT("action");
+        ACL_PRINT_OPT("tenant");
+        ACL_PRINT_OPT("tc");
+        ACL_PRINT_OPT("scountry");
+        ACL_PRINT_OPT("dcountry");
+        ACL_PRINT_OPT("sasn");
+        ACL_PRINT_OPT("dasn");
         CLI_PRINT(cli, "%s", "");
     }
 
+    #undef ACL_PRINT_OPT
     #undef ACL_PRINT
 
     if (jr) JR_FREE(jr);
@@ -268,11 +586,17 @@ static int
 acl_dump(struct cli_def *cli, const char *command, char *argv[], int argc) 
 {
     config_t *c = cli_get_context(cli);
+    acl_context_t *ac = c->acl_ctx;
     char buffer[2048] = {0};
 
     CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
 
-    _rte_acl_dump(c->acl_ctx, buffer);
+    if (!ac) {
+        CLI_PRINT(cli, "no acl context");
+        return 0;
+    }
+
+    _rte_acl_dump(ac->ctx, buffer);
     CLI_PRINT(cli, "%s", buffer);
     return 0;
 }
@@ -305,6 +629,11 @@ acl_add(struct cli_def *cli, const char *command, char *argv[], int argc)
         if (!jv) { ret = -1; CLI_PRINT(cli, "alloc json value failed"); goto done; } \
         CLI_PRINT(cli, "set item %s val %s", item, CLI_OPT_V(cli, item)); \
         JO_ADD(jo, item, jv);
+
+    #define ACL_SET_OPT(item) \
+        if (CLI_OPT_V(cli, item)) { \
+            ACL_SET(item); \
+        }
     
     jo = JO_NEW();
     if (!jo) {
@@ -320,7 +649,14 @@ acl_add(struct cli_def *cli, const char *command, char *argv[], int argc)
     ACL_SET("proto");
     ACL_SET("action");
     ACL_SET("enabled");
-
+    ACL_SET_OPT("tenant");
+    ACL_SET_OPT("tc");
+    ACL_SET_OPT("scountry");
+    ACL_SET_OPT("dcountry");
+    ACL_SET_OPT("sasn");
+    ACL_SET_OPT("dasn");
+
+    #undef ACL_SET_OPT
     #undef ACL_SET
 
     JA_ADD(ja, jo);
@@ -415,6 +751,13 @@ acl_set(struct cli_def *cli, const char *command, char *argv[], int argc)
             CLI_PRINT(cli, "modify item %s val %s", item, CLI_OPT_V(cli, item)); \
         }
 
+    #define ACL_MOD_OPT(item) \
+        if (CLI_OPT_V(cli, item) && !JV(jo, item)) { \
+            JO_ADD(jo, item, JV_NEW(CLI_OPT_V(cli, item))); \
+        } else { \
+            ACL_MOD(item); \
+        }
+
     for (i = 0; i < rule_num; i++) {
         jo = JO(ja, i);
         jv = JV(jo, "id");
@@ -426,9 +769,16 @@ acl_set(struct cli_def *cli, const char *command, char *argv[], int argc)
             ACL_MOD("proto");
             ACL_MOD("action");
             ACL_MOD("enabled");
+            ACL_MOD_OPT("tenant");
+            ACL_MOD_OPT("tc");
+            ACL_MOD_OPT("scountry");
+            ACL_MOD_OPT("dcountry");
+            ACL_MOD_OPT("sasn");
+            ACL_MOD_OPT("dasn");
         }
     }
 
+    #undef ACL_MOD_OPT
     #undef ACL_MOD
 
     ret = JR_SAVE(CONFIG_PATH, "acl.json", jr);
@@ -461,6 +811,7 @@ acl_cli_register(config_t *config)
 
     c = CLI_CMD_C(cli_def, NULL, "acl", NULL, "access control list");
     CLI_CMD_C(cli_def, c, "dump", acl_dump, "dump acl context");
+    CLI_CMD_C(cli_def, c, "compile", acl_compile, "expand acl.json and report rule count and trie memory");
     
     c1 = CLI_CMD_C(cli_def, c, "show", acl_show, "show acl config");
     CLI_OPT(c1, "id", "rule id");
@@ -469,11 +820,17 @@ acl_cli_register(config_t *config)
     CLI_OPT_A(c1, "id", "rule id");
     CLI_OPT_A(c1, "sip", "source ip address");
     CLI_OPT_A(c1, "dip", "destination ip address");
-    CLI_OPT_A(c1, "sp", "source port");
-    CLI_OPT_A(c1, "dp", "destination port");
+    CLI_OPT_A(c1, "sp", "source ports, e.g. 80, 1024-2047, @group");
+    CLI_OPT_A(c1, "dp", "destination ports, e.g. 80, 1024-2047, @group");
     CLI_OPT_A(c1, "proto", "transport layer protocol");
     CLI_OPT_A(c1, "action", "do action when rule matched");
     CLI_OPT_A(c1, "enabled", "switch of rule");
+    CLI_OPT(c1, "tenant", "tenant of vwire pairs and bridges, all tenants if not given");
+    CLI_OPT(c1, "tc", "qos traffic class, 0 the highest");
+    CLI_OPT(c1, "scountry", "source country code, e.g. CN, needs geo.json");
+    CLI_OPT(c1, "dcountry", "destination country code, needs geo.json");
+    CLI_OPT(c1, "sasn", "source autonomous system number, needs geo.json");
+    CLI_OPT(c1, "dasn", "destination autonomous system number, needs geo.json");
 
     c1 = CLI_CMD_C(cli_def, c, "delete", acl_delete, "delete an acl rule");
     CLI_OPT_A(c1, "id", "rule id");
@@ -487,26 +844,46 @@ acl_cli_register(config_t *config)
     CLI_OPT(c1, "proto", "transport layer protocol");
     CLI_OPT(c1, "action", "do action when rule matched");
     CLI_OPT(c1, "enabled", "switch of rule");
+    CLI_OPT(c1, "tenant", "tenant of vwire pairs and bridges");
+    CLI_OPT(c1, "tc", "qos traffic class, 0 the highest");
+    CLI_OPT(c1, "scountry", "source country code, e.g. CN, needs geo.json");
+    CLI_OPT(c1, "dcountry", "destination country code, needs geo.json");
+    CLI_OPT(c1, "sasn", "source autonomous system number, needs geo.json");
+    CLI_OPT(c1, "dasn", "destination autonomous system number, needs geo.json");
 }
 
 int acl_conf(void *config)
 {
     config_t *c = config;
+    struct rte_acl_param param;
+    char name[RTE_ACL_NAMESIZE];
+    acl_context_t *ac;
+    uint32_t tenants;
 
     if (!acl_param) acl_param = &acl_param_A;
     else acl_param = (acl_param == &acl_param_A) ? &acl_param_B : &acl_param_A;
+    ac = (acl_param == &acl_param_A) ? &acl_context_A : &acl_context_B;
     
-    c->acl_ctx = rte_acl_create(acl_param);
-    if (!c->acl_ctx) {
+    /** rte_acl_create hands back a context of the same name, even one
+     * of the process a hot takeover replaces
+     * */
+    param = *acl_param;
+    param.name = hot_object(HOT_ACL, name, sizeof(name), "%s", acl_param->name);
+    ac->ctx = rte_acl_create(&param);
+    if (!ac->ctx) {
         printf("create acl ctx failed\n");
         return -1;
     }
 
-    if (acl_rule_load(config)) {
+    tenants = acl_tenants(c->itf_cfg);
+    ac->categories = acl_categories(tenants);
+
+    if (acl_rule_load(config, ac)) {
         printf("acl rule load failed\n");
         return -1;
     }
 
+    c->acl_ctx = ac;
     return 0;
 }
 
@@ -527,30 +904,40 @@ acl_proc_ingress(config_t *config, struct rte_mbuf *mbuf)
 {
     M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "== acl proc ingress\n");
 
+    acl_context_t *ac;
     struct rte_acl_ctx *acl_ctx;
-    struct rte_acl_rule_data *data;
+    acl_rule_info_t *info;
+    interface_config_t *itfc = config->itf_cfg;
+    uint32_t results[RTE_ACL_MAX_CATEGORIES];
     packet_t *p;
     ip4_tuple_t *k;
     uint32_t r;
     int ret;
 
-    acl_ctx = config->acl_ctx;
-    if (!acl_ctx) {
+    capture_packet(mbuf, CAPTURE_POINT_INGRESS);
+
+    ac = config->acl_ctx;
+    if (!ac) {
         goto done;
     }
+    acl_ctx = ac->ctx;
 
     p = rte_mbuf_to_priv(mbuf);
     if (!p) {
         goto done;
     }
 
+    geo_tag_burst(config, &mbuf, 1);
+
     k = &p->tuple.v4;
 
-    ret = rte_acl_classify(acl_ctx, (const unsigned char **)&k, &r, 1, 1);
+    ret = rte_acl_classify(acl_ctx, (const unsigned char **)&k, results, 1, ac->categories);
     if (ret) {
         goto done;
     }
 
+    r = results[itfc->ports[p->iport].tenant];
+
     M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "packet proto %u sip %u dip %u sp %u dp %u\n",
         k->proto, k->sip, k->dip, k->sp, k->dp);
 
@@ -559,15 +946,19 @@ acl_proc_ingress(config_t *config, struct rte_mbuf *mbuf)
         goto done;
     }
 
-    data = rte_acl_rule_data(acl_ctx, r);
-    if (!data) {
-        M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "illegal acl rule id\n");
+    if (r > ac->rule_num) {
+        M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "illegal acl rule index\n");
         goto done;
     }
+    info = &ac->rules[r - 1];
 
-    M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "match acl id %u action %u\n", r, data->action);
+    M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "match acl id %u action %u\n", info->id, ACL_ACTION(info->action));
 
-    if (data->action == ACL_ACTION_DENY) {
+    p->acl_rule = info->id;
+    p->qos_tc = ACL_TC(info->action);
+
+    if (ACL_ACTION(info->action) == ACL_ACTION_DENY) {
+        capture_packet(mbuf, CAPTURE_POINT_DENY);
         rte_pktmbuf_free(mbuf);
         M_LOG(acl.log, RTE_LOG_DEBUG, MOD_ID_ACL, "acl action deny\n");
         return MOD_RET_STOLEN;
@@ -579,6 +970,57 @@ acl_proc_ingress(config_t *config, struct rte_mbuf *mbuf)
     return MOD_RET_ACCEPT;
 }
 
+int acl_classify(void *config, struct rte_mbuf **mbufs, uint8_t *actions, uint16_t n)
+{
+    config_t *c = config;
+    acl_context_t *ac = c->acl_ctx;
+    struct rte_acl_ctx *acl_ctx;
+    acl_rule_info_t *info;
+    interface_config_t *itfc = c->itf_cfg;
+    const uint8_t *keys[n];
+    uint32_t results[n * (ac ? ac->categories : 1)];
+    uint32_t r;
+    packet_t *p;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        keys[i] = (const uint8_t *)&p->tuple.v4;
+        actions[i] = ACL_ACTION_PASS;
+    }
+
+    if (!ac || !n) {
+        return 0;
+    }
+    acl_ctx = ac->ctx;
+
+    geo_tag_burst(config, mbufs, n);
+
+    /** one classify call for the whole vector, rte_acl walks
+     * several tries in parallel when given more than one key
+     * */
+    if (rte_acl_classify(acl_ctx, keys, results, n, ac->categories)) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        r = results[i * ac->categories + itfc->ports[p->iport].tenant];
+        if (!r || r > ac->rule_num) {
+            continue;
+        }
+
+        info = &ac->rules[r - 1];
+        p->acl_rule = info->id;
+        p->qos_tc = ACL_TC(info->action);
+        if (ACL_ACTION(info->action) == ACL_ACTION_DENY) {
+            actions[i] = ACL_ACTION_DENY;
+        }
+    }
+
+    return 0;
+}
+
 mod_ret_t acl_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
 {
     if (hook == MOD_HOOK_INGRESS) {
@@ -6,13 +6,60 @@
 
 #define MAX_ACL_RULE_NUM (1U << 16)
 
+/** Fields of the 5 tuple, then the countries and asns of geo.h
+ * */
+#define ACL_FIELD_GEO   5
+#define ACL_FIELD_NUM   9
+
 #define ACL_ACTION_DENY 0
 #define ACL_ACTION_PASS 1
 
+/** acl_rule_info_t.action keeps the action of acl.json in the low
+ * byte and the optional qos "tc" of the rule plus 1 above it
+ * */
+#define ACL_ACTION(a)   ((a) & 0xff)
+#define ACL_TC(a)       (((a) >> 8) & 0xff)
+
+/** A rule of acl.json, a rule expands to several rte_acl rules which
+ * all carry the index of its entry plus 1 as userdata, the result of
+ * a classify
+ * */
+typedef struct {
+    uint32_t id;                /** of acl.json */
+    uint32_t action;            /** see ACL_ACTION and ACL_TC */
+} acl_rule_info_t;
+
+/** What config->acl_ctx points to, one of the A/B buffers, the
+ * rte_acl context, the number of categories it is built with, one
+ * per tenant rounded up as rte_acl wants, and the rules its results
+ * index; workers classify with the context of their config, never one
+ * of a reload in progress
+ * */
+typedef struct {
+    struct rte_acl_ctx *ctx;
+    uint32_t categories;
+    acl_rule_info_t *rules;
+    uint32_t rule_num;
+} acl_context_t;
+
 int acl_init(void *config);
 mod_ret_t acl_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
 int acl_conf(void *config);
 
+/** Classify a vector of decoded mbufs with a single lookup
+ * @param config
+ *  the working configuration
+ * @param mbufs
+ *  mbufs already decoded, never freed here
+ * @param actions
+ *  output, ACL_ACTION_PASS or ACL_ACTION_DENY for each mbuf
+ * @param n
+ *  number of mbufs
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int acl_classify(void *config, struct rte_mbuf **mbufs, uint8_t *actions, uint16_t n);
+
 #endif
 
 // file format utf-8
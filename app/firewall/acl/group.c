@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "../prefix.h"
+
+#include "group.h"
+
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} acl_span_t;
+
+static int
+acl_span_cmp(const void *a, const void *b)
+{
+    const acl_span_t *x = a, *y = b;
+
+    return x->lo < y->lo ? -1 : x->lo > y->lo;
+}
+
+/** Sort spans and merge the overlapping or adjacent ones
+ * */
+static uint32_t
+acl_span_merge(acl_span_t *s, uint32_t n)
+{
+    uint32_t i, m = 0;
+
+    qsort(s, n, sizeof(*s), acl_span_cmp);
+
+    for (i = 0; i < n; i++) {
+        if (m && s[i].lo <= s[m - 1].hi + 1) {
+            if (s[i].hi > s[m - 1].hi) {
+                s[m - 1].hi = s[i].hi;
+            }
+        } else {
+            s[m++] = s[i];
+        }
+    }
+
+    return m;
+}
+
+static int
+acl_addr_span(const char *tok, acl_span_t *sp)
+{
+    uint32_t addr, mask;
+
+    if (!strcmp(tok, "any")) {
+        sp->lo = 0;
+        sp->hi = UINT32_MAX;
+        return 0;
+    }
+
+    if (prefix_parse4(tok, &addr, &mask)) {
+        return -1;
+    }
+
+    sp->lo = addr;
+    sp->hi = addr | ~mask;
+    return 0;
+}
+
+static int
+acl_port_span(const char *tok, acl_span_t *sp)
+{
+    unsigned long lo, hi;
+    char *end;
+
+    if (!strcmp(tok, "any")) {
+        sp->lo = 0;
+        sp->hi = UINT16_MAX;
+        return 0;
+    }
+
+    lo = hi = strtoul(tok, &end, 10);
+    if (*end == '-') {
+        hi = strtoul(end + 1, &end, 10);
+    }
+
+    if (*end || end == tok || lo > hi || hi > UINT16_MAX) {
+        return -1;
+    }
+
+    /** a single 0 keeps its old meaning of any port
+     * */
+    if (!strchr(tok, '-') && !lo) {
+        hi = UINT16_MAX;
+    }
+
+    sp->lo = lo;
+    sp->hi = hi;
+    return 0;
+}
+
+static const acl_group_t *
+acl_group_find(const acl_group_t *groups, uint32_t num, const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; i++) {
+        if (!strcmp(groups[i].name, name)) {
+            return &groups[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** Parse a comma list into spans, expanding group references
+ * @return
+ *  number of spans, -1 for a failure
+ * */
+static int
+acl_set_spans(const acl_groups_t *g, int is_addr, const char *s, acl_span_t *spans, uint32_t max)
+{
+    const acl_group_t *grp;
+    char *text, *tok, *save;
+    uint32_t n = 0, i;
+    int ret = 0;
+
+    text = strdup(s);
+    if (!text) {
+        return -1;
+    }
+
+    for (tok = strtok_r(text, ", ", &save); tok; tok = strtok_r(NULL, ", ", &save)) {
+        if (tok[0] != '@') {
+            if (n == max || (is_addr ? acl_addr_span(tok, &spans[n]) : acl_port_span(tok, &spans[n]))) {
+                printf("invalid %s '%s'\n", is_addr ? "address" : "port", tok);
+                ret = -1;
+                break;
+            }
+            n++;
+            continue;
+        }
+
+        grp = (!g) ? NULL : is_addr ? acl_group_find(g->addrs, g->addr_num, tok + 1) :
+            acl_group_find(g->ports, g->port_num, tok + 1);
+        if (!grp || n + grp->num > max) {
+            printf("unknown or too large group '%s'\n", tok);
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < grp->num; i++, n++) {
+            if (is_addr) {
+                acl_prefix_t *p = (acl_prefix_t *)grp->members + i;
+                spans[n].lo = p->addr;
+                spans[n].hi = p->addr | (p->depth ? ~(UINT32_MAX << (32 - p->depth)) : UINT32_MAX);
+            } else {
+                acl_range_t *r = (acl_range_t *)grp->members + i;
+                spans[n].lo = r->lo;
+                spans[n].hi = r->hi;
+            }
+        }
+    }
+
+    free(text);
+    return ret ? -1 : (int)acl_span_merge(spans, n);
+}
+
+int acl_addr_set(const acl_groups_t *g, const char *s, acl_prefix_t *out, uint32_t max)
+{
+    acl_span_t *spans;
+    uint64_t lo, block;
+    uint32_t n = 0;
+    int i, num;
+
+    spans = malloc(sizeof(*spans) * ACL_SET_MAX);
+    if (!spans) {
+        return -1;
+    }
+
+    num = acl_set_spans(g, 1, s, spans, ACL_SET_MAX);
+
+    /** cut every span into the largest aligned blocks it holds
+     * */
+    for (i = 0; i < num; i++) {
+        for (lo = spans[i].lo; lo <= spans[i].hi; lo += block) {
+            block = lo ? (lo & -lo) : (1ULL << 32);
+            while (lo + block - 1 > spans[i].hi) {
+                block >>= 1;
+            }
+
+            if (n == max) {
+                free(spans);
+                return -1;
+            }
+
+            out[n].addr = lo;
+            out[n].depth = 32 - __builtin_ctzll(block);
+            n++;
+        }
+    }
+
+    free(spans);
+    return num < 0 ? -1 : (int)n;
+}
+
+int acl_port_set(const acl_groups_t *g, const char *s, acl_range_t *out, uint32_t max)
+{
+    acl_span_t *spans;
+    int i, num;
+
+    spans = malloc(sizeof(*spans) * ACL_SET_MAX);
+    if (!spans) {
+        return -1;
+    }
+
+    num = acl_set_spans(g, 0, s, spans, ACL_SET_MAX);
+    if (num > (int)max) {
+        num = -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        out[i].lo = spans[i].lo;
+        out[i].hi = spans[i].hi;
+    }
+
+    free(spans);
+    return num;
+}
+
+int acl_group_add(acl_groups_t *g, int is_addr, const char *name, const char *const *members, uint32_t num)
+{
+    acl_group_t *grp;
+    uint32_t *group_num = is_addr ? &g->addr_num : &g->port_num;
+    size_t size = is_addr ? sizeof(acl_prefix_t) : sizeof(acl_range_t);
+    uint32_t k;
+    int len;
+
+    if (*group_num == ACL_GROUP_MAX || !num || strlen(name) >= ACL_GROUP_NAME) {
+        printf("invalid group %s\n", name);
+        return -1;
+    }
+
+    grp = is_addr ? &g->addrs[*group_num] : &g->ports[*group_num];
+    snprintf(grp->name, sizeof(grp->name), "%s", name);
+    grp->members = malloc(size * ACL_SET_MAX);
+    if (!grp->members) {
+        return -1;
+    }
+    grp->num = 0;
+    (*group_num)++;
+
+    /** members are normalized one by one, then as a whole through
+     * the group itself by acl_groups_normalize()
+     * */
+    for (k = 0; k < num; k++) {
+        len = is_addr ?
+            acl_addr_set(NULL, members[k], (acl_prefix_t *)grp->members + grp->num, ACL_SET_MAX - grp->num) :
+            acl_port_set(NULL, members[k], (acl_range_t *)grp->members + grp->num, ACL_SET_MAX - grp->num);
+        if (len < 0) {
+            printf("invalid member of group %s\n", grp->name);
+            return -1;
+        }
+        grp->num += len;
+    }
+
+    return 0;
+}
+
+/** Normalize a group over all its members, "@name" of itself is
+ * resolved against the raw members added
+ * */
+static int
+acl_group_normalize(acl_groups_t *g, acl_group_t *grp, int is_addr)
+{
+    char ref[ACL_GROUP_NAME + 1];
+    void *members;
+    int n;
+
+    members = malloc((is_addr ? sizeof(acl_prefix_t) : sizeof(acl_range_t)) * ACL_SET_MAX);
+    if (!members) {
+        return -1;
+    }
+
+    snprintf(ref, sizeof(ref), "@%s", grp->name);
+    n = is_addr ? acl_addr_set(g, ref, members, ACL_SET_MAX) : acl_port_set(g, ref, members, ACL_SET_MAX);
+    if (n < 0) {
+        free(members);
+        return -1;
+    }
+
+    free(grp->members);
+    grp->members = members;
+    grp->num = n;
+    return 0;
+}
+
+int acl_groups_normalize(acl_groups_t *g)
+{
+    uint32_t i;
+
+    for (i = 0; i < g->addr_num; i++) {
+        if (acl_group_normalize(g, &g->addrs[i], 1)) {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < g->port_num; i++) {
+        if (acl_group_normalize(g, &g->ports[i], 0)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+uint32_t acl_rule_expand(const acl_sets_t *s, const struct rte_acl_rule *base, size_t rule_size, void *out)
+{
+    struct rte_acl_rule *r;
+    int a, b, c, d;
+    uint32_t n = 0;
+
+    for (a = 0; a < s->nsip; a++)
+    for (b = 0; b < s->ndip; b++)
+    for (c = 0; c < s->nsp; c++)
+    for (d = 0; d < s->ndp; d++) {
+        r = RTE_PTR_ADD(out, rule_size * n);
+        memcpy(r, base, rule_size);
+        r->field[ACL_FIELD_SIP].value.u32 = s->sips[a].addr;
+        r->field[ACL_FIELD_SIP].mask_range.u32 = s->sips[a].depth;
+        r->field[ACL_FIELD_DIP].value.u32 = s->dips[b].addr;
+        r->field[ACL_FIELD_DIP].mask_range.u32 = s->dips[b].depth;
+        r->field[ACL_FIELD_SP].value.u16 = s->sps[c].lo;
+        r->field[ACL_FIELD_SP].mask_range.u16 = s->sps[c].hi;
+        r->field[ACL_FIELD_DP].value.u16 = s->dps[d].lo;
+        r->field[ACL_FIELD_DP].mask_range.u16 = s->dps[d].hi;
+        n++;
+    }
+
+    return n;
+}
+
+void acl_groups_free(acl_groups_t *g)
+{
+    uint32_t i;
+
+    for (i = 0; i < g->addr_num; i++) {
+        free(g->addrs[i].members);
+    }
+
+    for (i = 0; i < g->port_num; i++) {
+        free(g->ports[i].members);
+    }
+
+    g->addr_num = 0;
+    g->port_num = 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,105 @@
+#ifndef _M_ACL_GROUP_H_
+#define _M_ACL_GROUP_H_
+
+#include <stdint.h>
+
+#include <rte_acl.h>
+
+/** Address and service objects for acl.json
+ *
+ * Rule fields sip/dip take an address set and sp/dp a port set:
+ *
+ *   address: "any", "10.0.0.1", "10.0.0.0/8", "@group", or a comma list
+ *   port:    "any", "0" (any), "80", "1024-2047", "@group", or a comma list
+ *
+ * Groups are named in "address_groups" and "service_groups" with the
+ * same member syntax, except members can not name groups. A set is
+ * normalized before it reaches rte_acl: prefixes are merged with their
+ * overlapping or adjacent neighbours and split back into the fewest
+ * prefixes, ports into the fewest ranges, so a rule expands to
+ * |sip| x |dip| x |sp| x |dp| acl rules as small as the policy allows.
+ * */
+
+#define ACL_GROUP_NAME      32
+#define ACL_GROUP_MAX       1024        /** groups of each kind */
+#define ACL_SET_MAX         4096        /** members of a set after normalizing */
+
+/** rte_acl fields of the sets, after the protocol
+ * */
+#define ACL_FIELD_SIP       1
+#define ACL_FIELD_DIP       2
+#define ACL_FIELD_SP        3
+#define ACL_FIELD_DP        4
+
+typedef struct {
+    uint32_t addr;              /** host order */
+    uint8_t depth;
+} acl_prefix_t;
+
+typedef struct {
+    uint16_t lo;
+    uint16_t hi;
+} acl_range_t;
+
+typedef struct {
+    char name[ACL_GROUP_NAME];
+    uint32_t num;
+    void *members;              /** acl_prefix_t or acl_range_t */
+} acl_group_t;
+
+typedef struct {
+    acl_group_t addrs[ACL_GROUP_MAX];
+    acl_group_t ports[ACL_GROUP_MAX];
+    uint32_t addr_num;
+    uint32_t port_num;
+} acl_groups_t;
+
+/** The sets of one rule
+ * */
+typedef struct {
+    acl_prefix_t *sips;
+    acl_prefix_t *dips;
+    acl_range_t *sps;
+    acl_range_t *dps;
+    int nsip;
+    int ndip;
+    int nsp;
+    int ndp;
+} acl_sets_t;
+
+/** Add a group of num members, in the syntax of a set without groups
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int acl_group_add(acl_groups_t *g, int is_addr, const char *name, const char *const *members, uint32_t num);
+
+/** Normalize every group once all are added
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int acl_groups_normalize(acl_groups_t *g);
+void acl_groups_free(acl_groups_t *g);
+
+/** Parse and normalize an address set
+ * @return
+ *  number of prefixes in out, -1 for a failure
+ * */
+int acl_addr_set(const acl_groups_t *g, const char *s, acl_prefix_t *out, uint32_t max);
+
+/** Parse and normalize a port set
+ * @return
+ *  number of ranges in out, -1 for a failure
+ * */
+int acl_port_set(const acl_groups_t *g, const char *s, acl_range_t *out, uint32_t max);
+
+/** Expand base over the cross product of the sets into out, rules of
+ * rule_size bytes, nsip * ndip * nsp * ndp of them
+ * @return
+ *  number of rules written
+ * */
+uint32_t acl_rule_expand(const acl_sets_t *s, const struct rte_acl_rule *base, size_t rule_size, void *out);
+
+#endif
+
+// file format utf-8
+// ident using space
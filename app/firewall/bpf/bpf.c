@@ -0,0 +1,422 @@
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_errno.h>
+#include <rte_spinlock.h>
+#include <rte_bpf.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+
+#include "bpf.h"
+
+typedef struct {
+    struct rte_bpf *bpf;
+    uint64_t (*func)(void *);       /** JIT-ed code, NULL to interpret */
+    mod_hook_t hook;
+    uint8_t mbuf_arg;               /** context is the mbuf, otherwise packet data */
+    uint8_t drop_on_match;          /** non-zero return rejects */
+    char file[MAX_FILE_PATH];
+    char section[64];
+} bpf_prog_t;
+
+typedef struct {
+    uint64_t runs;
+    uint64_t drops;
+} __rte_cache_aligned bpf_stats_t;
+
+static bpf_prog_t *bpf_prog;
+static bpf_stats_t bpf_stats[RTE_MAX_LCORE];
+
+/** programs swapped out, destroyed BPF_GRACE_SEC after; cli sessions
+ * swap and the management core frees, both under the lock
+ * */
+static bpf_prog_t *bpf_retired[BPF_MAX_RETIRED];
+static uint64_t bpf_retired_at[BPF_MAX_RETIRED];
+static rte_spinlock_t bpf_retire_lock = RTE_SPINLOCK_INITIALIZER;
+
+static const struct {
+    const char *name;
+    mod_hook_t hook;
+} bpf_hooks[] = {
+    {"ingress", MOD_HOOK_INGRESS},
+    {"prerouting", MOD_HOOK_PREROUTING},
+    {"forward", MOD_HOOK_FORWARD},
+    {"postrouting", MOD_HOOK_POSTROUTING},
+    {"egress", MOD_HOOK_EGRESS},
+};
+
+MODULE_DECLARE(bpf) = {
+    .name = "bpf",
+    .id = MOD_ID_BPF,
+    .enabled = true,
+    .log = true,
+    .init = bpf_init,
+    .proc = bpf_proc,
+    .conf = bpf_conf,
+    .tick = bpf_tick,
+    .priv = NULL
+};
+
+static inline int
+bpf_reject(bpf_prog_t *prog, struct rte_mbuf *mbuf)
+{
+    void *ctx = prog->mbuf_arg ? (void *)mbuf : rte_pktmbuf_mtod(mbuf, void *);
+    uint64_t rc;
+
+    if (likely(prog->func)) {
+        rc = prog->func(ctx);
+    } else {
+        rc = rte_bpf_exec(prog->bpf, ctx);
+    }
+
+    return prog->drop_on_match ? rc != 0 : rc == 0;
+}
+
+mod_ret_t bpf_proc(__rte_unused void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    bpf_prog_t *prog = __atomic_load_n(&bpf_prog, __ATOMIC_ACQUIRE);
+    bpf_stats_t *st;
+
+    if (!prog || prog->hook != hook) {
+        return MOD_RET_ACCEPT;
+    }
+
+    st = &bpf_stats[rte_lcore_id()];
+    st->runs ++;
+
+    if (bpf_reject(prog, mbuf)) {
+        st->drops ++;
+        M_LOG(bpf.log, RTE_LOG_DEBUG, MOD_ID_BPF, "bpf %s rejects packet\n", prog->file);
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+void bpf_filter_burst(struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop)
+{
+    bpf_prog_t *prog = __atomic_load_n(&bpf_prog, __ATOMIC_ACQUIRE);
+    bpf_stats_t *st;
+    void *ctx[n];
+    uint64_t rc[n];
+    uint16_t i;
+
+    if (!prog || prog->hook != MOD_HOOK_INGRESS || !n) {
+        return;
+    }
+
+    st = &bpf_stats[rte_lcore_id()];
+    st->runs += n;
+
+    for (i = 0; i < n; i++) {
+        ctx[i] = prog->mbuf_arg ? (void *)mbufs[i] : rte_pktmbuf_mtod(mbufs[i], void *);
+    }
+
+    if (likely(prog->func)) {
+        for (i = 0; i < n; i++) {
+            rc[i] = prog->func(ctx[i]);
+        }
+    } else {
+        rte_bpf_exec_burst(prog->bpf, ctx, rc, n);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (prog->drop_on_match ? rc[i] != 0 : rc[i] == 0) {
+            drop[i] = 1;
+            st->drops ++;
+        }
+    }
+}
+
+static void
+bpf_prog_free(bpf_prog_t *prog)
+{
+    rte_bpf_destroy(prog->bpf);
+    rte_free(prog);
+}
+
+static bpf_prog_t *
+bpf_prog_load(const char *file, const char *section, const char *hook, const char *arg, const char *verdict)
+{
+    struct rte_bpf_prm prm;
+    struct rte_bpf_jit jit;
+    bpf_prog_t *prog;
+    unsigned int i;
+
+    prog = rte_zmalloc("bpf_prog", sizeof(*prog), RTE_CACHE_LINE_SIZE);
+    if (!prog) {
+        printf("alloc bpf prog failed\n");
+        return NULL;
+    }
+
+    snprintf(prog->file, sizeof(prog->file), "%s", file);
+    snprintf(prog->section, sizeof(prog->section), "%s", section ? section : ".text");
+    prog->mbuf_arg = arg && !strcmp(arg, "mbuf");
+    prog->drop_on_match = verdict && !strcmp(verdict, "drop");
+
+    prog->hook = MOD_HOOK_INGRESS;
+    for (i = 0; hook && i < RTE_DIM(bpf_hooks); i++) {
+        if (!strcmp(hook, bpf_hooks[i].name)) {
+            prog->hook = bpf_hooks[i].hook;
+            break;
+        }
+    }
+    if (hook && i == RTE_DIM(bpf_hooks)) {
+        printf("invalid bpf hook %s\n", hook);
+        rte_free(prog);
+        return NULL;
+    }
+
+    memset(&prm, 0, sizeof(prm));
+    if (prog->mbuf_arg) {
+        prm.prog_arg.type = RTE_BPF_ARG_PTR_MBUF;
+        prm.prog_arg.size = sizeof(struct rte_mbuf);
+        prm.prog_arg.buf_size = RTE_MBUF_DEFAULT_DATAROOM;
+    } else {
+        prm.prog_arg.type = RTE_BPF_ARG_PTR;
+        prm.prog_arg.size = RTE_MBUF_DEFAULT_DATAROOM;
+    }
+
+    prog->bpf = rte_bpf_elf_load(&prm, prog->file, prog->section);
+    if (!prog->bpf) {
+        printf("load bpf %s section %s failed, %s\n", prog->file, prog->section, rte_strerror(rte_errno));
+        rte_free(prog);
+        return NULL;
+    }
+
+    /** interpreted when the arch has no JIT
+     * */
+    if (!rte_bpf_get_jit(prog->bpf, &jit)) {
+        prog->func = jit.func;
+    }
+
+    return prog;
+}
+
+/** Publish prog, NULL to detach, the old one is retired
+ * */
+static int
+bpf_prog_swap(bpf_prog_t *prog)
+{
+    bpf_prog_t *old;
+    int i;
+
+    rte_spinlock_lock(&bpf_retire_lock);
+
+    for (i = 0; i < BPF_MAX_RETIRED; i++) {
+        if (!bpf_retired[i]) break;
+    }
+
+    if (i == BPF_MAX_RETIRED) {
+        rte_spinlock_unlock(&bpf_retire_lock);
+        printf("too many bpf programs retiring, retry later\n");
+        return -1;
+    }
+
+    /** the time goes first, a slot is taken once its pointer is set
+     * */
+    old = __atomic_exchange_n(&bpf_prog, prog, __ATOMIC_ACQ_REL);
+    if (old) {
+        __atomic_store_n(&bpf_retired_at[i], rte_get_timer_cycles(), __ATOMIC_RELAXED);
+        __atomic_store_n(&bpf_retired[i], old, __ATOMIC_RELEASE);
+    }
+
+    rte_spinlock_unlock(&bpf_retire_lock);
+    return 0;
+}
+
+static int
+bpf_json_load(void)
+{
+    json_object *jr, *jv;
+    const char *file, *section = NULL, *hook = NULL, *arg = NULL, *verdict = NULL;
+    bpf_prog_t *prog;
+    int ret = 0;
+
+    jr = JR(CONFIG_PATH, "bpf.json");
+    if (!jr) {
+        printf("no bpf.json, bpf disabled\n");
+        return 0;
+    }
+
+    jv = JV(jr, "file");
+    if (!jv) {
+        printf("parse file failed\n");
+        ret = -1;
+        goto done;
+    }
+    file = JV_S(jv);
+
+    jv = JV(jr, "section");
+    if (jv) section = JV_S(jv);
+
+    jv = JV(jr, "hook");
+    if (jv) hook = JV_S(jv);
+
+    jv = JV(jr, "arg");
+    if (jv) arg = JV_S(jv);
+
+    jv = JV(jr, "verdict");
+    if (jv) verdict = JV_S(jv);
+
+    prog = bpf_prog_load(file, section, hook, arg, verdict);
+    if (!prog) {
+        ret = -1;
+        goto done;
+    }
+
+    if (bpf_prog_swap(prog)) {
+        bpf_prog_free(prog);
+        ret = -1;
+    }
+
+done:
+    JR_FREE(jr);
+    return ret;
+}
+
+int bpf_conf(__rte_unused void *config)
+{
+    if (bpf_json_load()) {
+        printf("bpf json load failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void bpf_tick(__rte_unused void *config)
+{
+    bpf_prog_t *prog;
+    uint64_t now;
+    int i;
+
+    /** now after the lock, never before a time stored meanwhile
+     * */
+    rte_spinlock_lock(&bpf_retire_lock);
+    now = rte_get_timer_cycles();
+
+    for (i = 0; i < BPF_MAX_RETIRED; i++) {
+        prog = __atomic_load_n(&bpf_retired[i], __ATOMIC_ACQUIRE);
+        if (prog && now - __atomic_load_n(&bpf_retired_at[i], __ATOMIC_RELAXED) > BPF_GRACE_SEC * rte_get_timer_hz()) {
+            bpf_prog_free(prog);
+            __atomic_store_n(&bpf_retired[i], NULL, __ATOMIC_RELEASE);
+        }
+    }
+
+    rte_spinlock_unlock(&bpf_retire_lock);
+}
+
+static int
+bpf_load(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    bpf_prog_t *prog;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    prog = bpf_prog_load(CLI_OPT_V(cli, "file"), CLI_OPT_V(cli, "section"), CLI_OPT_V(cli, "hook"),
+        CLI_OPT_V(cli, "arg"), CLI_OPT_V(cli, "verdict"));
+    if (!prog) {
+        CLI_PRINT(cli, "load bpf %s failed", CLI_OPT_V(cli, "file"));
+        return -1;
+    }
+
+    if (bpf_prog_swap(prog)) {
+        CLI_PRINT(cli, "swap bpf program failed");
+        bpf_prog_free(prog);
+        return -1;
+    }
+
+    CLI_PRINT(cli, "bpf %s loaded, %s", prog->file, prog->func ? "jit" : "interpreted");
+    return 0;
+}
+
+static int
+bpf_unload(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (bpf_prog_swap(NULL)) {
+        CLI_PRINT(cli, "detach bpf program failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+bpf_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    bpf_prog_t *prog = bpf_prog;
+    uint64_t runs = 0, drops = 0;
+    unsigned int lcore_id, i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!prog) {
+        CLI_PRINT(cli, "no bpf program");
+    } else {
+        for (i = 0; i < RTE_DIM(bpf_hooks); i++) {
+            if (bpf_hooks[i].hook == prog->hook) break;
+        }
+
+        CLI_PRINT(cli, "file %s section %s hook %s arg %s verdict %s %s",
+            prog->file, prog->section, i < RTE_DIM(bpf_hooks) ? bpf_hooks[i].name : "-",
+            prog->mbuf_arg ? "mbuf" : "data", prog->drop_on_match ? "drop" : "keep",
+            prog->func ? "jit" : "interpreted");
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        runs += bpf_stats[lcore_id].runs;
+        drops += bpf_stats[lcore_id].drops;
+    }
+
+    CLI_PRINT(cli, "runs  %"PRIu64, runs);
+    CLI_PRINT(cli, "drops %"PRIu64, drops);
+    return 0;
+}
+
+static void
+bpf_cli_register(config_t *c)
+{
+    struct cli_command *cmd, *load;
+
+    cmd = CLI_CMD_C(c->cli_def, NULL, "bpf", NULL, "ebpf filter");
+
+    load = CLI_CMD_C(c->cli_def, cmd, "load", bpf_load, "load and attach an ebpf elf, replacing the current one");
+    CLI_OPT_A(load, "file", "elf object file");
+    CLI_OPT(load, "section", "elf section, .text by default");
+    CLI_OPT(load, "hook", "ingress, prerouting, forward, postrouting or egress");
+    CLI_OPT(load, "arg", "data or mbuf, what the program gets");
+    CLI_OPT(load, "verdict", "keep: return 0 drops, drop: non-zero drops");
+
+    CLI_CMD_C(c->cli_def, cmd, "unload", bpf_unload, "detach the ebpf program");
+    CLI_CMD_C(c->cli_def, c->cli_show, "bpf", bpf_show, "ebpf filter statistics");
+}
+
+int bpf_init(void *config)
+{
+    config_t *c = config;
+
+    if (bpf_conf(c)) {
+        printf("bpf conf failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        bpf_cli_register(c);
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,38 @@
+#ifndef _M_BPF_H_
+#define _M_BPF_H_
+
+#include "../module.h"
+
+/** User supplied eBPF filters, loaded from ELF and JIT-compiled by lib/bpf
+ *
+ * One program at a time runs at its hook, on the mbuf or on the packet
+ * data as lib/bpf eth callbacks do. A program returning 0 rejects the
+ * packet, or with verdict 'drop' a non-zero return does, which suits
+ * filters written to match attack patterns.
+ *
+ * Loading from the cli or bpf.json swaps the program pointer atomically,
+ * the old program is destroyed on a later tick once no worker can still
+ * be running it.
+ * */
+
+#define BPF_MAX_RETIRED     8
+#define BPF_GRACE_SEC       2
+
+/** Mark packets rejected by a program attached to INGRESS, for paths
+ * which do not pass module hooks, e.g. graph nodes
+ * @param mbufs
+ *  decoded packets
+ * @param drop
+ *  output, set to 1 for rejected packets, left untouched otherwise
+ * */
+void bpf_filter_burst(struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop);
+
+int bpf_init(void *config);
+mod_ret_t bpf_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int bpf_conf(void *config);
+void bpf_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,515 @@
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_pause.h>
+#include <rte_pcapng.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../worker.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../prefix.h"
+
+#include "capture.h"
+
+typedef struct {
+    uint32_t addr;              /** src or dst, host order */
+    uint32_t mask;              /** 0 for any address */
+    uint16_t port;              /** src or dst, host order, 0 for any */
+    uint8_t proto;              /** 0 for any */
+    uint8_t v4_only;            /** address, port or proto given */
+    uint32_t acl_rule;          /** matched acl rule, 0 for any */
+    uint32_t snaplen;
+    uint32_t rate;              /** packets per second on each lcore, 0 for no limit */
+    uint64_t cost;              /** cycles per packet of rate */
+    uint64_t count;             /** stop after count packets written, 0 for no limit */
+} capture_session_t;
+
+typedef struct {
+    struct rte_ring *ring;      /** pcapng mbufs, worker to writer */
+    uint64_t credit;            /** token bucket in cycles */
+    uint64_t last;
+    uint64_t captured;
+    uint64_t rate_drop;
+    uint64_t ring_drop;
+    uint64_t nomem;
+    volatile uint32_t inside;   /** in capture_packet_slow(), see capture_quiesce() */
+} __rte_cache_aligned capture_lcore_t;
+
+volatile uint32_t capture_points;
+
+static capture_session_t capture_session;
+static capture_lcore_t capture_lcores[RTE_MAX_LCORE];
+static struct rte_mempool *capture_pool;
+static rte_pcapng_t *capture_pcapng;
+static pthread_t capture_thread;
+static volatile int capture_running;
+static uint64_t capture_hz;
+static uint64_t capture_written;
+static uint64_t capture_write_failed;
+static char capture_file[256];
+
+static const char *capture_point_names[CAPTURE_POINT_MAX] = {
+    [CAPTURE_POINT_INGRESS] = "ingress",
+    [CAPTURE_POINT_DENY] = "deny",
+    [CAPTURE_POINT_EGRESS] = "egress",
+};
+
+MODULE_DECLARE(capture) = {
+    .name = "capture",
+    .id = MOD_ID_CAPTURE,
+    .enabled = true,
+    .log = true,
+    .init = capture_init,
+    .proc = capture_proc,
+    .conf = NULL,
+    .tick = NULL,
+    .priv = NULL
+};
+
+static inline int
+capture_match(capture_session_t *s, packet_t *p)
+{
+    ip4_tuple_t *t = &p->tuple.v4;
+
+    if (s->acl_rule && p->acl_rule != s->acl_rule) {
+        return 0;
+    }
+
+    if (!s->v4_only) {
+        return 1;
+    }
+
+    if (!p->is_v4) {
+        return 0;
+    }
+
+    if (s->proto && t->proto != s->proto) {
+        return 0;
+    }
+
+    if (s->mask && (rte_be_to_cpu_32(t->sip) & s->mask) != s->addr &&
+        (rte_be_to_cpu_32(t->dip) & s->mask) != s->addr) {
+        return 0;
+    }
+
+    if (s->port && rte_be_to_cpu_16(t->sp) != s->port && rte_be_to_cpu_16(t->dp) != s->port) {
+        return 0;
+    }
+
+    return 1;
+}
+
+void capture_packet_slow(struct rte_mbuf *mbuf, capture_point_t point)
+{
+    capture_session_t *s = &capture_session;
+    capture_lcore_t *cl = &capture_lcores[rte_lcore_id()];
+    struct rte_mbuf *mc;
+    packet_t *p;
+    uint64_t now;
+    uint16_t port;
+
+    /** announce before the point is checked again, so a stop either
+     * sees this lcore inside or this lcore sees the point disarmed
+     * */
+    cl->inside = 1;
+    rte_smp_mb();
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!(capture_points & (1U << point)) || !p || !cl->ring || !capture_match(s, p)) {
+        goto out;
+    }
+
+    now = rte_get_tsc_cycles();
+
+    if (s->rate) {
+        cl->credit += now - cl->last;
+        cl->last = now;
+        if (cl->credit > s->cost * CAPTURE_BURST) {
+            cl->credit = s->cost * CAPTURE_BURST;
+        }
+        if (cl->credit < s->cost) {
+            cl->rate_drop ++;
+            goto out;
+        }
+        cl->credit -= s->cost;
+    }
+
+    /** queue of the pcapng block carries the lcore, so per worker
+     * streams can be told apart
+     * */
+    port = (point == CAPTURE_POINT_EGRESS && p->oport < RTE_MAX_ETHPORTS) ? p->oport : p->iport;
+    mc = rte_pcapng_copy(port, rte_lcore_id(), mbuf, capture_pool, s->snaplen, now,
+        point == CAPTURE_POINT_EGRESS ? RTE_PCAPNG_DIRECTION_OUT : RTE_PCAPNG_DIRECTION_IN);
+    if (!mc) {
+        cl->nomem ++;
+        goto out;
+    }
+
+    if (rte_ring_enqueue(cl->ring, mc)) {
+        rte_pktmbuf_free(mc);
+        cl->ring_drop ++;
+        goto out;
+    }
+
+    cl->captured ++;
+
+out:
+    rte_smp_mb();
+    cl->inside = 0;
+}
+
+mod_ret_t capture_proc(__rte_unused void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (hook == MOD_HOOK_EGRESS) {
+        capture_packet(mbuf, CAPTURE_POINT_EGRESS);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static uint32_t
+capture_drain(int write)
+{
+    struct rte_mbuf *pkts[CAPTURE_BURST];
+    unsigned int lcore_id, n;
+    uint32_t total = 0;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        if (!capture_lcores[lcore_id].ring) {
+            continue;
+        }
+
+        n = rte_ring_dequeue_burst(capture_lcores[lcore_id].ring, (void **)pkts, CAPTURE_BURST, NULL);
+        if (!n) {
+            continue;
+        }
+
+        if (write) {
+            if (rte_pcapng_write_packets(capture_pcapng, pkts, n) < 0) {
+                capture_write_failed += n;
+            } else {
+                capture_written += n;
+            }
+        }
+
+        rte_pktmbuf_free_bulk(pkts, n);
+        total += n;
+    }
+
+    return total;
+}
+
+static void *
+capture_writer(__rte_unused void *arg)
+{
+    capture_session_t *s = &capture_session;
+
+    while (capture_running) {
+        if (!capture_drain(1)) {
+            usleep(1000);
+        }
+
+        if (s->count && capture_written >= s->count) {
+            capture_points = 0;
+        }
+    }
+
+    return NULL;
+}
+
+static int
+capture_num_parse(const char *s, uint64_t max, uint64_t *v)
+{
+    char *end;
+
+    if (*s == '-') {
+        return -1;
+    }
+
+    *v = strtoull(s, &end, 10);
+    if (end == s || *end || *v > max) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Disarm all points and wait until no worker is still copying with
+ * the session, which may then be changed
+ * */
+static void
+capture_quiesce(void)
+{
+    unsigned int lcore_id;
+
+    capture_points = 0;
+    rte_smp_mb();
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        while (capture_lcores[lcore_id].inside) {
+            rte_pause();
+        }
+    }
+}
+
+static int
+capture_start(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    capture_session_t *s = &capture_session, ns;
+    const char *opt, *points, *file;
+    uint32_t mask = 0;
+    uint64_t v;
+    unsigned int lcore_id;
+    int i, fd;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (capture_running) {
+        CLI_PRINT(cli, "capture to %s is running, stop it first", capture_file);
+        return -1;
+    }
+
+    points = CLI_OPT_V(cli, "point");
+    file = CLI_OPT_V(cli, "file");
+    if (!points || !file) {
+        CLI_PRINT(cli, "point and file are required");
+        return -1;
+    }
+
+    for (i = 0; i < CAPTURE_POINT_MAX; i++) {
+        if (strstr(points, capture_point_names[i])) {
+            mask |= 1U << i;
+        }
+    }
+
+    if (!mask) {
+        CLI_PRINT(cli, "invalid capture point %s", points);
+        return -1;
+    }
+
+    /** parsed aside, the session is only written once workers are
+     * out of it
+     * */
+    memset(&ns, 0, sizeof(ns));
+    ns.snaplen = CAPTURE_SNAPLEN;
+
+    #define CAPTURE_NUM(item, max) \
+        opt = CLI_OPT_V(cli, item); \
+        if (opt && capture_num_parse(opt, max, &v)) { \
+            CLI_PRINT(cli, "invalid %s %s", item, opt); \
+            return -1; \
+        }
+
+    opt = CLI_OPT_V(cli, "host");
+    if (opt) {
+        if (prefix_parse4(opt, &ns.addr, &ns.mask)) {
+            CLI_PRINT(cli, "invalid host %s", opt);
+            return -1;
+        }
+        ns.v4_only = 1;
+    }
+
+    CAPTURE_NUM("port", UINT16_MAX);
+    if (opt) {
+        ns.port = v;
+        ns.v4_only = 1;
+    }
+
+    CAPTURE_NUM("proto", UINT8_MAX);
+    if (opt) {
+        ns.proto = v;
+        ns.v4_only = 1;
+    }
+
+    CAPTURE_NUM("rule", UINT32_MAX);
+    if (opt) ns.acl_rule = v;
+
+    /** the pool holds copies of CAPTURE_SNAPLEN at most
+     * */
+    CAPTURE_NUM("snaplen", UINT32_MAX);
+    if (opt) ns.snaplen = RTE_MIN(RTE_MAX(v, 64ULL), (uint64_t)CAPTURE_SNAPLEN);
+
+    CAPTURE_NUM("rate", UINT32_MAX);
+    if (opt) ns.rate = v;
+    ns.cost = ns.rate ? capture_hz / ns.rate : 0;
+
+    CAPTURE_NUM("count", UINT64_MAX);
+    if (opt) ns.count = v;
+
+    #undef CAPTURE_NUM
+
+    fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        CLI_PRINT(cli, "open %s failed", file);
+        return -1;
+    }
+
+    capture_pcapng = rte_pcapng_fdopen(fd, NULL, NULL, "dpdk-firewall", NULL);
+    if (!capture_pcapng) {
+        CLI_PRINT(cli, "pcapng open %s failed", file);
+        close(fd);
+        return -1;
+    }
+
+    /** points are disarmed, a worker of the last capture may still
+     * be copying with the session
+     * */
+    capture_quiesce();
+    *s = ns;
+
+    /** copies left over by workers racing the last stop
+     * */
+    while (capture_drain(0));
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        capture_lcore_t *cl = &capture_lcores[lcore_id];
+        cl->credit = s->cost * CAPTURE_BURST;
+        cl->last = rte_get_tsc_cycles();
+        cl->captured = cl->rate_drop = cl->ring_drop = cl->nomem = 0;
+    }
+    capture_written = capture_write_failed = 0;
+    snprintf(capture_file, sizeof(capture_file), "%s", file);
+
+    capture_running = 1;
+    if (rte_ctrl_thread_create(&capture_thread, "fw-capture", NULL, capture_writer, NULL)) {
+        CLI_PRINT(cli, "create capture writer failed");
+        capture_running = 0;
+        rte_pcapng_close(capture_pcapng);
+        capture_pcapng = NULL;
+        return -1;
+    }
+
+    rte_smp_wmb();
+    capture_points = mask;
+
+    CLI_PRINT(cli, "capture %s to %s started", points, file);
+    return 0;
+}
+
+static int
+capture_stop(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!capture_running) {
+        CLI_PRINT(cli, "no capture running");
+        return 0;
+    }
+
+    /** let workers already inside capture_packet_slow() finish
+     * */
+    capture_quiesce();
+
+    capture_running = 0;
+    pthread_join(capture_thread, NULL);
+    while (capture_drain(1));
+
+    rte_pcapng_close(capture_pcapng);
+    capture_pcapng = NULL;
+
+    CLI_PRINT(cli, "capture to %s stopped, %"PRIu64" packets written", capture_file, capture_written);
+    return 0;
+}
+
+static int
+capture_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    capture_lcore_t *cl;
+    unsigned int lcore_id;
+    int i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    CLI_PRINT(cli, "capture %s file %s", capture_running ? "running" : "stopped", capture_file);
+    for (i = 0; i < CAPTURE_POINT_MAX; i++) {
+        CLI_PRINT(cli, "point %-8s %s", capture_point_names[i],
+            (capture_points & (1U << i)) ? "armed" : "-");
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        cl = &capture_lcores[lcore_id];
+        if (!cl->ring) {
+            continue;
+        }
+
+        CLI_PRINT(cli, "lcore %u captured %"PRIu64" rate drop %"PRIu64" ring drop %"PRIu64" nomem %"PRIu64,
+            lcore_id, cl->captured, cl->rate_drop, cl->ring_drop, cl->nomem);
+    }
+
+    CLI_PRINT(cli, "written        %"PRIu64, capture_written);
+    CLI_PRINT(cli, "write failed   %"PRIu64, capture_write_failed);
+
+    return 0;
+}
+
+static void
+capture_cli_register(config_t *c)
+{
+    struct cli_command *cmd, *start;
+
+    cmd = CLI_CMD_C(c->cli_def, NULL, "capture", NULL, "packet capture into pcapng");
+
+    start = CLI_CMD_C(c->cli_def, cmd, "start", capture_start, "start capture");
+    CLI_OPT_A(start, "point", "ingress, deny or egress, comma separated");
+    CLI_OPT_A(start, "file", "pcapng file path");
+    CLI_OPT(start, "host", "src or dst address, a.b.c.d[/n]");
+    CLI_OPT(start, "port", "src or dst port");
+    CLI_OPT(start, "proto", "transport layer protocol");
+    CLI_OPT(start, "rule", "matched acl rule id");
+    CLI_OPT(start, "snaplen", "bytes kept of each packet");
+    CLI_OPT(start, "rate", "packets per second on each worker");
+    CLI_OPT(start, "count", "stop after count packets");
+
+    CLI_CMD_C(c->cli_def, cmd, "stop", capture_stop, "stop capture");
+    CLI_CMD_C(c->cli_def, c->cli_show, "capture", capture_show, "capture statistics");
+}
+
+int capture_init(void *config)
+{
+    config_t *c = config;
+    char name[RTE_RING_NAMESIZE];
+    unsigned int lcore_id;
+
+    capture_hz = rte_get_tsc_hz();
+
+    capture_pool = rte_pktmbuf_pool_create(hot_object(HOT_MEMPOOL, name, sizeof(name), "capture_pool"), CAPTURE_POOL_SIZE, 256, 0,
+        rte_pcapng_mbuf_size(CAPTURE_SNAPLEN), rte_socket_id());
+    if (!capture_pool) {
+        printf("create capture pool failed\n");
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        hot_object(HOT_RING, name, sizeof(name), "capture_%u", lcore_id);
+        capture_lcores[lcore_id].ring = rte_ring_create(name, CAPTURE_RING_SIZE,
+            rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (!capture_lcores[lcore_id].ring) {
+            printf("create capture ring %s failed\n", name);
+            return -1;
+        }
+    }
+
+    if (c->cli_def) {
+        capture_cli_register(c);
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
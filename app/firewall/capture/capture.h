@@ -0,0 +1,49 @@
+#ifndef _M_CAPTURE_H_
+#define _M_CAPTURE_H_
+
+#include "../module.h"
+
+/** Packet capture at points inside the module chain, into pcapng
+ *
+ * A worker hitting an armed point checks the filter and its token
+ * bucket, then copies (truncated to snaplen) into a pcapng mbuf
+ * queued on its own single-producer/single-consumer ring. A control
+ * thread drains the rings and writes the file. Any shortage, ring
+ * full, no mbuf, out of tokens, drops the copy and never the packet.
+ *
+ * Unarmed, a capture point costs one load and one branch.
+ * */
+
+#define CAPTURE_RING_SIZE   1024
+#define CAPTURE_POOL_SIZE   4095
+#define CAPTURE_BURST       32
+#define CAPTURE_SNAPLEN     RTE_MBUF_DEFAULT_DATAROOM
+
+typedef enum {
+    CAPTURE_POINT_INGRESS,      /** decoded, before acl */
+    CAPTURE_POINT_DENY,         /** dropped by an acl rule */
+    CAPTURE_POINT_EGRESS,       /** leaving the module chain */
+    CAPTURE_POINT_MAX,
+} capture_point_t;
+
+/** bitmap of armed capture points
+ * */
+extern volatile uint32_t capture_points;
+
+void capture_packet_slow(struct rte_mbuf *mbuf, capture_point_t point);
+
+static inline void
+capture_packet(struct rte_mbuf *mbuf, capture_point_t point)
+{
+    if (unlikely(capture_points & (1U << point))) {
+        capture_packet_slow(mbuf, point);
+    }
+}
+
+int capture_init(void *config);
+mod_ret_t capture_proc(__rte_unused void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -8,6 +9,8 @@
 #include <sys/select.h>
 #include <pthread.h>
 
+#include <rte_lcore.h>
+
 #include "config.h"
 #include "cli.h"
 
@@ -19,6 +22,11 @@ unsigned int cli_regular_debug;
 struct cli_def *m_cli_def;
 int m_cli_sockfd;
 
+/** config the accepting thread was started with, see _cli_start()
+ * */
+static config_t *cli_listener;
+static pthread_t cli_thread;
+
 static int 
 cli_regular_callback(struct cli_def *cli) 
 {
@@ -60,11 +68,9 @@ cli_save_conf(struct cli_def *cli, const char *command, char *argv[], int argc)
     return 0;
 }
 
-int _cli_init(void *config)
+struct cli_def *_cli_new(void *config)
 {
-    config_t *c = (config_t *)config;
-    struct sockaddr_in addr;
-    int on = 1;
+    struct cli_def *cli;
     const char *banner = 
     "=====================================================================\n"
     "      _____ .__                                 .__   .__\n"   
@@ -75,24 +81,41 @@ int _cli_init(void *config)
     "                             \\/              \\/\n"
     "=====================================================================";
 
+    cli = cli_init();
+    cli_set_banner(cli, banner);
+    cli_set_hostname(cli, "sys");
+    cli_telnet_protocol(cli, 1);
+    cli_regular(cli, cli_regular_callback);
+    cli_regular_interval(cli, 5);
+    cli_set_idle_timeout_callback(cli, 300, cli_idle_timeout);
+    cli_set_auth_callback(cli, cli_check_auth);
+    cli_set_enable_callback(cli, cli_check_enable);
+    cli_set_context(cli, config);
+    return cli;
+}
+
+int _cli_init(void *config)
+{
+    config_t *c = (config_t *)config;
+
     if (c->cli_def || c->cli_sockfd) {
         return -1;
     }
 
-    c->cli_def = cli_init();
-    cli_set_banner(c->cli_def, banner);
-    cli_set_hostname(c->cli_def, "sys");
-    cli_telnet_protocol(c->cli_def, 1);
-    cli_regular(c->cli_def, cli_regular_callback);
-    cli_regular_interval(c->cli_def, 5);
-    cli_set_idle_timeout_callback(c->cli_def, 300, cli_idle_timeout);
-    cli_set_auth_callback(c->cli_def, cli_check_auth);
-    cli_set_enable_callback(c->cli_def, cli_check_enable);
-    cli_set_context(c->cli_def, c);
+    c->cli_def = _cli_new(c);
 
     CLI_CMD_C(c->cli_def, NULL, "save", cli_save_conf, "save and reload configuration");
     c->cli_show = CLI_CMD_C(c->cli_def, NULL, "show", NULL, "show system information");
 
+    return 0;
+}
+
+int _cli_listen(void *config)
+{
+    config_t *c = (config_t *)config;
+    struct sockaddr_in addr;
+    int on = 1;
+
     if ((c->cli_sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         perror("socket");
         return -1;
@@ -143,7 +166,7 @@ int _cli_run(void *config)
     fd_set fds;
     int x, r;
 
-    timeout.tv_sec = 10;
+    timeout.tv_sec = 1;
     timeout.tv_usec = 0;
     FD_ZERO(&fds);
     FD_SET(c->cli_sockfd, &fds);
@@ -172,5 +195,47 @@ int _cli_run(void *config)
     return 0;
 }
 
+static void *_cli_accept(void *arg)
+{
+    config_t *c = arg;
+
+    while (c->cli_sockfd > 0) {
+        _cli_run(c);
+    }
+
+    return NULL;
+}
+
+int _cli_start(void *config)
+{
+    config_t *c = config;
+
+    if (_cli_listen(c)) {
+        return -1;
+    }
+
+    cli_listener = c;
+    if (rte_ctrl_thread_create(&cli_thread, "fw-cli", NULL, _cli_accept, c)) {
+        printf("create cli thread failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void _cli_stop(void)
+{
+    int fd;
+
+    if (!cli_listener || cli_listener->cli_sockfd <= 0) {
+        return;
+    }
+
+    fd = cli_listener->cli_sockfd;
+    cli_listener->cli_sockfd = -1;
+    shutdown(fd, SHUT_RDWR);
+    close(fd);
+}
+
 // file format utf-8
 // ident using space
\ No newline at end of file
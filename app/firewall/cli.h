@@ -56,9 +56,24 @@
     cli_print(cli, fmt, ##__VA_ARGS__)
 
 
+/** libcli with the banner and logins of the firewall, no command yet
+ * */
+struct cli_def *_cli_new(void *config);
+
 int _cli_init(void *config);
+
+/** Listen on the cli port, separate from _cli_init for a hot takeover,
+ * whose predecessor holds the port until the handover
+ * */
+int _cli_listen(void *config);
 int _cli_run(void *config);
 
+/** Listen and accept sessions on a control thread, never on an lcore,
+ * _cli_stop closes the listening socket
+ * */
+int _cli_start(void *config);
+void _cli_stop(void);
+
 #endif
 
 // file format utf-8
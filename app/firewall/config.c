@@ -13,6 +13,13 @@ config_t config_A = {
     .cli_sockfd = 0,
     .itf_cfg = NULL,
     .acl_ctx = NULL,
+    .synproxy_cfg = NULL,
+    .nat_cfg = NULL,
+    .flow_cfg = NULL,
+    .dpi_cfg = NULL,
+    .route_cfg = NULL,
+    .urpf_cfg = NULL,
+    .geo_cfg = NULL,
     .promiscuous = 1,
     .worker_num = 0,
     .port_num = 0,
@@ -23,12 +30,16 @@ config_t config_A = {
     .rtx_worker_core = -1,
     .rx_queues = {0},
     .tx_queues = {{0}, {0}, {0}, {0}, {0}, {0}, {0}, {0}},
+    .graph_mode = 0,
+    .perf_mode = 0,
     .reload_mark = 0,
     .switch_mark = 0,
 };
 
 config_t config_B;
 
+char config_path[MAX_FILE_PATH] = "/opt/firewall/config";
+
 /** Indicator for config switch, when all workers' indicator equal to
  * the global indicator, a config switch process finished
  * */
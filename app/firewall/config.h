@@ -9,7 +9,7 @@
 #define MAX_QUEUE_NUM  MAX_WORKER_NUM
 #define MAX_PKT_BURST  32
 
-#define CONFIG_PATH "/opt/firewall/config"
+#define CONFIG_PATH config_path
 #define BINARY_PATH "/opt/firewall/bin"
 #define SCRIPT_PATH "/opt/firewall/script"
 
@@ -30,10 +30,23 @@ typedef struct {
     void *tx_queues[MAX_PORT_NUM][MAX_QUEUE_NUM];
     void *itf_cfg;
     void *acl_ctx;
+    void *synproxy_cfg;
+    void *nat_cfg;
+    void *flow_cfg;
+    void *dpi_cfg;
+    void *route_cfg;
+    void *urpf_cfg;
+    void *geo_cfg;
+    int graph_mode;     /** run workers on lib/graph nodes */
+    int perf_mode;      /** feed workers with synthetic traffic, see perf/perf.h */
     int reload_mark;    /** mark for configuration reload */
     int switch_mark;    /** mark for configuration switch */
 } config_t;
 
+/** directory of json files, overridden by --config
+ * */
+extern char config_path[MAX_FILE_PATH];
+
 int config_reload(config_t *c);
 config_t *config_switch(config_t *c, int lcore_id);
 
@@ -0,0 +1,45 @@
+#ifndef _M_CSUM_H_
+#define _M_CSUM_H_
+
+#include <stdint.h>
+
+/** Incremental internet checksum update, see RFC 1624:
+ *  HC' = ~(~HC + ~m + m')
+ * All values are taken as stored in the packet, the one's complement
+ * sum does not care about byte order as long as both sides agree.
+ * */
+
+static inline uint16_t
+csum_fold(uint32_t sum)
+{
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)sum;
+}
+
+static inline uint16_t
+csum_replace2(uint16_t check, uint16_t from, uint16_t to)
+{
+    uint32_t sum = (uint16_t)~check;
+
+    sum += (uint16_t)~from;
+    sum += to;
+    return (uint16_t)~csum_fold(sum);
+}
+
+static inline uint16_t
+csum_replace4(uint16_t check, uint32_t from, uint32_t to)
+{
+    uint32_t sum = (uint16_t)~check;
+
+    sum += (uint16_t)~(from & 0xffff);
+    sum += (uint16_t)~(from >> 16);
+    sum += to & 0xffff;
+    sum += to >> 16;
+    return (uint16_t)~csum_fold(sum);
+}
+
+#endif
+
+// file format utf-8
+// ident using space
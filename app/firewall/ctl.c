@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <rte_eal.h>
+#include <rte_cycles.h>
+#include <rte_memzone.h>
+#include <rte_string_fns.h>
+
+#include "config.h"
+#include "cli.h"
+#include "ctl.h"
+
+typedef enum {
+    CTL_OP_TREE,                /** dump the command tree */
+    CTL_OP_RUN,                 /** run a command line */
+} ctl_op_t;
+
+typedef struct {
+    uint8_t op;
+    uint8_t mode;               /** of the session */
+    uint8_t privilege;          /** of the session */
+    uint8_t pad;
+    uint32_t seq;
+    char line[CTL_LINE_MAX];
+} ctl_req_t;
+
+typedef struct {
+    int32_t ret;
+    uint32_t len;               /** bytes of output in the zone */
+    uint32_t seq;               /** of the request answered */
+} ctl_rsp_t;
+
+/** A cli process owns the zone from its request until it read the
+ * output. One whose request timed out gives the zone up while the
+ * dataplane may still run it, the sequence number tells the next
+ * owner whose output the zone holds.
+ * */
+typedef struct {
+    uint32_t owner;             /** pid of the cli process, 0 for none */
+    uint32_t seq;               /** last request given out */
+    uint32_t out_seq;           /** request the output belongs to */
+    uint32_t len;
+    char out[CTL_OUT_SIZE];
+} ctl_zone_t;
+
+/** Optargs of a command as registered by the dataplane, the secondary
+ * puts them back in front of the words left in argv
+ * */
+typedef struct {
+    char name[64];
+    int flags;
+} ctl_opt_t;
+
+typedef struct {
+    char name[128];             /** full command name */
+    ctl_opt_t opts[CTL_OPT_MAX];
+    int opt_num;
+} ctl_cmd_t;
+
+extern volatile bool force_quit;
+
+static ctl_zone_t *ctl_zone;
+static struct cli_def *ctl_cli;
+static ctl_cmd_t ctl_cmds[CTL_CMD_MAX];
+static int ctl_cmd_num;
+
+static void
+ctl_out(const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (ctl_zone->len >= CTL_OUT_SIZE - 1) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(ctl_zone->out + ctl_zone->len, CTL_OUT_SIZE - ctl_zone->len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        ctl_zone->len = RTE_MIN(ctl_zone->len + n, (uint32_t)CTL_OUT_SIZE - 1);
+    }
+}
+
+static void
+ctl_print(__rte_unused struct cli_def *cli, const char *s)
+{
+    ctl_out("%s\n", s);
+}
+
+/** "C depth callback privilege mode name\thelp" per command, followed
+ * by "O flags privilege mode name\thelp" per optarg of it
+ * */
+static void
+ctl_tree_dump(struct cli_command *cmd, int depth)
+{
+    struct cli_optarg *o;
+
+    for (; cmd; cmd = cmd->next) {
+        ctl_out("C %d %d %d %d %s\t%s\n", depth, cmd->callback != NULL,
+            cmd->privilege, cmd->mode, cmd->command, cmd->help ? cmd->help : "");
+
+        for (o = cmd->optargs; o; o = o->next) {
+            ctl_out("O %d %d %d %s\t%s\n", o->flags, o->privilege, o->mode,
+                o->name, o->help ? o->help : "");
+        }
+
+        ctl_tree_dump(cmd->children, depth + 1);
+    }
+}
+
+static int
+ctl_run(const ctl_req_t *req)
+{
+    int mode, privilege, ret;
+
+    mode = ctl_cli->mode;
+    privilege = ctl_cli->privilege;
+
+    ctl_cli->mode = req->mode;
+    ctl_cli->privilege = req->privilege;
+    cli_print_callback(ctl_cli, ctl_print);
+
+    ret = cli_run_command(ctl_cli, req->line);
+
+    cli_print_callback(ctl_cli, NULL);
+    ctl_cli->mode = mode;
+    ctl_cli->privilege = privilege;
+    return ret;
+}
+
+/** Runs on the EAL control thread of the dataplane, as the telnet
+ * sessions do on theirs
+ * */
+static int
+ctl_handle(const struct rte_mp_msg *msg, const void *peer)
+{
+    struct rte_mp_msg reply;
+    ctl_req_t req;
+    ctl_rsp_t rsp;
+
+    memset(&rsp, 0, sizeof(rsp));
+    ctl_zone->len = 0;
+    ctl_zone->out_seq = 0;
+
+    if (msg->len_param != sizeof(req)) {
+        rsp.ret = CLI_ERROR;
+    } else {
+        memcpy(&req, msg->param, sizeof(req));
+        req.line[CTL_LINE_MAX - 1] = 0;
+        rsp.seq = req.seq;
+
+        if (req.op == CTL_OP_TREE) {
+            ctl_tree_dump(ctl_cli->commands, 0);
+            rsp.ret = CLI_OK;
+        } else {
+            rsp.ret = ctl_run(&req);
+        }
+    }
+    rsp.len = ctl_zone->len;
+    __atomic_store_n(&ctl_zone->out_seq, rsp.seq, __ATOMIC_RELEASE);
+
+    memset(&reply, 0, sizeof(reply));
+    rte_strlcpy(reply.name, CTL_MP_NAME, sizeof(reply.name));
+    reply.len_param = sizeof(rsp);
+    memcpy(reply.param, &rsp, sizeof(rsp));
+    return rte_mp_reply(&reply, peer);
+}
+
+int ctl_init(config_t *c)
+{
+    const struct rte_memzone *mz;
+
+    RTE_BUILD_BUG_ON(sizeof(ctl_req_t) > RTE_MP_MAX_PARAM_LEN);
+
+    /** a secondary only hears from the primary, not from the cli
+     * */
+    if (rte_eal_process_type() != RTE_PROC_PRIMARY) {
+        printf("cli process needs the dataplane to be the primary\n");
+        return -1;
+    }
+
+    mz = rte_memzone_reserve(CTL_ZONE_NAME, sizeof(ctl_zone_t), rte_socket_id(), 0);
+    if (!mz) {
+        printf("reserve %s failed\n", CTL_ZONE_NAME);
+        return -1;
+    }
+
+    ctl_zone = mz->addr;
+    memset(ctl_zone, 0, sizeof(ctl_zone_t));
+    ctl_cli = c->cli_def;
+
+    if (rte_mp_action_register(CTL_MP_NAME, ctl_handle)) {
+        printf("register %s action failed\n", CTL_MP_NAME);
+        return -1;
+    }
+
+    return 0;
+}
+
+/** Send a request to the dataplane, the output is in the zone until
+ * ctl_unlock(). A late reply to a request which timed out may come
+ * in place of this one, it is ignored by sequence number.
+ * */
+static int
+ctl_request(ctl_req_t *req, ctl_rsp_t *rsp)
+{
+    struct rte_mp_msg msg;
+    struct rte_mp_reply reply;
+    struct timespec ts = {.tv_sec = CTL_TIMEOUT_SEC, .tv_nsec = 0};
+    int ret = -1;
+
+    req->seq = ++ctl_zone->seq;
+    if (!req->seq) {
+        req->seq = ++ctl_zone->seq;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    rte_strlcpy(msg.name, CTL_MP_NAME, sizeof(msg.name));
+    msg.len_param = sizeof(*req);
+    memcpy(msg.param, req, sizeof(*req));
+
+    if (rte_mp_request_sync(&msg, &reply, &ts) || reply.nb_received != 1) {
+        printf("no reply from dataplane\n");
+        return -1;
+    }
+
+    if (reply.msgs[0].len_param == sizeof(*rsp)) {
+        memcpy(rsp, reply.msgs[0].param, sizeof(*rsp));
+        if (rsp->seq == req->seq &&
+            __atomic_load_n(&ctl_zone->out_seq, __ATOMIC_ACQUIRE) == req->seq) {
+            ret = 0;
+        }
+    }
+
+    free(reply.msgs);
+    return ret;
+}
+
+/** Take the zone, from a cli process which exited holding it too
+ * */
+static int
+ctl_lock(void)
+{
+    uint64_t deadline = rte_get_timer_cycles() + rte_get_timer_hz() * CTL_TIMEOUT_SEC;
+    uint32_t owner, self = getpid();
+
+    for (;;) {
+        owner = __atomic_load_n(&ctl_zone->owner, __ATOMIC_ACQUIRE);
+        if ((!owner || (kill(owner, 0) && errno == ESRCH)) &&
+            __atomic_compare_exchange_n(&ctl_zone->owner, &owner, self, false,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+
+        if (rte_get_timer_cycles() > deadline) {
+            return -1;
+        }
+        rte_delay_us_sleep(1000);
+    }
+}
+
+static void
+ctl_unlock(void)
+{
+    __atomic_store_n(&ctl_zone->owner, 0, __ATOMIC_RELEASE);
+}
+
+static ctl_cmd_t *
+ctl_cmd_find(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ctl_cmd_num; i++) {
+        if (!strcmp(ctl_cmds[i].name, name)) {
+            return &ctl_cmds[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** Append a word, quoted when it has blanks
+ * */
+static int
+ctl_word(char *line, size_t size, const char *w)
+{
+    size_t n = strlen(line);
+    int ret;
+
+    if (strpbrk(w, " \t")) {
+        ret = snprintf(line + n, size - n, " \"%s\"", w);
+    } else {
+        ret = snprintf(line + n, size - n, " %s", w);
+    }
+
+    return (ret < 0 || (size_t)ret >= size - n) ? -1 : 0;
+}
+
+/** Callback of every command registered from the tree, the line is
+ * put back together from what libcli parsed
+ * */
+static int
+ctl_forward(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    ctl_req_t req;
+    ctl_rsp_t rsp;
+    ctl_cmd_t *cmd;
+    const char *v;
+    char *s, *e;
+    int i, ret = 0;
+
+    memset(&req, 0, sizeof(req));
+    req.op = CTL_OP_RUN;
+    req.mode = cli->mode;
+    req.privilege = cli->privilege;
+    rte_strlcpy(req.line, command, sizeof(req.line));
+
+    cmd = ctl_cmd_find(command);
+    for (i = 0; cmd && i < cmd->opt_num && !ret; i++) {
+        v = CLI_OPT_V(cli, cmd->opts[i].name);
+        if (!v) {
+            continue;
+        }
+
+        if (cmd->opts[i].flags & CLI_CMD_ARGUMENT) {
+            ret = ctl_word(req.line, sizeof(req.line), v);
+        } else if (cmd->opts[i].flags & CLI_CMD_OPTIONAL_FLAG) {
+            ret = ctl_word(req.line, sizeof(req.line), cmd->opts[i].name);
+        } else {
+            ret = ctl_word(req.line, sizeof(req.line), cmd->opts[i].name) ||
+                ctl_word(req.line, sizeof(req.line), v);
+        }
+    }
+
+    for (i = 0; i < argc && !ret; i++) {
+        ret = ctl_word(req.line, sizeof(req.line), argv[i]);
+    }
+
+    if (ret) {
+        CLI_PRINT(cli, "command line too long");
+        return CLI_ERROR;
+    }
+
+    if (ctl_lock()) {
+        CLI_PRINT(cli, "dataplane busy");
+        return CLI_ERROR;
+    }
+
+    if (ctl_request(&req, &rsp)) {
+        ctl_unlock();
+        CLI_PRINT(cli, "dataplane not responding");
+        return CLI_ERROR;
+    }
+
+    ctl_zone->out[RTE_MIN(rsp.len, (uint32_t)CTL_OUT_SIZE - 1)] = 0;
+    for (s = ctl_zone->out; *s; s = e + 1) {
+        e = strchr(s, '\n');
+        if (!e) {
+            CLI_PRINT(cli, "%s", s);
+            break;
+        }
+        *e = 0;
+        CLI_PRINT(cli, "%s", s);
+    }
+
+    ctl_unlock();
+    return rsp.ret;
+}
+
+/** Command names already in a bare libcli, enable, exit, help...
+ * */
+static int
+ctl_builtin(struct cli_def *cli, const char *name)
+{
+    struct cli_command *cmd;
+
+    for (cmd = cli->commands; cmd; cmd = cmd->next) {
+        if (!strcmp(cmd->command, name)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/** Register the tree dumped by ctl_tree_dump()
+ * */
+static int
+ctl_tree_load(struct cli_def *cli, char *text)
+{
+    struct cli_command *parents[16] = {NULL}, *cmd = NULL;
+    ctl_cmd_t *cc = NULL;
+    char *line, *save, *help, name[64];
+    int depth, cb, privilege, mode, flags, skip = -1;
+
+    for (line = strtok_r(text, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+        help = strchr(line, '\t');
+        if (!help) {
+            continue;
+        }
+        *help++ = 0;
+
+        if (line[0] == 'O') {
+            if (!cmd || !cc || sscanf(line, "O %d %d %d %63s", &flags, &privilege, &mode, name) != 4) {
+                continue;
+            }
+
+            cli_register_optarg(cmd, name, flags, privilege, mode, help, NULL, NULL, NULL);
+            if (cc->opt_num < CTL_OPT_MAX) {
+                rte_strlcpy(cc->opts[cc->opt_num].name, name, sizeof(cc->opts[0].name));
+                cc->opts[cc->opt_num].flags = flags;
+                cc->opt_num ++;
+            }
+            continue;
+        }
+
+        if (sscanf(line, "C %d %d %d %d %63s", &depth, &cb, &privilege, &mode, name) != 5 ||
+            depth < 0 || depth >= (int)RTE_DIM(parents)) {
+            cmd = NULL;
+            continue;
+        }
+
+        /** a builtin and all below it are left to the local libcli
+         * */
+        if (skip >= 0 && depth > skip) {
+            cmd = NULL;
+            continue;
+        }
+        skip = -1;
+
+        if (depth == 0 && ctl_builtin(cli, name)) {
+            skip = depth;
+            cmd = NULL;
+            continue;
+        }
+
+        if (depth > 0 && !parents[depth - 1]) {
+            cmd = NULL;
+            continue;
+        }
+
+        cmd = cli_register_command(cli, depth ? parents[depth - 1] : NULL, name,
+            cb ? ctl_forward : NULL, privilege, mode, help);
+        parents[depth] = cmd;
+        cc = NULL;
+
+        if (cmd && ctl_cmd_num < CTL_CMD_MAX) {
+            cc = &ctl_cmds[ctl_cmd_num++];
+            memset(cc, 0, sizeof(*cc));
+            rte_strlcpy(cc->name, cmd->full_command_name ? cmd->full_command_name : name, sizeof(cc->name));
+        }
+    }
+
+    return 0;
+}
+
+int ctl_client(config_t *c)
+{
+    const struct rte_memzone *mz;
+    ctl_req_t req;
+    ctl_rsp_t rsp;
+    int ret;
+
+    if (rte_eal_process_type() != RTE_PROC_SECONDARY) {
+        printf("cli process needs --proc-type=secondary\n");
+        return -1;
+    }
+
+    mz = rte_memzone_lookup(CTL_ZONE_NAME);
+    if (!mz) {
+        printf("dataplane serves no cli process, start it with --cli-proc\n");
+        return -1;
+    }
+    ctl_zone = mz->addr;
+
+    c->cli_def = _cli_new(c);
+    if (!c->cli_def) {
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.op = CTL_OP_TREE;
+
+    if (ctl_lock()) {
+        printf("dataplane busy\n");
+        return -1;
+    }
+
+    ret = ctl_request(&req, &rsp);
+    if (!ret) {
+        ctl_zone->out[RTE_MIN(rsp.len, (uint32_t)CTL_OUT_SIZE - 1)] = 0;
+        ret = ctl_tree_load(c->cli_def, ctl_zone->out);
+    }
+    ctl_unlock();
+
+    if (ret) {
+        printf("load command tree failed\n");
+        return -1;
+    }
+
+    printf("%d commands from dataplane\n", ctl_cmd_num);
+
+    if (_cli_listen(c)) {
+        return -1;
+    }
+
+    while (!force_quit) {
+        _cli_run(c);
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
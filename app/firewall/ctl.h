@@ -0,0 +1,47 @@
+#ifndef _M_CTL_H_
+#define _M_CTL_H_
+
+#include "config.h"
+
+/** Command line served by a secondary process
+ *
+ * The dataplane started with --cli-proc opens no socket, a secondary
+ * started with --cli listens on the cli port instead:
+ *
+ *   dpdk-firewall -l 0-3 -n 4 -- --cli-proc
+ *   dpdk-firewall -l 0 --proc-type=secondary -- --cli
+ *
+ * On start the secondary asks for the command tree of the dataplane
+ * and registers the same commands, so logins, modes, help and
+ * completion all stay local. A command line goes to the dataplane as
+ * an rte_mp request, runs there on the EAL control thread with the
+ * mode and privilege of the session, and its output comes back in a
+ * shared memzone. The management lcore is never involved.
+ *
+ * rte_mp requests of a secondary only reach the primary, so only a
+ * primary dataplane serves a cli process. A hot takeover, a secondary,
+ * is refused at argument parsing when given --cli-proc or when this
+ * memzone exists, see hot.h; a dataplane started with --cli-proc is
+ * upgraded by a cold restart.
+ * */
+
+#define CTL_MP_NAME         "fw_ctl"
+#define CTL_ZONE_NAME       "fw_ctl"
+#define CTL_LINE_MAX        248         /** a request fits RTE_MP_MAX_PARAM_LEN */
+#define CTL_OUT_SIZE        (1 << 20)   /** output of one command */
+#define CTL_CMD_MAX         256
+#define CTL_OPT_MAX         16
+#define CTL_TIMEOUT_SEC     5
+
+/** Serve command lines of a cli process, dataplane side
+ * */
+int ctl_init(config_t *c);
+
+/** Run the command line as a secondary until force_quit
+ * */
+int ctl_client(config_t *c);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -185,8 +185,7 @@ int decoder_init(__rte_unused void *config)
     return 0;
 }
 
-static mod_ret_t
-decoder_proc_ingress(struct rte_mbuf *mbuf)
+int decoder_decode(struct rte_mbuf *mbuf)
 {
     packet_t *p;
     const struct rte_ether_hdr *eh;
@@ -201,6 +200,16 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         goto error;
     }
 
+    p->l3_off = 0;
+    p->l4_off = 0;
+    p->tcp_flags = 0;
+    p->acl_rule = 0;
+    p->qos_tc = 0;
+    p->scountry = 0;
+    p->dcountry = 0;
+    p->sasn = 0;
+    p->dasn = 0;
+
 // L2:
     if (unlikely(rte_pktmbuf_data_len(mbuf) < sizeof(struct rte_ether_hdr))) {
         M_LOG(decoder.log, RTE_LOG_ERR, MOD_ID_DECODER, "pkt data len check failed\n");
@@ -304,6 +313,7 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         p->tuple.v4.sip = ip4h->src_addr;
         p->tuple.v4.dip = ip4h->dst_addr;
         p->is_v4 = true;
+        p->l3_off = offset;
 
         pkt_type |= ptype_l3_ip(ip4h->version_ihl);
         offset += rte_ipv4_hdr_len(ip4h);
@@ -334,6 +344,7 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         memcpy(p->tuple.v6.sip, ip6h->src_addr, 16);
         memcpy(p->tuple.v6.dip, ip6h->dst_addr, 16);
         p->is_v4 = false;
+        p->l3_off = offset;
 
         proto = ip6h->proto;
         offset += sizeof(*ip6h);
@@ -374,6 +385,8 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+
         if (p->is_v4) {
             p->tuple.v4.sp = uh->src_port;
             p->tuple.v4.dp = uh->dst_port;
@@ -397,6 +410,9 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+        p->tcp_flags = th->tcp_flags;
+
         if (p->is_v4) {
             p->tuple.v4.sp = th->src_port;
             p->tuple.v4.dp = th->dst_port;
@@ -420,6 +436,8 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+
         if (p->is_v4) {
             p->tuple.v4.sp = sh->src_port;
             p->tuple.v4.dp = sh->dst_port;
@@ -497,7 +515,7 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         vh = rte_pktmbuf_mtod_offset(mbuf, struct rte_vlan_hdr *, offset + sizeof(*vh));
         if (unlikely(vh == NULL)) {
             M_LOG(decoder.log, RTE_LOG_ERR, MOD_ID_DECODER, "vlan header check failed\n");
-            return pkt_type;
+            goto error;
         }
 
         offset += 2 * sizeof(*vh);
@@ -523,6 +541,7 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         p->tuple.v4.sip = ip4h->src_addr;
         p->tuple.v4.dip = ip4h->dst_addr;
         p->is_v4 = true;
+        p->l3_off = offset;
 
         pkt_type |= ptype_inner_l3_ip(ip4h->version_ihl);
         offset += rte_ipv4_hdr_len(ip4h);
@@ -553,6 +572,7 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
         memcpy(p->tuple.v6.sip, ip6h->src_addr, 16);
         memcpy(p->tuple.v6.dip, ip6h->dst_addr, 16);
         p->is_v4 = false;
+        p->l3_off = offset;
 
         proto = ip6h->proto;
         offset += sizeof(*ip6h);
@@ -593,6 +613,8 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+
         if (p->is_v4) {
             p->tuple.v4.sp = uh->src_port;
             p->tuple.v4.dp = uh->dst_port;
@@ -616,6 +638,9 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+        p->tcp_flags = th->tcp_flags;
+
         if (p->is_v4) {
             p->tuple.v4.sp = th->src_port;
             p->tuple.v4.dp = th->dst_port;
@@ -639,6 +664,8 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
             goto done;
         }
 
+        p->l4_off = offset;
+
         if (p->is_v4) {
             p->tuple.v4.sp = sh->src_port;
             p->tuple.v4.dp = sh->dst_port;
@@ -664,11 +691,21 @@ decoder_proc_ingress(struct rte_mbuf *mbuf)
 
 done:
     p->ptype = pkt_type;
-    return MOD_RET_ACCEPT;
+    return 0;
 
 error:
-    rte_pktmbuf_free(mbuf);
-    return MOD_RET_STOLEN;
+    return -1;
+}
+
+static mod_ret_t
+decoder_proc_ingress(struct rte_mbuf *mbuf)
+{
+    if (decoder_decode(mbuf)) {
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    return MOD_RET_ACCEPT;
 }
 
 mod_ret_t decoder_proc(__rte_unused void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
@@ -4,6 +4,15 @@
 #include "../module.h"
 
 int decoder_init(__rte_unused void *config);
+
+/** Decode one mbuf and fill in packet_t private data
+ * @param mbuf
+ *  the mbuf to decode, never freed here
+ * @return
+ *  0 on success, -1 for a malformed packet
+ * */
+int decoder_decode(struct rte_mbuf *mbuf);
+
 mod_ret_t decoder_proc(__rte_unused void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
 
 #endif
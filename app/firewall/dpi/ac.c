@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <rte_common.h>
+#include <rte_branch_prediction.h>
+#include <rte_malloc.h>
+#include <rte_vect.h>
+
+#include "ac.h"
+
+#define AC_NONE     UINT32_MAX
+
+typedef struct {
+    uint8_t *bytes;
+    uint32_t len;
+    uint32_t id;
+} ac_pattern_t;
+
+struct ac_builder {
+    ac_pattern_t *patterns;
+    uint32_t npatterns;
+    uint32_t size;
+    uint32_t total;             /** bytes of all patterns, bounds the trie */
+    int nocase;
+};
+
+ac_builder_t *ac_builder_create(int nocase)
+{
+    ac_builder_t *b;
+
+    b = calloc(1, sizeof(*b));
+    if (!b) {
+        return NULL;
+    }
+
+    b->nocase = nocase;
+    return b;
+}
+
+void ac_builder_free(ac_builder_t *b)
+{
+    uint32_t i;
+
+    if (!b) {
+        return;
+    }
+
+    for (i = 0; i < b->npatterns; i++) {
+        free(b->patterns[i].bytes);
+    }
+    free(b->patterns);
+    free(b);
+}
+
+int ac_add(ac_builder_t *b, const uint8_t *pattern, uint32_t len, uint32_t id)
+{
+    ac_pattern_t *p;
+    uint32_t i;
+
+    if (!len || b->total + len >= AC_MAX_STATES) {
+        return -1;
+    }
+
+    if (b->npatterns == b->size) {
+        b->size = b->size ? b->size * 2 : 64;
+        p = realloc(b->patterns, sizeof(*p) * b->size);
+        if (!p) {
+            return -1;
+        }
+        b->patterns = p;
+    }
+
+    p = &b->patterns[b->npatterns];
+    p->bytes = malloc(len);
+    if (!p->bytes) {
+        return -1;
+    }
+
+    for (i = 0; i < len; i++) {
+        p->bytes[i] = b->nocase ? tolower(pattern[i]) : pattern[i];
+    }
+    p->len = len;
+    p->id = id;
+
+    b->npatterns ++;
+    b->total += len;
+    return 0;
+}
+
+/** Bytes used by patterns get a class each, all others share the last
+ * */
+static void
+ac_classes(ac_builder_t *b, ac_t *ac)
+{
+    uint8_t used[256] = {0};
+    uint32_t i, j, n = 0;
+
+    for (i = 0; i < b->npatterns; i++) {
+        for (j = 0; j < b->patterns[i].len; j++) {
+            used[b->patterns[i].bytes[j]] = 1;
+        }
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (used[i]) {
+            ac->classes[i] = n++;
+        }
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (!used[i]) {
+            ac->classes[i] = (b->nocase && isupper(i) && used[tolower(i)]) ? ac->classes[tolower(i)] : n;
+        }
+    }
+
+    ac->nclasses = n < 256 ? n + 1 : n;
+    for (ac->shift = 0; (1U << ac->shift) < ac->nclasses; ac->shift++);
+}
+
+/** Shufti tables: byte x may start a pattern if
+ * lo[x & 0xf] & hi[x >> 4] is not 0, high nibbles h and h + 8 share a
+ * bucket bit so the test is a superset, which is fine for skipping
+ * */
+static void
+ac_accel(ac_t *ac)
+{
+    uint32_t x, n = 0;
+    uint8_t bit;
+
+    memset(ac->shufti_lo, 0, sizeof(ac->shufti_lo));
+    memset(ac->shufti_hi, 0, sizeof(ac->shufti_hi));
+
+    for (x = 0; x < 256; x++) {
+        if (ac->next[ac->classes[x]] == AC_ROOT) {
+            continue;
+        }
+
+        bit = 1U << ((x >> 4) & 7);
+        ac->shufti_lo[x & 0xf] |= bit;
+        ac->shufti_hi[x >> 4] |= bit;
+        n++;
+    }
+
+    ac->accel = n && n <= AC_ACCEL_MAX;
+}
+
+ac_t *ac_build(ac_builder_t *b)
+{
+    uint32_t *g = NULL, *fail = NULL, *queue = NULL, *head = NULL, *link = NULL, *cnt = NULL;
+    uint32_t max, nstates = 1, width, s, t, c, i, j, k, qh = 0, qt = 0;
+    ac_pattern_t *p;
+    ac_t *ac;
+
+    ac = rte_zmalloc("dpi_ac", sizeof(*ac), RTE_CACHE_LINE_SIZE);
+    if (!ac) {
+        goto fail;
+    }
+
+    ac->nocase = b->nocase;
+    ac->npatterns = b->npatterns;
+    ac_classes(b, ac);
+
+    width = 1U << ac->shift;
+    max = b->total + 1;
+    if ((uint64_t)max * width >= AC_MATCH) {
+        printf("too many dpi pattern bytes %u\n", b->total);
+        goto fail;
+    }
+
+    g = malloc(sizeof(uint32_t) * max * width);
+    fail = calloc(max, sizeof(uint32_t));
+    queue = malloc(sizeof(uint32_t) * max);
+    head = malloc(sizeof(uint32_t) * max);
+    cnt = calloc(max, sizeof(uint32_t));
+    link = malloc(sizeof(uint32_t) * (b->npatterns + 1));
+    if (!g || !fail || !queue || !head || !cnt || !link) {
+        goto fail;
+    }
+
+    memset(g, 0xff, sizeof(uint32_t) * max * width);
+    memset(head, 0xff, sizeof(uint32_t) * max);
+
+    /** trie, patterns ending at a state are chained from head[]
+     * */
+    for (i = 0; i < b->npatterns; i++) {
+        p = &b->patterns[i];
+        s = AC_ROOT;
+        for (j = 0; j < p->len; j++) {
+            c = ac->classes[p->bytes[j]];
+            if (g[s * width + c] == AC_NONE) {
+                g[s * width + c] = nstates++;
+            }
+            s = g[s * width + c];
+        }
+        link[i] = head[s];
+        head[s] = i;
+        cnt[s] ++;
+    }
+
+    /** breadth first, turn goto and failure functions into a dfa, a
+     * state matches what it ends itself plus what its failure state does
+     * */
+    for (c = 0; c < ac->nclasses; c++) {
+        t = g[c];
+        if (t == AC_NONE) {
+            g[c] = AC_ROOT;
+        } else {
+            fail[t] = AC_ROOT;
+            queue[qt++] = t;
+        }
+    }
+
+    while (qh < qt) {
+        s = queue[qh++];
+        cnt[s] += cnt[fail[s]];
+
+        for (c = 0; c < ac->nclasses; c++) {
+            t = g[s * width + c];
+            if (t == AC_NONE) {
+                g[s * width + c] = g[fail[s] * width + c];
+            } else {
+                fail[t] = g[fail[s] * width + c];
+                queue[qt++] = t;
+            }
+        }
+    }
+
+    ac->nstates = nstates;
+    ac->next = rte_zmalloc("dpi_ac_next", sizeof(uint32_t) * ((size_t)nstates << ac->shift), RTE_CACHE_LINE_SIZE);
+    ac->out_off = rte_malloc("dpi_ac_off", sizeof(uint32_t) * (nstates + 1), RTE_CACHE_LINE_SIZE);
+    if (!ac->next || !ac->out_off) {
+        goto fail;
+    }
+
+    ac->out_off[0] = 0;
+    for (s = 0; s < nstates; s++) {
+        ac->out_off[s + 1] = ac->out_off[s] + cnt[s];
+    }
+
+    ac->out = rte_malloc("dpi_ac_out", sizeof(uint32_t) * (ac->out_off[nstates] + 1), RTE_CACHE_LINE_SIZE);
+    if (!ac->out) {
+        goto fail;
+    }
+
+    /** failure states come earlier in bfs order, their lists are done
+     * */
+    for (i = 0; i < qt; i++) {
+        s = queue[i];
+        k = ac->out_off[s];
+        for (j = head[s]; j != AC_NONE; j = link[j]) {
+            ac->out[k++] = b->patterns[j].id;
+        }
+        for (j = ac->out_off[fail[s]]; j < ac->out_off[fail[s] + 1]; j++) {
+            ac->out[k++] = ac->out[j];
+        }
+    }
+
+    for (s = 0; s < nstates; s++) {
+        for (c = 0; c < ac->nclasses; c++) {
+            t = g[s * width + c];
+            ac->next[(s << ac->shift) + c] = (t << ac->shift) | (cnt[t] ? AC_MATCH : 0);
+        }
+    }
+
+    ac_accel(ac);
+
+    free(g);
+    free(fail);
+    free(queue);
+    free(head);
+    free(cnt);
+    free(link);
+    ac_builder_free(b);
+    return ac;
+
+fail:
+    free(g);
+    free(fail);
+    free(queue);
+    free(head);
+    free(cnt);
+    free(link);
+    ac_builder_free(b);
+    ac_free(ac);
+    return NULL;
+}
+
+void ac_free(ac_t *ac)
+{
+    if (!ac) {
+        return;
+    }
+
+    rte_free(ac->next);
+    rte_free(ac->out_off);
+    rte_free(ac->out);
+    rte_free(ac);
+}
+
+/** Offset of the first byte from i which may start a pattern, len if none
+ * */
+static inline uint32_t
+ac_skip(const ac_t *ac, const uint8_t *data, uint32_t i, uint32_t len)
+{
+#if defined(__AVX2__)
+    const __m256i lo32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ac->shufti_lo));
+    const __m256i hi32 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ac->shufti_hi));
+    const __m256i nib32 = _mm256_set1_epi8(0x0f);
+    __m256i v32, t32;
+    uint32_t m32;
+
+    while (i + 32 <= len) {
+        v32 = _mm256_loadu_si256((const __m256i *)(data + i));
+        t32 = _mm256_and_si256(_mm256_shuffle_epi8(lo32, _mm256_and_si256(v32, nib32)),
+            _mm256_shuffle_epi8(hi32, _mm256_and_si256(_mm256_srli_epi16(v32, 4), nib32)));
+        m32 = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(t32, _mm256_setzero_si256()));
+        if (m32) {
+            return i + __builtin_ctz(m32);
+        }
+        i += 32;
+    }
+#endif
+
+#if defined(__SSSE3__)
+    const __m128i lo16 = _mm_loadu_si128((const __m128i *)ac->shufti_lo);
+    const __m128i hi16 = _mm_loadu_si128((const __m128i *)ac->shufti_hi);
+    const __m128i nib16 = _mm_set1_epi8(0x0f);
+    __m128i v16, t16;
+    uint32_t m16;
+
+    while (i + 16 <= len) {
+        v16 = _mm_loadu_si128((const __m128i *)(data + i));
+        t16 = _mm_and_si128(_mm_shuffle_epi8(lo16, _mm_and_si128(v16, nib16)),
+            _mm_shuffle_epi8(hi16, _mm_and_si128(_mm_srli_epi16(v16, 4), nib16)));
+        m16 = ~_mm_movemask_epi8(_mm_cmpeq_epi8(t16, _mm_setzero_si128())) & 0xffff;
+        if (m16) {
+            return i + __builtin_ctz(m16);
+        }
+        i += 16;
+    }
+#endif
+
+    while (i < len && !(ac->shufti_lo[data[i] & 0xf] & ac->shufti_hi[data[i] >> 4])) {
+        i++;
+    }
+
+    return i;
+}
+
+uint32_t ac_scan(const ac_t *ac, uint32_t state, const uint8_t *data, uint32_t len,
+    ac_match_cb cb, void *arg)
+{
+    const uint32_t *next = ac->next;
+    const uint8_t *classes = ac->classes;
+    uint32_t s = state, i = 0, k, id;
+
+    while (i < len) {
+        if (s == AC_ROOT && ac->accel) {
+            i = ac_skip(ac, data, i, len);
+            if (i == len) {
+                break;
+            }
+        }
+
+        s = next[s + classes[data[i++]]];
+        if (unlikely(s & AC_MATCH)) {
+            s &= ~AC_MATCH;
+            id = s >> ac->shift;
+            for (k = ac->out_off[id]; k < ac->out_off[id + 1]; k++) {
+                if (cb(arg, ac->out[k], i)) {
+                    return s;
+                }
+            }
+        }
+    }
+
+    return s;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,96 @@
+#ifndef _M_AC_H_
+#define _M_AC_H_
+
+#include <stdint.h>
+
+/** Aho-Corasick multi-pattern matcher compiled into a dense DFA
+ *
+ * Bytes are first mapped to equivalence classes, only bytes appearing
+ * in some pattern get a class of their own, so a row of the transition
+ * table is a few dozen entries instead of 256 and hot states share
+ * cache lines. Rows are a power of two wide and states are stored as
+ * row offsets, a step is one table load with no multiply:
+ *
+ *   s = next[s + classes[byte]]
+ *
+ * The top bit of an entry tells the target state has matches, so the
+ * common path tests one bit. While in the root state the scanner skips
+ * bytes which cannot start any pattern, 16 or 32 at a time with a
+ * shufti-style nibble lookup on SSSE3/AVX2, see ac_skip() in ac.c.
+ *
+ * The automaton is read-only once built and shared by all lcores, a
+ * scan carries its state in and out so matches span packets.
+ * */
+
+#define AC_ROOT             0
+#define AC_MATCH            (1U << 31)
+#define AC_MAX_STATES       (1U << 20)
+#define AC_ACCEL_MAX        48          /** start bytes above which skipping is not worth it */
+
+typedef struct {
+    uint32_t *next;             /** nstates << shift entries */
+    uint32_t *out_off;          /** per state, first of its matches in out */
+    uint32_t *out;              /** pattern ids, grouped by state */
+    uint32_t nstates;
+    uint32_t npatterns;
+    uint16_t nclasses;
+    uint8_t shift;              /** log2 of row width */
+    uint8_t nocase;
+    uint8_t accel;
+    uint8_t classes[256];
+    uint8_t shufti_lo[16];      /** bucket bits by low nibble of start bytes */
+    uint8_t shufti_hi[16];      /** bucket bits by high nibble of start bytes */
+} ac_t;
+
+/** Called for each match, return non-zero to stop the scan
+ * @param id
+ *  id given to ac_add()
+ * @param end
+ *  offset right after the last byte of the match in this buffer
+ * */
+typedef int (*ac_match_cb)(void *arg, uint32_t id, uint32_t end);
+
+typedef struct ac_builder ac_builder_t;
+
+/** Start a new automaton
+ * @param nocase
+ *  match ascii letters case-insensitively
+ * */
+ac_builder_t *ac_builder_create(int nocase);
+
+/** Add a pattern, the same bytes may be added under several ids
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int ac_add(ac_builder_t *b, const uint8_t *pattern, uint32_t len, uint32_t id);
+
+/** Compile and free the builder
+ * @return
+ *  the automaton allocated from hugepages, NULL for a failure
+ * */
+ac_t *ac_build(ac_builder_t *b);
+
+void ac_builder_free(ac_builder_t *b);
+void ac_free(ac_t *ac);
+
+/** Scan a buffer from a state
+ * @param state
+ *  AC_ROOT or the state returned by the previous scan of the stream
+ * @return
+ *  state after the last byte scanned
+ * */
+uint32_t ac_scan(const ac_t *ac, uint32_t state, const uint8_t *data, uint32_t len,
+    ac_match_cb cb, void *arg);
+
+/** Bytes of the transition table
+ * */
+static inline uint64_t
+ac_memory(const ac_t *ac)
+{
+    return ((uint64_t)ac->nstates << ac->shift) * sizeof(uint32_t);
+}
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,650 @@
+#include <inttypes.h>
+#include <ctype.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+#include <rte_hash_crc.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../worker.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+
+#include "dpi.h"
+
+typedef struct {
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sp;
+    uint16_t dp;
+    uint8_t proto;
+    uint8_t verdict;            /** DPI_ACTION_DROP sticks to the stream */
+    uint8_t host_done;          /** hostname looked up */
+    uint16_t iport;
+    uint32_t hash;
+    uint32_t state;             /** automaton state after the last payload */
+    uint32_t gen;
+    uint32_t next_seq;          /** tcp, sequence expected next */
+    uint32_t scanned;           /** payload bytes scanned */
+    uint64_t last;              /** timer cycles, 0 for a free slot */
+} __rte_aligned(64) dpi_stream_t;
+
+typedef struct {
+    dpi_stream_t *table;
+    uint64_t *hits;             /** per signature index */
+    uint32_t gen;               /** generation of hits */
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t matches;
+    uint64_t drops;
+    uint64_t truncated;
+    uint64_t evicted;
+    uint64_t hosts;             /** hostnames found */
+    uint64_t host_hits;
+    uint64_t host_drops;
+} __rte_cache_aligned dpi_lcore_t;
+
+typedef struct {
+    dpi_config_t *dc;
+    dpi_lcore_t *dl;
+    uint8_t verdict;
+} dpi_scan_t;
+
+static dpi_config_t dpi_cfg_A, dpi_cfg_B;
+static dpi_lcore_t dpi_lcores[RTE_MAX_LCORE];
+static uint32_t dpi_gen;
+static uint64_t dpi_hz;
+
+MODULE_DECLARE(dpi) = {
+    .name = "dpi",
+    .id = MOD_ID_DPI,
+    .enabled = true,
+    .log = true,
+    .init = dpi_init,
+    .proc = dpi_proc,
+    .conf = dpi_conf,
+    .tick = NULL,
+    .priv = NULL
+};
+
+static int
+dpi_match(void *arg, uint32_t id, uint32_t end)
+{
+    dpi_scan_t *sc = arg;
+    dpi_sig_t *sig = &sc->dc->sigs[id];
+
+    sc->dl->hits[id] ++;
+    sc->dl->matches ++;
+
+    M_LOG(dpi.log, RTE_LOG_DEBUG, MOD_ID_DPI, "signature %u matches at %u\n", sig->id, end);
+
+    if (sig->action == DPI_ACTION_DROP) {
+        sc->verdict = DPI_ACTION_DROP;
+        return 1;
+    }
+
+    return 0;
+}
+
+/** Find the stream of the packet, or take a free or stale slot in the
+ * probe window, the home slot when there is none
+ * */
+static inline dpi_stream_t *
+dpi_stream_lookup(dpi_lcore_t *dl, dpi_config_t *dc, packet_t *p, uint64_t now)
+{
+    ip4_tuple_t *t = &p->tuple.v4;
+    dpi_stream_t *e, *slot = NULL;
+    uint32_t h, i;
+
+    h = rte_hash_crc(t, sizeof(*t), p->iport);
+
+    for (i = 0; i < DPI_PROBE_NUM; i++) {
+        e = &dl->table[(h + i) & DPI_STREAM_MASK];
+        if (!e->last || now - e->last > dc->timeout_cycles) {
+            if (!slot) slot = e;
+            continue;
+        }
+
+        if (e->hash == h && e->sip == t->sip && e->dip == t->dip &&
+            e->sp == t->sp && e->dp == t->dp && e->proto == t->proto && e->iport == p->iport) {
+            return e;
+        }
+    }
+
+    if (!slot) {
+        slot = &dl->table[h & DPI_STREAM_MASK];
+        dl->evicted ++;
+    }
+
+    slot->sip = t->sip;
+    slot->dip = t->dip;
+    slot->sp = t->sp;
+    slot->dp = t->dp;
+    slot->proto = t->proto;
+    slot->iport = p->iport;
+    slot->hash = h;
+    slot->verdict = DPI_ACTION_ALERT;
+    slot->host_done = 0;
+    slot->state = AC_ROOT;
+    slot->gen = dc->gen;
+    slot->next_seq = 0;
+    slot->scanned = 0;
+
+    return slot;
+}
+
+/** Locate the l4 payload inside the first segment
+ * @return
+ *  payload length, 0 if none
+ * */
+static inline uint32_t
+dpi_payload(struct rte_mbuf *mbuf, packet_t *p, const uint8_t **data, struct rte_tcp_hdr **th)
+{
+    uint32_t off, end;
+
+    if (p->is_v4) {
+        struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv4_hdr *, p->l3_off);
+        end = p->l3_off + rte_be_to_cpu_16(ip->total_length);
+    } else {
+        struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv6_hdr *, p->l3_off);
+        end = p->l3_off + sizeof(*ip6) + rte_be_to_cpu_16(ip6->payload_len);
+    }
+
+    *th = NULL;
+    if (p->tuple.v4.proto == IPPROTO_TCP) {
+        *th = rte_pktmbuf_mtod_offset(mbuf, struct rte_tcp_hdr *, p->l4_off);
+        off = p->l4_off + ((*th)->data_off >> 4) * 4;
+    } else {
+        off = p->l4_off + sizeof(struct rte_udp_hdr);
+    }
+
+    end = RTE_MIN(end, (uint32_t)rte_pktmbuf_data_len(mbuf));
+    if (off >= end) {
+        return 0;
+    }
+
+    *data = rte_pktmbuf_mtod_offset(mbuf, const uint8_t *, off);
+    return end - off;
+}
+
+static inline uint8_t
+dpi_host_verdict(dpi_config_t *dc, dpi_lcore_t *dl, const uint8_t *data, uint32_t len)
+{
+    const dpi_host_rule_t *r;
+    char name[DPI_HOST_MAX + 1];
+    uint32_t n;
+
+    n = dpi_host_parse(data, len, name);
+    if (!n) {
+        return DPI_ACTION_ALERT;
+    }
+
+    dl->hosts ++;
+    r = dpi_host_lookup(&dc->hosts, name, n);
+    if (!r) {
+        return DPI_ACTION_ALERT;
+    }
+
+    dl->host_hits ++;
+    M_LOG(dpi.log, RTE_LOG_DEBUG, MOD_ID_DPI, "host %s matches domain rule %u\n", name, r->id);
+
+    if (r->action == DPI_ACTION_DROP) {
+        dl->host_drops ++;
+    }
+
+    return r->action;
+}
+
+/** @return
+ *  1 if the packet is rejected, it is not freed here
+ * */
+static int
+dpi_inspect(dpi_config_t *dc, struct rte_mbuf *mbuf)
+{
+    dpi_lcore_t *dl = &dpi_lcores[rte_lcore_id()];
+    dpi_scan_t sc = {.dc = dc, .dl = dl, .verdict = DPI_ACTION_ALERT};
+    struct rte_tcp_hdr *th;
+    const uint8_t *data = NULL;
+    dpi_stream_t *e = NULL;
+    uint32_t len, n, state = AC_ROOT;
+    uint64_t now;
+    packet_t *p;
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!p || !p->l4_off) {
+        return 0;
+    }
+
+    /** proto is at the same place in both tuples
+     * */
+    if (p->tuple.v4.proto != IPPROTO_TCP && p->tuple.v4.proto != IPPROTO_UDP) {
+        return 0;
+    }
+
+    if (unlikely(dl->gen != dpi_gen)) {
+        memset(dl->hits, 0, sizeof(uint64_t) * DPI_MAX_SIGS);
+        dl->gen = dpi_gen;
+    }
+
+    len = dpi_payload(mbuf, p, &data, &th);
+
+    if (p->is_v4) {
+        now = rte_get_timer_cycles();
+        e = dpi_stream_lookup(dl, dc, p, now);
+        e->last = now;
+
+        /** rules changed, the stream is judged again
+         * */
+        if (e->gen != dc->gen) {
+            e->gen = dc->gen;
+            e->state = AC_ROOT;
+            e->verdict = DPI_ACTION_ALERT;
+            e->host_done = 0;
+        }
+
+        if (e->verdict == DPI_ACTION_DROP) {
+            dl->drops ++;
+            return 1;
+        }
+
+        if (th) {
+            uint32_t seq = rte_be_to_cpu_32(th->sent_seq);
+            if (seq != e->next_seq) {
+                e->state = AC_ROOT;
+            }
+            e->next_seq = seq + len + !!(th->tcp_flags & (RTE_TCP_SYN_FLAG | RTE_TCP_FIN_FLAG));
+            state = e->state;
+        }
+    }
+
+    if (len && dc->hosts.num && (!e || !e->host_done)) {
+        if (e) e->host_done = 1;
+        sc.verdict = dpi_host_verdict(dc, dl, data, len);
+        if (sc.verdict == DPI_ACTION_DROP) {
+            goto done;
+        }
+    }
+
+    if (!len || !dc->ac || (e && e->scanned >= dc->depth)) {
+        goto done;
+    }
+
+    n = RTE_MIN(len, dc->budget);
+    if (e) {
+        n = RTE_MIN(n, dc->depth - e->scanned);
+        e->scanned += n;
+    }
+    if (n < len) {
+        dl->truncated ++;
+    }
+
+    dl->packets ++;
+    dl->bytes += n;
+    state = ac_scan(dc->ac, state, data, n, dpi_match, &sc);
+
+    /** the stream can not go on from where a truncated scan stopped
+     * */
+    if (e && th) {
+        e->state = n < len ? AC_ROOT : state;
+    }
+
+done:
+    if (sc.verdict == DPI_ACTION_DROP) {
+        if (e) e->verdict = DPI_ACTION_DROP;
+        dl->drops ++;
+        return 1;
+    }
+
+    if (e && th && (th->tcp_flags & (RTE_TCP_FIN_FLAG | RTE_TCP_RST_FLAG))) {
+        e->last = 0;
+    }
+
+    return 0;
+}
+
+void dpi_inspect_burst(void *config, struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop)
+{
+    config_t *c = config;
+    dpi_config_t *dc = c->dpi_cfg;
+    uint16_t i;
+
+    if (!dc || !dc->enabled || !dpi_lcores[rte_lcore_id()].table) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!drop[i] && dpi_inspect(dc, mbufs[i])) {
+            drop[i] = 1;
+        }
+    }
+}
+
+mod_ret_t dpi_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    config_t *c = config;
+    dpi_config_t *dc = c->dpi_cfg;
+
+    if (hook != MOD_HOOK_FORWARD || !dc || !dc->enabled || !dpi_lcores[rte_lcore_id()].table) {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (dpi_inspect(dc, mbuf)) {
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+/** Pattern text with snort style hex runs, e.g. "GET |2f 2e 2e|"
+ * @return
+ *  length of the pattern, -1 for a failure
+ * */
+static int
+dpi_pattern_parse(const char *s, uint8_t *out, uint32_t size)
+{
+    uint32_t len = 0;
+    int hex = 0;
+    char *end;
+
+    while (*s) {
+        if (*s == '|') {
+            hex = !hex;
+            s++;
+            continue;
+        }
+
+        if (len == size) {
+            return -1;
+        }
+
+        if (!hex) {
+            out[len++] = *s++;
+            continue;
+        }
+
+        if (isspace((unsigned char)*s)) {
+            s++;
+            continue;
+        }
+
+        out[len++] = strtoul(s, &end, 16);
+        if (end != s + 2) {
+            return -1;
+        }
+        s = end;
+    }
+
+    return hex ? -1 : (int)len;
+}
+
+static int
+dpi_sigs_load(dpi_config_t *dc, json_object *jr, int nocase)
+{
+    json_object *ja, *jo, *jv;
+    ac_builder_t *b;
+    uint8_t pattern[DPI_MAX_PATTERN];
+    int i, n, len;
+
+    n = JA(jr, "signatures", &ja);
+    if (n <= 0) {
+        return 0;
+    }
+
+    if (n > DPI_MAX_SIGS) {
+        printf("too many dpi signatures %d\n", n);
+        return -1;
+    }
+
+    b = ac_builder_create(nocase);
+    if (!b) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        jo = JO(ja, i);
+
+        jv = JV(jo, "id");
+        if (!jv) {
+            printf("dpi signature %d has no id\n", i);
+            ac_builder_free(b);
+            return -1;
+        }
+        dc->sigs[i].id = JV_I(jv);
+
+        jv = JV(jo, "action");
+        dc->sigs[i].action = (jv && !strcmp(JV_S(jv), "drop")) ? DPI_ACTION_DROP : DPI_ACTION_ALERT;
+
+        jv = JV(jo, "pattern");
+        len = jv ? dpi_pattern_parse(JV_S(jv), pattern, sizeof(pattern)) : -1;
+        if (len <= 0 || ac_add(b, pattern, len, i)) {
+            printf("invalid pattern of dpi signature %u\n", dc->sigs[i].id);
+            ac_builder_free(b);
+            return -1;
+        }
+    }
+
+    dc->sig_num = n;
+    dc->ac = ac_build(b);
+    if (!dc->ac) {
+        printf("build dpi automaton failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+dpi_hosts_load(dpi_config_t *dc, json_object *jr, const char *name)
+{
+    json_object *ja, *jo, *jv, *jd;
+    uint8_t action;
+    int i, n;
+
+    n = JA(jr, "domains", &ja);
+    if (n <= 0) {
+        return 0;
+    }
+
+    if (n > (int)DPI_MAX_HOSTS) {
+        printf("too many dpi domains %d\n", n);
+        return -1;
+    }
+
+    if (dpi_hosts_create(&dc->hosts, name, n)) {
+        printf("create dpi domain table failed\n");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        jo = JO(ja, i);
+
+        jv = JV(jo, "id");
+        jd = JV(jo, "domain");
+        if (!jv || !jd) {
+            printf("dpi domain %d has no id or domain\n", i);
+            return -1;
+        }
+
+        action = DPI_ACTION_ALERT;
+        if (JV(jo, "action") && !strcmp(JV_S(JV(jo, "action")), "drop")) {
+            action = DPI_ACTION_DROP;
+        }
+
+        if (dpi_host_add(&dc->hosts, JV_S(jd), JV_I(jv), action)) {
+            printf("invalid domain %s\n", JV_S(jd));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+dpi_json_load(dpi_config_t *dc, const char *name)
+{
+    json_object *jr, *jv;
+    int nocase = 0;
+    int ret = 0;
+
+    ac_free(dc->ac);
+    dpi_hosts_free(&dc->hosts);
+    memset(dc, 0, sizeof(*dc));
+    dc->budget = 2048;
+    dc->depth = 65536;
+    dc->timeout = 30;
+    dc->timeout_cycles = dc->timeout * dpi_hz;
+
+    jr = JR(CONFIG_PATH, "dpi.json");
+    if (!jr) {
+        printf("no dpi.json, dpi disabled\n");
+        return 0;
+    }
+
+    jv = JV(jr, "budget");
+    if (jv) dc->budget = JV_I(jv);
+
+    jv = JV(jr, "depth");
+    if (jv) dc->depth = JV_I(jv);
+
+    jv = JV(jr, "timeout");
+    if (jv) dc->timeout = JV_I(jv);
+
+    jv = JV(jr, "nocase");
+    if (jv) nocase = JV_I(jv);
+
+    dc->timeout_cycles = dc->timeout * dpi_hz;
+
+    if (dpi_sigs_load(dc, jr, nocase) || dpi_hosts_load(dc, jr, name)) {
+        ret = -1;
+        goto done;
+    }
+
+    dc->gen = ++dpi_gen;
+    dc->enabled = dc->ac || dc->hosts.num;
+
+done:
+    JR_FREE(jr);
+    return ret;
+}
+
+/** The buffer rebuilt is the one workers left at the previous switch,
+ * its automaton is free to go
+ * */
+int dpi_conf(void *config)
+{
+    config_t *c = config;
+    dpi_config_t *dc;
+    char name[32];
+
+    dc = (c->dpi_cfg == &dpi_cfg_A) ? &dpi_cfg_B : &dpi_cfg_A;
+    if (dpi_json_load(dc, hot_object(HOT_HASH, name, sizeof(name), "dpi_hosts_%s", dc == &dpi_cfg_A ? "A" : "B"))) {
+        printf("dpi json load failed\n");
+        return -1;
+    }
+
+    c->dpi_cfg = dc;
+    return 0;
+}
+
+static int
+dpi_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+    dpi_config_t *dc = c->dpi_cfg;
+    dpi_lcore_t *dl;
+    unsigned int lcore_id;
+    uint64_t hits;
+    uint32_t i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!dc || !dc->enabled) {
+        CLI_PRINT(cli, "dpi disabled");
+        return 0;
+    }
+
+    if (dc->ac) {
+        CLI_PRINT(cli, "signatures %u states %u classes %u memory %"PRIu64" accel %s",
+            dc->sig_num, dc->ac->nstates, dc->ac->nclasses, ac_memory(dc->ac), dc->ac->accel ? "on" : "off");
+    }
+    CLI_PRINT(cli, "domains %u", dc->hosts.num);
+    CLI_PRINT(cli, "budget %u depth %u timeout %u", dc->budget, dc->depth, dc->timeout);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        dl = &dpi_lcores[lcore_id];
+        if (!dl->table) {
+            continue;
+        }
+
+        CLI_PRINT(cli, "lcore %u packets %"PRIu64" bytes %"PRIu64" matches %"PRIu64" drops %"PRIu64
+            " truncated %"PRIu64" evicted %"PRIu64, lcore_id, dl->packets, dl->bytes, dl->matches,
+            dl->drops, dl->truncated, dl->evicted);
+        CLI_PRINT(cli, "        hosts %"PRIu64" domain hits %"PRIu64" domain drops %"PRIu64,
+            dl->hosts, dl->host_hits, dl->host_drops);
+    }
+
+    for (i = 0; i < dc->sig_num; i++) {
+        hits = 0;
+        RTE_LCORE_FOREACH(lcore_id) {
+            dl = &dpi_lcores[lcore_id];
+            if (dl->hits && dl->gen == dc->gen) {
+                hits += dl->hits[i];
+            }
+        }
+
+        if (hits) {
+            CLI_PRINT(cli, "signature %u %s hits %"PRIu64, dc->sigs[i].id,
+                dc->sigs[i].action == DPI_ACTION_DROP ? "drop" : "alert", hits);
+        }
+    }
+
+    return 0;
+}
+
+int dpi_init(void *config)
+{
+    config_t *c = config;
+    unsigned int lcore_id;
+    dpi_lcore_t *dl;
+
+    dpi_hz = rte_get_timer_hz();
+
+    if (dpi_conf(c)) {
+        printf("dpi conf failed\n");
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        dl = &dpi_lcores[lcore_id];
+        dl->table = rte_zmalloc_socket("dpi_streams", sizeof(dpi_stream_t) * DPI_STREAM_SIZE,
+            RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        dl->hits = rte_zmalloc_socket("dpi_hits", sizeof(uint64_t) * DPI_MAX_SIGS,
+            RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        if (!dl->table || !dl->hits) {
+            printf("alloc dpi streams of lcore %u failed\n", lcore_id);
+            return -1;
+        }
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "dpi", dpi_show, "payload inspection statistics");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
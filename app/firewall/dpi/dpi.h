@@ -0,0 +1,68 @@
+#ifndef _M_DPI_H_
+#define _M_DPI_H_
+
+#include "../module.h"
+#include "ac.h"
+#include "host.h"
+
+/** Payload inspection against signatures from dpi.json
+ *
+ * All signature patterns compile into one Aho-Corasick automaton, see
+ * ac.h, and each TCP or UDP payload is scanned once at FORWARD whatever
+ * the number of signatures. Every worker lcore keeps the automaton
+ * state of its IPv4 streams, so a TCP pattern split over in-order
+ * segments still matches; a sequence gap restarts the stream at the
+ * root. IPv6 payloads are scanned one by one.
+ *
+ * Scanning is bounded by 'budget' bytes per packet and 'depth' bytes
+ * per stream. A 'drop' signature drops the packet and the rest of the
+ * stream without scanning it again, an 'alert' one is only counted.
+ *
+ * The first data packet of a stream also gives its hostname, TLS SNI or
+ * HTTP Host, see host.h, which is looked up in the 'domains' rules. The
+ * verdict is kept in the stream, so later packets skip the parser and
+ * the table; a ClientHello split over segments yields no name.
+ * */
+
+#define DPI_MAX_SIGS        4096
+#define DPI_MAX_PATTERN     256
+#define DPI_STREAM_SIZE     (1U << 16)  /** streams per worker lcore */
+#define DPI_STREAM_MASK     (DPI_STREAM_SIZE - 1)
+#define DPI_PROBE_NUM       8
+
+#define DPI_ACTION_ALERT    0
+#define DPI_ACTION_DROP     1
+
+typedef struct {
+    uint32_t id;
+    uint8_t action;
+} dpi_sig_t;
+
+typedef struct {
+    uint8_t enabled;
+    uint32_t budget;            /** payload bytes scanned per packet */
+    uint32_t depth;             /** payload bytes scanned per stream */
+    uint32_t timeout;           /** seconds a stream is kept without packets */
+    uint64_t timeout_cycles;
+    uint32_t gen;               /** streams of another generation restart at the root */
+    uint32_t sig_num;
+    dpi_sig_t sigs[DPI_MAX_SIGS];
+    ac_t *ac;                   /** NULL without signatures */
+    dpi_hosts_t hosts;
+} dpi_config_t;
+
+/** Mark packets rejected by signatures, for paths which do not pass
+ * module hooks, e.g. graph nodes
+ * @param drop
+ *  in and out, packets already marked are skipped
+ * */
+void dpi_inspect_burst(void *config, struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop);
+
+int dpi_init(void *config);
+mod_ret_t dpi_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int dpi_conf(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
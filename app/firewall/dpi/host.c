@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include <rte_common.h>
+#include <rte_malloc.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+
+#include "host.h"
+
+#define TLS_CONTENT_HANDSHAKE   0x16
+#define TLS_CLIENT_HELLO        0x01
+#define TLS_EXT_SERVER_NAME     0x0000
+
+static const char *http_methods[] = {
+    "GET ", "POST ", "HEAD ", "PUT ", "DELETE ", "OPTIONS ", "PATCH ", "CONNECT ",
+};
+
+static inline uint16_t
+host_be16(const uint8_t *d)
+{
+    return (uint16_t)d[0] << 8 | d[1];
+}
+
+/** Lowercase a dns name into name, dropping a trailing dot
+ * */
+static uint32_t
+host_copy(const uint8_t *s, uint32_t len, char *name)
+{
+    uint32_t i;
+    uint8_t c;
+
+    if (len && s[len - 1] == '.') {
+        len--;
+    }
+
+    if (!len || len > DPI_HOST_MAX) {
+        return 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        c = tolower(s[i]);
+        if (!isalnum(c) && c != '-' && c != '.' && c != '_') {
+            return 0;
+        }
+        name[i] = c;
+    }
+
+    name[len] = '\0';
+    return len;
+}
+
+/** server_name of a ClientHello in one record
+ * */
+static uint32_t
+host_tls(const uint8_t *d, uint32_t len, char *name)
+{
+    uint32_t off, end, ext_end, type, elen;
+
+    if (len < 9 || d[0] != TLS_CONTENT_HANDSHAKE || d[1] != 0x03 || d[5] != TLS_CLIENT_HELLO) {
+        return 0;
+    }
+
+    end = RTE_MIN(len, 5U + host_be16(d + 3));
+
+    /** handshake header, client version, random
+     * */
+    off = 5 + 4 + 2 + 32;
+
+    /** session id, cipher suites, compression methods
+     * */
+    if (off + 1 > end) return 0;
+    off += 1 + d[off];
+    if (off + 2 > end) return 0;
+    off += 2 + host_be16(d + off);
+    if (off + 1 > end) return 0;
+    off += 1 + d[off];
+    if (off + 2 > end) return 0;
+
+    ext_end = RTE_MIN(end, off + 2 + host_be16(d + off));
+    off += 2;
+
+    while (off + 4 <= ext_end) {
+        type = host_be16(d + off);
+        elen = host_be16(d + off + 2);
+        off += 4;
+        if (off + elen > ext_end) {
+            return 0;
+        }
+
+        if (type == TLS_EXT_SERVER_NAME) {
+            /** list length, name type 0 for host_name, name length
+             * */
+            if (elen < 5 || d[off + 2] != 0 || 5U + host_be16(d + off + 3) > elen) {
+                return 0;
+            }
+            return host_copy(d + off + 5, host_be16(d + off + 3), name);
+        }
+
+        off += elen;
+    }
+
+    return 0;
+}
+
+/** Host header of a request, the port is left out
+ * */
+static uint32_t
+host_http(const uint8_t *d, uint32_t len, char *name)
+{
+    uint32_t i, start;
+    unsigned int m;
+
+    for (m = 0; m < RTE_DIM(http_methods); m++) {
+        if (len > strlen(http_methods[m]) && !memcmp(d, http_methods[m], strlen(http_methods[m]))) {
+            break;
+        }
+    }
+
+    if (m == RTE_DIM(http_methods)) {
+        return 0;
+    }
+
+    for (i = 0; i + 6 < len; i++) {
+        if (d[i] != '\n') {
+            continue;
+        }
+
+        /** empty line, end of headers
+         * */
+        if (d[i + 1] == '\r' || d[i + 1] == '\n') {
+            return 0;
+        }
+
+        if (strncasecmp((const char *)d + i + 1, "host:", 5)) {
+            continue;
+        }
+
+        for (i += 6; i < len && (d[i] == ' ' || d[i] == '\t'); i++);
+        for (start = i; i < len && d[i] != '\r' && d[i] != '\n' && d[i] != ':' && d[i] != ' '; i++);
+
+        return host_copy(d + start, i - start, name);
+    }
+
+    return 0;
+}
+
+uint32_t dpi_host_parse(const uint8_t *data, uint32_t len, char *name)
+{
+    if (data[0] == TLS_CONTENT_HANDSHAKE) {
+        return host_tls(data, len, name);
+    }
+
+    return host_http(data, len, name);
+}
+
+static inline uint64_t
+host_key(const char *s, uint32_t len)
+{
+    return (uint64_t)rte_hash_crc(s, len, 0x9e3779b9) << 32 | rte_hash_crc(s, len, len);
+}
+
+const dpi_host_rule_t *dpi_host_lookup(const dpi_hosts_t *hosts, const char *name, uint32_t len)
+{
+    uint64_t keys[DPI_HOST_LABELS], hit_mask = 0;
+    const void *kp[DPI_HOST_LABELS];
+    void *data[DPI_HOST_LABELS];
+    uint32_t offs[DPI_HOST_LABELS];
+    const dpi_host_rule_t *r;
+    uint32_t i, dots = 0, n;
+
+    if (!hosts->num) {
+        return NULL;
+    }
+
+    /** the exact name, then suffixes from the longest, at most the
+     * last DPI_HOST_LABELS - 1 of them
+     * */
+    for (i = len; i-- > 0 && dots < DPI_HOST_LABELS - 1;) {
+        if (name[i] == '.') {
+            offs[DPI_HOST_LABELS - 1 - dots++] = i;
+        }
+    }
+
+    offs[DPI_HOST_LABELS - 1 - dots] = 0;
+    n = dots + 1;
+    memmove(offs, offs + DPI_HOST_LABELS - n, sizeof(offs[0]) * n);
+
+    for (i = 0; i < n; i++) {
+        keys[i] = host_key(name + offs[i], len - offs[i]);
+        kp[i] = &keys[i];
+    }
+
+    if (rte_hash_lookup_bulk_data(hosts->hash, kp, n, &hit_mask, data) <= 0) {
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (!(hit_mask & (1ULL << i))) {
+            continue;
+        }
+
+        r = &hosts->rules[(uintptr_t)data[i]];
+        if (r->len == len - offs[i] && !memcmp(r->name, name + offs[i], r->len)) {
+            return r;
+        }
+    }
+
+    return NULL;
+}
+
+int dpi_host_add(dpi_hosts_t *hosts, const char *domain, uint32_t id, uint8_t action)
+{
+    dpi_host_rule_t *r = &hosts->rules[hosts->num];
+    uint32_t len = strlen(domain);
+    uint64_t key;
+    void *data;
+
+    /** wildcards are keyed with their dot, ".example.com"
+     * */
+    if (!strncmp(domain, "*.", 2)) {
+        if (len - 2 >= DPI_HOST_MAX) {
+            return -1;
+        }
+        r->name[0] = '.';
+        len = host_copy((const uint8_t *)domain + 2, len - 2, r->name + 1);
+        if (!len) {
+            return -1;
+        }
+        len++;
+    } else {
+        len = host_copy((const uint8_t *)domain, len, r->name);
+        if (!len) {
+            return -1;
+        }
+    }
+
+    r->len = len;
+    r->id = id;
+    r->action = action;
+
+    key = host_key(r->name, r->len);
+    if (rte_hash_lookup_data(hosts->hash, &key, &data) >= 0) {
+        printf("duplicate domain %s of rule %u\n", domain, id);
+        return 0;
+    }
+
+    if (rte_hash_add_key_data(hosts->hash, &key, (void *)(uintptr_t)hosts->num)) {
+        return -1;
+    }
+
+    hosts->num ++;
+    return 0;
+}
+
+int dpi_hosts_create(dpi_hosts_t *hosts, const char *name, uint32_t size)
+{
+    struct rte_hash_parameters params = {
+        .name = name,
+        .entries = RTE_MAX(size, 64U),
+        .key_len = sizeof(uint64_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = SOCKET_ID_ANY,
+    };
+
+    hosts->num = 0;
+    hosts->hash = rte_hash_create(&params);
+    hosts->rules = rte_zmalloc("dpi_hosts", sizeof(dpi_host_rule_t) * RTE_MAX(size, 1U), RTE_CACHE_LINE_SIZE);
+    if (!hosts->hash || !hosts->rules) {
+        dpi_hosts_free(hosts);
+        return -1;
+    }
+
+    return 0;
+}
+
+void dpi_hosts_free(dpi_hosts_t *hosts)
+{
+    rte_hash_free(hosts->hash);
+    rte_free(hosts->rules);
+    hosts->hash = NULL;
+    hosts->rules = NULL;
+    hosts->num = 0;
+}
+
+// file format utf-8
+// ident using space
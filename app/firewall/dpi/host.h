@@ -0,0 +1,62 @@
+#ifndef _M_HOST_H_
+#define _M_HOST_H_
+
+#include <stdint.h>
+
+/** Hostname of a connection from its first data packet and the domain
+ * rules it hits
+ *
+ * The parser reads the server_name extension of a TLS ClientHello or
+ * the Host header of an HTTP/1.x request, walking at most the payload
+ * given with no allocation. Rules are exact names, "www.example.com",
+ * or wildcard suffixes, "*.example.com", kept in one lib/hash table on
+ * a 64-bit digest of the name. A lookup builds the keys of the name and
+ * of every suffix after a dot and resolves them in one bulk lookup, the
+ * exact name wins, then the longest suffix.
+ * */
+
+#define DPI_HOST_MAX        253         /** longest dns name */
+#define DPI_HOST_LABELS     16          /** suffixes tried, deeper names match by their last labels */
+#define DPI_MAX_HOSTS       (1U << 16)
+
+typedef struct {
+    uint32_t id;
+    uint8_t action;             /** DPI_ACTION_* */
+    uint16_t len;
+    char name[DPI_HOST_MAX + 1];    /** wildcards are kept as ".example.com" */
+} dpi_host_rule_t;
+
+typedef struct {
+    struct rte_hash *hash;
+    dpi_host_rule_t *rules;
+    uint32_t num;
+} dpi_hosts_t;
+
+/** Pull the hostname out of a payload, lowercased
+ * @param name
+ *  output, DPI_HOST_MAX + 1 bytes
+ * @return
+ *  length of the name, 0 if the payload carries none
+ * */
+uint32_t dpi_host_parse(const uint8_t *data, uint32_t len, char *name);
+
+/** @return
+ *  the rule matching name, NULL if none
+ * */
+const dpi_host_rule_t *dpi_host_lookup(const dpi_hosts_t *hosts, const char *name, uint32_t len);
+
+/** Add a rule, "*." prefixed names are wildcards
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int dpi_host_add(dpi_hosts_t *hosts, const char *domain, uint32_t id, uint8_t action);
+
+/** Create an empty table, the name tells both config buffers apart
+ * */
+int dpi_hosts_create(dpi_hosts_t *hosts, const char *name, uint32_t size);
+void dpi_hosts_free(dpi_hosts_t *hosts);
+
+#endif
+
+// file format utf-8
+// ident using space
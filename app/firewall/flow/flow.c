@@ -0,0 +1,619 @@
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_ring.h>
+#include <rte_ring_elem.h>
+#include <rte_hash_crc.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../worker.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../wheel.h"
+
+#include "flow.h"
+
+#define IPFIX_VERSION       10
+#define IPFIX_SET_TEMPLATE  2
+#define IPFIX_TEMPLATE_ID   256
+#define IPFIX_ENTERPRISE    0x8000
+
+typedef struct {
+    uint32_t sip;               /** network order */
+    uint32_t dip;
+    uint16_t sp;
+    uint16_t dp;
+    uint8_t proto;
+    uint8_t tcp_flags;          /** or of all packets */
+    uint16_t iport;
+    uint32_t acl_rule;          /** rule of the last packet */
+    wheel_node_t timer;         /** armed while the slot is in use */
+    uint64_t packets;           /** 0 for a free slot */
+    uint64_t bytes;
+    uint64_t first;             /** timer cycles */
+    uint64_t last;
+} __rte_aligned(64) flow_entry_t;
+
+typedef struct {
+    flow_entry_t *table;
+    wheel_t *wheel;
+    struct rte_ring *ring;      /** expired records, worker to mgmt */
+    flow_config_t *fc;          /** config and time of the running wheel_run() */
+    uint64_t now;
+    uint32_t pkts;
+    uint64_t created;
+    uint64_t evicted;
+    uint64_t exported;
+    uint64_t export_drop;
+} __rte_cache_aligned flow_cache_t;
+
+typedef struct {
+    uint16_t version;
+    uint16_t length;
+    uint32_t export_time;
+    uint32_t sequence;
+    uint32_t domain_id;
+} __rte_packed ipfix_header_t;
+
+typedef struct {
+    uint16_t id;
+    uint16_t length;
+} __rte_packed ipfix_set_t;
+
+/** Must follow the order of flow_template
+ * */
+typedef struct {
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sp;
+    uint16_t dp;
+    uint8_t proto;
+    uint8_t tcp_flags;
+    uint32_t iport;
+    uint32_t acl_rule;
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t start;
+    uint64_t end;
+} __rte_packed ipfix_record_t;
+
+static const struct {
+    uint16_t ie;
+    uint16_t length;
+} flow_template[] = {
+    {8, 4},                         /** sourceIPv4Address */
+    {12, 4},                        /** destinationIPv4Address */
+    {7, 2},                         /** sourceTransportPort */
+    {11, 2},                        /** destinationTransportPort */
+    {4, 1},                         /** protocolIdentifier */
+    {6, 1},                         /** tcpControlBits, reduced size */
+    {10, 4},                        /** ingressInterface */
+    {IPFIX_ENTERPRISE | 1, 4},      /** acl rule id */
+    {2, 8},                         /** packetDeltaCount */
+    {1, 8},                         /** octetDeltaCount */
+    {152, 8},                       /** flowStartMilliseconds */
+    {153, 8},                       /** flowEndMilliseconds */
+};
+
+static flow_config_t flow_cfg_A, flow_cfg_B;
+static flow_cache_t flow_caches[RTE_MAX_LCORE];
+static uint64_t flow_hz;
+static uint64_t flow_epoch_ms;      /** wall clock at flow_epoch_tsc */
+static uint64_t flow_epoch_tsc;
+static int flow_sockfd = -1;
+static uint32_t flow_sequence;
+static uint64_t flow_msg_sent;
+static uint64_t flow_record_sent;
+static uint64_t flow_send_failed;
+static flow_config_t *flow_template_fc;  /** config of the last template set */
+static uint64_t flow_template_at;
+
+MODULE_DECLARE(flow) = {
+    .name = "flow",
+    .id = MOD_ID_FLOW,
+    .enabled = true,
+    .log = true,
+    .init = flow_init,
+    .proc = flow_proc,
+    .conf = flow_conf,
+    .tick = flow_tick,
+    .priv = NULL
+};
+
+static inline void
+flow_export(flow_cache_t *fl, flow_entry_t *e)
+{
+    wheel_cancel(fl->wheel, e - fl->table);
+
+    if (rte_ring_enqueue_elem(fl->ring, e, sizeof(*e))) {
+        fl->export_drop ++;
+    } else {
+        fl->exported ++;
+    }
+    e->packets = 0;
+}
+
+/** Timers are armed once for the first deadline, an entry seen since
+ * then is armed again for whichever of its timeouts comes first
+ * */
+static void
+flow_expire(void *arg, const uint32_t *idx, uint16_t n)
+{
+    flow_cache_t *fl = arg;
+    flow_config_t *fc = fl->fc;
+    flow_entry_t *e;
+    uint64_t deadline;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        e = &fl->table[idx[i]];
+        if (!e->packets) {
+            continue;
+        }
+
+        deadline = RTE_MIN(e->last + fc->idle_cycles, e->first + fc->active_cycles);
+        if (fl->now >= deadline) {
+            flow_export(fl, e);
+        } else {
+            wheel_arm(fl->wheel, idx[i], deadline);
+        }
+    }
+}
+
+static inline void
+flow_age(flow_cache_t *fl, flow_config_t *fc, uint64_t now, uint32_t budget)
+{
+    fl->fc = fc;
+    fl->now = now;
+    wheel_run(fl->wheel, now, budget);
+}
+
+/** Find the entry of the packet, or take a free slot in the probe
+ * window; when the window is full its home slot is exported early
+ * */
+static inline flow_entry_t *
+flow_lookup(flow_cache_t *fl, flow_config_t *fc, packet_t *p, uint64_t now)
+{
+    ip4_tuple_t *t = &p->tuple.v4;
+    flow_entry_t *e, *slot = NULL;
+    uint32_t h, i;
+
+    /** the fields only, the padding after proto is not written
+     * */
+    h = rte_hash_crc_4byte(t->sip, p->iport);
+    h = rte_hash_crc_4byte(t->dip, h);
+    h = rte_hash_crc_4byte((uint32_t)t->sp << 16 | t->dp, h);
+    h = rte_hash_crc_1byte(t->proto, h);
+
+    for (i = 0; i < FLOW_PROBE_NUM; i++) {
+        e = &fl->table[(h + i) & FLOW_CACHE_MASK];
+        if (!e->packets) {
+            if (!slot) slot = e;
+            continue;
+        }
+
+        if (e->sip == t->sip && e->dip == t->dip &&
+            e->sp == t->sp && e->dp == t->dp && e->proto == t->proto && e->iport == p->iport) {
+            return e;
+        }
+    }
+
+    if (!slot) {
+        slot = &fl->table[h & FLOW_CACHE_MASK];
+        flow_export(fl, slot);
+        fl->evicted ++;
+    }
+
+    slot->sip = t->sip;
+    slot->dip = t->dip;
+    slot->sp = t->sp;
+    slot->dp = t->dp;
+    slot->proto = t->proto;
+    slot->iport = p->iport;
+    slot->tcp_flags = 0;
+    slot->bytes = 0;
+    slot->first = now;
+    fl->created ++;
+
+    wheel_arm(fl->wheel, slot - fl->table, now + RTE_MIN(fc->idle_cycles, fc->active_cycles));
+
+    return slot;
+}
+
+static mod_ret_t
+flow_proc_egress(config_t *config, struct rte_mbuf *mbuf)
+{
+    flow_config_t *fc = config->flow_cfg;
+    flow_cache_t *fl = &flow_caches[rte_lcore_id()];
+    flow_entry_t *e;
+    packet_t *p;
+    uint64_t now;
+
+    if (!fc || !fc->enabled || !fl->table) {
+        return MOD_RET_ACCEPT;
+    }
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!p || !p->is_v4) {
+        return MOD_RET_ACCEPT;
+    }
+
+    now = rte_get_timer_cycles();
+    e = flow_lookup(fl, fc, p, now);
+    e->packets ++;
+    e->bytes += rte_pktmbuf_pkt_len(mbuf);
+    e->tcp_flags |= p->tcp_flags;
+    e->acl_rule = p->acl_rule;
+    e->last = now;
+
+    if (!(++fl->pkts & FLOW_AGE_MASK)) {
+        flow_age(fl, fc, now, FLOW_AGE_BUDGET);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static mod_ret_t
+flow_proc_idle(config_t *config)
+{
+    flow_config_t *fc = config->flow_cfg;
+    flow_cache_t *fl = &flow_caches[rte_lcore_id()];
+
+    if (fc && fc->enabled && fl->table) {
+        flow_age(fl, fc, rte_get_timer_cycles(), FLOW_IDLE_BUDGET);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+mod_ret_t flow_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (hook == MOD_HOOK_EGRESS) {
+        return flow_proc_egress(config, mbuf);
+    }
+
+    if (hook == MOD_HOOK_IDLE) {
+        return flow_proc_idle(config);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static inline uint64_t
+flow_tsc_to_ms(uint64_t tsc)
+{
+    return flow_epoch_ms + (tsc - flow_epoch_tsc) * 1000 / flow_hz;
+}
+
+static uint16_t
+flow_ipfix_template(uint8_t *buf, flow_config_t *fc)
+{
+    ipfix_set_t *set = (ipfix_set_t *)buf;
+    uint16_t *w = (uint16_t *)(set + 1);
+    uint16_t len;
+    unsigned int i;
+
+    *w++ = htons(IPFIX_TEMPLATE_ID);
+    *w++ = htons(RTE_DIM(flow_template));
+
+    for (i = 0; i < RTE_DIM(flow_template); i++) {
+        *w++ = htons(flow_template[i].ie);
+        *w++ = htons(flow_template[i].length);
+        if (flow_template[i].ie & IPFIX_ENTERPRISE) {
+            uint32_t pen = htonl(fc->pen);
+            memcpy(w, &pen, sizeof(pen));
+            w += 2;
+        }
+    }
+
+    len = (uint8_t *)w - buf;
+    set->id = htons(IPFIX_SET_TEMPLATE);
+    set->length = htons(len);
+    return len;
+}
+
+static void
+flow_ipfix_record(ipfix_record_t *r, flow_entry_t *e)
+{
+    r->sip = e->sip;
+    r->dip = e->dip;
+    r->sp = e->sp;
+    r->dp = e->dp;
+    r->proto = e->proto;
+    r->tcp_flags = e->tcp_flags;
+    r->iport = htonl(e->iport);
+    r->acl_rule = htonl(e->acl_rule);
+    r->packets = rte_cpu_to_be_64(e->packets);
+    r->bytes = rte_cpu_to_be_64(e->bytes);
+    r->start = rte_cpu_to_be_64(flow_tsc_to_ms(e->first));
+    r->end = rte_cpu_to_be_64(flow_tsc_to_ms(e->last));
+}
+
+/** Send one message: header, optional template set, data set
+ * */
+static int
+flow_ipfix_send(flow_config_t *fc, flow_entry_t *recs, uint32_t n, int with_template)
+{
+    uint8_t buf[FLOW_IPFIX_MTU];
+    ipfix_header_t *h = (ipfix_header_t *)buf;
+    ipfix_set_t *set;
+    ipfix_record_t *r;
+    struct sockaddr_in sa;
+    uint16_t off = sizeof(*h);
+    uint32_t i;
+
+    if (with_template) {
+        off += flow_ipfix_template(buf + off, fc);
+    }
+
+    if (n) {
+        set = (ipfix_set_t *)(buf + off);
+        set->id = htons(IPFIX_TEMPLATE_ID);
+        set->length = htons(sizeof(*set) + n * sizeof(*r));
+        off += sizeof(*set);
+
+        for (i = 0; i < n; i++) {
+            r = (ipfix_record_t *)(buf + off);
+            flow_ipfix_record(r, &recs[i]);
+            off += sizeof(*r);
+        }
+    }
+
+    h->version = htons(IPFIX_VERSION);
+    h->length = htons(off);
+    h->export_time = htonl(time(NULL));
+    h->sequence = htonl(flow_sequence);
+    h->domain_id = htonl(fc->domain_id);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = fc->collector;
+    sa.sin_port = fc->port;
+
+    if (sendto(flow_sockfd, buf, off, 0, (struct sockaddr *)&sa, sizeof(sa)) != off) {
+        flow_send_failed ++;
+        return -1;
+    }
+
+    flow_sequence += n;
+    flow_msg_sent ++;
+    flow_record_sent += n;
+    return 0;
+}
+
+void flow_tick(void *config)
+{
+    config_t *c = config;
+    flow_config_t *fc = c->flow_cfg;
+    flow_entry_t recs[FLOW_EXPORT_BURST];
+    flow_cache_t *fl;
+    unsigned int lcore_id, n, max;
+    uint64_t now;
+
+    if (!fc || !fc->enabled || flow_sockfd < 0) {
+        return;
+    }
+
+    /** over udp the template set is sent again every template_refresh
+     * seconds, RFC 7011 8.4, and at once for a new config
+     * */
+    now = rte_get_timer_cycles();
+    if ((fc != flow_template_fc || now - flow_template_at >= fc->template_cycles) &&
+        !flow_ipfix_send(fc, NULL, 0, 1)) {
+        flow_template_fc = fc;
+        flow_template_at = now;
+    }
+
+    max = (FLOW_IPFIX_MTU - sizeof(ipfix_header_t) - sizeof(ipfix_set_t)) / sizeof(ipfix_record_t);
+    max = RTE_MIN(max, (unsigned int)FLOW_EXPORT_BURST);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        fl = &flow_caches[lcore_id];
+        if (!fl->ring) {
+            continue;
+        }
+
+        while ((n = rte_ring_dequeue_burst_elem(fl->ring, recs, sizeof(recs[0]), max, NULL))) {
+            flow_ipfix_send(fc, recs, n, 0);
+        }
+    }
+}
+
+static int
+flow_json_load(flow_config_t *fc)
+{
+    json_object *jr = NULL, *jv;
+    struct in_addr in;
+    int ret = 0;
+
+    memset(fc, 0, sizeof(*fc));
+    fc->port = htons(4739);
+    fc->domain_id = 1;
+    fc->pen = FLOW_IPFIX_PEN;
+    fc->idle_timeout = 15;
+    fc->active_timeout = 60;
+    fc->template_refresh = 60;
+
+    jr = JR(CONFIG_PATH, "flow.json");
+    if (!jr) {
+        printf("no flow.json, flow export disabled\n");
+        return 0;
+    }
+
+    jv = JV(jr, "collector");
+    if (!jv || !inet_aton(JV_S(jv), &in)) {
+        printf("invalid flow collector\n");
+        ret = -1;
+        goto done;
+    }
+    fc->collector = in.s_addr;
+
+    jv = JV(jr, "port");
+    if (jv) fc->port = htons(JV_I(jv));
+
+    jv = JV(jr, "domain_id");
+    if (jv) fc->domain_id = JV_I(jv);
+
+    jv = JV(jr, "enterprise");
+    if (jv) fc->pen = JV_I(jv);
+
+    jv = JV(jr, "idle_timeout");
+    if (jv) fc->idle_timeout = JV_I(jv);
+
+    jv = JV(jr, "active_timeout");
+    if (jv) fc->active_timeout = JV_I(jv);
+
+    jv = JV(jr, "template_refresh");
+    if (jv) fc->template_refresh = JV_I(jv);
+
+    if (!fc->idle_timeout || fc->active_timeout < fc->idle_timeout) {
+        printf("invalid flow timeout idle %u active %u\n", fc->idle_timeout, fc->active_timeout);
+        ret = -1;
+        goto done;
+    }
+
+    fc->enabled = 1;
+
+done:
+    fc->idle_cycles = fc->idle_timeout * flow_hz;
+    fc->active_cycles = fc->active_timeout * flow_hz;
+    fc->template_cycles = fc->template_refresh * flow_hz;
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int flow_conf(void *config)
+{
+    config_t *c = config;
+    flow_config_t *fc;
+
+    fc = (c->flow_cfg == &flow_cfg_A) ? &flow_cfg_B : &flow_cfg_A;
+    if (flow_json_load(fc)) {
+        printf("flow json load failed\n");
+        return -1;
+    }
+
+    c->flow_cfg = fc;
+    return 0;
+}
+
+static int
+flow_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+    flow_config_t *fc = c->flow_cfg;
+    flow_cache_t *fl;
+    unsigned int lcore_id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!fc || !fc->enabled) {
+        CLI_PRINT(cli, "flow export disabled");
+        return 0;
+    }
+
+    CLI_PRINT(cli, "collector %s:%u domain %u idle %u active %u template refresh %u",
+        inet_ntoa(*(struct in_addr *)&fc->collector), ntohs(fc->port),
+        fc->domain_id, fc->idle_timeout, fc->active_timeout, fc->template_refresh);
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        fl = &flow_caches[lcore_id];
+        if (!fl->table) {
+            continue;
+        }
+
+        CLI_PRINT(cli, "lcore %u created %"PRIu64" evicted %"PRIu64" exported %"PRIu64" drop %"PRIu64" queued %u",
+            lcore_id, fl->created, fl->evicted, fl->exported, fl->export_drop, rte_ring_count(fl->ring));
+        CLI_PRINT(cli, "    timers %u expired %"PRIu64" cascaded %"PRIu64,
+            fl->wheel->armed, fl->wheel->expired, fl->wheel->cascaded);
+    }
+
+    CLI_PRINT(cli, "messages sent  %"PRIu64, flow_msg_sent);
+    CLI_PRINT(cli, "records sent   %"PRIu64, flow_record_sent);
+    CLI_PRINT(cli, "send failed    %"PRIu64, flow_send_failed);
+
+    return 0;
+}
+
+int flow_init(void *config)
+{
+    config_t *c = config;
+    char name[RTE_RING_NAMESIZE];
+    unsigned int lcore_id;
+    struct timeval tv;
+    flow_cache_t *fl;
+    wheel_conf_t wc;
+
+    flow_hz = rte_get_timer_hz();
+    gettimeofday(&tv, NULL);
+    flow_epoch_tsc = rte_get_timer_cycles();
+    flow_epoch_ms = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+    if (flow_conf(c)) {
+        printf("flow conf failed\n");
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        fl = &flow_caches[lcore_id];
+        fl->table = rte_zmalloc_socket("flow_cache", sizeof(flow_entry_t) * FLOW_CACHE_SIZE,
+            RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        if (!fl->table) {
+            printf("alloc flow cache of lcore %u failed\n", lcore_id);
+            return -1;
+        }
+
+        memset(&wc, 0, sizeof(wc));
+        wc.entries = fl->table;
+        wc.size = sizeof(flow_entry_t);
+        wc.offset = offsetof(flow_entry_t, timer);
+        wc.num = FLOW_CACHE_SIZE;
+        wc.tick = flow_hz / 1000 * FLOW_TICK_MS;
+        wc.cb = flow_expire;
+        wc.arg = fl;
+        wc.socket = rte_lcore_to_socket_id(lcore_id);
+        fl->wheel = wheel_create(&wc);
+        if (!fl->wheel) {
+            printf("create flow timers of lcore %u failed\n", lcore_id);
+            return -1;
+        }
+
+        hot_object(HOT_RING, name, sizeof(name), "flow_export_%u", lcore_id);
+        fl->ring = rte_ring_create_elem(name, sizeof(flow_entry_t), FLOW_RING_SIZE,
+            rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (!fl->ring) {
+            printf("create flow export ring %s failed\n", name);
+            return -1;
+        }
+    }
+
+    flow_sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (flow_sockfd < 0) {
+        printf("create flow export socket failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "flow", flow_show, "flow export statistics");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,57 @@
+#ifndef _M_FLOW_H_
+#define _M_FLOW_H_
+
+#include "../module.h"
+
+/** Flow metering with IPFIX export, IPv4 only
+ *
+ * Every worker lcore owns an open-addressing flow cache, so a packet
+ * at EGRESS costs one hash, usually one probe and a few increments.
+ * Entries age on a timing wheel of the worker, see wheel.h, a packet
+ * only stores its time and the timer is checked again when it expires.
+ * The worker runs the wheel every FLOW_AGE_MASK + 1 packets, and when
+ * its rx queue is empty, expiring records on idle or active timeout
+ * into a single-producer/single-consumer ring.
+ * The management core drains the rings on tick, encodes IPFIX
+ * (RFC 7011) and sends it over UDP to the collector, with the template
+ * set every template_refresh seconds.
+ *
+ *   worker: packet --> cache --expire--> ring
+ *   mgmt:   ring --> template + data set --> udp collector
+ * */
+
+#define FLOW_CACHE_SIZE     (1U << 16)  /** entries per worker lcore */
+#define FLOW_CACHE_MASK     (FLOW_CACHE_SIZE - 1)
+#define FLOW_PROBE_NUM      8
+#define FLOW_RING_SIZE      8192
+#define FLOW_AGE_MASK       63
+#define FLOW_AGE_BUDGET     64          /** most records expired per run */
+#define FLOW_IDLE_BUDGET    256
+#define FLOW_TICK_MS        1
+#define FLOW_EXPORT_BURST   32
+#define FLOW_IPFIX_MTU      1400
+#define FLOW_IPFIX_PEN      32473       /** RFC 5612 example enterprise, for the acl rule id element */
+
+typedef struct {
+    uint8_t enabled;
+    uint32_t collector;         /** collector address, network order */
+    uint16_t port;              /** collector port, network order */
+    uint32_t domain_id;         /** ipfix observation domain */
+    uint32_t pen;               /** enterprise number of the acl rule id element */
+    uint32_t idle_timeout;      /** seconds */
+    uint32_t active_timeout;    /** seconds */
+    uint32_t template_refresh;  /** seconds between template sets */
+    uint64_t idle_cycles;
+    uint64_t active_cycles;
+    uint64_t template_cycles;
+} flow_config_t;
+
+int flow_init(void *config);
+mod_ret_t flow_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int flow_conf(void *config);
+void flow_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
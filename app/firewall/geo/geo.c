@@ -0,0 +1,428 @@
+#include <inttypes.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <strings.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_ptype.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_fib.h>
+#include <rte_fib6.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../prefix.h"
+
+#include "geo.h"
+
+static geo_config_t geo_cfg_A, geo_cfg_B;
+static int geo_enabled;
+
+MODULE_DECLARE(geo) = {
+    .name = "geo",
+    .id = MOD_ID_GEO,
+    .enabled = true,
+    .log = true,
+    .init = geo_init,
+    .proc = NULL,
+    .conf = geo_conf,
+    .tick = NULL,
+    .priv = NULL
+};
+
+int geo_country_parse(const char *s, uint16_t *country)
+{
+    char cc[2];
+
+    if (strlen(s) != 2 || !isalpha((unsigned char)s[0]) || !isalpha((unsigned char)s[1])) {
+        return -1;
+    }
+
+    cc[0] = toupper((unsigned char)s[0]);
+    cc[1] = toupper((unsigned char)s[1]);
+    *country = GEO_COUNTRY(cc);
+    return 0;
+}
+
+static inline void
+geo_tag_set(const geo_config_t *gc, uint64_t nh, uint16_t *country, uint32_t *asn)
+{
+    if (nh) {
+        *country = gc->tags[nh - 1].country;
+        *asn = gc->tags[nh - 1].asn;
+    }
+}
+
+void geo_tag_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    config_t *c = config;
+    geo_config_t *gc = c->geo_cfg;
+    uint32_t ips[2 * n];
+    uint8_t ips6[2 * n][RTE_FIB6_IPV6_ADDR_SIZE];
+    uint64_t nhs[2 * n], nhs6[2 * n];
+    uint16_t idx[n], idx6[n], n4 = 0, n6 = 0, i;
+    packet_t *p;
+
+    if (!geo_enabled || !gc) {
+        return;
+    }
+
+    /** source and destination side by side, one bulk lookup per family
+     * */
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!p) {
+            continue;
+        }
+
+        if (RTE_ETH_IS_IPV4_HDR(p->ptype)) {
+            ips[2 * n4] = rte_be_to_cpu_32(p->tuple.v4.sip);
+            ips[2 * n4 + 1] = rte_be_to_cpu_32(p->tuple.v4.dip);
+            idx[n4++] = i;
+        } else if (RTE_ETH_IS_IPV6_HDR(p->ptype)) {
+            memcpy(ips6[2 * n6], p->tuple.v6.sip, RTE_FIB6_IPV6_ADDR_SIZE);
+            memcpy(ips6[2 * n6 + 1], p->tuple.v6.dip, RTE_FIB6_IPV6_ADDR_SIZE);
+            idx6[n6++] = i;
+        }
+    }
+
+    if (n4) {
+        rte_fib_lookup_bulk(gc->fib, ips, nhs, 2 * n4);
+    }
+
+    if (n6) {
+        rte_fib6_lookup_bulk(gc->fib6, ips6, nhs6, 2 * n6);
+    }
+
+    for (i = 0; i < n4; i++) {
+        p = rte_mbuf_to_priv(mbufs[idx[i]]);
+        geo_tag_set(gc, nhs[2 * i], &p->scountry, &p->sasn);
+        geo_tag_set(gc, nhs[2 * i + 1], &p->dcountry, &p->dasn);
+    }
+
+    for (i = 0; i < n6; i++) {
+        p = rte_mbuf_to_priv(mbufs[idx6[i]]);
+        geo_tag_set(gc, nhs6[2 * i], &p->scountry, &p->sasn);
+        geo_tag_set(gc, nhs6[2 * i + 1], &p->dcountry, &p->dasn);
+    }
+}
+
+static void
+geo_config_free(geo_config_t *gc)
+{
+    rte_fib_free(gc->fib);
+    rte_fib6_free(gc->fib6);
+    rte_free(gc->tags);
+    memset(gc, 0, sizeof(*gc));
+}
+
+/** Index of the tag of country and asn plus 1, a new one if not seen
+ * in the database so far
+ * */
+static int
+geo_tag_get(geo_config_t *gc, struct rte_hash *h, uint16_t country, uint32_t asn, uint32_t *nh)
+{
+    uint64_t key = ((uint64_t)country << 32) | asn;
+    void *data;
+
+    if (rte_hash_lookup_data(h, &key, &data) >= 0) {
+        *nh = (uint32_t)(uintptr_t)data;
+        return 0;
+    }
+
+    if (gc->tag_num == GEO_MAX_TAGS) {
+        printf("too many geo tags, at most %u\n", GEO_MAX_TAGS);
+        return -1;
+    }
+
+    gc->tags[gc->tag_num].country = country;
+    gc->tags[gc->tag_num].asn = asn;
+    *nh = ++gc->tag_num;
+
+    if (rte_hash_add_key_data(h, &key, (void *)(uintptr_t)*nh)) {
+        printf("add geo tag failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/** One line of the database, "prefix,country,asn"
+ * */
+static int
+geo_line_load(geo_config_t *gc, struct rte_hash *h, char *line)
+{
+    char *prefix, *cc, *as, *end;
+    uint8_t family, addr[16], depth;
+    uint16_t country = 0;
+    unsigned long asn = 0;
+    uint32_t ip, nh;
+    int ret;
+
+    prefix = line;
+    cc = strchr(prefix, ',');
+    if (!cc) {
+        return -1;
+    }
+    *cc++ = '\0';
+
+    as = strchr(cc, ',');
+    if (as) {
+        *as++ = '\0';
+    }
+
+    if (prefix_parse(prefix, &family, addr, &depth)) {
+        return -1;
+    }
+
+    if (*cc && geo_country_parse(cc, &country)) {
+        return -1;
+    }
+
+    if (as && *as) {
+        if (!strncasecmp(as, "AS", 2)) {
+            as += 2;
+        }
+        asn = strtoul(as, &end, 10);
+        if (*end || end == as || asn > UINT32_MAX) {
+            return -1;
+        }
+    }
+
+    if (!country && !asn) {
+        return 0;
+    }
+
+    if (gc->prefix_num + gc->prefix6_num == GEO_MAX_PREFIXES) {
+        printf("too many geo prefixes, at most %u\n", GEO_MAX_PREFIXES);
+        return -1;
+    }
+
+    if (geo_tag_get(gc, h, country, asn, &nh)) {
+        return -1;
+    }
+
+    if (family == AF_INET) {
+        memcpy(&ip, addr, sizeof(ip));
+        ret = rte_fib_add(gc->fib, rte_be_to_cpu_32(ip), depth, nh);
+        gc->prefix_num ++;
+    } else {
+        ret = rte_fib6_add(gc->fib6, addr, depth, nh);
+        gc->prefix6_num ++;
+    }
+
+    if (ret) {
+        printf("add geo prefix %s failed %d\n", prefix, ret);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+geo_json_load(geo_config_t *gc)
+{
+    struct rte_fib_conf fib_conf = {
+        .type = RTE_FIB_DIR24_8,
+        .default_nh = 0,
+        .max_routes = GEO_MAX_PREFIXES,
+        .dir24_8 = {
+            .nh_sz = RTE_FIB_DIR24_8_4B,
+            .num_tbl8 = GEO_TBL8_NUM,
+        },
+    };
+    struct rte_fib6_conf fib6_conf = {
+        .type = RTE_FIB6_TRIE,
+        .default_nh = 0,
+        .max_routes = GEO_MAX_PREFIXES,
+        .trie = {
+            .nh_sz = RTE_FIB6_TRIE_4B,
+            .num_tbl8 = GEO6_TBL8_NUM,
+        },
+    };
+    struct rte_hash_parameters params = {
+        .entries = GEO_MAX_TAGS,
+        .key_len = sizeof(uint64_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = rte_socket_id(),
+    };
+    const char *suffix = (gc == &geo_cfg_A) ? "A" : "B";
+    struct rte_hash *h = NULL;
+    json_object *jr = NULL, *jv;
+    char name[64], line[256];
+    uint32_t line_no = 0;
+    FILE *fp = NULL;
+    size_t len;
+    int ret = 0;
+
+    /** the buffer was left by all workers at the last config switch
+     * */
+    geo_config_free(gc);
+
+    jr = JR(CONFIG_PATH, "geo.json");
+    if (!jr) {
+        printf("no geo.json\n");
+        return -1;
+    }
+
+    jv = JV(jr, "database");
+    if (!jv) {
+        printf("no geo database\n");
+        ret = -1;
+        goto done;
+    }
+    snprintf(gc->database, sizeof(gc->database), "%s", JV_S(jv));
+
+    fp = fopen(gc->database, "r");
+    if (!fp) {
+        printf("open geo database %s failed\n", gc->database);
+        ret = -1;
+        goto done;
+    }
+
+    hot_object(HOT_FIB, name, sizeof(name), "geo_fib_%s", suffix);
+    gc->fib = rte_fib_create(name, rte_socket_id(), &fib_conf);
+    hot_object(HOT_FIB6, name, sizeof(name), "geo_fib6_%s", suffix);
+    gc->fib6 = rte_fib6_create(name, rte_socket_id(), &fib6_conf);
+    gc->tags = rte_zmalloc("geo_tags", sizeof(geo_tag_t) * GEO_MAX_TAGS, RTE_CACHE_LINE_SIZE);
+    params.name = hot_object(HOT_HASH, name, sizeof(name), "geo_tags");
+    h = rte_hash_create(&params);
+    if (!gc->fib || !gc->fib6 || !gc->tags || !h) {
+        printf("create geo tables failed\n");
+        ret = -1;
+        goto done;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        line_no ++;
+
+        len = strcspn(line, "\r\n");
+        line[len] = '\0';
+        if (!len || line[0] == '#') {
+            continue;
+        }
+
+        if (geo_line_load(gc, h, line)) {
+            printf("invalid line %u of geo database %s\n", line_no, gc->database);
+            ret = -1;
+            goto done;
+        }
+    }
+
+done:
+    rte_hash_free(h);
+    if (fp) fclose(fp);
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int geo_conf(void *config)
+{
+    config_t *c = config;
+    geo_config_t *gc;
+
+    if (!geo_enabled) {
+        return 0;
+    }
+
+    gc = (c->geo_cfg == &geo_cfg_A) ? &geo_cfg_B : &geo_cfg_A;
+    if (geo_json_load(gc)) {
+        printf("geo json load failed\n");
+        geo_config_free(gc);
+        return -1;
+    }
+
+    printf("geo %u prefixes, %u prefixes6, %u tags\n", gc->prefix_num, gc->prefix6_num, gc->tag_num);
+
+    c->geo_cfg = gc;
+    return 0;
+}
+
+static int
+geo_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = (config_t *)cli_get_context(cli);
+    geo_config_t *gc = c->geo_cfg;
+    uint8_t family, addr[16], depth;
+    uint64_t nh = 0;
+    uint32_t ip;
+    char *opt;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!geo_enabled || !gc) {
+        CLI_PRINT(cli, "geo disabled");
+        return 0;
+    }
+
+    CLI_PRINT(cli, "database %s", gc->database);
+    CLI_PRINT(cli, "prefixes %u prefixes6 %u tags %u", gc->prefix_num, gc->prefix6_num, gc->tag_num);
+
+    opt = CLI_OPT_V(cli, "ip");
+    if (!opt) {
+        return 0;
+    }
+
+    if (prefix_parse(opt, &family, addr, &depth)) {
+        CLI_PRINT(cli, "invalid ip %s", opt);
+        return -1;
+    }
+
+    if (family == AF_INET) {
+        memcpy(&ip, addr, sizeof(ip));
+        ip = rte_be_to_cpu_32(ip);
+        rte_fib_lookup_bulk(gc->fib, &ip, &nh, 1);
+    } else {
+        rte_fib6_lookup_bulk(gc->fib6, (uint8_t (*)[RTE_FIB6_IPV6_ADDR_SIZE])addr, &nh, 1);
+    }
+
+    if (!nh) {
+        CLI_PRINT(cli, "%s not found", opt);
+        return 0;
+    }
+
+    CLI_PRINT(cli, "%s country %c%c asn %u", opt,
+        gc->tags[nh - 1].country ? gc->tags[nh - 1].country >> 8 : '-',
+        gc->tags[nh - 1].country ? gc->tags[nh - 1].country & 0xff : '-',
+        gc->tags[nh - 1].asn);
+    return 0;
+}
+
+int geo_init(void *config)
+{
+    config_t *c = config;
+    struct cli_command *cmd;
+    json_object *jr;
+
+    jr = JR(CONFIG_PATH, "geo.json");
+    if (!jr) {
+        printf("no geo.json, geo disabled\n");
+        return 0;
+    }
+    JR_FREE(jr);
+
+    geo_enabled = 1;
+    if (geo_conf(c)) {
+        printf("geo conf failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        cmd = CLI_CMD_C(c->cli_def, c->cli_show, "geo", geo_show, "country and asn database of addresses");
+        CLI_OPT(cmd, "ip", "look an address up");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
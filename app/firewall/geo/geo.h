@@ -0,0 +1,69 @@
+#ifndef _M_GEO_H_
+#define _M_GEO_H_
+
+#include <rte_mbuf.h>
+
+#include "../module.h"
+
+/** Country and ASN of addresses
+ *
+ * geo.json, optional, names a prefix database of lines of a prefix, a
+ * country code and an ASN, either of them may be empty:
+ *
+ *   {"database": "/opt/firewall/config/geo.csv"}
+ *
+ *   # prefix,country,asn
+ *   1.0.0.0/24,AU,13335
+ *   2001:200::/32,JP,2500
+ *
+ * Each distinct pair of country and ASN is a tag, the prefixes compile
+ * into an rte_fib and an rte_fib6 whose next hop is the tag index plus
+ * 1, double buffered as other configs, so the database is reloaded with
+ * the rest of the configs. Before acl, the source and destination of a
+ * burst are looked up in one bulk lookup per family and the country and
+ * ASN of both are kept in packet_t, which acl rules match by "scountry",
+ * "dcountry", "sasn" and "dasn".
+ * */
+
+#define GEO_MAX_PREFIXES    (1U << 20)
+#define GEO_MAX_TAGS        (1U << 18)
+#define GEO_TBL8_NUM        (1U << 15)
+#define GEO6_TBL8_NUM       (1U << 16)
+
+/** Country codes are kept as their two letters, 0 for none
+ * */
+#define GEO_COUNTRY(s)      ((uint16_t)(((uint8_t)(s)[0] << 8) | (uint8_t)(s)[1]))
+
+typedef struct {
+    uint16_t country;
+    uint32_t asn;
+} geo_tag_t;
+
+typedef struct {
+    struct rte_fib *fib;
+    struct rte_fib6 *fib6;
+    geo_tag_t *tags;
+    uint32_t tag_num;
+    uint32_t prefix_num;
+    uint32_t prefix6_num;
+    char database[256];
+} geo_config_t;
+
+/** Parse a country code of two letters, case insensitive
+ * @return
+ *  0 on success, -1 for a failure
+ * */
+int geo_country_parse(const char *s, uint16_t *country);
+
+/** Set the country and ASN of the source and destination of each
+ * packet of mbufs, left 0 as the decoder reset them if not found
+ * */
+void geo_tag_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+int geo_init(void *config);
+int geo_conf(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
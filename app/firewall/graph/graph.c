@@ -0,0 +1,511 @@
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_ring.h>
+#include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_prefetch.h>
+#include <rte_graph.h>
+#include <rte_graph_worker.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../cli.h"
+#include "../worker.h"
+#include "../decoder/decoder.h"
+#include "../acl/acl.h"
+#include "../interface/interface.h"
+#include "../interface/vwire.h"
+#include "../interface/bridge.h"
+#include "../capture/capture.h"
+#include "../perf/perf.h"
+#include "../bpf/bpf.h"
+#include "../dpi/dpi.h"
+#include "../route/route.h"
+#include "../punt/punt.h"
+#include "../urpf/urpf.h"
+#include "../ipsec/ipsec.h"
+#include "../hot.h"
+
+#include "graph.h"
+
+/** working config of current lcore, see main_loop()
+ * */
+extern __thread config_t *_m_cfg;
+
+static struct rte_graph *graphs[RTE_MAX_LCORE];
+
+MODULE_DECLARE(graph) = {
+    .name = "graph",
+    .id = MOD_ID_GRAPH,
+    .enabled = true,
+    .log = true,
+    .init = graph_init,
+    .proc = NULL,
+    .priv = NULL
+};
+
+enum {
+    FIREWALL_RX_NEXT_DECODE,
+    FIREWALL_RX_NEXT_MAX,
+};
+
+enum {
+    FIREWALL_DECODE_NEXT_DROP,
+    FIREWALL_DECODE_NEXT_ACL,
+    FIREWALL_DECODE_NEXT_MAX,
+};
+
+enum {
+    FIREWALL_ACL_NEXT_DROP,
+    FIREWALL_ACL_NEXT_FWD,
+    FIREWALL_ACL_NEXT_MAX,
+};
+
+enum {
+    FIREWALL_IPSEC_NEXT_FWD,
+    FIREWALL_IPSEC_NEXT_MAX,
+};
+
+enum {
+    VWIRE_FWD_NEXT_DROP,
+    VWIRE_FWD_NEXT_MAX,
+};
+
+/** Move objs to 'next' except those marked in 'drop', which go to 'drop_next'.
+ * Speculate that nothing is dropped, so the whole stream is handed over
+ * without copy in the common case.
+ * */
+static inline void
+graph_node_split(struct rte_graph *graph, struct rte_node *node, void **objs,
+    uint16_t nb_objs, const uint8_t *drop, rte_edge_t next, rte_edge_t drop_next)
+{
+    void **to_next, **from = objs;
+    uint16_t i, held = 0, last_spec = 0;
+
+    to_next = rte_node_next_stream_get(graph, node, next, nb_objs);
+
+    for (i = 0; i < nb_objs; i++) {
+        if (likely(!drop[i])) {
+            last_spec ++;
+            continue;
+        }
+
+        /** copy things successfully speculated till now
+         * */
+        rte_memcpy(to_next, from, last_spec * sizeof(from[0]));
+        to_next += last_spec;
+        held += last_spec;
+        from += last_spec;
+        last_spec = 0;
+
+        rte_node_enqueue_x1(graph, node, drop_next, from[0]);
+        from ++;
+    }
+
+    if (likely(last_spec == nb_objs)) {
+        rte_node_next_stream_move(graph, node, next);
+        return;
+    }
+
+    rte_memcpy(to_next, from, last_spec * sizeof(from[0]));
+    held += last_spec;
+    rte_node_next_stream_put(graph, node, next, held);
+}
+
+static uint16_t
+firewall_rx_process(struct rte_graph *graph, struct rte_node *node,
+    __rte_unused void **objs, __rte_unused uint16_t nb_objs)
+{
+    config_t *c = _m_cfg;
+    uint16_t queueid, n;
+
+    queueid = rte_lcore_id() % c->worker_num;
+    n = rte_ring_dequeue_burst(c->rx_queues[queueid], node->objs, RTE_GRAPH_BURST_SIZE, NULL);
+    if (!n) {
+        ipsec_poll(c);
+        return 0;
+    }
+
+    node->idx = n;
+    rte_node_next_stream_move(graph, node, FIREWALL_RX_NEXT_DECODE);
+    return n;
+}
+
+static uint16_t
+firewall_decode_process(struct rte_graph *graph, struct rte_node *node,
+    void **objs, uint16_t nb_objs)
+{
+    struct rte_mbuf **pkts = (struct rte_mbuf **)objs;
+    uint8_t drop[nb_objs];
+    uint16_t i;
+
+    for (i = 0; i < nb_objs; i++) {
+        if (likely(i + 4 < nb_objs)) {
+            rte_prefetch0(rte_pktmbuf_mtod(pkts[i + 4], void *));
+        }
+        drop[i] = decoder_decode(pkts[i]) ? 1 : 0;
+    }
+
+    graph_node_split(graph, node, objs, nb_objs, drop,
+        FIREWALL_DECODE_NEXT_ACL, FIREWALL_DECODE_NEXT_DROP);
+    return nb_objs;
+}
+
+static uint16_t
+firewall_acl_process(struct rte_graph *graph, struct rte_node *node,
+    void **objs, uint16_t nb_objs)
+{
+    uint8_t actions[nb_objs];
+    uint8_t drop[nb_objs];
+    uint16_t i;
+
+    for (i = 0; i < nb_objs; i++) {
+        capture_packet(objs[i], CAPTURE_POINT_INGRESS);
+    }
+
+    if (acl_classify(_m_cfg, (struct rte_mbuf **)objs, actions, nb_objs)) {
+        memset(actions, ACL_ACTION_PASS, nb_objs);
+    }
+
+    for (i = 0; i < nb_objs; i++) {
+        drop[i] = (actions[i] == ACL_ACTION_DENY);
+    }
+
+    urpf_check_burst(_m_cfg, (struct rte_mbuf **)objs, nb_objs, drop);
+    bpf_filter_burst((struct rte_mbuf **)objs, nb_objs, drop);
+    dpi_inspect_burst(_m_cfg, (struct rte_mbuf **)objs, nb_objs, drop);
+
+    for (i = 0; i < nb_objs; i++) {
+        if (drop[i]) {
+            capture_packet(objs[i], CAPTURE_POINT_DENY);
+        }
+    }
+
+    graph_node_split(graph, node, objs, nb_objs, drop,
+        FIREWALL_ACL_NEXT_FWD, FIREWALL_ACL_NEXT_DROP);
+    return nb_objs;
+}
+
+/** Packets of IPsec tunnels are stolen here and come back through
+ * firewall_rx once the crypto is done, see ipsec.h
+ * */
+static uint16_t
+firewall_ipsec_process(struct rte_graph *graph, struct rte_node *node,
+    void **objs, uint16_t nb_objs)
+{
+    uint16_t n;
+
+    n = ipsec_steal_burst(_m_cfg, (struct rte_mbuf **)objs, nb_objs);
+    if (likely(n == nb_objs)) {
+        rte_node_next_stream_move(graph, node, FIREWALL_IPSEC_NEXT_FWD);
+    } else if (n) {
+        rte_node_enqueue(graph, node, FIREWALL_IPSEC_NEXT_FWD, objs, n);
+    }
+
+    return nb_objs;
+}
+
+static uint16_t
+vwire_fwd_process(struct rte_graph *graph, struct rte_node *node,
+    void **objs, uint16_t nb_objs)
+{
+    config_t *c = _m_cfg;
+    interface_config_t *itfc = c->itf_cfg;
+    struct rte_mbuf **pkts = (struct rte_mbuf **)objs;
+    struct rte_mbuf *flood[nb_objs];
+    packet_t *p;
+    uint16_t i, start, queueid, portid, sent, nb_flood = 0;
+    int oport;
+
+    queueid = rte_lcore_id() % c->worker_num;
+
+    for (i = 0; i < nb_objs; i++) {
+        p = rte_mbuf_to_priv(pkts[i]);
+        oport = -1;
+        if (itfc->ports[p->iport].type == PORT_TYPE_VWIRE) {
+            oport = vwire_pair(c, p->iport);
+        }
+        p->oport = (oport < 0 || oport >= c->port_num) ? PORT_DROP : oport;
+        capture_packet(pkts[i], CAPTURE_POINT_EGRESS);
+        perf_packet(pkts[i]);
+    }
+
+    /** bridge ports learn and look up the whole burst at once
+     * */
+    if (itfc->bridge_num) {
+        bridge_forward_burst(c, pkts, nb_objs);
+    }
+
+    /** and routed ports, one fib and one neighbor lookup per burst
+     * */
+    route_lookup_burst(c, pkts, nb_objs);
+    route_rewrite_burst(c, pkts, nb_objs);
+    punt_classify_burst(c, pkts, nb_objs);
+
+    /** enqueue runs of packets with the same output port in one go
+     * */
+    for (start = 0; start < nb_objs; start = i) {
+        p = rte_mbuf_to_priv(pkts[start]);
+        portid = p->oport;
+
+        for (i = start + 1; i < nb_objs; i++) {
+            p = rte_mbuf_to_priv(pkts[i]);
+            if (p->oport != portid) {
+                break;
+            }
+        }
+
+        if (portid == PORT_FLOOD) {
+            memcpy(&flood[nb_flood], &pkts[start], sizeof(flood[0]) * (i - start));
+            nb_flood += i - start;
+            continue;
+        }
+
+        if (portid == PORT_PUNT) {
+            for (; start < i; start++) {
+                neigh_punt(pkts[start]);
+            }
+            continue;
+        }
+
+        if (portid == PORT_LOCAL) {
+            for (; start < i; start++) {
+                punt_local(pkts[start]);
+            }
+            continue;
+        }
+
+        sent = 0;
+        if (portid != PORT_DROP) {
+            sent = rte_ring_enqueue_burst(c->tx_queues[portid][queueid], &objs[start], i - start, NULL);
+        }
+
+        if (sent < i - start) {
+            rte_node_enqueue(graph, node, VWIRE_FWD_NEXT_DROP, &objs[start + sent], i - start - sent);
+        }
+    }
+
+    if (nb_flood) {
+        bridge_flood(c, flood, nb_flood, queueid);
+    }
+
+    return nb_objs;
+}
+
+static uint16_t
+pkt_drop_process(__rte_unused struct rte_graph *graph, __rte_unused struct rte_node *node,
+    void **objs, uint16_t nb_objs)
+{
+    rte_pktmbuf_free_bulk((struct rte_mbuf **)objs, nb_objs);
+    return nb_objs;
+}
+
+static struct rte_node_register firewall_rx_node = {
+    .name = "firewall_rx",
+    .flags = RTE_NODE_SOURCE_F,
+    .process = firewall_rx_process,
+    .nb_edges = FIREWALL_RX_NEXT_MAX,
+    .next_nodes = {
+        [FIREWALL_RX_NEXT_DECODE] = "firewall_decode",
+    },
+};
+RTE_NODE_REGISTER(firewall_rx_node);
+
+static struct rte_node_register firewall_decode_node = {
+    .name = "firewall_decode",
+    .process = firewall_decode_process,
+    .nb_edges = FIREWALL_DECODE_NEXT_MAX,
+    .next_nodes = {
+        [FIREWALL_DECODE_NEXT_DROP] = "pkt_drop",
+        [FIREWALL_DECODE_NEXT_ACL] = "firewall_acl",
+    },
+};
+RTE_NODE_REGISTER(firewall_decode_node);
+
+static struct rte_node_register firewall_acl_node = {
+    .name = "firewall_acl",
+    .process = firewall_acl_process,
+    .nb_edges = FIREWALL_ACL_NEXT_MAX,
+    .next_nodes = {
+        [FIREWALL_ACL_NEXT_DROP] = "pkt_drop",
+        [FIREWALL_ACL_NEXT_FWD] = "firewall_ipsec",
+    },
+};
+RTE_NODE_REGISTER(firewall_acl_node);
+
+static struct rte_node_register firewall_ipsec_node = {
+    .name = "firewall_ipsec",
+    .process = firewall_ipsec_process,
+    .nb_edges = FIREWALL_IPSEC_NEXT_MAX,
+    .next_nodes = {
+        [FIREWALL_IPSEC_NEXT_FWD] = "vwire_fwd",
+    },
+};
+RTE_NODE_REGISTER(firewall_ipsec_node);
+
+static struct rte_node_register vwire_fwd_node = {
+    .name = "vwire_fwd",
+    .process = vwire_fwd_process,
+    .nb_edges = VWIRE_FWD_NEXT_MAX,
+    .next_nodes = {
+        [VWIRE_FWD_NEXT_DROP] = "pkt_drop",
+    },
+};
+RTE_NODE_REGISTER(vwire_fwd_node);
+
+/** pkt_drop is also provided by lib/node, only register ours
+ * when that one is not linked in
+ * */
+static struct rte_node_register pkt_drop_node = {
+    .name = "pkt_drop",
+    .process = pkt_drop_process,
+};
+
+static int
+graph_stats_print(bool is_first, __rte_unused bool is_last, void *cookie,
+    const struct rte_graph_cluster_node_stats *st)
+{
+    struct cli_def *cli = cookie;
+    char line[RTE_NODE_NAMESIZE + 128];
+    int n;
+
+    if (is_first) {
+        snprintf(line, sizeof(line), "%-20s %16s %16s %16s %10s %10s",
+            "node", "calls", "objs", "cycles", "objs/call", "cycles/obj");
+        if (cli) CLI_PRINT(cli, "%s", line);
+        else printf("%s\n", line);
+    }
+
+    /** ratios of 64 bit counters fit, a line cut short is still printed
+     * */
+    n = snprintf(line, sizeof(line), "%-20s %16"PRIu64" %16"PRIu64" %16"PRIu64" %10.1f %10.1f",
+        st->name, st->calls, st->objs, st->cycles,
+        st->calls ? (double)st->objs / st->calls : 0.0,
+        st->objs ? (double)st->cycles / st->objs : 0.0);
+    n = RTE_MIN(n, (int)sizeof(line) - 1);
+    if (cli) CLI_PRINT(cli, "%.*s", n, line);
+    else printf("%.*s\n", n, line);
+    return 0;
+}
+
+void graph_stats_dump(struct cli_def *cli)
+{
+    struct rte_graph_cluster_stats_param prm;
+    struct rte_graph_cluster_stats *stats;
+    const char *pattern;
+    char name[RTE_GRAPH_NAMESIZE];
+
+    pattern = hot_name(name, sizeof(name), GRAPH_NAME_PREFIX "*");
+
+    memset(&prm, 0, sizeof(prm));
+    prm.socket_id = SOCKET_ID_ANY;
+    prm.fn = graph_stats_print;
+    prm.cookie = cli;
+    prm.nb_graph_patterns = 1;
+    prm.graph_patterns = &pattern;
+
+    stats = rte_graph_cluster_stats_create(&prm);
+    if (!stats) {
+        printf("create graph stats failed\n");
+        return;
+    }
+
+    rte_graph_cluster_stats_get(stats, 0);
+    rte_graph_cluster_stats_destroy(stats);
+}
+
+static int
+graph_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!c->graph_mode) {
+        CLI_PRINT(cli, "graph mode disabled, start with --graph");
+        return 0;
+    }
+
+    graph_stats_dump(cli);
+    return 0;
+}
+
+static void
+graph_cli_register(config_t *config)
+{
+    if (!config || !config->cli_def) {
+        return;
+    }
+
+    CLI_CMD_C(config->cli_def, config->cli_show, "graph", graph_show, "per node statistics of graph workers");
+}
+
+int graph_init(void *config)
+{
+    config_t *c = config;
+    static const char *node_patterns[] = {
+        "firewall_*",
+        "vwire_fwd",
+        "pkt_drop",
+    };
+    struct rte_graph_param prm;
+    char name[RTE_GRAPH_NAMESIZE];
+    rte_graph_t id;
+    unsigned int lcore_id;
+
+    graph_cli_register(c);
+
+    if (!c->graph_mode) {
+        return 0;
+    }
+
+    if (rte_node_from_name("pkt_drop") == RTE_NODE_ID_INVALID) {
+        if (__rte_node_register(&pkt_drop_node) == RTE_NODE_ID_INVALID) {
+            printf("register pkt_drop node failed\n");
+            return -1;
+        }
+    }
+
+    memset(&prm, 0, sizeof(prm));
+    prm.node_patterns = node_patterns;
+    prm.nb_node_patterns = RTE_DIM(node_patterns);
+
+    /** One graph per lcore running WORKER(), see main_loop()
+     * */
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        hot_object(HOT_GRAPH, name, sizeof(name), GRAPH_NAME_PREFIX "%u", lcore_id);
+        prm.socket_id = rte_lcore_to_socket_id(lcore_id);
+
+        id = rte_graph_create(name, &prm);
+        if (id == RTE_GRAPH_ID_INVALID) {
+            printf("create graph %s failed\n", name);
+            return -1;
+        }
+
+        graphs[lcore_id] = rte_graph_lookup(name);
+        if (!graphs[lcore_id]) {
+            printf("lookup graph %s failed\n", name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+struct rte_graph *graph_get(unsigned int lcore_id)
+{
+    if (lcore_id >= RTE_MAX_LCORE) {
+        return NULL;
+    }
+
+    return graphs[lcore_id];
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,46 @@
+#ifndef _M_GRAPH_H_
+#define _M_GRAPH_H_
+
+#include <rte_graph.h>
+
+#include "../module.h"
+
+/** Firewall pipeline as lib/graph nodes, selected by --graph
+ *
+ *   firewall_rx -> firewall_decode -> firewall_acl -> firewall_ipsec -> vwire_fwd
+ *                        |                 |
+ *                        +---> pkt_drop <--+
+ *
+ * firewall_rx dequeues from the worker rx ring, vwire_fwd enqueues
+ * to the worker tx ring, so RX/TX cores are shared with the module
+ * framework and only the worker stage differs. vwire_fwd also forwards
+ * bridge ports, flooding a burst over a domain with one enqueue per port,
+ * and routed ports, punting to the management core what it can not route.
+ * firewall_ipsec steals the packets of IPsec tunnels, which come back
+ * through the rx ring once encrypted or decrypted.
+ * */
+
+#define GRAPH_NAME_PREFIX "worker-"
+
+int graph_init(void *config);
+
+/** Get graph instance of given worker lcore
+ * @param lcore_id
+ *  worker lcore id
+ * @return
+ *  graph pointer, NULL if lcore has no graph
+ * */
+struct rte_graph *graph_get(unsigned int lcore_id);
+
+struct cli_def;
+
+/** Print per node statistics of all worker graphs
+ * @param cli
+ *  cli to print to, NULL for stdout
+ * */
+void graph_stats_dump(struct cli_def *cli);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,567 @@
+#include <inttypes.h>
+#include <pthread.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ring_elem.h>
+#include <rte_ether.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../interface/interface.h"
+#include "../hot.h"
+
+#include "ha.h"
+
+#define HA_RX_RING_SIZE     1024
+#define HA_BURST            32
+#define HA_TICK_US          1000
+#define HA_TX_BYTES_PER_TICK (128 * 1024)   /** about 1 Gbit/s of sync */
+#define HA_STAGE_RECS       8
+
+typedef struct {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t count;              /** records following */
+    uint32_t seq;
+} __rte_packed ha_msg_t;
+
+/** A record as queued, the stamp orders the records of all lcores
+ * and is not sent
+ * */
+typedef struct {
+    uint64_t at;
+    ha_rec_t rec;
+} ha_item_t;
+
+/** Records dequeued from one lcore queue, the oldest at head
+ * */
+typedef struct {
+    ha_item_t items[HA_STAGE_RECS];
+    uint16_t head;
+    uint16_t num;
+} ha_stage_t;
+
+typedef struct {
+    uint64_t pushed;
+    uint64_t queue_full;
+} __rte_cache_aligned ha_lcore_stats_t;
+
+typedef struct {
+    uint64_t tx_msgs;
+    uint64_t tx_recs;
+    uint64_t tx_fail;
+    uint64_t rx_msgs;
+    uint64_t rx_recs;
+    uint64_t rx_lost;           /** messages missing by sequence */
+    uint64_t rx_bad;
+} ha_stats_t;
+
+volatile int ha_sending;
+uint16_t ha_port_id = UINT16_MAX;
+
+static struct rte_ring *ha_queues[RTE_MAX_LCORE];  /** records pushed by each lcore */
+static struct rte_ring *ha_rx_ring;                 /** sync frames from the RX core */
+static ha_lcore_stats_t ha_lcore_stats[RTE_MAX_LCORE];
+static ha_apply_t ha_applies[UINT8_MAX + 1];
+static uint64_t ha_rx_full;                         /** written by the RX core */
+static uint64_t ha_rx_at;                           /** last sync frame, stamped by the RX core */
+
+/** the ha thread only, apart from a reload holding the management core
+ * */
+static pthread_t ha_thread;
+static volatile uint8_t ha_parked;
+static volatile int ha_promote_req;
+static ha_stage_t ha_stages[RTE_MAX_LCORE];
+static ha_rec_t ha_out[HA_MSG_RECS];
+static uint16_t ha_out_num;
+static uint64_t ha_out_at;          /** when the first record of ha_out came */
+static uint64_t ha_tx_at;
+static uint32_t ha_tx_seq;
+
+/** management core only, tx counters are the ha thread's
+ * */
+static ha_stats_t ha_stats;
+static uint32_t ha_rx_seq;
+static uint8_t ha_peer_mac[RTE_ETHER_ADDR_LEN];
+static uint64_t ha_batch, ha_failover;  /** timer cycles */
+static int ha_peer_seen;
+
+extern volatile bool force_quit;
+
+MODULE_DECLARE(ha) = {
+    .name = "ha",
+    .id = MOD_ID_HA,
+    .enabled = true,
+    .log = true,
+    .init = ha_init,
+    .proc = NULL,
+    .conf = NULL,
+    .tick = ha_tick,
+    .priv = NULL
+};
+
+void ha_push_slow(uint8_t mod, uint8_t op, const void *data, uint16_t len)
+{
+    unsigned int lcore_id = rte_lcore_id();
+    ha_lcore_stats_t *st = &ha_lcore_stats[lcore_id];
+    ha_item_t item;
+
+    if (!ha_queues[lcore_id] || len > HA_REC_DATA) {
+        return;
+    }
+
+    item.at = rte_rdtsc();
+    item.rec.mod = mod;
+    item.rec.op = op;
+    item.rec.len = len;
+    memcpy(item.rec.data, data, len);
+
+    if (rte_ring_sp_enqueue_elem(ha_queues[lcore_id], &item, sizeof(item))) {
+        st->queue_full ++;
+        return;
+    }
+
+    st->pushed ++;
+}
+
+int ha_register(uint8_t mod, ha_apply_t apply)
+{
+    if (ha_applies[mod]) {
+        return -1;
+    }
+
+    ha_applies[mod] = apply;
+    return 0;
+}
+
+void ha_receive(struct rte_mbuf **pkts, uint16_t n)
+{
+    struct rte_ether_hdr *eh;
+    unsigned int sent = 0, i;
+
+    /** the peer is alive whatever the management core is busy with
+     * */
+    for (i = 0; i < n; i++) {
+        eh = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+        if (rte_pktmbuf_data_len(pkts[i]) >= sizeof(*eh) + sizeof(ha_msg_t) &&
+            eh->ether_type == rte_cpu_to_be_16(HA_ETHER_TYPE) &&
+            ((const ha_msg_t *)(eh + 1))->magic == rte_cpu_to_be_16(HA_MAGIC)) {
+            __atomic_store_n(&ha_rx_at, rte_get_timer_cycles(), __ATOMIC_RELEASE);
+            break;
+        }
+    }
+
+    if (ha_rx_ring) {
+        sent = rte_ring_enqueue_burst(ha_rx_ring, (void *const *)pkts, n, NULL);
+    }
+
+    if (sent < n) {
+        ha_rx_full += n - sent;
+        rte_pktmbuf_free_bulk(&pkts[sent], n - sent);
+    }
+}
+
+/** Send ha_out, a heartbeat when empty, and return the frame length
+ * */
+static uint16_t
+ha_flush(config_t *c, uint64_t now)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    struct rte_ether_hdr *eh;
+    struct rte_mbuf *mbuf;
+    ha_msg_t *msg;
+    uint16_t len;
+
+    len = sizeof(*eh) + sizeof(*msg) + sizeof(ha_rec_t) * ha_out_num;
+    mbuf = rte_pktmbuf_alloc(c->pktmbuf_pool);
+    if (!mbuf || !rte_pktmbuf_append(mbuf, RTE_MAX(len, RTE_ETHER_MIN_LEN - RTE_ETHER_CRC_LEN))) {
+        if (mbuf) {
+            rte_pktmbuf_free(mbuf);
+        }
+        ha_stats.tx_fail ++;
+        goto done;
+    }
+
+    if (rte_mbuf_to_priv(mbuf)) {
+        memset(rte_mbuf_to_priv(mbuf), 0, sizeof(packet_t));
+    }
+
+    eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    memcpy(&eh->dst_addr, ha_peer_mac, RTE_ETHER_ADDR_LEN);
+    memcpy(&eh->src_addr, itfc->ports[ha_port_id].hwaddr, RTE_ETHER_ADDR_LEN);
+    eh->ether_type = rte_cpu_to_be_16(HA_ETHER_TYPE);
+
+    msg = (ha_msg_t *)(eh + 1);
+    msg->magic = rte_cpu_to_be_16(HA_MAGIC);
+    msg->version = HA_VERSION;
+    msg->count = ha_out_num;
+    msg->seq = rte_cpu_to_be_32(ha_tx_seq++);
+    memcpy(msg + 1, ha_out, sizeof(ha_rec_t) * ha_out_num);
+
+    if (rte_ring_enqueue(c->tx_queues[ha_port_id][0], mbuf)) {
+        rte_pktmbuf_free(mbuf);
+        ha_stats.tx_fail ++;
+        goto done;
+    }
+
+    ha_stats.tx_msgs ++;
+    ha_stats.tx_recs += ha_out_num;
+
+done:
+    ha_out_num = 0;
+    ha_tx_at = now;
+    return len;
+}
+
+/** The stage holding the oldest record of all lcores, NULL once every
+ * queue is empty
+ * */
+static ha_stage_t *
+ha_next(void)
+{
+    ha_stage_t *sg, *next = NULL;
+    unsigned int lcore_id;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        sg = &ha_stages[lcore_id];
+        if (sg->head == sg->num && ha_queues[lcore_id]) {
+            sg->head = 0;
+            sg->num = rte_ring_sc_dequeue_burst_elem(ha_queues[lcore_id], sg->items, sizeof(ha_item_t),
+                HA_STAGE_RECS, NULL);
+        }
+
+        if (sg->head < sg->num &&
+            (!next || (int64_t)(sg->items[sg->head].at - next->items[next->head].at) < 0)) {
+            next = sg;
+        }
+    }
+
+    return next;
+}
+
+/** Drain the lcore queues into messages, up to HA_TX_BYTES_PER_TICK.
+ * A session is created by a worker and deleted by the management core,
+ * records go out in the order they were pushed so the standby never
+ * sees the delete first.
+ * */
+static void
+ha_send(config_t *c, uint64_t now, uint64_t hz)
+{
+    ha_stage_t *sg;
+    uint32_t bytes = 0;
+
+    while (bytes < HA_TX_BYTES_PER_TICK && (sg = ha_next())) {
+        if (!ha_out_num) {
+            ha_out_at = now;
+        }
+        ha_out[ha_out_num++] = sg->items[sg->head++].rec;
+
+        if (ha_out_num == HA_MSG_RECS) {
+            bytes += ha_flush(c, now);
+        }
+    }
+
+    if ((ha_out_num && now - ha_out_at > ha_batch) || now - ha_tx_at > HA_HEARTBEAT_MS * hz / 1000) {
+        ha_flush(c, now);
+    }
+}
+
+static void
+ha_apply_msg(const ha_msg_t *msg)
+{
+    const ha_rec_t *recs = (const ha_rec_t *)(msg + 1);
+    uint16_t i, start;
+
+    for (start = 0; start < msg->count; start = i) {
+        for (i = start + 1; i < msg->count; i++) {
+            if (recs[i].mod != recs[start].mod) {
+                break;
+            }
+        }
+
+        if (ha_applies[recs[start].mod]) {
+            ha_applies[recs[start].mod](&recs[start], i - start);
+        }
+    }
+}
+
+static void
+ha_recv(void)
+{
+    struct rte_mbuf *pkts[HA_BURST];
+    struct rte_ether_hdr *eh;
+    const ha_msg_t *msg;
+    uint32_t seq;
+    unsigned int i, n;
+
+    n = rte_ring_sc_dequeue_burst(ha_rx_ring, (void **)pkts, HA_BURST, NULL);
+    for (i = 0; i < n; i++) {
+        eh = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+        msg = (const ha_msg_t *)(eh + 1);
+
+        if (rte_pktmbuf_data_len(pkts[i]) < sizeof(*eh) + sizeof(*msg) ||
+            eh->ether_type != rte_cpu_to_be_16(HA_ETHER_TYPE) ||
+            msg->magic != rte_cpu_to_be_16(HA_MAGIC) || msg->version != HA_VERSION ||
+            msg->count > HA_MSG_RECS ||
+            rte_pktmbuf_data_len(pkts[i]) < sizeof(*eh) + sizeof(*msg) + sizeof(ha_rec_t) * msg->count) {
+            ha_stats.rx_bad ++;
+            rte_pktmbuf_free(pkts[i]);
+            continue;
+        }
+
+        seq = rte_be_to_cpu_32(msg->seq);
+        /** a lower sequence is a restarted peer
+         * */
+        if (ha_peer_seen && seq > ha_rx_seq) {
+            ha_stats.rx_lost += seq - ha_rx_seq;
+        }
+        ha_rx_seq = seq + 1;
+        ha_peer_seen = 1;
+
+        /** an active node still hearing a peer only counts it
+         * */
+        if (!ha_sending) {
+            ha_apply_msg(msg);
+        }
+
+        ha_stats.rx_msgs ++;
+        ha_stats.rx_recs += msg->count;
+        rte_pktmbuf_free(pkts[i]);
+    }
+}
+
+static void
+ha_promote(const char *why)
+{
+    if (ha_sending) {
+        return;
+    }
+
+    ha_tx_seq = 0;
+    ha_sending = 1;
+    printf("ha standby promoted to active, %s\n", why);
+}
+
+/** Park while the process does not own the ports, the next generation
+ * sends on the same TX rings, see hot.h
+ * */
+static void
+ha_park(void)
+{
+    ha_parked = 0;
+    while (!ha_parked && !force_quit) {
+        rte_pause();
+    }
+}
+
+/** Heartbeats, sync messages and failover run on a thread of their own
+ * every HA_TICK_US, the management tick is 100 ms and a reload holds it
+ * for as long as an acl build takes
+ * */
+static void *
+ha_loop(void *arg)
+{
+    config_t *c = arg;
+    uint64_t now, rx_at, hz = rte_get_timer_hz();
+
+    while (!force_quit) {
+        if (!hot_running) {
+            ha_parked = 1;
+            rte_delay_us_sleep(HA_TICK_US);
+            continue;
+        }
+
+        now = rte_get_timer_cycles();
+
+        if (ha_promote_req) {
+            ha_promote_req = 0;
+            ha_promote("by command");
+        }
+
+        rx_at = __atomic_load_n(&ha_rx_at, __ATOMIC_ACQUIRE);
+        if (ha_sending) {
+            ha_send(c, now, hz);
+        } else if (ha_failover && rx_at && now - rx_at > ha_failover) {
+            ha_promote("peer silent");
+        }
+
+        rte_delay_us_sleep(HA_TICK_US);
+    }
+
+    return NULL;
+}
+
+/** Records are applied on the management core, with the modules
+ * */
+void ha_tick(__rte_unused void *config)
+{
+    if (ha_port_id == UINT16_MAX) {
+        return;
+    }
+
+    ha_recv();
+}
+
+static int
+ha_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    uint64_t pushed = 0, queue_full = 0, queued = 0;
+    unsigned int lcore_id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (ha_port_id == UINT16_MAX) {
+        CLI_PRINT(cli, "ha disabled");
+        return 0;
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        pushed += ha_lcore_stats[lcore_id].pushed;
+        queue_full += ha_lcore_stats[lcore_id].queue_full;
+        if (ha_queues[lcore_id]) {
+            queued += rte_ring_count(ha_queues[lcore_id]);
+        }
+        queued += ha_stages[lcore_id].num - ha_stages[lcore_id].head;
+    }
+
+    CLI_PRINT(cli, "role %s port %u peer %s", ha_sending ? "active" : "standby", ha_port_id,
+        ha_peer_seen ? "seen" : "unknown");
+    CLI_PRINT(cli, "records pushed %"PRIu64" queued %"PRIu64" queue full %"PRIu64, pushed, queued, queue_full);
+    CLI_PRINT(cli, "tx msgs %"PRIu64" recs %"PRIu64" failed %"PRIu64,
+        ha_stats.tx_msgs, ha_stats.tx_recs, ha_stats.tx_fail);
+    CLI_PRINT(cli, "rx msgs %"PRIu64" recs %"PRIu64" lost %"PRIu64" bad %"PRIu64" ring full %"PRIu64,
+        ha_stats.rx_msgs, ha_stats.rx_recs, ha_stats.rx_lost, ha_stats.rx_bad, ha_rx_full);
+    return 0;
+}
+
+static int
+ha_promote_cmd(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!ha_standby()) {
+        CLI_PRINT(cli, "not a standby");
+        return -1;
+    }
+
+    ha_promote_req = 1;
+    CLI_PRINT(cli, "ok!");
+    return 0;
+}
+
+static int
+ha_json_load(config_t *c)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    json_object *jr = NULL, *jv;
+    struct rte_ether_addr mac;
+    uint16_t port;
+    int ret = 0;
+
+    jr = JR(CONFIG_PATH, "ha.json");
+    if (!jr) {
+        printf("no ha.json, ha disabled\n");
+        return 0;
+    }
+
+    jv = JV(jr, "port");
+    if (!jv) {
+        printf("parse port failed\n");
+        ret = -1;
+        goto done;
+    }
+
+    port = JV_I(jv);
+    if (port >= itfc->port_num || itfc->ports[port].type != PORT_TYPE_NONE) {
+        printf("ha port %u must be a port of type 0\n", port);
+        ret = -1;
+        goto done;
+    }
+
+    /** the peer, broadcast unless given
+     * */
+    memset(ha_peer_mac, 0xff, sizeof(ha_peer_mac));
+    jv = JV(jr, "peer_mac");
+    if (jv) {
+        if (rte_ether_unformat_addr(JV_S(jv), &mac)) {
+            printf("invalid ha peer_mac %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+        memcpy(ha_peer_mac, &mac, sizeof(ha_peer_mac));
+    }
+
+    jv = JV(jr, "batch_us");
+    ha_batch = (jv ? (uint64_t)JV_I(jv) : 1000) * rte_get_timer_hz() / 1000000;
+
+    jv = JV(jr, "failover_ms");
+    ha_failover = (jv ? (uint64_t)JV_I(jv) : 1000) * rte_get_timer_hz() / 1000;
+
+    jv = JV(jr, "role");
+    ha_sending = jv && !strcmp(JV_S(jv), "active");
+    ha_port_id = port;
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int ha_init(void *config)
+{
+    config_t *c = config;
+    char name[RTE_RING_NAMESIZE];
+    unsigned int lcore_id;
+
+    if (ha_json_load(c)) {
+        printf("ha json load failed\n");
+        return -1;
+    }
+
+    if (ha_port_id == UINT16_MAX) {
+        return 0;
+    }
+
+    ha_rx_ring = rte_ring_create(hot_object(HOT_RING, name, sizeof(name), "ha_rx"), HA_RX_RING_SIZE, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+    if (!ha_rx_ring) {
+        printf("create ha rx ring failed\n");
+        return -1;
+    }
+
+    /** a standby may be promoted, every lcore gets its queue anyway
+     * */
+    RTE_LCORE_FOREACH(lcore_id) {
+        hot_object(HOT_RING, name, sizeof(name), "ha_queue_%u", lcore_id);
+        ha_queues[lcore_id] = rte_ring_create_elem(name, sizeof(ha_item_t), HA_QUEUE_SIZE,
+            rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (!ha_queues[lcore_id]) {
+            printf("create ha queue %s failed\n", name);
+            return -1;
+        }
+    }
+
+    hot_park_register(ha_park);
+    if (rte_ctrl_thread_create(&ha_thread, "fw-ha", NULL, ha_loop, c)) {
+        printf("create ha thread failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        struct cli_command *cmd;
+
+        CLI_CMD_C(c->cli_def, c->cli_show, "ha", ha_show, "ha state synchronization");
+        cmd = CLI_CMD_C(c->cli_def, NULL, "ha", NULL, "ha state synchronization");
+        CLI_CMD_C(c->cli_def, cmd, "promote", ha_promote_cmd, "take over as the active node");
+    }
+
+    printf("ha %s on port %u\n", ha_sending ? "active" : "standby", ha_port_id);
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,98 @@
+#ifndef _M_HA_H_
+#define _M_HA_H_
+
+#include <rte_mbuf.h>
+
+#include "../module.h"
+
+/** Active/standby state synchronization over a dedicated port
+ *
+ * ha.json, optional, names the sync port, a port of interface.json
+ * with type "0", and the role of this node:
+ *
+ *   {"role": "active", "port": "2", "peer_mac": "00:0c:29:93:45:e6",
+ *    "batch_us": "1000", "failover_ms": "1000"}
+ *
+ * Stateful modules describe session changes as fixed size records,
+ * pushed by the lcore which made the change into a ring of its own, so
+ * a worker never shares a write. A control thread of the active node
+ * drains all rings in push order, by a timestamp of each record, into
+ * messages of up to HA_MSG_RECS records, sent when full, after
+ * batch_us, or empty every HA_HEARTBEAT_MS as a heartbeat. The RX core hands sync port frames to the management core
+ * of the standby, which gives each run of records of one module to
+ * that module in a single call.
+ *
+ * There is no retransmission: a lost message is counted by sequence
+ * number, and what it carried is only known again when the session
+ * changes. A standby promotes itself after failover_ms without a
+ * frame of the peer, 0 for 'ha promote' only. Heartbeats and failover
+ * run on the control thread and the RX core, never on the management
+ * tick, which a reload may hold longer than failover_ms.
+ * */
+
+#define HA_ETHER_TYPE       0x88b5      /** local experimental */
+#define HA_MAGIC            0x4846
+#define HA_VERSION          1
+#define HA_REC_DATA         28
+#define HA_MSG_RECS         46          /** records in a 1514 bytes frame */
+#define HA_QUEUE_SIZE       16384       /** records per lcore */
+#define HA_HEARTBEAT_MS     100
+
+typedef enum {
+    HA_OP_CREATE,
+    HA_OP_UPDATE,
+    HA_OP_DELETE,
+} ha_op_t;
+
+typedef struct {
+    uint8_t mod;                /** mod_id_t of the owner */
+    uint8_t op;                 /** ha_op_t */
+    uint16_t len;               /** bytes of data used */
+    uint8_t data[HA_REC_DATA];  /** defined by the owner, in network order */
+} ha_rec_t;
+
+/** Apply n records of one module on the standby, management core
+ * */
+typedef void (*ha_apply_t)(const ha_rec_t *recs, uint16_t n);
+
+extern volatile int ha_sending;
+extern uint16_t ha_port_id;
+
+void ha_push_slow(uint8_t mod, uint8_t op, const void *data, uint16_t len);
+
+/** Queue a session change for the standby, a no-op unless active
+ * */
+static inline void
+ha_push(uint8_t mod, uint8_t op, const void *data, uint16_t len)
+{
+    if (ha_sending) {
+        ha_push_slow(mod, op, data, len);
+    }
+}
+
+/** Whether port is the sync port, whose frames go to ha_receive()
+ * */
+static inline int
+ha_port(uint16_t port)
+{
+    return port == ha_port_id;
+}
+
+/** Whether this node is a standby, whose sessions are owned by the peer
+ * */
+static inline int
+ha_standby(void)
+{
+    return ha_port_id != UINT16_MAX && !ha_sending;
+}
+
+void ha_receive(struct rte_mbuf **pkts, uint16_t n);
+int ha_register(uint8_t mod, ha_apply_t apply);
+
+int ha_init(void *config);
+void ha_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
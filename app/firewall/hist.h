@@ -0,0 +1,121 @@
+#ifndef _M_HIST_H_
+#define _M_HIST_H_
+
+/** Log-linear histogram in the spirit of HdrHistogram
+ *
+ * Values below 2^HIST_SUB_BITS have a bucket each, above that every
+ * power of two is split into 2^HIST_SUB_BITS buckets, so the error of
+ * a reported percentile stays under 1/2^HIST_SUB_BITS (~6%) from a few
+ * cycles up to 2^HIST_MAX_BITS. One writer per histogram, readers merge
+ * copies without locking.
+ * */
+
+#include <stdint.h>
+#include <string.h>
+
+#define HIST_SUB_BITS   4
+#define HIST_SUB_NUM    (1U << HIST_SUB_BITS)
+#define HIST_MAX_BITS   40      /** values from 2^40 on share the last bucket */
+#define HIST_BUCKETS    ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_NUM)
+
+typedef struct {
+    uint64_t count[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} hist_t;
+
+static inline uint32_t
+hist_index(uint64_t v)
+{
+    uint32_t e;
+
+    if (v < HIST_SUB_NUM) {
+        return v;
+    }
+
+    /** v in [2^e, 2^(e+1)), e >= HIST_SUB_BITS
+     * */
+    e = 63 - __builtin_clzll(v);
+    if (e >= HIST_MAX_BITS) {
+        return HIST_BUCKETS - 1;
+    }
+
+    return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_NUM - 1));
+}
+
+/** Highest value counted in bucket i
+ * */
+static inline uint64_t
+hist_value(uint32_t i)
+{
+    uint32_t shift;
+
+    if (i < HIST_SUB_NUM) {
+        return i;
+    }
+
+    shift = (i >> HIST_SUB_BITS) - 1;
+    return ((uint64_t)(HIST_SUB_NUM + (i & (HIST_SUB_NUM - 1))) << shift) + (1ULL << shift) - 1;
+}
+
+static inline void
+hist_add(hist_t *h, uint64_t v)
+{
+    h->count[hist_index(v)] ++;
+    h->total ++;
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+static inline void
+hist_merge(hist_t *dst, const hist_t *src)
+{
+    uint32_t i;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        dst->count[i] += src->count[i];
+    }
+    dst->total += src->total;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+static inline void
+hist_reset(hist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/** Value under which pct percent of samples fall, e.g. pct 99.9
+ * */
+static inline uint64_t
+hist_percentile(const hist_t *h, double pct)
+{
+    uint64_t target, sum = 0;
+    uint32_t i;
+
+    if (!h->total) {
+        return 0;
+    }
+
+    target = (uint64_t)(h->total * pct / 100.0 + 0.5);
+    if (!target) {
+        target = 1;
+    }
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        sum += h->count[i];
+        if (sum >= target) {
+            return hist_value(i) < h->max ? hist_value(i) : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+#endif
+
+// file format utf-8
+// ident using space
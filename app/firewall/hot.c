@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <rte_eal.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_memzone.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_hash.h>
+#include <rte_fib.h>
+#include <rte_fib6.h>
+#include <rte_acl.h>
+#include <rte_ipsec_sad.h>
+#include <rte_graph.h>
+
+#include "config.h"
+#include "hot.h"
+#include "cli.h"
+
+#define HOT_ZONE_NAME "fw_hot"
+
+typedef struct {
+    char name[RTE_MEMZONE_NAMESIZE];
+    uint32_t size;
+} hot_layout_t;
+
+/** What the primary left in hugepages, shared by every generation
+ * */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t mgt_core;
+    int32_t rx_core;
+    int32_t tx_core;
+    int32_t rtx_core;
+    int32_t rtx_worker_core;
+    int32_t worker_num;
+    int32_t port_num;
+    uint32_t ops_num;                   /** mempool ops, indexed per process */
+    char ops[RTE_MEMPOOL_MAX_OPS_IDX][RTE_MEMPOOL_OPS_NAMESIZE];
+    uint32_t layout_num;
+    hot_layout_t layouts[HOT_LAYOUT_MAX];
+    uint32_t generation;                /** last one handed out */
+    uint32_t owner;                     /** generation polling the ports */
+    uint32_t request;                   /** generation asking for them, 0 for none */
+} hot_state_t;
+
+/** An object of this generation, looked up again by name on release as
+ * modules free and create some of them again on reload
+ * */
+typedef struct {
+    hot_kind_t kind;
+    char name[RTE_MEMZONE_NAMESIZE];
+} hot_object_t;
+
+extern volatile bool force_quit;
+
+volatile int hot_running;
+volatile int hot_draining;
+uint32_t hot_gen;
+
+static hot_state_t *hot;
+static volatile uint8_t hot_parked[RTE_MAX_LCORE];
+static void (*hot_parks[HOT_PARK_MAX])(void);
+static int hot_park_num;
+static hot_object_t hot_objects[HOT_OBJECT_MAX];
+static uint32_t hot_object_num;
+
+static void
+hot_vname(char *buf, size_t size, const char *fmt, va_list ap)
+{
+    int n = 0;
+
+    if (hot_gen) {
+        n = snprintf(buf, size, "g%u_", hot_gen);
+        if (n < 0 || (size_t)n >= size) {
+            n = 0;
+        }
+    }
+
+    vsnprintf(buf + n, size - n, fmt, ap);
+}
+
+const char *hot_name(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    hot_vname(buf, size, fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+const char *hot_object(hot_kind_t kind, char *buf, size_t size, const char *fmt, ...)
+{
+    hot_object_t *o;
+    va_list ap;
+    uint32_t i;
+
+    va_start(ap, fmt);
+    hot_vname(buf, size, fmt, ap);
+    va_end(ap);
+
+    for (i = 0; i < hot_object_num; i++) {
+        if (hot_objects[i].kind == kind && !strcmp(hot_objects[i].name, buf)) {
+            return buf;
+        }
+    }
+
+    if (hot_object_num >= HOT_OBJECT_MAX) {
+        printf("too many hot objects, %s is not released\n", buf);
+        return buf;
+    }
+
+    o = &hot_objects[hot_object_num++];
+    o->kind = kind;
+    snprintf(o->name, sizeof(o->name), "%s", buf);
+    return buf;
+}
+
+void hot_release(void)
+{
+    hot_object_t *o;
+    rte_graph_t id;
+    uint32_t i;
+
+    for (i = hot_object_num; i > 0; i--) {
+        o = &hot_objects[i - 1];
+
+        switch (o->kind) {
+        case HOT_RING:
+            rte_ring_free(rte_ring_lookup(o->name));
+            break;
+        case HOT_HASH:
+            rte_hash_free(rte_hash_find_existing(o->name));
+            break;
+        case HOT_FIB:
+            rte_fib_free(rte_fib_find_existing(o->name));
+            break;
+        case HOT_FIB6:
+            rte_fib6_free(rte_fib6_find_existing(o->name));
+            break;
+        case HOT_ACL:
+            rte_acl_free(rte_acl_find_existing(o->name));
+            break;
+        case HOT_MEMPOOL:
+            rte_mempool_free(rte_mempool_lookup(o->name));
+            break;
+        case HOT_SAD:
+            rte_ipsec_sad_destroy(rte_ipsec_sad_find_existing(o->name));
+            break;
+        case HOT_GRAPH:
+            id = rte_graph_from_name(o->name);
+            if (id != RTE_GRAPH_ID_INVALID) {
+                rte_graph_destroy(id);
+            }
+            break;
+        }
+    }
+
+    printf("generation %u released %u objects\n", hot_gen, hot_object_num);
+    hot_object_num = 0;
+}
+
+int hot_layout(const char *name, uint32_t size)
+{
+    hot_layout_t *l;
+    uint32_t i;
+
+    if (!hot) {
+        return 0;
+    }
+
+    for (i = 0; i < hot->layout_num; i++) {
+        l = &hot->layouts[i];
+        if (strcmp(l->name, name)) {
+            continue;
+        }
+
+        if (l->size != size) {
+            printf("hot layout %s was %u bytes, now %u\n", name, l->size, size);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (hot_takeover()) {
+        printf("hot layout %s unknown to the running process\n", name);
+        return -1;
+    }
+
+    if (hot->layout_num >= HOT_LAYOUT_MAX) {
+        printf("too many hot layouts\n");
+        return -1;
+    }
+
+    l = &hot->layouts[hot->layout_num++];
+    snprintf(l->name, sizeof(l->name), "%s", name);
+    l->size = size;
+    return 0;
+}
+
+int hot_park_register(void (*park)(void))
+{
+    if (hot_park_num >= HOT_PARK_MAX) {
+        return -1;
+    }
+
+    hot_parks[hot_park_num++] = park;
+    return 0;
+}
+
+void hot_idle(unsigned int lcore_id)
+{
+    if (!hot_parked[lcore_id]) {
+        hot_parked[lcore_id] = 1;
+    }
+    rte_delay_us_sleep(1000);
+}
+
+/** The running process wrote this, a takeover must see the same
+ * */
+static int
+hot_check(config_t *c)
+{
+    uint32_t i;
+
+    if (hot->magic != HOT_MAGIC || hot->version != HOT_VERSION) {
+        printf("hot state version %u, expect %u\n", hot->version, HOT_VERSION);
+        return -1;
+    }
+
+    if (hot->mgt_core != c->mgt_core || hot->rx_core != c->rx_core ||
+        hot->tx_core != c->tx_core || hot->rtx_core != c->rtx_core ||
+        hot->rtx_worker_core != c->rtx_worker_core || hot->worker_num != c->worker_num) {
+        printf("lcores differ from the running process\n");
+        return -1;
+    }
+
+    if (hot->port_num != c->port_num) {
+        printf("ports differ from the running process\n");
+        return -1;
+    }
+
+    if (hot->ops_num > rte_mempool_ops_table.num_ops) {
+        printf("mempool ops differ from the running process\n");
+        return -1;
+    }
+
+    for (i = 0; i < hot->ops_num; i++) {
+        if (strcmp(hot->ops[i], rte_mempool_ops_table.ops[i].name)) {
+            printf("mempool ops %u is %s, expect %s\n", i, rte_mempool_ops_table.ops[i].name, hot->ops[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int hot_init(config_t *c, int takeover)
+{
+    const struct rte_memzone *mz;
+    uint32_t i;
+
+    if (!takeover) {
+        mz = rte_memzone_reserve(HOT_ZONE_NAME, sizeof(hot_state_t), rte_socket_id(), 0);
+        if (!mz) {
+            printf("reserve %s failed\n", HOT_ZONE_NAME);
+            return -1;
+        }
+
+        hot = mz->addr;
+        memset(hot, 0, sizeof(*hot));
+        hot->magic = HOT_MAGIC;
+        hot->version = HOT_VERSION;
+        hot->mgt_core = c->mgt_core;
+        hot->rx_core = c->rx_core;
+        hot->tx_core = c->tx_core;
+        hot->rtx_core = c->rtx_core;
+        hot->rtx_worker_core = c->rtx_worker_core;
+        hot->worker_num = c->worker_num;
+        hot->port_num = c->port_num;
+        hot->ops_num = rte_mempool_ops_table.num_ops;
+        for (i = 0; i < hot->ops_num; i++) {
+            snprintf(hot->ops[i], RTE_MEMPOOL_OPS_NAMESIZE, "%s", rte_mempool_ops_table.ops[i].name);
+        }
+
+        hot_gen = 0;
+        hot_running = 1;
+        return 0;
+    }
+
+    if (rte_eal_process_type() != RTE_PROC_SECONDARY) {
+        printf("takeover needs --proc-type=secondary\n");
+        return -1;
+    }
+
+    mz = rte_memzone_lookup(HOT_ZONE_NAME);
+    if (!mz) {
+        printf("no running process to take over\n");
+        return -1;
+    }
+
+    hot = mz->addr;
+    if (hot_check(c)) {
+        return -1;
+    }
+
+    hot_gen = __atomic_add_fetch(&hot->generation, 1, __ATOMIC_ACQ_REL);
+    if (hot_gen > HOT_GEN_MAX) {
+        printf("generation %u over %u, restart cold\n", hot_gen, HOT_GEN_MAX);
+        return -1;
+    }
+    hot_running = 0;
+    printf("hot takeover as generation %u, owner is %u\n", hot_gen,
+        __atomic_load_n(&hot->owner, __ATOMIC_ACQUIRE));
+    return 0;
+}
+
+int hot_acquire(void)
+{
+    uint32_t expect = 0;
+    uint64_t deadline;
+
+    if (!__atomic_compare_exchange_n(&hot->request, &expect, hot_gen, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        printf("generation %u is taking over already\n", expect);
+        return -1;
+    }
+
+    deadline = rte_get_timer_cycles() + rte_get_timer_hz() * HOT_WAIT_MS / 1000;
+    while (__atomic_load_n(&hot->owner, __ATOMIC_ACQUIRE) != hot_gen) {
+        /** withdraw, unless the running process took the request
+         * meanwhile and the handover is on its way
+         * */
+        expect = hot_gen;
+        if (rte_get_timer_cycles() > deadline &&
+            __atomic_compare_exchange_n(&hot->request, &expect, 0, 0,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            printf("no handover in %u ms\n", HOT_WAIT_MS);
+            return -1;
+        }
+        rte_delay_us_sleep(1000);
+    }
+
+    hot_running = 1;
+    printf("generation %u owns the ports\n", hot_gen);
+    return 0;
+}
+
+static int
+hot_rings_empty(config_t *c)
+{
+    int i, j;
+
+    for (i = 0; i < c->worker_num; i++) {
+        if (rte_ring_count(c->rx_queues[i])) {
+            return 0;
+        }
+    }
+
+    for (i = 0; i < c->port_num; i++) {
+        for (j = 0; j < c->worker_num; j++) {
+            if (rte_ring_count(c->tx_queues[i][j])) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+int hot_tick(config_t *c)
+{
+    unsigned int lcore_id;
+    uint32_t req;
+    uint64_t deadline;
+    int i;
+
+    if (!hot) {
+        return 0;
+    }
+
+    if (!hot_running) {
+        rte_delay_us_sleep(100 * 1000);
+        return 1;
+    }
+
+    req = __atomic_load_n(&hot->request, __ATOMIC_ACQUIRE);
+    if (!req || req == hot_gen) {
+        return 0;
+    }
+
+    printf("generation %u asks for the ports\n", req);
+
+    /** NICs are left alone, what is already in the rings goes out
+     * */
+    hot_draining = 1;
+    deadline = rte_get_timer_cycles() + rte_get_timer_hz() * HOT_DRAIN_MS / 1000;
+    while (!hot_rings_empty(c) && rte_get_timer_cycles() < deadline) {
+        rte_delay_us_sleep(100);
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        hot_parked[lcore_id] = 0;
+    }
+    rte_smp_mb();
+    hot_running = 0;
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        while (!hot_parked[lcore_id] && !force_quit) {
+            rte_pause();
+        }
+    }
+
+    for (i = 0; i < hot_park_num; i++) {
+        hot_parks[i]();
+    }
+
+    if (!__atomic_compare_exchange_n(&hot->request, &req, 0, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        printf("generation %u gave up, resume\n", req);
+        hot_draining = 0;
+        hot_running = 1;
+        return 0;
+    }
+
+    /** the new generation listens once it owns the ports
+     * */
+    _cli_stop();
+
+    __atomic_store_n(&hot->owner, req, __ATOMIC_RELEASE);
+    printf("ports handed over to generation %u\n", req);
+
+    /** the primary anchors the hugepages the others run on, its
+     * objects stay with it
+     * */
+    if (rte_eal_process_type() == RTE_PROC_SECONDARY) {
+        hot_release();
+        force_quit = true;
+    }
+
+    return 1;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,124 @@
+#ifndef _M_HOT_H_
+#define _M_HOT_H_
+
+#include <stdint.h>
+
+#include "config.h"
+
+/** Hot restart, a new binary takes over the ports of a running one
+ *
+ * The first process, an EAL primary, publishes a memzone describing
+ * what it left in hugepages: its lcore layout, the mempool ops and the
+ * size of each structure registered by hot_layout(). A new process is
+ * started with the same lcores as a secondary and --takeover:
+ *
+ *   dpdk-firewall -l 0-3 -n 4 --proc-type=secondary -- --takeover
+ *
+ * It attaches to the shared objects, the mbuf pool, the worker rings
+ * and the nat connections, refuses to go on when the layout differs,
+ * creates everything else under its generation prefix, see hot_name(),
+ * and runs a full init, acl build included, while the old process still
+ * forwards. Only then it asks for the ports:
+ *
+ *   1. the old process stops polling the NICs and lets its workers and
+ *      TX drain the rings, for HOT_DRAIN_MS at most
+ *   2. its lcores park and ack, its listening CLI socket is closed
+ *   3. it hands ownership to the new generation, which starts polling
+ *
+ * The outage is the drain and a few milliseconds. A parked primary
+ * stays as the anchor of the hugepage memory, a parked secondary exits.
+ * The new process gives up after HOT_WAIT_MS, the old one goes on.
+ *
+ * A secondary releases the objects it named with hot_object() before
+ * it exits, whether it handed the ports over or gave up taking them.
+ * Tables of rte_malloc are not tracked and stay in the heap, so at most
+ * HOT_GEN_MAX generations take over before a cold restart is needed.
+ *
+ * A takeover serves the command line on its own socket. It is refused
+ * with --cli-proc, or when the running process serves a cli process,
+ * see ctl.h.
+ * */
+
+#define HOT_MAGIC           0x46574854  /** "FWHT" */
+#define HOT_VERSION         1
+#define HOT_LAYOUT_MAX      16
+#define HOT_PARK_MAX        8
+#define HOT_DRAIN_MS        100
+#define HOT_WAIT_MS         5000
+#define HOT_GEN_MAX         32
+#define HOT_OBJECT_MAX      128
+
+/** Set once this process forwards, cleared when it parks
+ * */
+extern volatile int hot_running;
+
+/** Set while the ports are being handed over, RX stops polling
+ * */
+extern volatile int hot_draining;
+
+/** Generation of this process, 0 for the primary
+ * */
+extern uint32_t hot_gen;
+
+static inline int
+hot_takeover(void)
+{
+    return hot_gen != 0;
+}
+
+/** Format an object name, prefixed with the generation of a takeover
+ * so it never clashes with the one of the process being replaced
+ * */
+const char *hot_name(char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+typedef enum {
+    HOT_RING,
+    HOT_HASH,
+    HOT_FIB,
+    HOT_FIB6,
+    HOT_ACL,
+    HOT_MEMPOOL,
+    HOT_SAD,
+    HOT_GRAPH,
+} hot_kind_t;
+
+/** hot_name() for an object this generation owns, released by name
+ * when the generation exits, see hot_release()
+ * */
+const char *hot_object(hot_kind_t kind, char *buf, size_t size, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/** Free what is left of the objects of hot_object(), newest first, on
+ * the way out of a secondary whose lcores no longer forward
+ * */
+void hot_release(void);
+
+/** Record, or check on takeover, the size of a structure kept in a
+ * shared object, any change of its layout must change its name
+ * */
+int hot_layout(const char *name, uint32_t size);
+
+/** Called on the management core once every lcore parked, before the
+ * new generation owns the ports, for state only freed there
+ * */
+int hot_park_register(void (*park)(void));
+
+/** Lcore loop when not running, acks the park
+ * */
+void hot_idle(unsigned int lcore_id);
+
+int hot_init(config_t *c, int takeover);
+
+/** Wait until the running process handed over the ports, takeover only
+ * */
+int hot_acquire(void);
+
+/** Serve a takeover request, nonzero when this process is parked
+ * */
+int hot_tick(config_t *c);
+
+#endif
+
+// file format utf-8
+// ident using space
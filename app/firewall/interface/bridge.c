@@ -0,0 +1,649 @@
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+
+#include "../config.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+
+#include "interface.h"
+#include "bridge.h"
+
+#define BRIDGE_BULK         (RTE_HASH_LOOKUP_BULK_MAX / 2)  /** a source and a destination key per packet */
+#define BRIDGE_SWEEP_NUM    1024        /** entries aged out per sweep, one sweep each 10ms */
+#define BRIDGE_VLAN_MASK    0xfff
+
+typedef enum {
+    BRIDGE_MAC_FREE,
+    BRIDGE_MAC_USED,
+    BRIDGE_MAC_RETIRED,         /** out of the hash, free after BRIDGE_GRACE_SEC */
+} bridge_mac_state_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint16_t vid;               /** domain index << 12 | vlan */
+} bridge_key_t;
+
+typedef struct {
+    bridge_key_t key;
+    uint16_t port;
+    uint8_t state;
+    uint64_t seen;              /** timer cycles, refreshed at most once a second */
+} bridge_mac_t;
+
+typedef struct {
+    uint32_t idx;
+    int32_t pos;                /** hash position to free, -1 if none */
+    uint64_t at;
+} bridge_retired_t;
+
+typedef struct {
+    uint64_t learned;
+    uint64_t moved;
+    uint64_t flooded;
+    uint64_t dropped;
+    uint64_t full;
+} __rte_cache_aligned bridge_stats_t;
+
+static struct rte_hash *bridge_hash;
+static bridge_mac_t *bridge_macs;
+static struct rte_ring *bridge_free;        /** free indexes of bridge_macs */
+static bridge_stats_t bridge_stats[RTE_MAX_LCORE];
+
+/** management core only, entries out of the hash in retiring order
+ * */
+static bridge_retired_t *bridge_retired;
+static uint32_t bridge_retired_head, bridge_retired_tail;
+static uint32_t bridge_cursor;
+static uint64_t bridge_swept;
+
+static inline int
+bridge_vlan_has(const bridge_config_t *b, uint16_t port, uint16_t vlan)
+{
+    return !!(b->vlans[port][vlan / 64] & (1ULL << (vlan % 64)));
+}
+
+/** Parse "0,10,20-29" into a vlan bitmap
+ * */
+static int
+bridge_vlans_parse(const char *s, uint64_t *vlans)
+{
+    unsigned long lo, hi;
+    const char *p = s;
+    char *end;
+
+    memset(vlans, 0, sizeof(uint64_t) * BRIDGE_VLAN_WORDS);
+
+    while (*p) {
+        lo = hi = strtoul(p, &end, 10);
+        if (*end == '-') {
+            hi = strtoul(end + 1, &end, 10);
+        }
+
+        if (end == p || lo > hi || hi > BRIDGE_VLAN_MASK || (*end && *end != ',')) {
+            return -1;
+        }
+
+        for (; lo <= hi; lo++) {
+            vlans[lo / 64] |= 1ULL << (lo % 64);
+        }
+
+        p = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+static int
+bridge_json_load(interface_config_t *itf_cfg)
+{
+    json_object *jr = NULL, *ja, *jp;
+    bridge_config_t *bridges = NULL, *b;
+    int i, k, bridge_num, port_num, tenant;
+    uint16_t portid;
+    int ret = 0;
+
+    jr = JR(CONFIG_PATH, "bridge.json");
+    if (!jr) {
+        printf("no bridge.json, bridge disabled\n");
+        return 0;
+    }
+
+    bridge_num = JA(jr, "bridges", &ja);
+    if (bridge_num <= 0) {
+        goto done;
+    }
+
+    if (bridge_num > MAX_BRIDGE_NUM) {
+        printf("too many bridges %d, at most %d\n", bridge_num, MAX_BRIDGE_NUM);
+        ret = -1;
+        goto done;
+    }
+
+    bridges = calloc(bridge_num, sizeof(bridge_config_t));
+    if (!bridges) {
+        ret = -1;
+        goto done;
+    }
+
+    #define BRIDGE_JV(item) \
+        jv = JV(jo, item); \
+        if (!jv) { \
+            printf("parse %s failed\n", item); \
+            ret = -1; \
+            goto done; \
+        }
+
+    for (i = 0; i < bridge_num; i++) {
+        json_object *jo, *jv;
+        b = &bridges[i];
+        jo = JO(ja, i);
+
+        BRIDGE_JV("id");
+        b->id = JV_I(jv);
+
+        jv = JV(jo, "aging");
+        b->aging = jv ? JV_I(jv) : BRIDGE_AGING_SEC;
+
+        jv = JV(jo, "vlan_aware");
+        b->vlan_aware = jv ? !!JV_I(jv) : 0;
+
+        jv = JV(jo, "tenant");
+        tenant = jv ? JV_I(jv) : 0;
+        if (tenant < 0 || tenant >= MAX_TENANT_NUM) {
+            printf("tenant of bridge %u must be below %u\n", b->id, MAX_TENANT_NUM);
+            ret = -1;
+            goto done;
+        }
+        b->tenant = tenant;
+
+        port_num = JA(jo, "ports", &jp);
+        if (port_num <= 0) {
+            printf("bridge %u has no ports\n", b->id);
+            ret = -1;
+            goto done;
+        }
+
+        for (k = 0; k < port_num; k++) {
+            json_object *jo = JO(jp, k);
+
+            BRIDGE_JV("id");
+            portid = JV_I(jv);
+            if (portid >= itf_cfg->port_num || itf_cfg->ports[portid].type != PORT_TYPE_BRIDGE ||
+                itf_cfg->ports[portid].bridge) {
+                printf("port %u of bridge %u is not a free bridge port\n", portid, b->id);
+                ret = -1;
+                goto done;
+            }
+
+            /** all vlans unless given
+             * */
+            jv = JV(jo, "vlans");
+            if (!jv) {
+                memset(b->vlans[portid], 0xff, sizeof(b->vlans[portid]));
+            } else if (bridge_vlans_parse(JV_S(jv), b->vlans[portid])) {
+                printf("invalid vlans '%s' of port %u\n", JV_S(jv), portid);
+                ret = -1;
+                goto done;
+            }
+
+            /** domains are 1 based in ports, 0 for none
+             * */
+            b->port_mask |= 1U << portid;
+            itf_cfg->ports[portid].bridge = i + 1;
+            itf_cfg->ports[portid].tenant = b->tenant;
+        }
+
+        itf_cfg->tenant_num = RTE_MAX(itf_cfg->tenant_num, b->tenant + 1);
+        itf_cfg->bridge_num ++;
+    }
+
+    #undef BRIDGE_JV
+
+done:
+    if (jr) JR_FREE(jr);
+
+    if (ret) {
+        free(bridges);
+        itf_cfg->bridge_num = 0;
+    } else {
+        itf_cfg->bridges = bridges;
+    }
+
+    return ret;
+}
+
+static inline bridge_config_t *
+bridge_of(interface_config_t *itf_cfg, uint16_t port)
+{
+    return (bridge_config_t *)itf_cfg->bridges + itf_cfg->ports[port].bridge - 1;
+}
+
+/** VLAN of a frame, 0 for untagged
+ * */
+static inline int
+bridge_vlan(struct rte_mbuf *mbuf)
+{
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_vlan_hdr *vh;
+
+    if (eh->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_VLAN)) {
+        return 0;
+    }
+
+    if (rte_pktmbuf_data_len(mbuf) < sizeof(*eh) + sizeof(*vh)) {
+        return -1;
+    }
+
+    vh = (struct rte_vlan_hdr *)(eh + 1);
+    return rte_be_to_cpu_16(vh->vlan_tci) & BRIDGE_VLAN_MASK;
+}
+
+static inline void
+bridge_touch(uint32_t idx, uint16_t port, uint64_t now, uint64_t hz)
+{
+    bridge_mac_t *e = &bridge_macs[idx];
+
+    /** the station moved to another port
+     * */
+    if (unlikely(__atomic_load_n(&e->port, __ATOMIC_RELAXED) != port)) {
+        __atomic_store_n(&e->port, port, __ATOMIC_RELAXED);
+        bridge_stats[rte_lcore_id()].moved ++;
+    }
+
+    if (now - __atomic_load_n(&e->seen, __ATOMIC_RELAXED) > hz) {
+        __atomic_store_n(&e->seen, now, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+bridge_learn(const bridge_key_t *key, uint16_t port, uint64_t now)
+{
+    bridge_stats_t *st = &bridge_stats[rte_lcore_id()];
+    bridge_mac_t *e;
+    void *data;
+    uint32_t idx;
+
+    /** learned by an earlier packet of the same burst
+     * */
+    if (rte_hash_lookup_data(bridge_hash, key, &data) >= 0) {
+        bridge_touch((uintptr_t)data, port, now, rte_get_timer_hz());
+        return;
+    }
+
+    if (rte_ring_mc_dequeue(bridge_free, &data)) {
+        st->full ++;
+        return;
+    }
+
+    idx = (uintptr_t)data;
+    e = &bridge_macs[idx];
+    e->key = *key;
+    e->port = port;
+    e->seen = now;
+    __atomic_store_n(&e->state, BRIDGE_MAC_USED, __ATOMIC_RELEASE);
+
+    /** two workers learning one station both add, the later one wins and
+     * the other entry is left to age out
+     * */
+    if (rte_hash_add_key_data(bridge_hash, key, data)) {
+        __atomic_store_n(&e->state, BRIDGE_MAC_FREE, __ATOMIC_RELEASE);
+        rte_ring_mp_enqueue(bridge_free, data);
+        st->full ++;
+        return;
+    }
+
+    st->learned ++;
+}
+
+void bridge_forward_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    bridge_key_t keys[2 * BRIDGE_BULK];
+    const void *kp[2 * BRIDGE_BULK];
+    void *data[2 * BRIDGE_BULK];
+    struct rte_mbuf *pkts[BRIDGE_BULK];
+    struct rte_ether_hdr *eh;
+    bridge_config_t *b;
+    packet_t *p;
+    uint64_t hit, now, hz;
+    uint16_t i, j, k, m, port;
+    int vlan;
+
+    if (!bridge_hash) {
+        return;
+    }
+
+    now = rte_get_timer_cycles();
+    hz = rte_get_timer_hz();
+
+    for (i = 0; i < n; i += m) {
+        /** gather bridge packets, a source and a destination key each
+         * */
+        for (k = 0, m = 0; i + m < n && k < BRIDGE_BULK; m++) {
+            p = rte_mbuf_to_priv(mbufs[i + m]);
+            if (!p || p->iport >= itfc->port_num || !itfc->ports[p->iport].bridge) {
+                continue;
+            }
+
+            b = bridge_of(itfc, p->iport);
+            vlan = b->vlan_aware ? bridge_vlan(mbufs[i + m]) : 0;
+            if (vlan < 0 || (b->vlan_aware && !bridge_vlan_has(b, p->iport, vlan))) {
+                bridge_stats[rte_lcore_id()].dropped ++;
+                p->oport = PORT_DROP;
+                continue;
+            }
+
+            eh = rte_pktmbuf_mtod(mbufs[i + m], struct rte_ether_hdr *);
+            memcpy(keys[2 * k].mac, &eh->src_addr, RTE_ETHER_ADDR_LEN);
+            memcpy(keys[2 * k + 1].mac, &eh->dst_addr, RTE_ETHER_ADDR_LEN);
+            keys[2 * k].vid = keys[2 * k + 1].vid = (itfc->ports[p->iport].bridge - 1) << 12 | vlan;
+            kp[2 * k] = &keys[2 * k];
+            kp[2 * k + 1] = &keys[2 * k + 1];
+            pkts[k++] = mbufs[i + m];
+        }
+
+        if (!k) {
+            continue;
+        }
+
+        hit = 0;
+        rte_hash_lookup_bulk_data(bridge_hash, kp, 2 * k, &hit, data);
+
+        for (j = 0; j < k; j++) {
+            p = rte_mbuf_to_priv(pkts[j]);
+
+            if (hit & (1ULL << (2 * j))) {
+                bridge_touch((uintptr_t)data[2 * j], p->iport, now, hz);
+            } else if (!rte_is_multicast_ether_addr((struct rte_ether_addr *)keys[2 * j].mac)) {
+                bridge_learn(&keys[2 * j], p->iport, now);
+            }
+
+            if (rte_is_multicast_ether_addr((struct rte_ether_addr *)keys[2 * j + 1].mac) ||
+                !(hit & (1ULL << (2 * j + 1)))) {
+                p->oport = PORT_FLOOD;
+                continue;
+            }
+
+            /** the station is on the segment it came from
+             * */
+            port = __atomic_load_n(&bridge_macs[(uintptr_t)data[2 * j + 1]].port, __ATOMIC_RELAXED);
+            if (port == p->iport) {
+                bridge_stats[rte_lcore_id()].dropped ++;
+                p->oport = PORT_DROP;
+            } else {
+                p->oport = port;
+            }
+        }
+    }
+}
+
+void bridge_flood(void *config, struct rte_mbuf **mbufs, uint16_t n, uint16_t queueid)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    bridge_stats_t *st = &bridge_stats[rte_lcore_id()];
+    struct rte_mbuf *out[n];
+    uint32_t masks[n], all = 0, mask, bits;
+    bridge_config_t *b;
+    packet_t *p;
+    uint16_t i, m, sent, port;
+    int vlan;
+
+    /** the ports of each packet first, so its reference count is set once
+     * before any port can send and free it
+     * */
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        b = bridge_of(itfc, p->iport);
+        mask = b->port_mask & ~(1U << p->iport);
+
+        if (b->vlan_aware) {
+            vlan = bridge_vlan(mbufs[i]);
+            for (bits = mask; bits; bits &= bits - 1) {
+                port = __builtin_ctz(bits);
+                if (!bridge_vlan_has(b, port, vlan)) {
+                    mask &= ~(1U << port);
+                }
+            }
+        }
+
+        masks[i] = mask;
+        if (!mask) {
+            rte_pktmbuf_free(mbufs[i]);
+            continue;
+        }
+
+        if (mask & (mask - 1)) {
+            rte_mbuf_refcnt_update(mbufs[i], __builtin_popcount(mask) - 1);
+        }
+        all |= mask;
+    }
+
+    for (bits = all; bits; bits &= bits - 1) {
+        port = __builtin_ctz(bits);
+
+        for (i = 0, m = 0; i < n; i++) {
+            if (masks[i] & (1U << port)) {
+                out[m++] = mbufs[i];
+            }
+        }
+
+        sent = rte_ring_enqueue_burst(c->tx_queues[port][queueid], (void *const *)out, m, NULL);
+        st->flooded += sent;
+        st->dropped += m - sent;
+        for (; sent < m; sent++) {
+            rte_pktmbuf_free(out[sent]);
+        }
+    }
+}
+
+static void
+bridge_retire(uint32_t idx, uint64_t now)
+{
+    bridge_mac_t *e = &bridge_macs[idx];
+    bridge_retired_t *r;
+    void *data;
+    int32_t pos;
+
+    __atomic_store_n(&e->state, BRIDGE_MAC_RETIRED, __ATOMIC_RELAXED);
+
+    /** an entry lost to a concurrent add is not in the hash
+     * */
+    pos = rte_hash_lookup_data(bridge_hash, &e->key, &data);
+    if (pos >= 0 && (uintptr_t)data == idx) {
+        pos = rte_hash_del_key(bridge_hash, &e->key);
+    } else {
+        pos = -1;
+    }
+
+    r = &bridge_retired[bridge_retired_tail++ & (BRIDGE_MAC_SIZE - 1)];
+    r->idx = idx;
+    r->pos = pos;
+    r->at = now;
+}
+
+void bridge_tick(void *config)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    bridge_retired_t *r;
+    bridge_config_t *b;
+    bridge_mac_t *e;
+    uint64_t now, hz;
+    uint32_t i;
+
+    if (!bridge_hash) {
+        return;
+    }
+
+    now = rte_get_timer_cycles();
+    hz = rte_get_timer_hz();
+
+    /** no worker holds an entry a grace period after it left the hash
+     * */
+    while (bridge_retired_head != bridge_retired_tail) {
+        r = &bridge_retired[bridge_retired_head & (BRIDGE_MAC_SIZE - 1)];
+        if (now - r->at < BRIDGE_GRACE_SEC * hz) {
+            break;
+        }
+
+        if (r->pos >= 0) {
+            rte_hash_free_key_with_position(bridge_hash, r->pos);
+        }
+        __atomic_store_n(&bridge_macs[r->idx].state, BRIDGE_MAC_FREE, __ATOMIC_RELAXED);
+        rte_ring_mp_enqueue(bridge_free, (void *)(uintptr_t)r->idx);
+        bridge_retired_head ++;
+    }
+
+    if (now - bridge_swept < hz / 100) {
+        return;
+    }
+    bridge_swept = now;
+
+    for (i = 0; i < BRIDGE_SWEEP_NUM; i++) {
+        e = &bridge_macs[bridge_cursor];
+        if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) == BRIDGE_MAC_USED) {
+            b = (bridge_config_t *)itfc->bridges + (e->key.vid >> 12);
+            if (now - __atomic_load_n(&e->seen, __ATOMIC_RELAXED) > b->aging * hz) {
+                bridge_retire(bridge_cursor, now);
+            }
+        }
+        bridge_cursor = (bridge_cursor + 1) & (BRIDGE_MAC_SIZE - 1);
+    }
+}
+
+static int
+bridge_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = (config_t *)cli_get_context(cli);
+    interface_config_t *itfc = c->itf_cfg;
+    bridge_stats_t sum = {0};
+    bridge_config_t *b;
+    bridge_mac_t *e;
+    uint64_t now, hz;
+    uint32_t i, bits;
+    int lcore_id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!bridge_hash) {
+        CLI_PRINT(cli, "bridge disabled");
+        return 0;
+    }
+
+    for (i = 0; i < itfc->bridge_num; i++) {
+        b = (bridge_config_t *)itfc->bridges + i;
+        CLI_PRINT(cli, "bridge %u tenant %u aging %us %s", b->id, b->tenant, b->aging,
+            b->vlan_aware ? "vlan aware" : "");
+        for (bits = b->port_mask; bits; bits &= bits - 1) {
+            CLI_PRINT(cli, "  port %u", __builtin_ctz(bits));
+        }
+    }
+
+    now = rte_get_timer_cycles();
+    hz = rte_get_timer_hz();
+
+    CLI_PRINT(cli, "%-8s %-6s %-18s %-6s %s", "bridge", "vlan", "mac", "port", "age");
+    for (i = 0; i < BRIDGE_MAC_SIZE; i++) {
+        e = &bridge_macs[i];
+        if (__atomic_load_n(&e->state, __ATOMIC_ACQUIRE) != BRIDGE_MAC_USED) {
+            continue;
+        }
+
+        b = (bridge_config_t *)itfc->bridges + (e->key.vid >> 12);
+        CLI_PRINT(cli, "%-8u %-6u %02x:%02x:%02x:%02x:%02x:%02x  %-6u %"PRIu64"s", b->id,
+            e->key.vid & BRIDGE_VLAN_MASK, e->key.mac[0], e->key.mac[1], e->key.mac[2],
+            e->key.mac[3], e->key.mac[4], e->key.mac[5], e->port, (now - e->seen) / hz);
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        sum.learned += bridge_stats[lcore_id].learned;
+        sum.moved += bridge_stats[lcore_id].moved;
+        sum.flooded += bridge_stats[lcore_id].flooded;
+        sum.dropped += bridge_stats[lcore_id].dropped;
+        sum.full += bridge_stats[lcore_id].full;
+    }
+
+    CLI_PRINT(cli, "learned %"PRIu64" moved %"PRIu64" flooded %"PRIu64" dropped %"PRIu64" full %"PRIu64,
+        sum.learned, sum.moved, sum.flooded, sum.dropped, sum.full);
+    return 0;
+}
+
+static int
+bridge_table_create(void)
+{
+    struct rte_hash_parameters params = {
+        .name = "bridge_macs",
+        .entries = BRIDGE_MAC_SIZE,
+        .key_len = sizeof(bridge_key_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = rte_socket_id(),
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF | RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD,
+    };
+    char name[RTE_HASH_NAMESIZE];
+    uint32_t i;
+
+    params.name = hot_object(HOT_HASH, name, sizeof(name), "bridge_macs");
+    bridge_hash = rte_hash_create(&params);
+    bridge_macs = rte_zmalloc("bridge_macs", sizeof(bridge_mac_t) * BRIDGE_MAC_SIZE, RTE_CACHE_LINE_SIZE);
+    bridge_retired = rte_zmalloc("bridge_retired", sizeof(bridge_retired_t) * BRIDGE_MAC_SIZE, RTE_CACHE_LINE_SIZE);
+    bridge_free = rte_ring_create(hot_object(HOT_RING, name, sizeof(name), "bridge_free"), BRIDGE_MAC_SIZE, rte_socket_id(), RING_F_EXACT_SZ);
+    if (!bridge_hash || !bridge_macs || !bridge_retired || !bridge_free) {
+        return -1;
+    }
+
+    for (i = 0; i < BRIDGE_MAC_SIZE; i++) {
+        rte_ring_sp_enqueue(bridge_free, (void *)(uintptr_t)i);
+    }
+
+    return 0;
+}
+
+int bridge_init(void *config)
+{
+    config_t *c = config;
+    interface_config_t *itf_cfg = c->itf_cfg;
+    int i;
+
+    if (bridge_json_load(itf_cfg)) {
+        printf("bridge json load failed\n");
+        return -1;
+    }
+
+    for (i = 0; i < itf_cfg->port_num; i++) {
+        if (itf_cfg->ports[i].type == PORT_TYPE_BRIDGE && !itf_cfg->ports[i].bridge) {
+            printf("bridge port %d is in no bridge\n", i);
+            return -1;
+        }
+    }
+
+    if (!itf_cfg->bridge_num) {
+        return 0;
+    }
+
+    if (bridge_table_create()) {
+        printf("create bridge mac table failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "bridge", bridge_show, "bridge domains and mac table");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,56 @@
+#ifndef _M_BRIDGE_H_
+#define _M_BRIDGE_H_
+
+#include "interface.h"
+
+/** L2 bridge domains over PORT_TYPE_BRIDGE ports, from bridge.json
+ *
+ *   {"bridges": [{"id": "0", "aging": "300", "vlan_aware": "1", "tenant": "0",
+ *       "ports": [{"id": "2", "vlans": "0,10,20-29"}, {"id": "3"}]}]}
+ *
+ * Source MACs are learned into one rte_hash for all domains, keyed by
+ * MAC, domain and VLAN. Workers add and look up entries themselves: the
+ * hash has lock-free readers, only adding a new station takes the writer
+ * lock. The management core ages entries out, and reuses them a grace
+ * period after they left the hash, so no worker ever holds a stale one.
+ *
+ * Unknown unicast, broadcast and multicast go to every other port of the
+ * domain, see bridge_flood(). A domain with vlan_aware learns per VLAN
+ * and keeps a VLAN on the ports listing it in "vlans", 0 for untagged
+ * frames, all VLANs if not given. Frames are forwarded as they are, tags
+ * are neither pushed nor popped.
+ * */
+
+#define BRIDGE_MAC_SIZE     (1U << 16)  /** stations of all domains */
+#define BRIDGE_VLAN_WORDS   (4096 / 64)
+#define BRIDGE_AGING_SEC    300
+#define BRIDGE_GRACE_SEC    1
+
+typedef struct {
+    uint16_t id;
+    uint8_t tenant;
+    uint8_t vlan_aware;
+    uint32_t aging;                     /** seconds */
+    uint32_t port_mask;                 /** ports of the domain */
+    uint64_t vlans[MAX_PORT_NUM][BRIDGE_VLAN_WORDS];    /** by port id */
+} bridge_config_t;
+
+int bridge_init(void *config);
+void bridge_tick(void *config);
+
+/** Learn the source and set p->oport of the bridge port packets in
+ * mbufs: a port, PORT_FLOOD or PORT_DROP. Other packets are left as
+ * they are.
+ * */
+void bridge_forward_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+/** Send PORT_FLOOD packets to the tx queues of the other ports of their
+ * domain, one enqueue per port for the whole burst. A packet is shared
+ * by the ports through its reference count, not copied.
+ * */
+void bridge_flood(void *config, struct rte_mbuf **mbufs, uint16_t n, uint16_t queueid);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -2,14 +2,23 @@
 #include <rte_ethdev.h>
 #include <rte_ring.h>
 #include <rte_log.h>
+#include <rte_dev.h>
+#include <arpa/inet.h>
 
 #include "../config.h"
 #include "../module.h"
 #include "../packet.h"
 #include "../json.h"
+#include "../hot.h"
+#include "../prefix.h"
+#include "../worker.h"
 
 #include "interface.h"
 #include "vwire.h"
+#include "bridge.h"
+#include "../latency/latency.h"
+#include "../qos/qos.h"
+#include "../ha/ha.h"
 
 MODULE_DECLARE(interface) = {
     .name = "interface",
@@ -18,9 +27,35 @@ MODULE_DECLARE(interface) = {
     .log = true,
     .init = interface_init,
     .proc = interface_proc,
+    .tick = interface_tick,
     .priv = NULL
 };
 
+/** Parse "10.0.0.1/24" or "2001:db8::1/64", the address is in host order
+ * for AF_INET and as it is for AF_INET6
+ * */
+static int
+interface_addr_parse(const char *s, int af, void *addr, uint8_t *depth)
+{
+    uint8_t family, a[16];
+    uint32_t ip;
+
+    /** the prefix length is not optional for a port
+     * */
+    if (!strchr(s, '/') || prefix_parse(s, &family, a, depth) || family != af || !*depth) {
+        return -1;
+    }
+
+    if (af == AF_INET) {
+        memcpy(&ip, a, sizeof(ip));
+        *(uint32_t *)addr = ntohl(ip);
+    } else {
+        memcpy(addr, a, 16);
+    }
+
+    return 0;
+}
+
 static int
 interface_json_load(config_t *config)
 {
@@ -57,6 +92,7 @@ interface_json_load(config_t *config)
 
         INTF_JV("id");
         port_config->id = JV_I(jv);
+        port_config->peer = PORT_DROP;
 
         INTF_JV("type");
         port_config->type = JV_I(jv);
@@ -67,6 +103,22 @@ interface_json_load(config_t *config)
         INTF_JV("mac")
         sprintf(port_config->mac, "%s", JV_S(jv));
 
+        /** addresses of a routed port, either or both
+         * */
+        jv = JV(jo, "ip");
+        if (jv && interface_addr_parse(JV_S(jv), AF_INET, &port_config->ip, &port_config->ip_depth)) {
+            printf("invalid ip %s of port %u\n", JV_S(jv), port_config->id);
+            ret = -1;
+            goto done;
+        }
+
+        jv = JV(jo, "ip6");
+        if (jv && interface_addr_parse(JV_S(jv), AF_INET6, port_config->ip6, &port_config->ip6_depth)) {
+            printf("invalid ip6 %s of port %u\n", JV_S(jv), port_config->id);
+            ret = -1;
+            goto done;
+        }
+
         itfc->port_num ++;
     }
 
@@ -77,105 +129,292 @@ interface_json_load(config_t *config)
     return ret;
 }
 
-int interface_init(void *config)
+/** Devargs of a memif port, zero-copy needs the client role, memif
+ * then hands the peer the hugepages of the mbuf pool instead of
+ * copying, and EAL to run with --single-file-segments
+ * */
+static int
+interface_memif_args(json_object *jm, const char *name, const char *mac, char *args, size_t size)
+{
+    json_object *jv;
+    const char *role, *socket;
+    int id, zc;
+
+    jv = JV(jm, "role");
+    role = jv ? JV_S(jv) : "client";
+    if (strcmp(role, "client") && strcmp(role, "server")) {
+        printf("memif role of %s is client or server\n", name);
+        return -1;
+    }
+
+    jv = JV(jm, "socket");
+    socket = jv ? JV_S(jv) : "/run/memif.sock";
+
+    jv = JV(jm, "id");
+    id = jv ? JV_I(jv) : 0;
+
+    jv = JV(jm, "zero_copy");
+    zc = jv ? JV_I(jv) : 0;
+    if (zc && strcmp(role, "client")) {
+        printf("memif zero copy of %s needs the client role\n", name);
+        return -1;
+    }
+
+    snprintf(args, size, "%s,role=%s,socket=%s,id=%d,mac=%s,zero-copy=%s",
+        name, role, socket, id, mac, zc ? "yes" : "no");
+    return 0;
+}
+
+int interface_probe(__rte_unused void *config)
+{
+    json_object *jr = NULL, *ja, *jo, *jm, *jv;
+    char args[512];
+    const char *name;
+    uint16_t portid;
+    int i, num, ret = 0;
+
+    jr = JR(CONFIG_PATH, "interface.json");
+    if (!jr) {
+        return 0;
+    }
+
+    num = JA(jr, "ports", &ja);
+    for (i = 0; i < num; i++) {
+        jo = JO(ja, i);
+        jm = JV(jo, "memif");
+        if (!jm) {
+            continue;
+        }
+
+        jv = JV(jo, "bus");
+        name = jv ? JV_S(jv) : "";
+        if (strncmp(name, "net_memif", strlen("net_memif"))) {
+            printf("memif port %d needs a bus like net_memif0\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        /** a takeover finds it created by the running process
+         * */
+        if (!rte_eth_dev_get_port_by_name(name, &portid)) {
+            continue;
+        }
+
+        jv = JV(jo, "mac");
+        if (!jv || interface_memif_args(jm, name, JV_S(jv), args, sizeof(args))) {
+            ret = -1;
+            goto done;
+        }
+
+        if (rte_dev_probe(args) < 0 || rte_eth_dev_get_port_by_name(name, &portid)) {
+            printf("probe %s failed\n", args);
+            ret = -1;
+            goto done;
+        }
+
+        /** ports are referred to by ethdev id
+         * */
+        jv = JV(jo, "id");
+        if (!jv || JV_I(jv) != portid) {
+            printf("%s is port %u, not %s\n", name, portid, jv ? JV_S(jv) : "set");
+            ret = -1;
+            goto done;
+        }
+
+        printf("memif port %u %s\n", portid, args);
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+/** Configure and start a port with a rx/tx queue pair per worker
+ * */
+static int
+interface_port_start(config_t *c, uint16_t portid)
 {
-    config_t *c = config;
     struct rte_eth_conf port_conf;
     struct rte_eth_dev_info dev_info;
-    uint16_t portid, rx_queues, tx_queues, i;
+    uint16_t rx_queues, tx_queues, i;
     uint16_t nb_rx_desc = 1024;
     uint16_t nb_tx_desc = 1024;
     int ret;
 
-    port_conf.rxmode.split_hdr_size = 0;
+    ret = rte_eth_dev_info_get(portid, &dev_info);
+    if (ret) {
+        printf("rte eth dev info get failed\n");
+        return -1;
+    }
+
+    if (dev_info.max_rx_queues > c->worker_num) {
+        rx_queues = c->worker_num;
+    } else {
+        rx_queues = dev_info.max_rx_queues;
+    }
+
+    if (dev_info.max_tx_queues > c->worker_num) {
+        tx_queues = c->worker_num;
+    } else {
+        tx_queues = dev_info.max_tx_queues;
+    }
+
+    /** RSS spreads flows over the queues of the workers, its RETA is
+     * rewritten when workers are parked, see interface_reta_update()
+     * */
+    memset(&port_conf, 0, sizeof(port_conf));
     port_conf.txmode.mq_mode = RTE_ETH_MQ_TX_NONE;
+    if (rx_queues > 1 && dev_info.flow_type_rss_offloads) {
+        port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_RSS;
+        port_conf.rx_adv_conf.rss_conf.rss_hf = (RTE_ETH_RSS_IP | RTE_ETH_RSS_TCP | RTE_ETH_RSS_UDP) &
+            dev_info.flow_type_rss_offloads;
+    }
 
-    c->itf_cfg = malloc(sizeof(interface_config_t));
-    if (!c->itf_cfg) {
-        printf("alloc interface config failed\n");
+    ret = rte_eth_dev_configure(portid, rx_queues, tx_queues, &port_conf);
+    if (ret < 0) {
+        printf("rte eth dev configure failed\n");
         return -1;
     }
 
-    if (interface_json_load(c)) {
-        printf("interface json load failed\n");
+    uint16_t rxds = nb_rx_desc * rx_queues;
+    uint16_t txds = nb_tx_desc * tx_queues;
+
+    ret = rte_eth_dev_adjust_nb_rx_tx_desc(portid, &rxds, &txds);
+    if (ret < 0) {
+        printf("rte eth dev adjust nb rx tx desc failed\n");
         return -1;
     }
 
-    if (vwire_init(c)) {
-        printf("vwire init failed\n");
+    for (i = 0; i < rx_queues; i++) {
+        ret = rte_eth_rx_queue_setup(portid, i, nb_rx_desc, rte_eth_dev_socket_id(portid),
+            &dev_info.default_rxconf, c->pktmbuf_pool);
+        if (ret < 0) {
+            printf("rte eth rx queue setup failed\n");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < tx_queues; i++) {
+        ret = rte_eth_tx_queue_setup(portid, i, nb_tx_desc, rte_eth_dev_socket_id(portid),
+            &dev_info.default_txconf);
+        if (ret < 0) {
+            printf("rte eth tx queue setup failed\n");
+            return -1;
+        }
+    }
+
+    ret = rte_eth_dev_set_ptypes(portid, RTE_PTYPE_UNKNOWN, NULL, 0);
+    if (ret < 0) {
+        printf("rte eth dev set ptypes failed\n");
         return -1;
     }
 
-    rx_queues = tx_queues = 0;
+    ret = rte_eth_dev_start(portid);
+    if (ret < 0) {
+        printf("rte eth dev start failed\n");
+        return -1;
+    }
 
-    RTE_ETH_FOREACH_DEV(portid) {
-        ret = rte_eth_dev_info_get(portid, &dev_info);
-        if (ret) {
-            printf("rte eth dev info get failed\n");
+    /** virtual ports like memif have no promiscuous mode to set
+     * */
+    if (c->promiscuous) {
+        ret = rte_eth_promiscuous_enable(portid);
+        if (ret != 0 && ret != -ENOTSUP) {
+            printf("rte eth promiscuous enable failed\n");
             return -1;
         }
+    }
 
-        if (dev_info.max_rx_queues > c->worker_num) {
-            rx_queues = c->worker_num;
-        } else {
-            rx_queues = dev_info.max_rx_queues;
-        }
+    return 0;
+}
 
-        if (dev_info.max_tx_queues > c->worker_num) {
-            tx_queues = c->worker_num;
-        } else {
-            tx_queues = dev_info.max_tx_queues;
+int interface_reta_update(void *config)
+{
+    config_t *c = config;
+    struct rte_eth_rss_reta_entry64 *reta;
+    struct rte_eth_dev_info dev_info;
+    uint16_t portid, queues[MAX_WORKER_NUM], n, i;
+    int ret = 0;
+
+    RTE_ETH_FOREACH_DEV(portid) {
+        if (rte_eth_dev_info_get(portid, &dev_info) || !dev_info.reta_size || dev_info.nb_rx_queues < 2) {
+            continue;
         }
 
-        ret = rte_eth_dev_configure(portid, rx_queues, tx_queues, &port_conf);
-        if (ret < 0) {
-            printf("rte eth dev configure failed\n");
-            return -1;
+        n = 0;
+        for (i = 0; i < dev_info.nb_rx_queues && i < c->worker_num; i++) {
+            if (worker_states[i] == WORKER_ACTIVE) queues[n++] = i;
         }
 
-        uint16_t rxds = nb_rx_desc * rx_queues;
-        uint16_t txds = nb_tx_desc * tx_queues;
+        /** the active workers are beyond the queues of this port, the
+         * RX lcore moves what it gets to them anyway
+         * */
+        if (!n) {
+            continue;
+        }
 
-        ret = rte_eth_dev_adjust_nb_rx_tx_desc(portid, &rxds, &txds);
-        if (ret < 0) {
-            printf("rte eth dev adjust nb rx tx desc failed\n");
+        reta = calloc(RTE_ALIGN(dev_info.reta_size, RTE_ETH_RETA_GROUP_SIZE) / RTE_ETH_RETA_GROUP_SIZE,
+            sizeof(*reta));
+        if (!reta) {
             return -1;
         }
 
-        for (i = 0; i < rx_queues; i++) {
-            ret = rte_eth_rx_queue_setup(portid, i, nb_rx_desc, rte_eth_dev_socket_id(portid),
-                &dev_info.default_rxconf, c->pktmbuf_pool);
-            if (ret < 0) {
-                printf("rte eth rx queue setup failed\n");
-                return -1;
-            }
+        for (i = 0; i < dev_info.reta_size; i++) {
+            reta[i / RTE_ETH_RETA_GROUP_SIZE].mask |= 1ULL << (i % RTE_ETH_RETA_GROUP_SIZE);
+            reta[i / RTE_ETH_RETA_GROUP_SIZE].reta[i % RTE_ETH_RETA_GROUP_SIZE] = queues[i % n];
         }
 
-        for (i = 0; i < tx_queues; i++) {
-            ret = rte_eth_tx_queue_setup(portid, i, nb_tx_desc, rte_eth_dev_socket_id(portid),
-                &dev_info.default_txconf);
-            if (ret < 0) {
-                printf("rte eth tx queue setup failed\n");
-                return -1;
-            }
+        if (rte_eth_dev_rss_reta_update(portid, reta, dev_info.reta_size)) {
+            printf("port %u reta update failed\n", portid);
+            ret = -1;
         }
+        free(reta);
+    }
 
-        ret = rte_eth_dev_set_ptypes(portid, RTE_PTYPE_UNKNOWN, NULL, 0);
-        if (ret < 0) {
-            printf("rte eth dev set ptypes failed\n");
-            return -1;
-        }
+    return ret;
+}
 
-        ret = rte_eth_dev_start(portid);
-        if (ret < 0) {
-            printf("rte eth dev start failed\n");
+int interface_init(void *config)
+{
+    config_t *c = config;
+    interface_config_t *itfc;
+    uint16_t portid;
+    int ret;
+
+    c->itf_cfg = calloc(1, sizeof(interface_config_t));
+    if (!c->itf_cfg) {
+        printf("alloc interface config failed\n");
+        return -1;
+    }
+    itfc = c->itf_cfg;
+
+    if (interface_json_load(c)) {
+        printf("interface json load failed\n");
+        return -1;
+    }
+
+    if (vwire_init(c)) {
+        printf("vwire init failed\n");
+        return -1;
+    }
+
+    if (bridge_init(c)) {
+        printf("bridge init failed\n");
+        return -1;
+    }
+
+    RTE_ETH_FOREACH_DEV(portid) {
+        /** ports keep running across a hot restart, the queues belong
+         * to whichever process owns them, see hot.h
+         * */
+        if (!hot_takeover() && interface_port_start(c, portid)) {
             return -1;
         }
 
-        if (c->promiscuous) {
-            ret = rte_eth_promiscuous_enable(portid);
-            if (ret != 0) {
-                printf("rte eth promiscuous enable failed\n");
+        if (portid < MAX_PORT_NUM) {
+            ret = rte_eth_macaddr_get(portid, (struct rte_ether_addr *)itfc->ports[portid].hwaddr);
+            if (ret < 0) {
+                printf("rte eth macaddr get failed\n");
                 return -1;
             }
         }
@@ -191,12 +430,29 @@ interface_proc_recv(config_t *config)
     packet_t *p;
     int i, nb_rx, portid, queueid;
 
+    worker_rx_ack();
+
+    /** a hot restart is draining the rings for the next process
+     * */
+    if (unlikely(hot_draining)) {
+        return 0;
+    }
+
     RTE_ETH_FOREACH_DEV(portid) {
         for (queueid = 0; queueid < config->worker_num; queueid ++) {
             nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst, MAX_PKT_BURST);
             if (nb_rx) {
                 M_LOG(interface.log, RTE_LOG_DEBUG, MOD_ID_INTERFACE, "\nrecv %d pkt from %d-%d\n", nb_rx, portid, queueid);
 
+                /** state sync frames skip the workers
+                 * */
+                if (ha_port(portid)) {
+                    ha_receive(pkts_burst, nb_rx);
+                    continue;
+                }
+
+                latency_stamp(pkts_burst, nb_rx);
+
                 for (i = 0; i < nb_rx; i++) {
                     p = rte_mbuf_to_priv(pkts_burst[i]);
                     if (p) {
@@ -207,7 +463,7 @@ interface_proc_recv(config_t *config)
                 /**
                  * enqueue must sucess.
                  * */
-                while (!rte_ring_enqueue_bulk(config->rx_queues[queueid], (void *const *)pkts_burst, nb_rx, NULL)) {;};
+                while (!rte_ring_enqueue_bulk(worker_rx_ring(config, queueid), (void *const *)pkts_burst, nb_rx, NULL)) {;};
                 M_LOG(interface.log, RTE_LOG_DEBUG, MOD_ID_INTERFACE, "enqueue worker rx queue %d\n", queueid);
             }
         }
@@ -234,8 +490,18 @@ interface_proc_prerouting(config_t *config, struct rte_mbuf *mbuf)
         case PORT_TYPE_VWIRE:
             p->oport = vwire_pair(config, portid);
             break;
-        default:
+        case PORT_TYPE_BRIDGE:
+            bridge_forward_burst(config, &mbuf, 1);
             break;
+        default:
+            /** routed ports are left to the route module
+             * */
+            return 0;
+    }
+
+    if (p->oport == PORT_DROP) {
+        rte_pktmbuf_free(mbuf);
+        return -1;
     }
 
     return 0;
@@ -258,6 +524,11 @@ interface_proc_send(config_t *config)
             nb_tx = rte_ring_dequeue_bulk(config->tx_queues[portid][queueid], (void **)pkts_burst, nb_tx, NULL);
             if (nb_tx) {
                 M_LOG(interface.log, RTE_LOG_DEBUG, MOD_ID_INTERFACE, "dequeue %d pkt from worker tx queue %d-%d\n", nb_tx, portid, queueid);
+                if (qos_port_enabled(portid)) {
+                    qos_enqueue(portid, pkts_burst, nb_tx);
+                    continue;
+                }
+                latency_account(pkts_burst, nb_tx, portid);
                 tx = rte_eth_tx_burst(portid, queueid, pkts_burst, nb_tx);
                 if (tx < nb_tx) {
                     M_LOG(interface.log, RTE_LOG_ERR, MOD_ID_INTERFACE, "send failed %d pkts\n", nb_tx - tx);
@@ -265,6 +536,12 @@ interface_proc_send(config_t *config)
                 M_LOG(interface.log, RTE_LOG_DEBUG, MOD_ID_INTERFACE, "send %d pkt to %d-%d\n", tx, portid, queueid);
             }
         }
+
+        /** scheduled ports send on their first queue only
+         * */
+        if (qos_port_enabled(portid)) {
+            qos_send(portid, 0);
+        }
     }
 
     return 0;
@@ -278,7 +555,9 @@ mod_ret_t interface_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
     }
 
     if (hook == MOD_HOOK_PREROUTING) {
-        interface_proc_prerouting(config, mbuf);
+        if (interface_proc_prerouting(config, mbuf)) {
+            return MOD_RET_STOLEN;
+        }
     }
 
     if (hook == MOD_HOOK_SEND) {
@@ -288,5 +567,10 @@ mod_ret_t interface_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
     return MOD_RET_ACCEPT;
 }
 
+void interface_tick(void *config)
+{
+    bridge_tick(config);
+}
+
 // file-format: utf-8
 // ident using spaces
\ No newline at end of file
@@ -5,17 +5,36 @@
 
 #define MAX_PORT_NUM   32
 #define MAX_VWIRE_NUM  16
+#define MAX_TENANT_NUM 16     /** RTE_ACL_MAX_CATEGORIES */
+#define MAX_BRIDGE_NUM 16
+
+/** output ports of packet_t beyond the real ones
+ * */
+#define PORT_DROP      UINT16_MAX
+#define PORT_FLOOD     (UINT16_MAX - 1)     /** all ports of the bridge domain, see bridge.h */
+#define PORT_PUNT      (UINT16_MAX - 2)     /** to the management core, see route/neigh.h */
+#define PORT_LOCAL     (UINT16_MAX - 3)     /** to the kernel, see punt/punt.h */
 
 typedef enum {
     PORT_TYPE_NONE,
     PORT_TYPE_VWIRE,
+    PORT_TYPE_BRIDGE,
+    PORT_TYPE_ROUTED,
 } port_type_t;
 
 typedef struct {
     uint16_t id;
     port_type_t type;
+    uint8_t tenant;         /** acl category, set by the vwire pair or bridge */
+    uint8_t bridge;         /** bridge domain of a PORT_TYPE_BRIDGE port */
+    uint16_t peer;          /** other port of a PORT_TYPE_VWIRE pair */
     char bus[16];
     char mac[32];
+    uint8_t hwaddr[6];      /** mac of the device */
+    uint32_t ip;            /** address of a PORT_TYPE_ROUTED port, host order, 0 if none */
+    uint8_t ip_depth;
+    uint8_t ip6[16];        /** all zero if none */
+    uint8_t ip6_depth;
 } port_config_t;
 
 typedef struct {
@@ -23,11 +42,24 @@ typedef struct {
     void *vwire_pairs;
     uint16_t port_num;
     uint16_t vwire_pair_num;
+    void *bridges;
+    uint16_t bridge_num;
+    uint8_t tenant_num;     /** highest tenant of vwire pairs and bridges plus 1 */
     void *priv;
 } interface_config_t;
 
 int interface_init(void *config);
+
+/** Create the memif ports of interface.json, before ports are counted
+ * */
+int interface_probe(void *config);
+
+/** Spread the RSS RETA of each port over the queues of active workers,
+ * ports without a RETA still have queues of parked workers polled
+ * */
+int interface_reta_update(void *config);
 mod_ret_t interface_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+void interface_tick(void *config);
 
 #endif
 
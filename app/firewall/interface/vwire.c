@@ -7,7 +7,7 @@ static int
 vwire_json_load(interface_config_t *itf_cfg)
 {
     json_object *jr = NULL, *ja;
-    int i, vwire_pairs_num;
+    int i, vwire_pairs_num, tenant;
     vwire_config_t *vwire_pairs_mem = NULL;
     int ret = 0;
 
@@ -62,6 +62,23 @@ vwire_json_load(interface_config_t *itf_cfg)
             goto done;
         }
 
+        /** both ports of a pair belong to one tenant, 0 if not given
+         * */
+        jv = JV(jo, "tenant");
+        tenant = jv ? JV_I(jv) : 0;
+        if (tenant < 0 || tenant >= MAX_TENANT_NUM) {
+            printf("tenant of vwire %u must be below %u\n", vwire_config->id, MAX_TENANT_NUM);
+            ret = -1;
+            goto done;
+        }
+        vwire_config->tenant = tenant;
+
+        itf_cfg->ports[vwire_config->port1].tenant = vwire_config->tenant;
+        itf_cfg->ports[vwire_config->port2].tenant = vwire_config->tenant;
+        itf_cfg->ports[vwire_config->port1].peer = vwire_config->port2;
+        itf_cfg->ports[vwire_config->port2].peer = vwire_config->port1;
+        itf_cfg->tenant_num = RTE_MAX(itf_cfg->tenant_num, vwire_config->tenant + 1);
+
         itf_cfg->vwire_pair_num ++;
     }
 
@@ -96,27 +113,20 @@ int vwire_init(void *config)
     return 0;
 }
 
+/** The peer is kept in the port itself when vwire.json is loaded, no
+ * scan of the pairs per packet
+ * */
 int vwire_pair(void *config, uint16_t port_id)
 {
     config_t *c = config;
     interface_config_t *itf_cfg = c->itf_cfg;
-    vwire_config_t *vwire_config;
-    int i;
-
-    for (i = 0; i < itf_cfg->vwire_pair_num; i++) {
-        vwire_config = (vwire_config_t *)itf_cfg->vwire_pairs + i;
-        if (vwire_config) {
-            if (port_id == vwire_config->port1) {
-                return vwire_config->port2;
-            }
-
-            if (port_id == vwire_config->port2) {
-                return vwire_config->port1;
-            }
-        }
+
+    if (port_id >= itf_cfg->port_num || itf_cfg->ports[port_id].type != PORT_TYPE_VWIRE ||
+        itf_cfg->ports[port_id].peer == PORT_DROP) {
+        return -1;
     }
 
-    return -1;
+    return itf_cfg->ports[port_id].peer;
 }
 
 // file format utf-8
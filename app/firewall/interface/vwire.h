@@ -7,6 +7,7 @@ typedef struct {
     uint16_t id;
     uint16_t port1;
     uint16_t port2;
+    uint8_t tenant;
 } vwire_config_t;
 
 #define VWIRE_VALID_PORTID(i) ((i < itf_cfg->port_num) && (itf_cfg->ports[i].type == PORT_TYPE_VWIRE))
@@ -0,0 +1,834 @@
+#include <inttypes.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_ptype.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_esp.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+#include <rte_fib.h>
+#include <rte_cryptodev.h>
+#include <rte_ipsec.h>
+#include <rte_ipsec_sad.h>
+#include <rte_ipsec_group.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../prefix.h"
+
+#include "ipsec.h"
+
+#define IPSEC_TBL8_NUM      (1U << 8)
+
+typedef struct {
+    /** collected by the worker, enqueued as runs of the same sa
+     * */
+    struct rte_mbuf *pkts[IPSEC_BURST];
+    ipsec_sa_t *sas[IPSEC_BURST];
+    uint16_t num;
+    uint32_t inflight;
+    uint64_t deadline;
+
+    uint64_t encrypted;
+    uint64_t decrypted;
+    uint64_t bytes;
+    uint64_t busy;              /** no crypto op or queue pair full */
+    uint64_t failed;            /** prepare, crypto or process failed */
+    uint64_t policy;            /** decrypted but not of the tunnel subnets */
+    uint64_t ring_full;
+} __rte_cache_aligned ipsec_lcore_t;
+
+static ipsec_lcore_t ipsec_lcores[RTE_MAX_LCORE];
+static ipsec_tunnel_t *ipsec_tunnels;
+static uint32_t ipsec_tunnel_num;
+static struct rte_ipsec_sad *ipsec_sad;
+static struct rte_fib *ipsec_fib;
+static struct rte_mempool *ipsec_op_pool;
+static struct rte_mempool *ipsec_ses_pool;
+static struct rte_mempool *ipsec_ses_priv_pool;
+static uint8_t ipsec_dev;
+static uint64_t ipsec_flush_cycles;
+static int ipsec_enabled;
+
+MODULE_DECLARE(ipsec) = {
+    .name = "ipsec",
+    .id = MOD_ID_IPSEC,
+    .enabled = true,
+    .log = true,
+    .init = ipsec_init,
+    .proc = ipsec_proc,
+    .conf = NULL,
+    .tick = NULL,
+    .priv = NULL
+};
+
+/** The sa a packet is stolen for, NULL if none
+ * */
+static void
+ipsec_match_burst(struct rte_mbuf **mbufs, uint16_t n, ipsec_sa_t **sas)
+{
+    union rte_ipsec_sad_key keys[n];
+    const union rte_ipsec_sad_key *kp[n];
+    void *found[n];
+    uint32_t dips[n];
+    uint64_t nhs[n];
+    uint16_t in[n], out[n], nin = 0, nout = 0, i;
+    const struct rte_ipv4_hdr *ip4h;
+    const struct rte_esp_hdr *esph;
+    ipsec_tunnel_t *t;
+    packet_t *p;
+    uint32_t off;
+
+    for (i = 0; i < n; i++) {
+        sas[i] = NULL;
+
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!p || !RTE_ETH_IS_IPV4_HDR(p->ptype) || (p->ptype & RTE_PTYPE_TUNNEL_MASK) ||
+            (p->ptype & RTE_PTYPE_L4_MASK) == RTE_PTYPE_L4_FRAG) {
+            continue;
+        }
+
+        if (p->tuple.v4.proto != IPPROTO_ESP) {
+            dips[nout] = rte_be_to_cpu_32(p->tuple.v4.dip);
+            out[nout++] = i;
+            continue;
+        }
+
+        ip4h = rte_pktmbuf_mtod_offset(mbufs[i], const struct rte_ipv4_hdr *, p->l3_off);
+        off = p->l3_off + rte_ipv4_hdr_len(ip4h);
+        if (rte_pktmbuf_data_len(mbufs[i]) < off + sizeof(*esph)) {
+            continue;
+        }
+
+        esph = rte_pktmbuf_mtod_offset(mbufs[i], const struct rte_esp_hdr *, off);
+        keys[nin].v4.spi = esph->spi;
+        keys[nin].v4.dip = p->tuple.v4.dip;
+        keys[nin].v4.sip = p->tuple.v4.sip;
+        kp[nin] = &keys[nin];
+        in[nin++] = i;
+    }
+
+    if (nin && rte_ipsec_sad_lookup(ipsec_sad, kp, found, nin) > 0) {
+        for (i = 0; i < nin; i++) {
+            sas[in[i]] = found[i];
+        }
+    }
+
+    if (nout) {
+        rte_fib_lookup_bulk(ipsec_fib, dips, nhs, nout);
+        for (i = 0; i < nout; i++) {
+            if (!nhs[i]) {
+                continue;
+            }
+
+            t = &ipsec_tunnels[nhs[i] - 1];
+            p = rte_mbuf_to_priv(mbufs[out[i]]);
+            if ((p->tuple.v4.sip & t->local_mask) == t->local_net) {
+                sas[out[i]] = &t->out;
+            }
+        }
+    }
+}
+
+static void
+ipsec_enqueue(ipsec_lcore_t *lc, uint16_t qp, ipsec_sa_t *s, struct rte_mbuf **mb, uint16_t n)
+{
+    struct rte_crypto_op *cop[IPSEC_BURST];
+    uint16_t k, sent, i;
+
+    if (!rte_crypto_op_bulk_alloc(ipsec_op_pool, RTE_CRYPTO_OP_TYPE_SYMMETRIC, cop, n)) {
+        lc->busy += n;
+        rte_pktmbuf_free_bulk(mb, n);
+        return;
+    }
+
+    /** failed mbufs are moved behind the prepared ones
+     * */
+    k = rte_ipsec_pkt_crypto_prepare(&s->ss, mb, cop, n);
+    if (k < n) {
+        lc->failed += n - k;
+        rte_pktmbuf_free_bulk(mb + k, n - k);
+        rte_mempool_put_bulk(ipsec_op_pool, (void **)(cop + k), n - k);
+    }
+
+    sent = rte_cryptodev_enqueue_burst(ipsec_dev, qp, cop, k);
+    lc->inflight += sent;
+
+    if (sent < k) {
+        lc->busy += k - sent;
+        for (i = sent; i < k; i++) {
+            rte_pktmbuf_free(cop[i]->sym->m_src);
+        }
+        rte_mempool_put_bulk(ipsec_op_pool, (void **)(cop + sent), k - sent);
+    }
+}
+
+/** Put the ethernet header of the packet back in front of the IP header
+ * lib/ipsec leaves, the addresses are those the decoder saw
+ * */
+static int
+ipsec_l2_restore(struct rte_mbuf *m)
+{
+    packet_t *p = rte_mbuf_to_priv(m);
+    struct rte_ether_hdr *eh;
+
+    eh = (struct rte_ether_hdr *)rte_pktmbuf_prepend(m, sizeof(*eh));
+    if (!eh || !p) {
+        return -1;
+    }
+
+    rte_ether_addr_copy((struct rte_ether_addr *)p->dmac, &eh->dst_addr);
+    rte_ether_addr_copy((struct rte_ether_addr *)p->smac, &eh->src_addr);
+    eh->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    return 0;
+}
+
+/** Finish the packets of one session, the outer header of encrypted
+ * ones gets its checksum, decrypted ones must match the subnets
+ * */
+static uint16_t
+ipsec_finish(ipsec_lcore_t *lc, struct rte_ipsec_session *ss, struct rte_mbuf **mb, uint16_t n,
+    struct rte_mbuf **out)
+{
+    ipsec_sa_t *s = container_of(ss, ipsec_sa_t, ss);
+    struct rte_ipv4_hdr *ip4h;
+    ipsec_tunnel_t *t;
+    uint16_t k, i, nout = 0;
+
+    t = s->inbound ? container_of(s, ipsec_tunnel_t, in) : container_of(s, ipsec_tunnel_t, out);
+
+    k = rte_ipsec_pkt_process(ss, mb, n);
+    if (k < n) {
+        lc->failed += n - k;
+        rte_pktmbuf_free_bulk(mb + k, n - k);
+    }
+
+    for (i = 0; i < k; i++) {
+        ip4h = rte_pktmbuf_mtod(mb[i], struct rte_ipv4_hdr *);
+
+        if (s->inbound) {
+            if ((ip4h->version_ihl >> 4) != 4 ||
+                (ip4h->src_addr & t->remote_mask) != t->remote_net ||
+                (ip4h->dst_addr & t->local_mask) != t->local_net) {
+                lc->policy ++;
+                rte_pktmbuf_free(mb[i]);
+                continue;
+            }
+            lc->decrypted ++;
+        } else {
+            ip4h->hdr_checksum = 0;
+            ip4h->hdr_checksum = rte_ipv4_cksum(ip4h);
+            lc->encrypted ++;
+        }
+
+        lc->bytes += rte_pktmbuf_pkt_len(mb[i]);
+
+        if (ipsec_l2_restore(mb[i])) {
+            lc->failed ++;
+            rte_pktmbuf_free(mb[i]);
+            continue;
+        }
+
+        out[nout++] = mb[i];
+    }
+
+    return nout;
+}
+
+static void
+ipsec_dequeue(config_t *c, ipsec_lcore_t *lc, uint16_t qp)
+{
+    struct rte_crypto_op *cop[IPSEC_BURST * 2];
+    struct rte_mbuf *mb[IPSEC_BURST * 2], *out[IPSEC_BURST * 2];
+    struct rte_ipsec_group grp[IPSEC_BURST * 2];
+    uint16_t n, ng, i, done = 0, nout = 0, sent;
+
+    n = rte_cryptodev_dequeue_burst(ipsec_dev, qp, cop, RTE_DIM(cop));
+    if (!n) {
+        return;
+    }
+    lc->inflight -= n;
+
+    ng = rte_ipsec_pkt_crypto_group((const struct rte_crypto_op **)(uintptr_t)cop, mb, grp, n);
+    rte_mempool_put_bulk(ipsec_op_pool, (void **)cop, n);
+
+    for (i = 0; i < ng; i++) {
+        nout += ipsec_finish(lc, grp[i].id.ptr, grp[i].m, grp[i].cnt, out + nout);
+        done += grp[i].cnt;
+    }
+
+    /** ops without a session are left behind the groups
+     * */
+    if (done < n) {
+        lc->failed += n - done;
+        rte_pktmbuf_free_bulk(mb + done, n - done);
+    }
+
+    sent = rte_ring_enqueue_burst(c->rx_queues[qp], (void **)out, nout, NULL);
+    if (sent < nout) {
+        lc->ring_full += nout - sent;
+        rte_pktmbuf_free_bulk(out + sent, nout - sent);
+    }
+}
+
+int ipsec_poll(void *config)
+{
+    config_t *c = config;
+    ipsec_lcore_t *lc = &ipsec_lcores[rte_lcore_id()];
+    uint16_t qp = rte_lcore_id() % c->worker_num;
+    uint16_t i, j;
+
+    if (!ipsec_enabled) {
+        return 0;
+    }
+
+    for (i = 0; i < lc->num; i = j) {
+        for (j = i + 1; j < lc->num && lc->sas[j] == lc->sas[i]; j++);
+        ipsec_enqueue(lc, qp, lc->sas[i], &lc->pkts[i], j - i);
+    }
+    lc->num = 0;
+
+    if (lc->inflight) {
+        ipsec_dequeue(c, lc, qp);
+    }
+
+    lc->deadline = rte_get_timer_cycles() + ipsec_flush_cycles;
+    return lc->inflight != 0;
+}
+
+uint16_t ipsec_steal_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    ipsec_lcore_t *lc = &ipsec_lcores[rte_lcore_id()];
+    ipsec_sa_t *sas[n];
+    packet_t *p;
+    uint16_t i, left = 0;
+
+    if (!ipsec_enabled) {
+        return n;
+    }
+
+    ipsec_match_burst(mbufs, n, sas);
+
+    for (i = 0; i < n; i++) {
+        if (!sas[i]) {
+            mbufs[left++] = mbufs[i];
+            continue;
+        }
+
+        /** lib/ipsec wants the IP header first on the way out, and the
+         * lengths of the headers before ESP on the way in
+         * */
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!sas[i]->inbound) {
+            rte_pktmbuf_adj(mbufs[i], p->l3_off);
+            mbufs[i]->l2_len = 0;
+        } else {
+            mbufs[i]->l2_len = p->l3_off;
+        }
+        mbufs[i]->l3_len = rte_ipv4_hdr_len(rte_pktmbuf_mtod_offset(mbufs[i], struct rte_ipv4_hdr *,
+            mbufs[i]->l2_len));
+
+        if (!lc->num) {
+            lc->deadline = rte_get_timer_cycles() + ipsec_flush_cycles;
+        }
+
+        lc->pkts[lc->num] = mbufs[i];
+        lc->sas[lc->num++] = sas[i];
+        if (lc->num == IPSEC_BURST) {
+            ipsec_poll(config);
+        }
+    }
+
+    if ((lc->num || lc->inflight) && rte_get_timer_cycles() > lc->deadline) {
+        ipsec_poll(config);
+    }
+
+    return left;
+}
+
+mod_ret_t ipsec_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (!ipsec_enabled) {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook == MOD_HOOK_IDLE) {
+        ipsec_poll(config);
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook != MOD_HOOK_INGRESS) {
+        return MOD_RET_ACCEPT;
+    }
+
+    return ipsec_steal_burst(config, &mbuf, 1) ? MOD_RET_ACCEPT : MOD_RET_STOLEN;
+}
+
+static int
+ipsec_hex_parse(const char *s, uint8_t *out, int max)
+{
+    int n = 0;
+
+    if (!strncmp(s, "0x", 2)) {
+        s += 2;
+    }
+
+    while (*s) {
+        if (*s == ':') {
+            s ++;
+            continue;
+        }
+
+        if (n == max || !isxdigit((unsigned char)s[0]) || !isxdigit((unsigned char)s[1])) {
+            return -1;
+        }
+
+        out[n++] = (uint8_t)((isdigit((unsigned char)s[0]) ? s[0] - '0' : (tolower((unsigned char)s[0]) - 'a' + 10)) << 4 |
+            (isdigit((unsigned char)s[1]) ? s[1] - '0' : (tolower((unsigned char)s[1]) - 'a' + 10)));
+        s += 2;
+    }
+
+    return n;
+}
+
+/** Crypto transforms of an sa, auth then cipher on the way in and
+ * cipher then auth on the way out
+ * */
+static int
+ipsec_xform_build(ipsec_sa_t *s, int inbound, const char *cipher, const char *auth,
+    int key_len, int auth_key_len, struct rte_ipsec_sa_prm *prm)
+{
+    struct rte_crypto_sym_xform *c = &s->xf[0], *a = &s->xf[1];
+
+    memset(s->xf, 0, sizeof(s->xf));
+
+    if (!strcmp(cipher, "aes-gcm")) {
+        if (key_len != 20 && key_len != 28 && key_len != 36) {
+            printf("aes-gcm key is 16, 24 or 32 bytes and 4 bytes of salt\n");
+            return -1;
+        }
+        key_len -= 4;
+        memcpy(&prm->ipsec_xform.salt, s->key + key_len, sizeof(prm->ipsec_xform.salt));
+
+        c->type = RTE_CRYPTO_SYM_XFORM_AEAD;
+        c->aead.algo = RTE_CRYPTO_AEAD_AES_GCM;
+        c->aead.op = inbound ? RTE_CRYPTO_AEAD_OP_DECRYPT : RTE_CRYPTO_AEAD_OP_ENCRYPT;
+        c->aead.key.data = s->key;
+        c->aead.key.length = key_len;
+        c->aead.iv.offset = IPSEC_IV_OFFSET;
+        c->aead.iv.length = 12;
+        c->aead.digest_length = 16;
+        c->aead.aad_length = 8 + (prm->ipsec_xform.options.esn ? 4 : 0);
+        prm->crypto_xform = c;
+        return 0;
+    }
+
+    c->type = RTE_CRYPTO_SYM_XFORM_CIPHER;
+    c->cipher.op = inbound ? RTE_CRYPTO_CIPHER_OP_DECRYPT : RTE_CRYPTO_CIPHER_OP_ENCRYPT;
+    c->cipher.key.data = s->key;
+    c->cipher.key.length = key_len;
+    c->cipher.iv.offset = IPSEC_IV_OFFSET;
+
+    if (!strcmp(cipher, "aes-cbc") && (key_len == 16 || key_len == 24 || key_len == 32)) {
+        c->cipher.algo = RTE_CRYPTO_CIPHER_AES_CBC;
+        c->cipher.iv.length = 16;
+    } else if (!strcmp(cipher, "null")) {
+        c->cipher.algo = RTE_CRYPTO_CIPHER_NULL;
+        c->cipher.key.length = 0;
+    } else {
+        printf("cipher is aes-gcm, aes-cbc with a key of 16, 24 or 32 bytes, or null\n");
+        return -1;
+    }
+
+    a->type = RTE_CRYPTO_SYM_XFORM_AUTH;
+    a->auth.op = inbound ? RTE_CRYPTO_AUTH_OP_VERIFY : RTE_CRYPTO_AUTH_OP_GENERATE;
+    a->auth.key.data = s->auth_key;
+    a->auth.key.length = auth_key_len;
+
+    if (!strcmp(auth, "sha1-hmac")) {
+        a->auth.algo = RTE_CRYPTO_AUTH_SHA1_HMAC;
+        a->auth.digest_length = 12;
+    } else if (!strcmp(auth, "sha256-hmac")) {
+        a->auth.algo = RTE_CRYPTO_AUTH_SHA256_HMAC;
+        a->auth.digest_length = 16;
+    } else if (!strcmp(auth, "null")) {
+        a->auth.algo = RTE_CRYPTO_AUTH_NULL;
+        a->auth.key.length = 0;
+    } else {
+        printf("auth is sha1-hmac, sha256-hmac or null\n");
+        return -1;
+    }
+
+    if (inbound) {
+        a->next = c;
+        prm->crypto_xform = a;
+    } else {
+        c->next = a;
+        prm->crypto_xform = c;
+    }
+
+    return 0;
+}
+
+static int
+ipsec_sa_init(ipsec_tunnel_t *t, ipsec_sa_t *s, int inbound, json_object *jo)
+{
+    struct rte_ipv4_hdr hdr = {
+        .version_ihl = RTE_IPV4_VHL_DEF,
+        .time_to_live = 64,
+        .next_proto_id = IPPROTO_ESP,
+        .src_addr = inbound ? t->remote : t->local,
+        .dst_addr = inbound ? t->local : t->remote,
+    };
+    struct rte_ipsec_sa_prm prm;
+    struct rte_ipsec_sa *sa;
+    union rte_ipsec_sad_key key;
+    const char *cipher, *auth;
+    json_object *jv;
+    int key_len = 0, auth_key_len = 0, size;
+
+    memset(&prm, 0, sizeof(prm));
+    s->inbound = inbound;
+
+    jv = JV(jo, inbound ? "spi_in" : "spi_out");
+    s->spi = jv ? strtoul(JV_S(jv), NULL, 0) : 0;
+    if (s->spi < 256) {
+        printf("spi of tunnel %u is at least 256\n", t->id);
+        return -1;
+    }
+
+    jv = JV(jo, "cipher");
+    cipher = jv ? JV_S(jv) : "";
+    jv = JV(jo, "auth");
+    auth = jv ? JV_S(jv) : "null";
+
+    jv = JV(jo, inbound ? "key_in" : "key_out");
+    if (jv) {
+        key_len = ipsec_hex_parse(JV_S(jv), s->key, sizeof(s->key));
+    }
+    jv = JV(jo, inbound ? "auth_key_in" : "auth_key_out");
+    if (jv) {
+        auth_key_len = ipsec_hex_parse(JV_S(jv), s->auth_key, sizeof(s->auth_key));
+    }
+    if (key_len < 0 || auth_key_len < 0) {
+        printf("keys of tunnel %u are hex\n", t->id);
+        return -1;
+    }
+
+    prm.userdata = t->id;
+    prm.flags = RTE_IPSEC_SAFLAG_SQN_ATOM;
+    prm.ipsec_xform.spi = s->spi;
+    prm.ipsec_xform.direction = inbound ? RTE_SECURITY_IPSEC_SA_DIR_INGRESS : RTE_SECURITY_IPSEC_SA_DIR_EGRESS;
+    prm.ipsec_xform.proto = RTE_SECURITY_IPSEC_SA_PROTO_ESP;
+    prm.ipsec_xform.mode = RTE_SECURITY_IPSEC_SA_MODE_TUNNEL;
+    prm.ipsec_xform.options.copy_dscp = !inbound;
+    jv = JV(jo, "esn");
+    prm.ipsec_xform.options.esn = jv && JV_I(jv);
+    jv = JV(jo, "replay");
+    prm.ipsec_xform.replay_win_sz = jv ? JV_I(jv) : IPSEC_REPLAY;
+    prm.ipsec_xform.tunnel.type = RTE_SECURITY_IPSEC_TUNNEL_IPV4;
+    prm.ipsec_xform.tunnel.ipv4.src_ip.s_addr = hdr.src_addr;
+    prm.ipsec_xform.tunnel.ipv4.dst_ip.s_addr = hdr.dst_addr;
+    prm.ipsec_xform.tunnel.ipv4.ttl = hdr.time_to_live;
+    prm.tun.hdr_len = sizeof(hdr);
+    prm.tun.hdr_l3_off = 0;
+    prm.tun.next_proto = IPPROTO_IPIP;
+    prm.tun.hdr = &hdr;
+
+    if (ipsec_xform_build(s, inbound, cipher, auth, key_len, auth_key_len, &prm)) {
+        printf("invalid crypto of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    size = rte_ipsec_sa_size(&prm);
+    if (size < 0) {
+        printf("invalid sa of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    sa = rte_zmalloc("ipsec_sa", size, RTE_CACHE_LINE_SIZE);
+    if (!sa || rte_ipsec_sa_init(sa, &prm, size) < 0) {
+        printf("init sa of tunnel %u failed\n", t->id);
+        return -1;
+    }
+
+    s->ss.sa = sa;
+    s->ss.type = RTE_SECURITY_ACTION_TYPE_NONE;
+    s->ss.crypto.dev_id = ipsec_dev;
+    s->ss.crypto.ses = rte_cryptodev_sym_session_create(ipsec_ses_pool);
+    if (!s->ss.crypto.ses ||
+        rte_cryptodev_sym_session_init(ipsec_dev, s->ss.crypto.ses, prm.crypto_xform, ipsec_ses_priv_pool)) {
+        printf("cryptodev does not take the crypto of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    if (rte_ipsec_session_prepare(&s->ss)) {
+        printf("prepare session of tunnel %u failed\n", t->id);
+        return -1;
+    }
+
+    rte_ipsec_telemetry_sa_add(sa);
+
+    if (inbound) {
+        memset(&key, 0, sizeof(key));
+        key.v4.spi = rte_cpu_to_be_32(s->spi);
+        key.v4.dip = t->local;
+        if (rte_ipsec_sad_add(ipsec_sad, &key, RTE_IPSEC_SAD_SPI_DIP, s)) {
+            printf("add sa of tunnel %u failed, spi in use\n", t->id);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+ipsec_subnet_parse(json_object *jo, const char *item, uint32_t *net, uint32_t *mask, uint8_t *depth)
+{
+    uint8_t family, addr[16];
+    json_object *jv;
+
+    jv = JV(jo, item);
+    if (!jv || prefix_parse(JV_S(jv), &family, addr, depth) || family != AF_INET) {
+        return -1;
+    }
+
+    *mask = *depth ? rte_cpu_to_be_32(~0U << (32 - *depth)) : 0;
+    memcpy(net, addr, sizeof(*net));
+    *net &= *mask;
+    return 0;
+}
+
+static int
+ipsec_tunnel_load(ipsec_tunnel_t *t, uint32_t idx, json_object *jo)
+{
+    json_object *jv;
+    uint8_t depth;
+
+    jv = JV(jo, "id");
+    t->id = jv ? (uint32_t)JV_I(jv) : idx;
+
+    jv = JV(jo, "local");
+    if (!jv || inet_pton(AF_INET, JV_S(jv), &t->local) != 1) {
+        printf("invalid local of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    jv = JV(jo, "remote");
+    if (!jv || inet_pton(AF_INET, JV_S(jv), &t->remote) != 1) {
+        printf("invalid remote of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    if (ipsec_subnet_parse(jo, "local_subnet", &t->local_net, &t->local_mask, &depth)) {
+        printf("invalid local_subnet of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    if (ipsec_subnet_parse(jo, "remote_subnet", &t->remote_net, &t->remote_mask, &depth)) {
+        printf("invalid remote_subnet of tunnel %u\n", t->id);
+        return -1;
+    }
+
+    if (rte_fib_add(ipsec_fib, rte_be_to_cpu_32(t->remote_net), depth, idx + 1)) {
+        printf("add remote_subnet of tunnel %u failed\n", t->id);
+        return -1;
+    }
+
+    if (ipsec_sa_init(t, &t->in, 1, jo) || ipsec_sa_init(t, &t->out, 0, jo)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/** One queue pair for each worker, and the pools of sessions and ops
+ * */
+static int
+ipsec_cryptodev_setup(config_t *c, const char *name, uint32_t tunnels)
+{
+    struct rte_cryptodev_config conf = {
+        .socket_id = rte_socket_id(),
+        .nb_queue_pairs = c->worker_num,
+    };
+    struct rte_cryptodev_qp_conf qp_conf = {
+        .nb_descriptors = IPSEC_QP_DESC,
+    };
+    struct rte_cryptodev_info info;
+    char pname[RTE_MEMPOOL_NAMESIZE];
+    int dev, q;
+
+    dev = *name ? rte_cryptodev_get_dev_id(name) : (rte_cryptodev_count() ? 0 : -1);
+    if (dev < 0) {
+        printf("no cryptodev %s, give one to EAL, e.g. --vdev crypto_aesni_mb\n", name);
+        return -1;
+    }
+    ipsec_dev = dev;
+
+    rte_cryptodev_info_get(ipsec_dev, &info);
+    if ((unsigned int)c->worker_num > info.max_nb_queue_pairs) {
+        printf("cryptodev %s has %u queue pairs for %d workers, see max_nb_queue_pairs\n",
+            info.driver_name, info.max_nb_queue_pairs, c->worker_num);
+        return -1;
+    }
+
+    ipsec_ses_pool = rte_cryptodev_sym_session_pool_create(hot_object(HOT_MEMPOOL, pname, sizeof(pname), "ipsec_ses"),
+        2 * tunnels, 0, 0, 0, rte_socket_id());
+    ipsec_ses_priv_pool = rte_mempool_create(hot_object(HOT_MEMPOOL, pname, sizeof(pname), "ipsec_ses_priv"), 2 * tunnels,
+        rte_cryptodev_sym_get_private_session_size(ipsec_dev), 0, 0, NULL, NULL, NULL, NULL, rte_socket_id(), 0);
+    ipsec_op_pool = rte_crypto_op_pool_create(hot_object(HOT_MEMPOOL, pname, sizeof(pname), "ipsec_ops"),
+        RTE_CRYPTO_OP_TYPE_SYMMETRIC, IPSEC_OP_NUM, 128, IPSEC_IV_SIZE, rte_socket_id());
+    if (!ipsec_ses_pool || !ipsec_ses_priv_pool || !ipsec_op_pool) {
+        printf("create ipsec pools failed\n");
+        return -1;
+    }
+
+    if (rte_cryptodev_configure(ipsec_dev, &conf)) {
+        printf("configure cryptodev %s failed\n", info.driver_name);
+        return -1;
+    }
+
+    qp_conf.mp_session = ipsec_ses_pool;
+    qp_conf.mp_session_private = ipsec_ses_priv_pool;
+    for (q = 0; q < c->worker_num; q++) {
+        if (rte_cryptodev_queue_pair_setup(ipsec_dev, q, &qp_conf, rte_socket_id())) {
+            printf("setup queue pair %d of cryptodev %s failed\n", q, info.driver_name);
+            return -1;
+        }
+    }
+
+    if (rte_cryptodev_start(ipsec_dev)) {
+        printf("start cryptodev %s failed\n", info.driver_name);
+        return -1;
+    }
+
+    printf("ipsec on cryptodev %u %s, %d queue pairs\n", ipsec_dev, info.driver_name, c->worker_num);
+    return 0;
+}
+
+static int
+ipsec_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    char local[INET_ADDRSTRLEN], remote[INET_ADDRSTRLEN];
+    ipsec_lcore_t *lc;
+    ipsec_tunnel_t *t;
+    unsigned int lcore_id;
+    uint32_t i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!ipsec_enabled) {
+        CLI_PRINT(cli, "ipsec disabled");
+        return 0;
+    }
+
+    for (i = 0; i < ipsec_tunnel_num; i++) {
+        t = &ipsec_tunnels[i];
+        inet_ntop(AF_INET, &t->local, local, sizeof(local));
+        inet_ntop(AF_INET, &t->remote, remote, sizeof(remote));
+        CLI_PRINT(cli, "tunnel %u %s <-> %s spi in %u out %u", t->id, local, remote, t->in.spi, t->out.spi);
+    }
+
+    /** one line per worker to see how the load spreads
+     * */
+    RTE_LCORE_FOREACH(lcore_id) {
+        lc = &ipsec_lcores[lcore_id];
+        if (!lc->encrypted && !lc->decrypted && !lc->busy && !lc->failed) {
+            continue;
+        }
+
+        CLI_PRINT(cli, "lcore %u encrypted %"PRIu64" decrypted %"PRIu64" bytes %"PRIu64" in flight %u",
+            lcore_id, lc->encrypted, lc->decrypted, lc->bytes, lc->inflight);
+        CLI_PRINT(cli, "    busy %"PRIu64" failed %"PRIu64" policy %"PRIu64" ring full %"PRIu64,
+            lc->busy, lc->failed, lc->policy, lc->ring_full);
+    }
+
+    return 0;
+}
+
+int ipsec_init(void *config)
+{
+    config_t *c = config;
+    struct rte_ipsec_sad_conf sad_conf = {
+        .socket_id = rte_socket_id(),
+        .flags = 0,
+    };
+    struct rte_fib_conf fib_conf = {
+        .type = RTE_FIB_DIR24_8,
+        .default_nh = 0,
+        .max_routes = IPSEC_MAX_TUNNELS,
+        .dir24_8 = {
+            .nh_sz = RTE_FIB_DIR24_8_2B,
+            .num_tbl8 = IPSEC_TBL8_NUM,
+        },
+    };
+    json_object *jr, *ja, *jv;
+    char name[64];
+    int i, num, ret = -1;
+
+    jr = JR(CONFIG_PATH, "ipsec.json");
+    if (!jr) {
+        printf("no ipsec.json, ipsec disabled\n");
+        return 0;
+    }
+
+    /** sessions and sequence numbers stay with the running process
+     * */
+    if (hot_takeover()) {
+        printf("ipsec disabled on takeover\n");
+        ret = 0;
+        goto done;
+    }
+
+    num = JA(jr, "tunnels", &ja);
+    if (num <= 0 || num > IPSEC_MAX_TUNNELS) {
+        printf("ipsec.json has 1 to %u tunnels\n", IPSEC_MAX_TUNNELS);
+        goto done;
+    }
+
+    jv = JV(jr, "crypto_dev");
+    if (ipsec_cryptodev_setup(c, jv ? JV_S(jv) : "", num)) {
+        goto done;
+    }
+
+    sad_conf.max_sa[RTE_IPSEC_SAD_SPI_DIP] = num;
+    ipsec_sad = rte_ipsec_sad_create(hot_object(HOT_SAD, name, sizeof(name), "ipsec_sad"), &sad_conf);
+    ipsec_fib = rte_fib_create(hot_object(HOT_FIB, name, sizeof(name), "ipsec_fib"), rte_socket_id(), &fib_conf);
+    ipsec_tunnels = rte_zmalloc("ipsec_tunnels", sizeof(ipsec_tunnel_t) * num, RTE_CACHE_LINE_SIZE);
+    if (!ipsec_sad || !ipsec_fib || !ipsec_tunnels) {
+        printf("create ipsec tables failed\n");
+        goto done;
+    }
+
+    for (i = 0; i < num; i++) {
+        if (ipsec_tunnel_load(&ipsec_tunnels[i], i, JO(ja, i))) {
+            goto done;
+        }
+        ipsec_tunnel_num ++;
+    }
+
+    ipsec_flush_cycles = rte_get_timer_hz() / 1000000 * IPSEC_FLUSH_US;
+    ipsec_enabled = 1;
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "ipsec", ipsec_show, "ipsec tunnels and crypto of each worker");
+    }
+
+    ret = 0;
+
+done:
+    JR_FREE(jr);
+    return ret;
+}
+
+// file format utf-8
+// ident using space
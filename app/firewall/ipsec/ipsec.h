@@ -0,0 +1,102 @@
+#ifndef _M_IPSEC_H_
+#define _M_IPSEC_H_
+
+#include <rte_mbuf.h>
+#include <rte_ipsec.h>
+
+#include "../module.h"
+#include "../interface/interface.h"
+
+/** Site to site IPsec tunnels, ESP in tunnel mode over IPv4
+ *
+ * ipsec.json, optional, names a cryptodev given to EAL by --vdev or a
+ * PCI device, the first one if not set, and the tunnels:
+ *
+ *   {"crypto_dev": "crypto_aesni_mb",
+ *    "tunnels": [{"id": "1", "local": "203.0.113.1", "remote": "198.51.100.1",
+ *                 "local_subnet": "172.16.0.0/16", "remote_subnet": "10.1.0.0/16",
+ *                 "spi_in": "1001", "spi_out": "2001", "cipher": "aes-gcm",
+ *                 "key_in": "<hex key and salt>", "key_out": "<hex key and salt>"}]}
+ *
+ * "cipher" is "aes-gcm" with 4 bytes of salt after the key, "aes-cbc"
+ * with an "auth" of "sha1-hmac" or "sha256-hmac" and "auth_key_in" and
+ * "auth_key_out", or "null" with "auth" "null" for the crypto_null PMD.
+ * "replay" sets the replay window, 64 by default, "esn" turns extended
+ * sequence numbers on.
+ *
+ * Both directions are stolen at INGRESS, after acl, which therefore sees
+ * the ESP of the tunnel on the way in and the clear text on the way out:
+ *
+ *   inbound    ESP for "local" whose SPI is found in the SAD of lib/ipsec
+ *   outbound   IPv4 from "local_subnet" to "remote_subnet", the tunnel is
+ *              found by a bulk rte_fib lookup of the destinations
+ *
+ * Each worker collects what it steals into bursts per SA, prepares the
+ * crypto ops with rte_ipsec_pkt_crypto_prepare and enqueues them into a
+ * queue pair of its own, without waiting. Completed ops are dequeued
+ * after each enqueue, when the worker idles and at the latest after
+ * IPSEC_FLUSH_US, finished by rte_ipsec_pkt_process and put
+ * back into the rx ring of the worker with an ethernet header, to pass
+ * all hooks again as the decrypted or the encrypted packet. Decrypted
+ * packets must be from "remote_subnet" to "local_subnet", else dropped.
+ *
+ * Outbound SAs are shared by all workers with atomic sequence numbers.
+ * An inbound SA is only processed by the worker RSS hashes its outer
+ * addresses to. A takeover, see hot.h, runs without tunnels.
+ * */
+
+#define IPSEC_MAX_TUNNELS   1024
+#define IPSEC_BURST         32
+#define IPSEC_FLUSH_US      100
+#define IPSEC_QP_DESC       2048
+#define IPSEC_OP_NUM        (1U << 15)
+#define IPSEC_KEY_MAX       64
+#define IPSEC_REPLAY        64
+
+/** IV of the crypto op, right after its symmetric part
+ * */
+#define IPSEC_IV_OFFSET     (sizeof(struct rte_crypto_op) + sizeof(struct rte_crypto_sym_op))
+#define IPSEC_IV_SIZE       16
+
+typedef struct {
+    struct rte_ipsec_session ss;
+    struct rte_crypto_sym_xform xf[2];
+    uint8_t key[IPSEC_KEY_MAX];
+    uint8_t auth_key[IPSEC_KEY_MAX];
+    uint32_t spi;
+    uint8_t inbound;
+} ipsec_sa_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t local;             /** network order, as the subnets */
+    uint32_t remote;
+    uint32_t local_net;
+    uint32_t local_mask;
+    uint32_t remote_net;
+    uint32_t remote_mask;
+    ipsec_sa_t in;
+    ipsec_sa_t out;
+} ipsec_tunnel_t;
+
+/** Steal the packets of tunnels out of mbufs, the others are moved to
+ * the front in their order
+ * @return
+ *  number of packets left in mbufs
+ * */
+uint16_t ipsec_steal_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+/** Enqueue what the worker collected and put completed packets back
+ * into its rx ring
+ * @return
+ *  non-zero while the worker has packets in flight
+ * */
+int ipsec_poll(void *config);
+
+int ipsec_init(void *config);
+mod_ret_t ipsec_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+
+#endif
+
+// file format utf-8
+// ident using space
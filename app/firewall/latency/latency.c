@@ -0,0 +1,312 @@
+#include <inttypes.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_telemetry.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../worker.h"
+#include "../hist.h"
+#include "../cli.h"
+
+#include "latency.h"
+
+typedef struct {
+    hist_t *ports;              /** one per port, written by this lcore at TX */
+    uint32_t gen;               /** reset generation applied */
+} __rte_cache_aligned latency_lcore_t;
+
+volatile int latency_enabled;
+int latency_ts_off = -1;
+uint64_t latency_ts_flag;
+
+static latency_lcore_t latency_lcores[RTE_MAX_LCORE];
+static volatile uint32_t latency_gen;
+static uint16_t latency_port_num;
+static uint64_t latency_hz;
+
+MODULE_DECLARE(latency) = {
+    .name = "latency",
+    .id = MOD_ID_LATENCY,
+    .enabled = true,
+    .log = true,
+    .init = latency_init,
+    .proc = NULL,
+    .conf = NULL,
+    .tick = NULL,
+    .priv = NULL
+};
+
+void latency_account_slow(struct rte_mbuf **pkts, uint16_t n, uint16_t port)
+{
+    latency_lcore_t *ll = &latency_lcores[rte_lcore_id()];
+    uint64_t now;
+    hist_t *h;
+    uint16_t i;
+
+    if (!ll->ports || port >= latency_port_num) {
+        return;
+    }
+
+    /** reset is asked by management and done by the only writer
+     * */
+    if (unlikely(ll->gen != latency_gen)) {
+        memset(ll->ports, 0, sizeof(hist_t) * latency_port_num);
+        ll->gen = latency_gen;
+    }
+
+    h = &ll->ports[port];
+    now = rte_rdtsc();
+
+    for (i = 0; i < n; i++) {
+        if (pkts[i]->ol_flags & latency_ts_flag) {
+            hist_add(h, now - *RTE_MBUF_DYNFIELD(pkts[i], latency_ts_off, rte_mbuf_timestamp_t *));
+        }
+    }
+}
+
+static void
+latency_port_merge(uint16_t port, hist_t *h)
+{
+    unsigned int lcore_id;
+
+    hist_reset(h);
+    RTE_LCORE_FOREACH(lcore_id) {
+        if (latency_lcores[lcore_id].ports && latency_lcores[lcore_id].gen == latency_gen) {
+            hist_merge(h, &latency_lcores[lcore_id].ports[port]);
+        }
+    }
+}
+
+static void
+latency_module_merge(int id, hist_t *h)
+{
+    unsigned int lcore_id;
+
+    hist_reset(h);
+    RTE_LCORE_FOREACH(lcore_id) {
+        if (module_stats[lcore_id][id].hist) {
+            hist_merge(h, module_stats[lcore_id][id].hist);
+        }
+    }
+}
+
+static int
+latency_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    static hist_t h;
+    double us = 1e6 / latency_hz;
+    module_t *m;
+    uint16_t port;
+    int id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    CLI_PRINT(cli, "latency %s, module profile %s", latency_enabled ? "enabled" : "disabled",
+        modules_profile ? "on" : "off");
+
+    CLI_PRINT(cli, "%-8s %14s %10s %10s %10s %10s", "port", "packets", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (port = 0; port < latency_port_num; port++) {
+        latency_port_merge(port, &h);
+        CLI_PRINT(cli, "%-8u %14"PRIu64" %10.2f %10.2f %10.2f %10.2f", port, h.total,
+            hist_percentile(&h, 50) * us, hist_percentile(&h, 99) * us,
+            hist_percentile(&h, 99.9) * us, h.max * us);
+    }
+
+    if (!modules_profile) {
+        return 0;
+    }
+
+    CLI_PRINT(cli, "%-16s %14s %10s %10s %10s %10s", "module", "packets", "p50 cyc", "p99 cyc", "p99.9 cyc", "max cyc");
+    MODULE_FOREACH(m, id) {
+        if (!m) {
+            continue;
+        }
+
+        latency_module_merge(id, &h);
+        if (!h.total) {
+            continue;
+        }
+
+        CLI_PRINT(cli, "%-16s %14"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64, m->name, h.total,
+            hist_percentile(&h, 50), hist_percentile(&h, 99), hist_percentile(&h, 99.9), h.max);
+    }
+
+    return 0;
+}
+
+static int
+latency_enable(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+    latency_enabled = 1;
+    return 0;
+}
+
+static int
+latency_disable(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+    latency_enabled = 0;
+    return 0;
+}
+
+static int
+latency_reset(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+    latency_gen ++;
+    return 0;
+}
+
+/** Module histograms have no writer while profile is off, so they
+ * are cleared right before turning it on
+ * */
+static int
+latency_profile(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    const char *sw = CLI_OPT_V(cli, "switch");
+    unsigned int lcore_id;
+    int id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!sw || (strcmp(sw, "on") && strcmp(sw, "off"))) {
+        CLI_PRINT(cli, "switch must be on or off");
+        return -1;
+    }
+
+    if (!strcmp(sw, "off")) {
+        modules_profile = 0;
+        return 0;
+    }
+
+    if (modules_profile) {
+        return 0;
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        for (id = 0; id <= max_module_id; id++) {
+            module_stats[lcore_id][id].calls = 0;
+            module_stats[lcore_id][id].cycles = 0;
+            if (module_stats[lcore_id][id].hist) {
+                hist_reset(module_stats[lcore_id][id].hist);
+            }
+        }
+    }
+
+    rte_smp_wmb();
+    modules_profile = 1;
+    return 0;
+}
+
+static int
+latency_telemetry(__rte_unused const char *cmd, __rte_unused const char *params, struct rte_tel_data *d)
+{
+    hist_t *h;
+    struct rte_tel_data *pd;
+    double ns = 1e9 / latency_hz;
+    char name[16];
+    uint16_t port;
+
+    h = malloc(sizeof(*h));
+    if (!h) {
+        return -1;
+    }
+
+    rte_tel_data_start_dict(d);
+    for (port = 0; port < latency_port_num; port++) {
+        pd = rte_tel_data_alloc();
+        if (!pd) {
+            break;
+        }
+
+        latency_port_merge(port, h);
+        rte_tel_data_start_dict(pd);
+        rte_tel_data_add_dict_u64(pd, "packets", h->total);
+        rte_tel_data_add_dict_u64(pd, "p50_ns", hist_percentile(h, 50) * ns);
+        rte_tel_data_add_dict_u64(pd, "p99_ns", hist_percentile(h, 99) * ns);
+        rte_tel_data_add_dict_u64(pd, "p999_ns", hist_percentile(h, 99.9) * ns);
+        rte_tel_data_add_dict_u64(pd, "max_ns", h->max * ns);
+
+        snprintf(name, sizeof(name), "port%u", port);
+        rte_tel_data_add_dict_container(d, name, pd, 0);
+    }
+
+    free(h);
+    return 0;
+}
+
+static void
+latency_cli_register(config_t *c)
+{
+    struct cli_command *cmd, *profile;
+
+    cmd = CLI_CMD_C(c->cli_def, NULL, "latency", NULL, "rx to tx latency");
+    CLI_CMD_C(c->cli_def, cmd, "enable", latency_enable, "stamp and account packets");
+    CLI_CMD_C(c->cli_def, cmd, "disable", latency_disable, "stop stamping and accounting");
+    CLI_CMD_C(c->cli_def, cmd, "reset", latency_reset, "clear port histograms");
+
+    profile = CLI_CMD_C(c->cli_def, cmd, "profile", latency_profile, "cycles of each module per packet");
+    CLI_OPT_A(profile, "switch", "on or off");
+
+    CLI_CMD_C(c->cli_def, c->cli_show, "latency", latency_show, "latency percentiles per port and module");
+}
+
+int latency_init(void *config)
+{
+    config_t *c = config;
+    unsigned int lcore_id;
+    int id;
+
+    latency_hz = rte_get_tsc_hz();
+    latency_port_num = c->port_num;
+
+    if (rte_mbuf_dyn_rx_timestamp_register(&latency_ts_off, &latency_ts_flag)) {
+        printf("register rx timestamp dynfield failed\n");
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        latency_lcores[lcore_id].ports = rte_zmalloc_socket("latency_ports", sizeof(hist_t) * latency_port_num,
+            RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        if (!latency_lcores[lcore_id].ports) {
+            printf("alloc latency histograms of lcore %u failed\n", lcore_id);
+            return -1;
+        }
+
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        for (id = 0; id <= max_module_id; id++) {
+            if (!modules[id]) {
+                continue;
+            }
+
+            module_stats[lcore_id][id].hist = rte_zmalloc_socket("latency_module", sizeof(hist_t),
+                RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+            if (!module_stats[lcore_id][id].hist) {
+                printf("alloc module histogram of lcore %u failed\n", lcore_id);
+                return -1;
+            }
+        }
+    }
+
+    rte_telemetry_register_cmd("/firewall/latency", latency_telemetry,
+        "Returns rx to tx latency percentiles per port. No parameters");
+
+    if (c->cli_def) {
+        latency_cli_register(c);
+    }
+
+    latency_enabled = 1;
+    return 0;
+}
+
+// file format utf-8
+// ident using space
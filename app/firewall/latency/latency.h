@@ -0,0 +1,59 @@
+#ifndef _M_LATENCY_H_
+#define _M_LATENCY_H_
+
+#include <rte_cycles.h>
+#include <rte_mbuf_dyn.h>
+
+#include "../module.h"
+
+/** RX to TX latency histograms, per port and per module
+ *
+ * interface_proc_recv() stamps a burst with one TSC read into the rx
+ * timestamp dynfield, interface_proc_send() adds now - stamp of every
+ * packet to the histogram of its output port, kept by each TX lcore
+ * so no write is shared. Percentiles come from merging lcores on read,
+ * by 'show latency' or telemetry '/firewall/latency'.
+ *
+ * 'latency profile on' also keeps a histogram of cycles spent in each
+ * module per packet, see modules_proc().
+ * */
+
+extern volatile int latency_enabled;
+extern int latency_ts_off;
+extern uint64_t latency_ts_flag;
+
+static inline void
+latency_stamp(struct rte_mbuf **pkts, uint16_t n)
+{
+    uint64_t now;
+    uint16_t i;
+
+    if (!latency_enabled) {
+        return;
+    }
+
+    now = rte_rdtsc();
+    for (i = 0; i < n; i++) {
+        *RTE_MBUF_DYNFIELD(pkts[i], latency_ts_off, rte_mbuf_timestamp_t *) = now;
+        pkts[i]->ol_flags |= latency_ts_flag;
+    }
+}
+
+void latency_account_slow(struct rte_mbuf **pkts, uint16_t n, uint16_t port);
+
+/** Account a burst about to be sent on port
+ * */
+static inline void
+latency_account(struct rte_mbuf **pkts, uint16_t n, uint16_t port)
+{
+    if (latency_enabled) {
+        latency_account_slow(pkts, n, port);
+    }
+}
+
+int latency_init(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
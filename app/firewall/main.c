@@ -3,6 +3,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 
 #include <rte_common.h>
@@ -10,6 +11,7 @@
 #include <rte_eal.h>
 #include <rte_launch.h>
 #include <rte_ethdev.h>
+#include <rte_memzone.h>
 #include <rte_per_lcore.h>
 
 #include "config.h"
@@ -17,8 +19,14 @@
 #include "worker.h"
 #include "packet.h"
 #include "cli.h"
+#include "hot.h"
+#include "ctl.h"
 #include "interface/interface.h"
 
+/** Period of the management loop, modules_tick() included
+ * */
+#define MGMT_TICK_MS 100
+
 extern config_t config_A, config_B;
 extern int _config_I[MAX_WORKER_NUM], config_I;
 
@@ -57,7 +65,17 @@ main_loop(__rte_unused void *arg)
     _m_cfg = (config_t *)arg;
     _config_I[lcore_id] = 0;
 
+    rte_rcu_qsbr_thread_register(worker_qsv, lcore_id);
+    rte_rcu_qsbr_thread_online(worker_qsv, lcore_id);
+
     while (!force_quit) {
+        rte_rcu_qsbr_quiescent(worker_qsv, lcore_id);
+
+        if (unlikely(!hot_running)) {
+            hot_idle(lcore_id);
+            continue;
+        }
+
         if (_m_cfg->switch_mark) {
             _m_cfg = config_switch(_m_cfg, lcore_id);
         }
@@ -69,6 +87,8 @@ main_loop(__rte_unused void *arg)
         else WORKER(_m_cfg);
     }
 
+    rte_rcu_qsbr_thread_offline(worker_qsv, lcore_id);
+    rte_rcu_qsbr_thread_unregister(worker_qsv, lcore_id);
     return 0;
 }
 
@@ -78,6 +98,12 @@ mgmt_loop(__rte_unused config_t *c)
     config_t *_c = c;
 
     while (!force_quit) {
+        /** A parked process does nothing but wait to quit, see hot.h
+         * */
+        if (hot_tick(_c)) {
+            continue;
+        }
+
         /** When a reload mark set, a config switch process started, included steps below:
          * 1. reload config into 'free' one, eg. working with _A now then reload witch _B
          * 2. tell worker to switch config. eg. working with _A now then switch to _B
@@ -92,13 +118,19 @@ mgmt_loop(__rte_unused config_t *c)
                 cli_set_context(_c->cli_def, _c);
             }
         }
-        _cli_run(_c);
+        modules_tick(_c);
+        rte_delay_us_sleep(MGMT_TICK_MS * 1000);
     }
 }
 
 int main(int argc, char **argv)
 {
-    int lcore_id;
+    const char *log_file = "/opt/firewall/log/firewall.log";
+    uint32_t log_level = RTE_LOG_DEBUG;
+    int lcore_id, i;
+    int takeover = 0;
+    int cli_proc = 0;
+    int cli_client = 0;
     int ret = 0;
 
     printf("==== firewall built at 2024 01 01 =====\n");
@@ -112,9 +144,47 @@ int main(int argc, char **argv)
     argc -= ret;
     argv += ret;
 
+    /** Parse application arguments
+     * --graph: run workers on lib/graph nodes instead of module hooks
+     * --config <dir>: read json files from dir instead of CONFIG_PATH
+     * --log <file>: write log to file
+     * --perf: benchmark with synthetic traffic, see perf/perf.h
+     * --takeover: replace the running process, see hot.h
+     * --cli-proc: leave the command line to a cli process, see ctl.h
+     * --cli: be that cli process
+     * */
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--graph")) {
+            m_cfg->graph_mode = 1;
+        } else if (!strcmp(argv[i], "--config") && i + 1 < argc) {
+            snprintf(config_path, sizeof(config_path), "%s", argv[++i]);
+        } else if (!strcmp(argv[i], "--log") && i + 1 < argc) {
+            log_file = argv[++i];
+        } else if (!strcmp(argv[i], "--perf")) {
+            m_cfg->perf_mode = 1;
+            /** per packet debug logs would be all we measure
+             * */
+            log_level = RTE_LOG_ERR;
+        } else if (!strcmp(argv[i], "--takeover")) {
+            takeover = 1;
+        } else if (!strcmp(argv[i], "--cli-proc")) {
+            cli_proc = 1;
+        } else if (!strcmp(argv[i], "--cli")) {
+            cli_client = 1;
+        }
+    }
+
+    /** A takeover is a secondary, which never hears from a cli process,
+     * nor can it listen while one holds the cli port; refuse before
+     * anything is acquired
+     * */
+    if (takeover && (cli_proc || rte_memzone_lookup(CTL_ZONE_NAME))) {
+        rte_exit(EXIT_FAILURE, "--takeover does not go with --cli-proc, see ctl.h\n");
+    }
+
     /** Open debug log stream
      * */
-    ret = _rte_log_init("/opt/firewall/log/firewall.log", RTE_LOG_DEBUG);
+    ret = _rte_log_init(log_file, log_level);
     if (ret) {
         rte_exit(EXIT_FAILURE, "rte init log failed\n");
     }
@@ -125,9 +195,21 @@ int main(int argc, char **argv)
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    /** Init mbuf pool
+    /** A cli process runs the command line only
+     * */
+    if (cli_client) {
+        ret = ctl_client(m_cfg);
+        rte_eal_cleanup();
+        return ret ? EXIT_FAILURE : 0;
+    }
+
+    /** Init mbuf pool, a takeover keeps the one the NICs are filled from
      * */
-    m_cfg->pktmbuf_pool = rte_pktmbuf_pool_create("mbuf_pool", 8192, 256, sizeof(packet_t), 128 + 2048, rte_socket_id());
+    if (takeover) {
+        m_cfg->pktmbuf_pool = rte_mempool_lookup("mbuf_pool");
+    } else {
+        m_cfg->pktmbuf_pool = rte_pktmbuf_pool_create("mbuf_pool", 8192, 256, sizeof(packet_t), 128 + 2048, rte_socket_id());
+    }
     if (!m_cfg->pktmbuf_pool) {
         rte_exit(EXIT_FAILURE, "create pktmbuf pool failed\n");
     }
@@ -181,6 +263,14 @@ int main(int argc, char **argv)
         }
     }
 
+    /** Create the memif ports of interface.json, other ports are
+     * given to EAL
+     * */
+    ret = interface_probe(m_cfg);
+    if (ret) {
+        rte_exit(EXIT_FAILURE, "interface probe erorr\n");
+    }
+
     /** Port num check
      * */
     m_cfg->port_num = rte_eth_dev_count_avail();
@@ -188,6 +278,14 @@ int main(int argc, char **argv)
         rte_exit(EXIT_FAILURE, "need 2 port at least");
     }
 
+    /** Init hot restart state
+     * must before anything named is created
+     * */
+    ret = hot_init(m_cfg, takeover);
+    if (ret) {
+        rte_exit(EXIT_FAILURE, "hot init erorr\n");
+    }
+
     /** Init worker
      * create RX and TX queues for mbuf flow
      * */
@@ -211,9 +309,33 @@ int main(int argc, char **argv)
     modules_load();
     ret = modules_init(m_cfg);
     if (ret) {
+        hot_release();
         rte_exit(EXIT_FAILURE, "module init erorr\n");
     }
 
+    /** Take the ports over once everything is ready, the running
+     * process forwards until then
+     * */
+    if (takeover) {
+        ret = hot_acquire();
+        if (ret) {
+            hot_release();
+            rte_exit(EXIT_FAILURE, "hot takeover erorr\n");
+        }
+    }
+
+    /** Sessions are served off the lcores, by a control thread or by
+     * a cli process
+     * */
+    if (cli_proc) {
+        ret = ctl_init(m_cfg);
+    } else {
+        ret = _cli_start(m_cfg);
+    }
+    if (ret) {
+        rte_exit(EXIT_FAILURE, "cli start erorr\n");
+    }
+
     /** Start up worker loop on each lcore
      * */
     rte_eal_mp_remote_launch(main_loop, (void *)m_cfg, SKIP_MAIN);
@@ -1,3 +1,6 @@
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+
 #include "module.h"
 
 // module secetion start and end point, see module_section.lds
@@ -8,6 +11,9 @@ module_t __module_end__;
 module_t* modules[MAX_MODULE_NUM] = {0};
 int max_module_id = -1;
 
+int modules_profile = 0;
+module_stats_t module_stats[RTE_MAX_LCORE][MAX_MODULE_NUM];
+
 
 int modules_load(void)
 {
@@ -52,6 +58,18 @@ int modules_conf(void *config)
     return 0;
 }
 
+void modules_tick(void *config)
+{
+    __rte_unused module_t *m;
+    __rte_unused int id;
+
+    MODULE_FOREACH(m, id) {
+        if (m && m->tick && m->enabled) {
+            m->tick(config);
+        }
+    }
+}
+
 int modules_proc(void *config, struct rte_mbuf *pkt, mod_hook_t hook)
 {
     module_t *m;
@@ -61,7 +79,20 @@ int modules_proc(void *config, struct rte_mbuf *pkt, mod_hook_t hook)
         mod_ret_t ret;
 
         if (m && m->proc && m->enabled) {
-            ret = m->proc(config, pkt, hook);
+            if (unlikely(modules_profile && pkt)) {
+                module_stats_t *st = &module_stats[rte_lcore_id()][id];
+                uint64_t start = rte_rdtsc();
+
+                ret = m->proc(config, pkt, hook);
+                start = rte_rdtsc() - start;
+                st->cycles += start;
+                st->calls ++;
+                if (st->hist) {
+                    hist_add(st->hist, start);
+                }
+            } else {
+                ret = m->proc(config, pkt, hook);
+            }
 
             if (ret == MOD_RET_STOLEN) {
                 return ret;
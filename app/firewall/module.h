@@ -11,6 +11,8 @@
 #include <rte_mbuf.h>
 #include <rte_log.h>
 
+#include "hist.h"
+
 #define __module__ __attribute((section(".module_section")))
 
 typedef enum {
@@ -18,6 +20,23 @@ typedef enum {
     MOD_ID_INTERFACE,
     MOD_ID_DECODER,
     MOD_ID_ACL,
+    MOD_ID_GRAPH,
+    MOD_ID_SYNPROXY,
+    MOD_ID_NAT,
+    MOD_ID_FLOW,
+    MOD_ID_CAPTURE,
+    MOD_ID_PERF,
+    MOD_ID_LATENCY,
+    MOD_ID_BPF,
+    MOD_ID_DPI,
+    MOD_ID_ROUTE,
+    MOD_ID_QOS,
+    MOD_ID_HA,
+    MOD_ID_SCALE,
+    MOD_ID_PUNT,
+    MOD_ID_URPF,
+    MOD_ID_GEO,
+    MOD_ID_IPSEC,
 } mod_id_t;
 
 typedef enum {
@@ -30,6 +49,7 @@ typedef enum {
     MOD_HOOK_LOCALOUT,
     MOD_HOOK_EGRESS,
     MOD_HOOK_SEND,
+    MOD_HOOK_IDLE,          /** worker found its rx queue empty, mbuf is NULL */
 } mod_hook_t;
 
 typedef enum {
@@ -40,6 +60,7 @@ typedef enum {
 typedef mod_ret_t (*mod_func_t)(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
 typedef int (*mod_init_t)(void *config);
 typedef int (*mod_conf_t)(void *config);
+typedef void (*mod_tick_t)(void *config);
 
 #pragma pack(1)
 
@@ -52,15 +73,27 @@ typedef struct {
     mod_func_t proc;            /** process function */
     mod_conf_t conf;            /** config function */
     void *priv;                 /** private use */
-    char reserved[20];          /** reserved */
+    mod_tick_t tick;            /** periodic function on management core */
+    char reserved[12];          /** reserved */
 } module_t;
 
 #pragma pack()
 
+typedef struct {
+    uint64_t calls;             /** proc calls with a packet */
+    uint64_t cycles;            /** cycles spent in those calls */
+    hist_t *hist;               /** cycles per call, NULL if not kept */
+} module_stats_t;
+
 #define MAX_MODULE_NUM 128
 extern int max_module_id;
 extern module_t* modules[MAX_MODULE_NUM];
 
+/** Per lcore cycle accounting of each module, on when modules_profile set
+ * */
+extern int modules_profile;
+extern module_stats_t module_stats[RTE_MAX_LCORE][MAX_MODULE_NUM];
+
 #define MODULE_DECLARE(m) module_t m __module__
 
 #define MODULE_REGISTER(m) \
@@ -80,6 +113,7 @@ int modules_load(void);
 int modules_init(void *config);
 int modules_proc(void *config, struct rte_mbuf *pkt, mod_hook_t hook);
 int modules_conf(void *config);
+void modules_tick(void *config);
 
 #endif
 
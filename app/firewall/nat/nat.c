@@ -0,0 +1,911 @@
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_ring_elem.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../worker.h"
+#include "../csum.h"
+#include "../prefix.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../ha/ha.h"
+#include "../hot.h"
+
+#include "nat.h"
+
+#define NAT_REWRITE_SRC 0
+#define NAT_REWRITE_DST 1
+
+typedef struct {
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sp;
+    uint16_t dp;
+    uint8_t proto;
+    uint8_t pad[3];
+} nat_key_t;
+
+typedef struct nat_conn_s nat_conn_t;
+
+typedef struct {
+    nat_key_t key;
+    uint32_t addr;          /** new address, network order */
+    uint16_t port;          /** new port, network order */
+    uint8_t rewrite;
+    nat_conn_t *conn;
+} nat_entry_t;
+
+struct nat_conn_s {
+    nat_entry_t orig;
+    nat_entry_t reply;
+    volatile uint64_t last_seen;
+    uint16_t ext_port;      /** allocated port, host order, 0 for dnat */
+    uint16_t owner;         /** lcore owning ext_port */
+    volatile uint8_t closing;
+};
+
+/** A connection as synchronized to the standby, see ha.h
+ * */
+typedef struct {
+    nat_key_t key;          /** of the original direction */
+    uint32_t addr;
+    uint16_t port;
+    uint8_t rewrite;
+    uint8_t pad;
+} nat_sync_t;
+
+typedef struct {
+    uint64_t translated;
+    uint64_t snat_created;
+    uint64_t dnat_created;
+    uint64_t port_exhausted;
+    uint64_t port_in_use;
+    uint64_t conn_full;
+    uint64_t synced;        /** created from the ha peer */
+    uint64_t sync_miss;     /** ha deletes of unknown conns */
+} __rte_cache_aligned nat_stats_t;
+
+static nat_config_t nat_cfg_A, nat_cfg_B;
+static nat_stats_t nat_stats[RTE_MAX_LCORE];
+static struct rte_ring *nat_ports[RTE_MAX_LCORE];
+static struct rte_hash *nat_table;
+static struct rte_mempool *nat_pool;
+static uint16_t nat_port_min = 1024, nat_port_max = UINT16_MAX;
+static uint64_t nat_hz;
+
+/** conns deleted from hash, freed once workers passed token
+ * */
+static nat_conn_t *nat_pending_conn[NAT_AGE_BATCH];
+static int32_t nat_pending_pos[NAT_AGE_BATCH * 2];
+static uint32_t nat_pending_num;
+static uint64_t nat_pending_token;
+static int nat_was_standby;
+
+MODULE_DECLARE(nat) = {
+    .name = "nat",
+    .id = MOD_ID_NAT,
+    .enabled = true,
+    .log = true,
+    .init = nat_init,
+    .proc = nat_proc,
+    .conf = nat_conf,
+    .tick = nat_tick,
+    .priv = NULL
+};
+
+/** The hash is shared with the next process of a hot restart, whose
+ * hash_func would be another address, so it is never called: every
+ * key is hashed here
+ * */
+static inline hash_sig_t
+nat_hash(const nat_key_t *k)
+{
+    return rte_hash_crc(k, sizeof(*k), 0);
+}
+
+static inline void
+nat_key_set(nat_key_t *k, uint8_t proto, uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp)
+{
+    k->sip = sip;
+    k->dip = dip;
+    k->sp = sp;
+    k->dp = dp;
+    k->proto = proto;
+    k->pad[0] = k->pad[1] = k->pad[2] = 0;
+}
+
+static inline int
+nat_eligible(packet_t *p)
+{
+    return p->is_v4 && p->l4_off &&
+        (p->tuple.v4.proto == IPPROTO_TCP || p->tuple.v4.proto == IPPROTO_UDP);
+}
+
+/** Rewrite address and port of one side, checksums are updated
+ * incrementally rather than recomputed
+ * */
+static inline void
+nat_rewrite(struct rte_mbuf *mbuf, packet_t *p, nat_entry_t *e)
+{
+    struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv4_hdr *, p->l3_off);
+    void *l4 = rte_pktmbuf_mtod_offset(mbuf, void *, p->l4_off);
+    uint32_t *addr;
+    uint16_t *port, *cksum, old_port;
+    uint32_t old_addr;
+
+    if (e->rewrite == NAT_REWRITE_SRC) {
+        addr = &ip->src_addr;
+        port = &((struct rte_tcp_hdr *)l4)->src_port;
+        p->tuple.v4.sip = e->addr;
+        p->tuple.v4.sp = e->port;
+    } else {
+        addr = &ip->dst_addr;
+        port = &((struct rte_tcp_hdr *)l4)->dst_port;
+        p->tuple.v4.dip = e->addr;
+        p->tuple.v4.dp = e->port;
+    }
+
+    old_addr = *addr;
+    old_port = *port;
+    *addr = e->addr;
+    *port = e->port;
+
+    ip->hdr_checksum = csum_replace4(ip->hdr_checksum, old_addr, e->addr);
+
+    if (p->tuple.v4.proto == IPPROTO_TCP) {
+        cksum = &((struct rte_tcp_hdr *)l4)->cksum;
+    } else {
+        cksum = &((struct rte_udp_hdr *)l4)->dgram_cksum;
+        if (!*cksum) {
+            return;
+        }
+    }
+
+    *cksum = csum_replace4(*cksum, old_addr, e->addr);
+    *cksum = csum_replace2(*cksum, old_port, e->port);
+
+    if (p->tuple.v4.proto == IPPROTO_UDP && !*cksum) {
+        *cksum = 0xffff;
+    }
+}
+
+static inline void
+nat_sync(nat_conn_t *conn, uint8_t op)
+{
+    nat_sync_t ns;
+
+    ns.key = conn->orig.key;
+    ns.addr = conn->orig.addr;
+    ns.port = conn->orig.port;
+    ns.rewrite = conn->orig.rewrite;
+    ns.pad = 0;
+    ha_push(MOD_ID_NAT, op, &ns, sizeof(ns));
+}
+
+static inline void
+nat_touch(nat_conn_t *conn, packet_t *p)
+{
+    conn->last_seen = rte_get_timer_cycles();
+    if ((p->tcp_flags & (RTE_TCP_RST_FLAG | RTE_TCP_FIN_FLAG)) && !conn->closing) {
+        conn->closing = 1;
+        nat_sync(conn, HA_OP_UPDATE);
+    }
+}
+
+static nat_conn_t *
+nat_conn_add(nat_stats_t *st, nat_key_t *orig, uint8_t orig_rewrite, uint32_t addr, uint16_t port)
+{
+    nat_conn_t *conn;
+
+    if (rte_mempool_get(nat_pool, (void **)&conn)) {
+        st->conn_full ++;
+        return NULL;
+    }
+
+    conn->orig.key = *orig;
+    conn->orig.rewrite = orig_rewrite;
+    conn->orig.addr = addr;
+    conn->orig.port = port;
+    conn->orig.conn = conn;
+
+    /** reply comes back with translated side swapped, and is
+     * rewritten to the original address on the other side
+     * */
+    conn->reply.conn = conn;
+    if (orig_rewrite == NAT_REWRITE_SRC) {
+        nat_key_set(&conn->reply.key, orig->proto, orig->dip, addr, orig->dp, port);
+        conn->reply.rewrite = NAT_REWRITE_DST;
+        conn->reply.addr = orig->sip;
+        conn->reply.port = orig->sp;
+    } else {
+        nat_key_set(&conn->reply.key, orig->proto, addr, orig->sip, port, orig->sp);
+        conn->reply.rewrite = NAT_REWRITE_SRC;
+        conn->reply.addr = orig->dip;
+        conn->reply.port = orig->dp;
+    }
+
+    conn->ext_port = 0;
+    conn->owner = rte_lcore_id();
+    conn->closing = 0;
+    conn->last_seen = rte_get_timer_cycles();
+
+    /** a port of this lcore may still be held by a connection taken
+     * over from the ha peer, adding would replace its reply
+     * */
+    if (rte_hash_lookup_with_hash(nat_table, &conn->reply.key, nat_hash(&conn->reply.key)) >= 0) {
+        rte_mempool_put(nat_pool, conn);
+        st->port_in_use ++;
+        return NULL;
+    }
+
+    if (rte_hash_add_key_with_hash_data(nat_table, &conn->reply.key, nat_hash(&conn->reply.key), &conn->reply)) {
+        rte_mempool_put(nat_pool, conn);
+        st->conn_full ++;
+        return NULL;
+    }
+
+    if (rte_hash_add_key_with_hash_data(nat_table, &conn->orig.key, nat_hash(&conn->orig.key), &conn->orig)) {
+        int32_t pos = rte_hash_del_key_with_hash(nat_table, &conn->reply.key, nat_hash(&conn->reply.key));
+        if (pos >= 0) {
+            /** no packet can match the reply key yet, the first packet
+             * of the connection has not left
+             * */
+            rte_hash_free_key_with_position(nat_table, pos);
+        }
+        rte_mempool_put(nat_pool, conn);
+        st->conn_full ++;
+        return NULL;
+    }
+
+    nat_sync(conn, HA_OP_CREATE);
+    return conn;
+}
+
+static mod_ret_t
+nat_proc_prerouting(config_t *config, struct rte_mbuf *mbuf)
+{
+    nat_config_t *nc = config->nat_cfg;
+    nat_stats_t *st;
+    nat_entry_t *e;
+    nat_conn_t *conn;
+    nat_rule_t *r;
+    nat_key_t key;
+    packet_t *p;
+    uint32_t dip;
+    int i;
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!p) {
+        return MOD_RET_ACCEPT;
+    }
+
+    p->nat = NULL;
+
+    if (!nc || !nat_eligible(p)) {
+        return MOD_RET_ACCEPT;
+    }
+
+    st = &nat_stats[rte_lcore_id()];
+    nat_key_set(&key, p->tuple.v4.proto, p->tuple.v4.sip, p->tuple.v4.dip, p->tuple.v4.sp, p->tuple.v4.dp);
+
+    if (rte_hash_lookup_with_hash_data(nat_table, &key, nat_hash(&key), (void **)&e) >= 0) {
+        nat_touch(e->conn, p);
+        if (e->rewrite == NAT_REWRITE_DST) {
+            nat_rewrite(mbuf, p, e);
+            st->translated ++;
+        } else {
+            p->nat = e;
+        }
+        return MOD_RET_ACCEPT;
+    }
+
+    dip = rte_be_to_cpu_32(p->tuple.v4.dip);
+    for (i = 0; i < nc->dnat_num; i++) {
+        r = &nc->dnat[i];
+        if ((dip & r->mask) != r->addr) continue;
+        if (r->proto && r->proto != p->tuple.v4.proto) continue;
+        if (r->port && rte_cpu_to_be_16(r->port) != p->tuple.v4.dp) continue;
+
+        conn = nat_conn_add(st, &key, NAT_REWRITE_DST, r->to_addr, r->to_port ? r->to_port : p->tuple.v4.dp);
+        if (!conn) {
+            rte_pktmbuf_free(mbuf);
+            return MOD_RET_STOLEN;
+        }
+
+        st->dnat_created ++;
+        nat_touch(conn, p);
+        nat_rewrite(mbuf, p, &conn->orig);
+        st->translated ++;
+        break;
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static mod_ret_t
+nat_proc_postrouting(config_t *config, struct rte_mbuf *mbuf)
+{
+    nat_config_t *nc = config->nat_cfg;
+    unsigned int lcore_id = rte_lcore_id();
+    nat_stats_t *st = &nat_stats[lcore_id];
+    nat_entry_t *e;
+    nat_conn_t *conn;
+    nat_rule_t *r = NULL;
+    nat_key_t key;
+    packet_t *p;
+    uint32_t sip, port = 0;
+    int i;
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!p) {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (p->nat) {
+        nat_rewrite(mbuf, p, p->nat);
+        p->nat = NULL;
+        st->translated ++;
+        return MOD_RET_ACCEPT;
+    }
+
+    if (!nc || !nc->snat_num || !nat_eligible(p)) {
+        return MOD_RET_ACCEPT;
+    }
+
+    sip = rte_be_to_cpu_32(p->tuple.v4.sip);
+    for (i = 0; i < nc->snat_num; i++) {
+        if ((sip & nc->snat[i].mask) == nc->snat[i].addr) {
+            r = &nc->snat[i];
+            break;
+        }
+    }
+
+    if (!r) {
+        return MOD_RET_ACCEPT;
+    }
+
+    nat_key_set(&key, p->tuple.v4.proto, p->tuple.v4.sip, p->tuple.v4.dip, p->tuple.v4.sp, p->tuple.v4.dp);
+
+    if (rte_hash_lookup_with_hash_data(nat_table, &key, nat_hash(&key), (void **)&e) >= 0) {
+        nat_touch(e->conn, p);
+        if (e->rewrite == NAT_REWRITE_SRC) {
+            nat_rewrite(mbuf, p, e);
+            st->translated ++;
+        }
+        return MOD_RET_ACCEPT;
+    }
+
+    /** port slice of this lcore, no one else dequeues from it
+     * */
+    if (!nat_ports[lcore_id] || rte_ring_dequeue_elem(nat_ports[lcore_id], &port, sizeof(port))) {
+        st->port_exhausted ++;
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    /** the management core gives aged ports back to the same ring,
+     * both ends enqueue as multi producers, see nat_port_init()
+     * */
+    conn = nat_conn_add(st, &key, NAT_REWRITE_SRC, r->to_addr, rte_cpu_to_be_16(port));
+    if (!conn) {
+        rte_ring_mp_enqueue_elem(nat_ports[lcore_id], &port, sizeof(port));
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    conn->ext_port = port;
+    st->snat_created ++;
+    nat_touch(conn, p);
+    nat_rewrite(mbuf, p, &conn->orig);
+    st->translated ++;
+    return MOD_RET_ACCEPT;
+}
+
+mod_ret_t nat_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (hook == MOD_HOOK_PREROUTING) {
+        return nat_proc_prerouting(config, mbuf);
+    }
+
+    if (hook == MOD_HOOK_POSTROUTING) {
+        return nat_proc_postrouting(config, mbuf);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static int
+nat_json_load(nat_config_t *nc, int init)
+{
+    json_object *jr = NULL, *ja, *jo, *jv;
+    uint32_t addr, mask;
+    int i, num, lo, hi;
+    int ret = 0;
+
+    memset(nc, 0, sizeof(*nc));
+    nc->tcp_timeout = 300;
+    nc->udp_timeout = 60;
+
+    jr = JR(CONFIG_PATH, "nat.json");
+    if (!jr) {
+        printf("no nat.json, nat disabled\n");
+        return 0;
+    }
+
+    jv = JV(jr, "tcp_timeout");
+    if (jv) nc->tcp_timeout = JV_I(jv);
+
+    jv = JV(jr, "udp_timeout");
+    if (jv) nc->udp_timeout = JV_I(jv);
+
+    /** port pools are built once, a new range takes effect on restart
+     * */
+    jv = JV(jr, "port_range");
+    if (jv && init) {
+        if (sscanf(JV_S(jv), "%d-%d", &lo, &hi) != 2 || lo <= 0 || hi > UINT16_MAX || lo > hi) {
+            printf("invalid nat port range %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+        nat_port_min = lo;
+        nat_port_max = hi;
+    }
+
+    #define NAT_JV(item) \
+        jv = JV(jo, item); \
+        if (!jv) { \
+            printf("parse %s failed\n", item); \
+            ret = -1; \
+            goto done; \
+        }
+
+    num = JA(jr, "snat", &ja);
+    for (i = 0; i < num && i < MAX_NAT_RULE_NUM; i++) {
+        nat_rule_t *r = &nc->snat[nc->snat_num];
+        jo = JO(ja, i);
+
+        NAT_JV("id");
+        r->id = JV_I(jv);
+
+        NAT_JV("src");
+        if (prefix_parse4(JV_S(jv), &r->addr, &r->mask)) {
+            printf("invalid snat src %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+
+        NAT_JV("to");
+        if (prefix_parse4(JV_S(jv), &addr, &mask)) {
+            printf("invalid snat to %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+        r->to_addr = rte_cpu_to_be_32(addr);
+
+        nc->snat_num ++;
+    }
+
+    num = JA(jr, "dnat", &ja);
+    for (i = 0; i < num && i < MAX_NAT_RULE_NUM; i++) {
+        nat_rule_t *r = &nc->dnat[nc->dnat_num];
+        jo = JO(ja, i);
+
+        NAT_JV("id");
+        r->id = JV_I(jv);
+
+        NAT_JV("dip");
+        if (prefix_parse4(JV_S(jv), &r->addr, &r->mask)) {
+            printf("invalid dnat dip %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+
+        NAT_JV("dp");
+        r->port = JV_I(jv);
+
+        NAT_JV("proto");
+        r->proto = JV_I(jv);
+
+        NAT_JV("to");
+        if (prefix_parse4(JV_S(jv), &addr, &mask)) {
+            printf("invalid dnat to %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+        r->to_addr = rte_cpu_to_be_32(addr);
+
+        jv = JV(jo, "to_port");
+        r->to_port = jv ? rte_cpu_to_be_16(JV_I(jv)) : 0;
+
+        nc->dnat_num ++;
+    }
+
+    #undef NAT_JV
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int nat_conf(void *config)
+{
+    config_t *c = config;
+    nat_config_t *nc;
+
+    nc = (c->nat_cfg == &nat_cfg_A) ? &nat_cfg_B : &nat_cfg_A;
+    if (nat_json_load(nc, !c->nat_cfg)) {
+        printf("nat json load failed\n");
+        return -1;
+    }
+
+    c->nat_cfg = nc;
+    return 0;
+}
+
+/** Free conns no worker can hold any more, callers check the token
+ * or know the workers parked
+ * */
+static void
+nat_pending_free(void)
+{
+    nat_conn_t *conn;
+    uint32_t i, port;
+
+    for (i = 0; i < nat_pending_num; i++) {
+        conn = nat_pending_conn[i];
+        if (nat_pending_pos[i * 2] >= 0) {
+            rte_hash_free_key_with_position(nat_table, nat_pending_pos[i * 2]);
+        }
+        if (nat_pending_pos[i * 2 + 1] >= 0) {
+            rte_hash_free_key_with_position(nat_table, nat_pending_pos[i * 2 + 1]);
+        }
+        if (conn->ext_port) {
+            port = conn->ext_port;
+            rte_ring_mp_enqueue_elem(nat_ports[conn->owner], &port, sizeof(port));
+        }
+        rte_mempool_put(nat_pool, conn);
+    }
+    nat_pending_num = 0;
+}
+
+void nat_tick(void *config)
+{
+    config_t *c = config;
+    nat_config_t *nc = c->nat_cfg;
+    nat_entry_t *e;
+    nat_conn_t *conn;
+    const void *key;
+    void *data;
+    uint64_t now, timeout;
+    uint32_t iter = 0, i, n = 0;
+    int32_t pos;
+
+    if (!nat_table || !nc) {
+        return;
+    }
+
+    if (nat_pending_num && !rte_rcu_qsbr_check(worker_qsv, nat_pending_token, false)) {
+        return;
+    }
+    nat_pending_free();
+
+    now = rte_get_timer_cycles();
+
+    /** connections of a standby are aged by its peer, they start
+     * afresh once it takes over
+     * */
+    if (ha_standby()) {
+        nat_was_standby = 1;
+        return;
+    }
+
+    if (nat_was_standby) {
+        nat_was_standby = 0;
+        while (rte_hash_iterate(nat_table, &key, &data, &iter) >= 0) {
+            ((nat_entry_t *)data)->conn->last_seen = now;
+        }
+        return;
+    }
+
+    /** collect first, deleting while iterating may skip entries
+     * */
+    while (n < NAT_AGE_BATCH && rte_hash_iterate(nat_table, &key, &data, &iter) >= 0) {
+        e = data;
+        conn = e->conn;
+        if (e != &conn->orig) {
+            continue;
+        }
+
+        if (conn->closing) {
+            timeout = 10;
+        } else {
+            timeout = (conn->orig.key.proto == IPPROTO_TCP) ? nc->tcp_timeout : nc->udp_timeout;
+        }
+
+        if (now - conn->last_seen < timeout * nat_hz) {
+            continue;
+        }
+
+        nat_pending_conn[n++] = conn;
+    }
+
+    for (i = 0; i < n; i++) {
+        conn = nat_pending_conn[i];
+        pos = rte_hash_del_key_with_hash(nat_table, &conn->orig.key, nat_hash(&conn->orig.key));
+        nat_pending_pos[i * 2] = pos;
+        pos = rte_hash_del_key_with_hash(nat_table, &conn->reply.key, nat_hash(&conn->reply.key));
+        nat_pending_pos[i * 2 + 1] = pos;
+        nat_sync(conn, HA_OP_DELETE);
+    }
+    nat_pending_num = n;
+
+    if (n) {
+        nat_pending_token = rte_rcu_qsbr_start(worker_qsv);
+    }
+}
+
+/** Connections of the active node applied on the standby, they own no
+ * port slice, a delete goes through the pending list as aging does and
+ * waits for the workers when the list is full, it is never dropped
+ * */
+static void
+nat_sync_apply(const ha_rec_t *recs, uint16_t n)
+{
+    nat_stats_t *st = &nat_stats[rte_lcore_id()];
+    nat_sync_t ns;
+    nat_entry_t *e;
+    nat_conn_t *conn;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        if (recs[i].len != sizeof(nat_sync_t)) {
+            continue;
+        }
+
+        memcpy(&ns, recs[i].data, sizeof(ns));
+
+        if (rte_hash_lookup_with_hash_data(nat_table, &ns.key, nat_hash(&ns.key), (void **)&e) < 0) {
+            if (recs[i].op == HA_OP_CREATE && nat_conn_add(st, &ns.key, ns.rewrite, ns.addr, ns.port)) {
+                st->synced ++;
+            } else if (recs[i].op == HA_OP_DELETE) {
+                st->sync_miss ++;
+            }
+            continue;
+        }
+
+        conn = e->conn;
+        if (recs[i].op == HA_OP_UPDATE) {
+            conn->closing = 1;
+            conn->last_seen = rte_get_timer_cycles();
+        } else if (recs[i].op == HA_OP_DELETE && e == &conn->orig) {
+            if (nat_pending_num == NAT_AGE_BATCH) {
+                rte_rcu_qsbr_synchronize(worker_qsv, RTE_QSBR_THRID_INVALID);
+                nat_pending_free();
+            }
+            nat_pending_conn[nat_pending_num] = conn;
+            nat_pending_pos[nat_pending_num * 2] = rte_hash_del_key_with_hash(nat_table, &conn->orig.key,
+                nat_hash(&conn->orig.key));
+            nat_pending_pos[nat_pending_num * 2 + 1] = rte_hash_del_key_with_hash(nat_table, &conn->reply.key,
+                nat_hash(&conn->reply.key));
+            nat_pending_num ++;
+            nat_pending_token = rte_rcu_qsbr_start(worker_qsv);
+        }
+    }
+}
+
+static int
+nat_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+    nat_config_t *nc = c->nat_cfg;
+    nat_stats_t sum;
+    unsigned int lcore_id;
+    int i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (nc) {
+        CLI_PRINT(cli, "snat rules %u dnat rules %u tcp timeout %u udp timeout %u",
+            nc->snat_num, nc->dnat_num, nc->tcp_timeout, nc->udp_timeout);
+    }
+
+    memset(&sum, 0, sizeof(sum));
+    RTE_LCORE_FOREACH(lcore_id) {
+        sum.translated += nat_stats[lcore_id].translated;
+        sum.snat_created += nat_stats[lcore_id].snat_created;
+        sum.dnat_created += nat_stats[lcore_id].dnat_created;
+        sum.port_exhausted += nat_stats[lcore_id].port_exhausted;
+        sum.conn_full += nat_stats[lcore_id].conn_full;
+        sum.port_in_use += nat_stats[lcore_id].port_in_use;
+        sum.synced += nat_stats[lcore_id].synced;
+        sum.sync_miss += nat_stats[lcore_id].sync_miss;
+
+        if (nat_ports[lcore_id]) {
+            CLI_PRINT(cli, "lcore %u free ports %u", lcore_id, rte_ring_count(nat_ports[lcore_id]));
+        }
+    }
+
+    CLI_PRINT(cli, "translated     %"PRIu64, sum.translated);
+    CLI_PRINT(cli, "snat created   %"PRIu64, sum.snat_created);
+    CLI_PRINT(cli, "dnat created   %"PRIu64, sum.dnat_created);
+    CLI_PRINT(cli, "port exhausted %"PRIu64, sum.port_exhausted);
+    CLI_PRINT(cli, "conn full      %"PRIu64, sum.conn_full);
+    CLI_PRINT(cli, "port in use    %"PRIu64, sum.port_in_use);
+    CLI_PRINT(cli, "ha synced      %"PRIu64, sum.synced);
+    CLI_PRINT(cli, "ha sync miss   %"PRIu64, sum.sync_miss);
+    CLI_PRINT(cli, "connections    %d", rte_hash_count(nat_table) / 2);
+
+    for (i = 0; nc && i < nc->snat_num; i++) {
+        CLI_PRINT(cli, "snat %u src %08x/%08x to %08x", nc->snat[i].id,
+            nc->snat[i].addr, nc->snat[i].mask, rte_be_to_cpu_32(nc->snat[i].to_addr));
+    }
+
+    return 0;
+}
+
+/** Split [nat_port_min, nat_port_max] into one slice per worker lcore
+ * */
+static int
+nat_port_init(config_t *c)
+{
+    char name[RTE_RING_NAMESIZE];
+    unsigned int lcore_id, workers = 0, idx = 0;
+    uint32_t total, slice, port, first, last;
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (worker_lcore(c, lcore_id)) workers ++;
+    }
+
+    if (!workers) {
+        return 0;
+    }
+
+    total = nat_port_max - nat_port_min + 1;
+    slice = total / workers;
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        first = nat_port_min + idx * slice;
+        last = (idx == workers - 1) ? nat_port_max : first + slice - 1;
+        idx ++;
+
+        snprintf(name, sizeof(name), "nat_ports_%u", lcore_id);
+        if (hot_takeover()) {
+            nat_ports[lcore_id] = rte_ring_lookup(name);
+            if (!nat_ports[lcore_id]) {
+                printf("lookup nat port ring %s failed\n", name);
+                return -1;
+            }
+            continue;
+        }
+
+        /** a worker dequeues, and enqueues back what it fails to use
+         * while the management core enqueues aged ports, so two producers;
+         * they use the mp calls, a ring of a process taken over may still
+         * have RING_F_SP_ENQ
+         * */
+        nat_ports[lcore_id] = rte_ring_create_elem(name, sizeof(uint32_t), last - first + 1,
+            rte_lcore_to_socket_id(lcore_id), RING_F_SC_DEQ | RING_F_EXACT_SZ);
+        if (!nat_ports[lcore_id]) {
+            printf("create nat port ring %s failed\n", name);
+            return -1;
+        }
+
+        for (port = first; port <= last; port++) {
+            rte_ring_enqueue_elem(nat_ports[lcore_id], &port, sizeof(port));
+        }
+    }
+
+    return 0;
+}
+
+/** The last tick deleted conns, the lcores are parked now and the
+ * next process knows nothing of them
+ * */
+static void
+nat_park(void)
+{
+    nat_pending_free();
+}
+
+/** Connections, ports and the table outlive a hot restart, a takeover
+ * attaches to those left by the running process
+ * */
+static int
+nat_attach(void)
+{
+    if (hot_layout("nat_conn_t", sizeof(nat_conn_t)) ||
+        hot_layout("nat_key_t", sizeof(nat_key_t))) {
+        return -1;
+    }
+
+    if (!hot_takeover()) {
+        return 0;
+    }
+
+    nat_table = rte_hash_find_existing("nat_table");
+    nat_pool = rte_mempool_lookup("nat_pool");
+    if (!nat_table || !nat_pool) {
+        printf("lookup nat table failed\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int nat_init(void *config)
+{
+    config_t *c = config;
+    struct rte_hash_parameters hash_params = {
+        .name = "nat_table",
+        .entries = MAX_NAT_CONN_NUM * 2,
+        .key_len = sizeof(nat_key_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = rte_socket_id(),
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF | RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD,
+    };
+
+    if (nat_conf(c)) {
+        printf("nat conf failed\n");
+        return -1;
+    }
+
+    nat_hz = rte_get_timer_hz();
+
+    if (nat_attach()) {
+        printf("nat attach failed\n");
+        return -1;
+    }
+
+    if (!nat_table) {
+        nat_table = rte_hash_create(&hash_params);
+    }
+    if (!nat_table) {
+        printf("create nat table failed\n");
+        return -1;
+    }
+
+    if (!nat_pool) {
+        nat_pool = rte_mempool_create("nat_pool", MAX_NAT_CONN_NUM - 1, sizeof(nat_conn_t),
+            256, 0, NULL, NULL, NULL, NULL, rte_socket_id(), 0);
+    }
+    if (!nat_pool) {
+        printf("create nat conn pool failed\n");
+        return -1;
+    }
+
+    if (nat_port_init(c)) {
+        printf("nat port init failed\n");
+        return -1;
+    }
+
+    ha_register(MOD_ID_NAT, nat_sync_apply);
+    hot_park_register(nat_park);
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "nat", nat_show, "nat statistics");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
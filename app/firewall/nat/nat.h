@@ -0,0 +1,50 @@
+#ifndef _M_NAT_H_
+#define _M_NAT_H_
+
+#include "../module.h"
+
+/** Source and destination NAT for IPv4 TCP/UDP
+ *
+ * PREROUTING rewrites destination (DNAT, and replies of SNAT),
+ * POSTROUTING rewrites source (SNAT, and replies of DNAT).
+ * Each connection owns two keys in one lock-free hash, one per
+ * direction, so a packet costs one probe.
+ *
+ * The external port range is split into one slice per worker lcore,
+ * each slice is a single-producer/single-consumer ring of free ports:
+ * the worker takes ports, the management core gives them back when
+ * a connection times out, no lock on either side.
+ * */
+
+#define MAX_NAT_RULE_NUM    64
+#define MAX_NAT_CONN_NUM    (1U << 20)
+#define NAT_AGE_BATCH       4096
+
+typedef struct {
+    uint32_t id;
+    uint32_t addr;          /** match address, host order */
+    uint32_t mask;          /** match mask, host order */
+    uint16_t port;          /** match dst port of dnat, host order, 0 for any */
+    uint8_t proto;          /** match proto of dnat, 0 for any */
+    uint32_t to_addr;       /** translated address, network order */
+    uint16_t to_port;       /** translated port of dnat, network order, 0 for unchanged */
+} nat_rule_t;
+
+typedef struct {
+    nat_rule_t snat[MAX_NAT_RULE_NUM];
+    nat_rule_t dnat[MAX_NAT_RULE_NUM];
+    uint16_t snat_num;
+    uint16_t dnat_num;
+    uint32_t tcp_timeout;   /** seconds */
+    uint32_t udp_timeout;   /** seconds */
+} nat_config_t;
+
+int nat_init(void *config);
+mod_ret_t nat_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int nat_conf(void *config);
+void nat_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
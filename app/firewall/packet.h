@@ -37,7 +37,24 @@ typedef struct {
         ip6_tuple_t v6;
     } tuple;
 
-    uint8_t reserved[191];
+    uint16_t l3_off;        /** offset of (inner) l3 header */
+    uint16_t l4_off;        /** offset of (inner) l4 header, 0 if none */
+    uint8_t tcp_flags;
+
+    void *nat;              /** nat entry found at PREROUTING for POSTROUTING */
+    uint32_t acl_rule;      /** matched acl rule id, 0 if none */
+    uint16_t nh;            /** route next hop found at PREROUTING for POSTROUTING, 0 if none */
+    uint8_t qos_tc;         /** qos traffic class of the matched acl rule plus 1, 0 if none */
+
+    /** geo tags of source and destination, 0 if none, keys of acl as well,
+     * the countries and the asns form 4 consecutive bytes each
+     * */
+    uint16_t scountry;
+    uint16_t dcountry;
+    uint32_t sasn;
+    uint32_t dasn;
+
+    uint8_t reserved[159];
 } packet_t;
 
 #pragma pack()
@@ -0,0 +1,547 @@
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_random.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../worker.h"
+#include "../hist.h"
+#include "../prefix.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../graph/graph.h"
+
+#include "perf.h"
+
+#define PERF_OUT(cli, fmt, ...) \
+    do { \
+        if (cli) CLI_PRINT(cli, fmt, ##__VA_ARGS__); \
+        else printf(fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+
+typedef struct {
+    uint8_t hdr[PERF_HDR_MAX];          /** ether, ip and l4 header */
+    uint16_t hdr_len;
+    uint16_t port;                      /** input port */
+    uint8_t is_v6;
+    uint8_t proto;
+} perf_flow_t;
+
+typedef struct {
+    uint64_t packets;
+    hist_t latency;                     /** cycles from generation to egress */
+} __rte_cache_aligned perf_lcore_t;
+
+extern volatile bool force_quit;
+
+volatile int perf_running;
+
+static volatile int perf_generating;
+static perf_config_t perf_cfg;
+static perf_flow_t *perf_flows;
+static perf_lcore_t perf_lcores[RTE_MAX_LCORE];
+static struct rte_mempool *perf_pool;
+static int perf_ts_off = -1;
+static uint64_t perf_ts_flag;
+static uint64_t perf_hz;
+static uint64_t perf_start, perf_stop;
+static uint64_t perf_credit, perf_last, perf_cost;
+static uint64_t perf_seq;
+static uint64_t perf_generated;
+static uint64_t perf_nomem;
+static uint64_t perf_backpressure;
+
+MODULE_DECLARE(perf) = {
+    .name = "perf",
+    .id = MOD_ID_PERF,
+    .enabled = true,
+    .log = true,
+    .init = perf_init,
+    .proc = perf_proc,
+    .conf = NULL,
+    .tick = perf_tick,
+    .priv = NULL
+};
+
+/** Build one packet of flow f with total length len
+ * */
+static inline void
+perf_fill(struct rte_mbuf *m, perf_flow_t *f, uint16_t len)
+{
+    uint8_t *data = rte_pktmbuf_mtod(m, uint8_t *);
+    uint16_t l3_len = len - sizeof(struct rte_ether_hdr);
+    uint16_t l4_off, l4_len;
+    packet_t *p;
+
+    rte_memcpy(data, f->hdr, f->hdr_len);
+    m->data_len = m->pkt_len = len;
+
+    if (f->is_v6) {
+        struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(data + sizeof(struct rte_ether_hdr));
+        l4_off = sizeof(struct rte_ether_hdr) + sizeof(*ip6);
+        l4_len = l3_len - sizeof(*ip6);
+        ip6->payload_len = rte_cpu_to_be_16(l4_len);
+    } else {
+        struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(data + sizeof(struct rte_ether_hdr));
+        l4_off = sizeof(struct rte_ether_hdr) + sizeof(*ip);
+        l4_len = l3_len - sizeof(*ip);
+        ip->total_length = rte_cpu_to_be_16(l3_len);
+        ip->hdr_checksum = 0;
+        ip->hdr_checksum = rte_ipv4_cksum(ip);
+    }
+
+    if (f->proto == IPPROTO_UDP) {
+        ((struct rte_udp_hdr *)(data + l4_off))->dgram_len = rte_cpu_to_be_16(l4_len);
+    }
+
+    *RTE_MBUF_DYNFIELD(m, perf_ts_off, rte_mbuf_timestamp_t *) = rte_rdtsc();
+    m->ol_flags |= perf_ts_flag;
+
+    p = rte_mbuf_to_priv(m);
+    p->iport = f->port;
+}
+
+/** Generate on the RX role, flow i always goes to worker queue
+ * i % worker_num like RSS would do
+ * */
+static void
+perf_generate(config_t *c)
+{
+    perf_config_t *pc = &perf_cfg;
+    struct rte_mbuf *pkts[PERF_BURST];
+    uint64_t now, budget;
+    uint32_t per_queue, idx;
+    int q, i, n, sent;
+
+    now = rte_rdtsc();
+
+    if (now >= perf_stop) {
+        perf_generating = 0;
+        return;
+    }
+
+    budget = (uint64_t)PERF_BURST * c->worker_num;
+    if (pc->rate) {
+        perf_credit += now - perf_last;
+        perf_last = now;
+        if (perf_credit > perf_cost * budget) {
+            perf_credit = perf_cost * budget;
+        }
+        budget = perf_credit / perf_cost;
+        perf_credit -= budget * perf_cost;
+    }
+
+    per_queue = pc->flows / c->worker_num;
+
+    for (q = 0; q < c->worker_num && budget; q++) {
+        n = RTE_MIN(budget, (uint64_t)PERF_BURST);
+        if (rte_pktmbuf_alloc_bulk(perf_pool, pkts, n)) {
+            perf_nomem += n;
+            continue;
+        }
+
+        for (i = 0; i < n; i++) {
+            idx = (perf_seq % per_queue) * c->worker_num + q;
+            perf_fill(pkts[i], &perf_flows[idx],
+                RTE_MAX(pc->sizes[perf_seq % PERF_TABLE_SIZE], perf_flows[idx].hdr_len));
+            perf_seq ++;
+        }
+
+        sent = rte_ring_enqueue_burst(worker_rx_ring(c, q), (void **)pkts, n, NULL);
+        if (sent < n) {
+            rte_pktmbuf_free_bulk(&pkts[sent], n - sent);
+            perf_backpressure += n - sent;
+        }
+
+        perf_generated += sent;
+        budget -= n;
+    }
+}
+
+void perf_packet_slow(struct rte_mbuf *mbuf)
+{
+    perf_lcore_t *pl = &perf_lcores[rte_lcore_id()];
+
+    pl->packets ++;
+    if (mbuf->ol_flags & perf_ts_flag) {
+        hist_add(&pl->latency, rte_rdtsc() - *RTE_MBUF_DYNFIELD(mbuf, perf_ts_off, rte_mbuf_timestamp_t *));
+    }
+}
+
+mod_ret_t perf_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (hook == MOD_HOOK_RECV && perf_generating) {
+        perf_generate(config);
+    }
+
+    if (hook == MOD_HOOK_EGRESS) {
+        perf_packet(mbuf);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static void
+perf_report(config_t *c, struct cli_def *cli)
+{
+    static hist_t lat;
+    module_stats_t st;
+    unsigned int lcore_id;
+    uint64_t forwarded = 0, total = 0, end;
+    double secs, us = 1e6 / perf_hz;
+    module_t *m;
+    int id;
+
+    end = perf_generating ? rte_rdtsc() : perf_stop;
+    secs = (double)(end - perf_start) / perf_hz;
+
+    hist_reset(&lat);
+    RTE_LCORE_FOREACH(lcore_id) {
+        forwarded += perf_lcores[lcore_id].packets;
+        hist_merge(&lat, &perf_lcores[lcore_id].latency);
+    }
+
+    PERF_OUT(cli, "==== perf report");
+    PERF_OUT(cli, "layout      lcores %u workers %d mode %s", rte_lcore_count(), c->worker_num,
+        c->graph_mode ? "graph" : "module");
+    PERF_OUT(cli, "profile     flows %u ipv6 %u%% rate %u duration %u",
+        perf_cfg.flows, perf_cfg.ipv6, perf_cfg.rate, perf_cfg.duration);
+    PERF_OUT(cli, "generated   %"PRIu64" %.3f Mpps, nomem %"PRIu64" backpressure %"PRIu64,
+        perf_generated, perf_generated / secs / 1e6, perf_nomem, perf_backpressure);
+    PERF_OUT(cli, "forwarded   %"PRIu64" %.3f Mpps, dropped %"PRIu64,
+        forwarded, forwarded / secs / 1e6,
+        perf_generated > forwarded ? perf_generated - forwarded : 0);
+    PERF_OUT(cli, "latency us  p50 %.2f p99 %.2f p99.9 %.2f max %.2f",
+        hist_percentile(&lat, 50) * us, hist_percentile(&lat, 99) * us,
+        hist_percentile(&lat, 99.9) * us, lat.max * us);
+
+    if (c->graph_mode) {
+        graph_stats_dump(cli);
+        return;
+    }
+
+    PERF_OUT(cli, "%-16s %16s %16s %12s", "module", "calls", "cycles", "cycles/pkt");
+    MODULE_FOREACH(m, id) {
+        if (!m) {
+            continue;
+        }
+
+        memset(&st, 0, sizeof(st));
+        RTE_LCORE_FOREACH_WORKER(lcore_id) {
+            if (worker_lcore(c, lcore_id)) {
+                st.calls += module_stats[lcore_id][id].calls;
+                st.cycles += module_stats[lcore_id][id].cycles;
+            }
+        }
+
+        total += st.cycles;
+        PERF_OUT(cli, "%-16s %16"PRIu64" %16"PRIu64" %12.1f", m->name, st.calls, st.cycles,
+            perf_generated ? (double)st.cycles / perf_generated : 0.0);
+    }
+
+    PERF_OUT(cli, "%-16s %16s %16"PRIu64" %12.1f", "total", "", total,
+        perf_generated ? (double)total / perf_generated : 0.0);
+}
+
+void perf_tick(void *config)
+{
+    static int drained;
+
+    if (!perf_running || perf_generating) {
+        return;
+    }
+
+    /** one more tick after generation stops, let workers drain
+     * */
+    if (!drained) {
+        drained = 1;
+        return;
+    }
+
+    perf_report(config, NULL);
+    perf_running = 0;
+    force_quit = true;
+}
+
+static int
+perf_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!c->perf_mode) {
+        CLI_PRINT(cli, "perf mode disabled, start with --perf");
+        return 0;
+    }
+
+    perf_report(c, cli);
+    return 0;
+}
+
+/** Spread "value:weight,..." over PERF_TABLE_SIZE slots, table[i]
+ * gets the index of a value, values keep their text
+ * */
+static int
+perf_weighted_parse(const char *s, char values[][32], uint8_t *table)
+{
+    char buf[512], *tok, *save, *colon;
+    uint32_t weights[PERF_MAX_CHOICES], sum = 0, slot = 0, n;
+    int num = 0, i;
+
+    snprintf(buf, sizeof(buf), "%s", s);
+    for (tok = strtok_r(buf, ",", &save); tok && num < PERF_MAX_CHOICES; tok = strtok_r(NULL, ",", &save)) {
+        colon = strchr(tok, ':');
+        weights[num] = colon ? (uint32_t)atoi(colon + 1) : 1;
+        if (colon) *colon = 0;
+        snprintf(values[num], 32, "%s", tok);
+        sum += weights[num];
+        num ++;
+    }
+
+    if (!num || !sum) {
+        return -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        n = (i == num - 1) ? PERF_TABLE_SIZE - slot : weights[i] * PERF_TABLE_SIZE / sum;
+        while (n-- && slot < PERF_TABLE_SIZE) {
+            table[slot++] = i;
+        }
+    }
+
+    return num;
+}
+
+static int
+perf_json_load(perf_config_t *pc)
+{
+    json_object *jr = NULL, *jv;
+    char values[PERF_MAX_CHOICES][32];
+    perf_prefix_t dsts[PERF_MAX_CHOICES];
+    uint8_t table[PERF_TABLE_SIZE];
+    int i, num, ret = 0;
+
+    memset(pc, 0, sizeof(*pc));
+    pc->duration = 10;
+    pc->flows = 1024;
+
+    jr = JR(CONFIG_PATH, "perf.json");
+    if (!jr) {
+        printf("no perf.json in %s\n", CONFIG_PATH);
+        return -1;
+    }
+
+    jv = JV(jr, "duration");
+    if (jv) pc->duration = JV_I(jv);
+
+    jv = JV(jr, "rate");
+    if (jv) pc->rate = JV_I(jv);
+
+    jv = JV(jr, "flows");
+    if (jv) pc->flows = RTE_MIN((uint32_t)JV_I(jv), PERF_MAX_FLOWS);
+
+    jv = JV(jr, "ipv6");
+    if (jv) pc->ipv6 = RTE_MIN(JV_I(jv), 100);
+
+    #define PERF_WEIGHTED(item, dflt) \
+        jv = JV(jr, item); \
+        num = perf_weighted_parse(jv ? JV_S(jv) : dflt, values, table); \
+        if (num < 0) { \
+            printf("invalid perf %s\n", item); \
+            ret = -1; \
+            goto done; \
+        }
+
+    PERF_WEIGHTED("sizes", "64");
+    for (i = 0; i < PERF_TABLE_SIZE; i++) {
+        pc->sizes[i] = RTE_MIN(RTE_MAX(atoi(values[table[i]]), RTE_ETHER_MIN_LEN), RTE_ETHER_MAX_LEN);
+    }
+
+    PERF_WEIGHTED("proto", "17");
+    for (i = 0; i < PERF_TABLE_SIZE; i++) {
+        pc->protos[i] = atoi(values[table[i]]) == IPPROTO_TCP ? IPPROTO_TCP : IPPROTO_UDP;
+    }
+
+    PERF_WEIGHTED("dst_port", "80");
+    for (i = 0; i < PERF_TABLE_SIZE; i++) {
+        pc->dports[i] = atoi(values[table[i]]);
+    }
+
+    PERF_WEIGHTED("dst", "192.168.0.0/16");
+    for (i = 0; i < num; i++) {
+        if (prefix_parse4(values[i], &dsts[i].addr, &dsts[i].mask)) {
+            printf("invalid perf dst %s\n", values[i]);
+            ret = -1;
+            goto done;
+        }
+    }
+    for (i = 0; i < PERF_TABLE_SIZE; i++) {
+        pc->dsts[i] = dsts[table[i]];
+    }
+
+    #undef PERF_WEIGHTED
+
+    jv = JV(jr, "src");
+    if (prefix_parse4(jv ? JV_S(jv) : "10.0.0.0/16", &pc->src.addr, &pc->src.mask)) {
+        printf("invalid perf src\n");
+        ret = -1;
+        goto done;
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+/** IPv6 flows carry their IPv4 addresses in 2001:db8:0:1::/64 and
+ * 2001:db8:0:2::/64, documentation space
+ * */
+static void
+perf_flow_build(config_t *c, perf_flow_t *f, uint32_t i)
+{
+    perf_config_t *pc = &perf_cfg;
+    struct rte_ether_hdr *eth = (struct rte_ether_hdr *)f->hdr;
+    perf_prefix_t *dst = &pc->dsts[rte_rand() % PERF_TABLE_SIZE];
+    uint32_t sip, dip;
+    uint16_t sp, dp;
+    uint8_t *l4;
+
+    memset(f, 0, sizeof(*f));
+    f->port = i % c->port_num;
+    f->is_v6 = (rte_rand() % 100) < pc->ipv6;
+    f->proto = pc->protos[rte_rand() % PERF_TABLE_SIZE];
+
+    sip = pc->src.addr | ((uint32_t)rte_rand() & ~pc->src.mask);
+    dip = dst->addr | ((uint32_t)rte_rand() & ~dst->mask);
+    sp = 1024 + rte_rand() % (UINT16_MAX - 1024);
+    dp = pc->dports[rte_rand() % PERF_TABLE_SIZE];
+
+    memset(&eth->dst_addr, 0, sizeof(eth->dst_addr));
+    memset(&eth->src_addr, 0, sizeof(eth->src_addr));
+    eth->dst_addr.addr_bytes[0] = eth->src_addr.addr_bytes[0] = 0x02;
+    eth->dst_addr.addr_bytes[5] = 0x02;
+    eth->src_addr.addr_bytes[5] = 0x01;
+
+    if (f->is_v6) {
+        struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+        static const uint8_t pfx[2][8] = {
+            {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 1},
+            {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 2},
+        };
+
+        eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6);
+        ip6->vtc_flow = rte_cpu_to_be_32(6 << 28);
+        ip6->proto = f->proto;
+        ip6->hop_limits = 64;
+        memcpy(ip6->src_addr, pfx[0], 8);
+        memcpy(ip6->dst_addr, pfx[1], 8);
+        sip = rte_cpu_to_be_32(sip);
+        dip = rte_cpu_to_be_32(dip);
+        memcpy(&ip6->src_addr[12], &sip, 4);
+        memcpy(&ip6->dst_addr[12], &dip, 4);
+        l4 = (uint8_t *)(ip6 + 1);
+    } else {
+        struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+
+        eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+        ip->version_ihl = RTE_IPV4_VHL_DEF;
+        ip->time_to_live = 64;
+        ip->next_proto_id = f->proto;
+        ip->src_addr = rte_cpu_to_be_32(sip);
+        ip->dst_addr = rte_cpu_to_be_32(dip);
+        l4 = (uint8_t *)(ip + 1);
+    }
+
+    if (f->proto == IPPROTO_TCP) {
+        struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)l4;
+        tcp->src_port = rte_cpu_to_be_16(sp);
+        tcp->dst_port = rte_cpu_to_be_16(dp);
+        tcp->sent_seq = rte_cpu_to_be_32((uint32_t)rte_rand());
+        tcp->data_off = (sizeof(*tcp) / 4) << 4;
+        tcp->tcp_flags = RTE_TCP_ACK_FLAG;
+        tcp->rx_win = rte_cpu_to_be_16(UINT16_MAX);
+        f->hdr_len = l4 + sizeof(*tcp) - f->hdr;
+    } else {
+        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)l4;
+        udp->src_port = rte_cpu_to_be_16(sp);
+        udp->dst_port = rte_cpu_to_be_16(dp);
+        f->hdr_len = l4 + sizeof(*udp) - f->hdr;
+    }
+}
+
+int perf_init(void *config)
+{
+    config_t *c = config;
+    char name[RTE_MEMPOOL_NAMESIZE];
+    uint32_t i;
+
+    if (!c->perf_mode) {
+        return 0;
+    }
+
+    if (perf_json_load(&perf_cfg)) {
+        printf("perf json load failed\n");
+        return -1;
+    }
+
+    /** every worker queue gets the same number of flows
+     * */
+    perf_cfg.flows = RTE_MAX(perf_cfg.flows / c->worker_num, 1U) * c->worker_num;
+
+    if (rte_mbuf_dyn_rx_timestamp_register(&perf_ts_off, &perf_ts_flag)) {
+        printf("register rx timestamp dynfield failed\n");
+        return -1;
+    }
+
+    perf_pool = rte_pktmbuf_pool_create(hot_object(HOT_MEMPOOL, name, sizeof(name), "perf_pool"), PERF_POOL_SIZE, 256, sizeof(packet_t),
+        RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+    if (!perf_pool) {
+        printf("create perf pool failed\n");
+        return -1;
+    }
+
+    perf_flows = rte_zmalloc("perf_flows", sizeof(perf_flow_t) * perf_cfg.flows, RTE_CACHE_LINE_SIZE);
+    if (!perf_flows) {
+        printf("alloc perf flows failed\n");
+        return -1;
+    }
+
+    rte_srand(1);
+    for (i = 0; i < perf_cfg.flows; i++) {
+        perf_flow_build(c, &perf_flows[i], i);
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "perf", perf_show, "benchmark report so far");
+    }
+
+    perf_hz = rte_get_tsc_hz();
+    perf_cost = perf_cfg.rate ? RTE_MAX(perf_hz / perf_cfg.rate, 1UL) : 0;
+    perf_start = perf_last = rte_rdtsc();
+    perf_stop = perf_start + perf_cfg.duration * perf_hz;
+    modules_profile = 1;
+    perf_generating = 1;
+    perf_running = 1;
+
+    printf("perf %u flows for %u seconds\n", perf_cfg.flows, perf_cfg.duration);
+    return 0;
+}
+
+// file format utf-8
+// ident using space
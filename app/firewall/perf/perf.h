@@ -0,0 +1,69 @@
+#ifndef _M_PERF_H_
+#define _M_PERF_H_
+
+#include "../module.h"
+
+/** Benchmark mode, selected by --perf
+ *
+ * The RX role generates synthetic traffic from perf.json instead of
+ * relying on a traffic generator: flows, packet size mix, IPv4/IPv6
+ * ratio, protocols, destination ports and destination prefixes, the
+ * latter two weighted so the share of packets hitting each acl rule is
+ * set by the profile. Ports only need to exist, net_null vdevs with
+ * no-rx=1 do, so the whole module chain runs and TX frees on send.
+ *
+ * Each packet is stamped with the TSC in the rx timestamp dynfield,
+ * workers account latency at EGRESS, modules_proc() accounts cycles
+ * of every module, a report is printed after 'duration' seconds and
+ * the firewall exits. See perf.sh at the top of the tree.
+ * */
+
+#define PERF_MAX_FLOWS      (1U << 16)
+#define PERF_MAX_CHOICES    16
+#define PERF_TABLE_SIZE     128         /** weighted choices are spread over a table */
+#define PERF_POOL_SIZE      ((1U << 16) - 1)
+#define PERF_BURST          32
+#define PERF_HDR_MAX        80
+
+typedef struct {
+    uint32_t addr;                      /** host order */
+    uint32_t mask;
+} perf_prefix_t;
+
+typedef struct {
+    uint32_t duration;                  /** seconds */
+    uint32_t rate;                      /** packets per second, 0 for line rate of the generator */
+    uint32_t flows;
+    uint32_t ipv6;                      /** percent of flows */
+    perf_prefix_t src;
+    uint16_t sizes[PERF_TABLE_SIZE];
+    uint8_t protos[PERF_TABLE_SIZE];
+    uint16_t dports[PERF_TABLE_SIZE];
+    perf_prefix_t dsts[PERF_TABLE_SIZE];
+} perf_config_t;
+
+/** true while traffic is generated or still draining
+ * */
+extern volatile int perf_running;
+
+void perf_packet_slow(struct rte_mbuf *mbuf);
+
+/** Account one packet leaving the chain, for paths which do not
+ * pass module hooks, e.g. graph nodes
+ * */
+static inline void
+perf_packet(struct rte_mbuf *mbuf)
+{
+    if (unlikely(perf_running)) {
+        perf_packet_slow(mbuf);
+    }
+}
+
+int perf_init(void *config);
+mod_ret_t perf_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+void perf_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,88 @@
+#ifndef _M_PREFIX_H_
+#define _M_PREFIX_H_
+
+/** The one parser of address prefixes of the json files and the cli,
+ * "10.0.0.0/8", "2001:db8::/32", or an address as a host prefix
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/** @param addr
+ *  16 bytes, the address in network order, the rest zeroed
+ * @return
+ *  0, -1 for a malformed prefix
+ * */
+static inline int
+prefix_parse(const char *s, uint8_t *family, uint8_t *addr, uint8_t *depth)
+{
+    char ip[INET6_ADDRSTRLEN];
+    const char *slash;
+    unsigned long d, max;
+    char *end;
+    size_t len;
+
+    if (!s) {
+        return -1;
+    }
+
+    slash = strchr(s, '/');
+    len = slash ? (size_t)(slash - s) : strlen(s);
+    if (len >= sizeof(ip)) {
+        return -1;
+    }
+
+    memcpy(ip, s, len);
+    ip[len] = '\0';
+
+    *family = strchr(ip, ':') ? AF_INET6 : AF_INET;
+    max = *family == AF_INET ? 32 : 128;
+    memset(addr, 0, 16);
+
+    if (inet_pton(*family, ip, addr) != 1) {
+        return -1;
+    }
+
+    d = max;
+    if (slash) {
+        d = strtoul(slash + 1, &end, 10);
+        if (*end || end == slash + 1 || d > max) {
+            return -1;
+        }
+    }
+
+    *depth = d;
+    return 0;
+}
+
+static inline uint32_t
+prefix_mask4(uint8_t depth)
+{
+    return depth ? UINT32_MAX << (32 - depth) : 0;
+}
+
+/** An IPv4 prefix as a host order address, masked, and its mask
+ * */
+static inline int
+prefix_parse4(const char *s, uint32_t *addr, uint32_t *mask)
+{
+    uint8_t family, depth, a[16];
+    uint32_t ip;
+
+    if (prefix_parse(s, &family, a, &depth) || family != AF_INET) {
+        return -1;
+    }
+
+    memcpy(&ip, a, sizeof(ip));
+    *mask = prefix_mask4(depth);
+    *addr = ntohl(ip) & *mask;
+    return 0;
+}
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,570 @@
+#include <inttypes.h>
+#include <string.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_dev.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_arp.h>
+#include <rte_ip.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+
+#include "punt.h"
+
+#define ICMP6_ND_SOLICIT    135
+
+typedef struct {
+    char iface[IF_NAMESIZE];
+    struct rte_ether_addr mac;
+    uint32_t ips[PUNT_ADDR_MAX];            /** network order */
+    uint8_t ip6s[PUNT_ADDR_MAX][16];
+    uint8_t ip_num;
+    uint8_t ip6_num;
+} punt_port_t;
+
+typedef struct {
+    uint64_t at;                /** earliest time of the next punt, cycles */
+    uint64_t punted;
+    uint64_t limited;
+    uint64_t full;
+} __rte_cache_aligned punt_lcore_t;
+
+/** Written by the TX lcore only
+ * */
+typedef struct {
+    uint64_t to_kernel;
+    uint64_t to_kernel_fail;
+    uint64_t from_kernel;
+    uint64_t from_kernel_fail;
+} punt_port_stats_t;
+
+uint16_t punt_ports[MAX_PORT_NUM] = {[0 ... MAX_PORT_NUM - 1] = UINT16_MAX};
+
+static punt_port_t punt_cfg[MAX_PORT_NUM];
+static punt_port_stats_t punt_port_stats[MAX_PORT_NUM];
+static punt_lcore_t punt_lcores[RTE_MAX_LCORE];
+static struct rte_ring *punt_rings[RTE_MAX_LCORE];
+static uint64_t punt_cost;      /** cycles per packet at the rate */
+static uint64_t punt_span;      /** cycles of a burst */
+static int punt_enabled;
+
+MODULE_DECLARE(punt) = {
+    .name = "punt",
+    .id = MOD_ID_PUNT,
+    .enabled = true,
+    .log = true,
+    .init = punt_init,
+    .proc = punt_proc,
+    .conf = NULL,
+    .tick = NULL,
+    .priv = NULL
+};
+
+/** ARP request or neighbor solicitation for an address of the kernel
+ * */
+static int
+punt_is_neigh(const punt_port_t *pp, struct rte_mbuf *mbuf, uint16_t type, uint16_t off)
+{
+    uint16_t len = rte_pktmbuf_data_len(mbuf);
+    const struct rte_arp_hdr *ah;
+    const struct rte_ipv6_hdr *ip6;
+    const uint8_t *nd;
+    int i;
+
+    if (type == rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP)) {
+        if (len < off + sizeof(*ah)) {
+            return 0;
+        }
+
+        ah = rte_pktmbuf_mtod_offset(mbuf, const struct rte_arp_hdr *, off);
+        if (ah->arp_opcode != rte_cpu_to_be_16(RTE_ARP_OP_REQUEST)) {
+            return 0;
+        }
+
+        for (i = 0; i < pp->ip_num; i++) {
+            if (ah->arp_data.arp_tip == pp->ips[i]) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    if (type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6) || !pp->ip6_num) {
+        return 0;
+    }
+
+    /** type, code, checksum, reserved, then the target
+     * */
+    if (len < off + sizeof(*ip6) + 24) {
+        return 0;
+    }
+
+    ip6 = rte_pktmbuf_mtod_offset(mbuf, const struct rte_ipv6_hdr *, off);
+    nd = (const uint8_t *)(ip6 + 1);
+    if (ip6->proto != IPPROTO_ICMPV6 || nd[0] != ICMP6_ND_SOLICIT) {
+        return 0;
+    }
+
+    for (i = 0; i < pp->ip6_num; i++) {
+        if (!memcmp(nd + 8, pp->ip6s[i], 16)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void punt_classify_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    const struct rte_ether_hdr *eh;
+    const struct rte_vlan_hdr *vh;
+    const punt_port_t *pp;
+    packet_t *p;
+    uint16_t type, off, i;
+
+    if (!punt_enabled) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!p || !punt_port(p->iport) || itfc->ports[p->iport].type == PORT_TYPE_ROUTED ||
+            rte_pktmbuf_data_len(mbufs[i]) < sizeof(*eh) + sizeof(*vh)) {
+            continue;
+        }
+
+        pp = &punt_cfg[p->iport];
+        eh = rte_pktmbuf_mtod(mbufs[i], const struct rte_ether_hdr *);
+        if (rte_is_same_ether_addr(&eh->dst_addr, &pp->mac)) {
+            p->oport = PORT_LOCAL;
+            continue;
+        }
+
+        if (!rte_is_multicast_ether_addr(&eh->dst_addr)) {
+            continue;
+        }
+
+        type = eh->ether_type;
+        off = sizeof(*eh);
+        if (type == rte_cpu_to_be_16(RTE_ETHER_TYPE_VLAN)) {
+            vh = (const struct rte_vlan_hdr *)(eh + 1);
+            type = vh->eth_proto;
+            off += sizeof(*vh);
+        }
+
+        if (punt_is_neigh(pp, mbufs[i], type, off)) {
+            p->oport = PORT_LOCAL;
+        }
+    }
+}
+
+void punt_local(struct rte_mbuf *mbuf)
+{
+    punt_lcore_t *lc = &punt_lcores[rte_lcore_id()];
+    uint64_t now;
+
+    if (unlikely(!punt_rings[rte_lcore_id()])) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    /** the rate as a virtual schedule, at most a burst behind now
+     * */
+    now = rte_get_timer_cycles();
+    if (lc->at + punt_span < now) {
+        lc->at = now - punt_span;
+    }
+
+    if (lc->at + punt_cost > now) {
+        lc->limited ++;
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    if (rte_ring_sp_enqueue(punt_rings[rte_lcore_id()], mbuf)) {
+        lc->full ++;
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    lc->at += punt_cost;
+    lc->punted ++;
+}
+
+/** TX lcore, the punt rings to the kernel, runs of one port in a burst
+ * */
+static void
+punt_to_kernel(void)
+{
+    struct rte_mbuf *pkts[MAX_PKT_BURST];
+    unsigned int lcore_id, n, i, start, sent;
+    packet_t *p;
+    uint16_t port;
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        if (!punt_rings[lcore_id]) {
+            continue;
+        }
+
+        n = rte_ring_sc_dequeue_burst(punt_rings[lcore_id], (void **)pkts, MAX_PKT_BURST, NULL);
+        for (start = 0; start < n; start = i) {
+            p = rte_mbuf_to_priv(pkts[start]);
+            port = p->iport;
+
+            for (i = start + 1; i < n; i++) {
+                p = rte_mbuf_to_priv(pkts[i]);
+                if (p->iport != port) {
+                    break;
+                }
+            }
+
+            sent = rte_eth_tx_burst(punt_ports[port], 0, &pkts[start], i - start);
+            punt_port_stats[port].to_kernel += sent;
+            if (sent < i - start) {
+                punt_port_stats[port].to_kernel_fail += i - start - sent;
+                rte_pktmbuf_free_bulk(&pkts[start + sent], i - start - sent);
+            }
+        }
+    }
+}
+
+/** TX lcore, what the kernel sends goes out of its port as from queue 0
+ * */
+static void
+punt_from_kernel(config_t *c)
+{
+    struct rte_mbuf *pkts[MAX_PKT_BURST];
+    uint16_t port, n, m, i, sent;
+    packet_t *p;
+
+    for (port = 0; port < c->port_num && port < MAX_PORT_NUM; port++) {
+        if (!punt_port(port)) {
+            continue;
+        }
+
+        n = rte_eth_rx_burst(punt_ports[port], 0, pkts, MAX_PKT_BURST);
+        for (i = 0, m = 0; i < n; i++) {
+            p = rte_mbuf_to_priv(pkts[i]);
+            memset(p, 0, sizeof(packet_t));
+            p->iport = port;
+            p->oport = port;
+            if (modules_proc(c, pkts[i], MOD_HOOK_LOCALOUT)) {
+                continue;
+            }
+            pkts[m++] = pkts[i];
+        }
+
+        if (!m) {
+            continue;
+        }
+
+        sent = rte_ring_enqueue_burst(c->tx_queues[port][0], (void **)pkts, m, NULL);
+        punt_port_stats[port].from_kernel += sent;
+        if (sent < m) {
+            punt_port_stats[port].from_kernel_fail += m - sent;
+            rte_pktmbuf_free_bulk(&pkts[sent], m - sent);
+        }
+    }
+}
+
+mod_ret_t punt_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    packet_t *p;
+
+    if (!punt_enabled) {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook == MOD_HOOK_SEND) {
+        punt_to_kernel();
+        punt_from_kernel(config);
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook == MOD_HOOK_PREROUTING) {
+        punt_classify_burst(config, &mbuf, 1);
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook == MOD_HOOK_LOCALIN) {
+        p = rte_mbuf_to_priv(mbuf);
+        if (p && p->oport == PORT_LOCAL) {
+            punt_local(mbuf);
+            return MOD_RET_STOLEN;
+        }
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static int
+punt_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    uint64_t punted = 0, limited = 0, full = 0;
+    char ea[RTE_ETHER_ADDR_FMT_SIZE];
+    punt_port_stats_t *st;
+    unsigned int lcore_id;
+    uint16_t port;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!punt_enabled) {
+        CLI_PRINT(cli, "punt disabled");
+        return 0;
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        punted += punt_lcores[lcore_id].punted;
+        limited += punt_lcores[lcore_id].limited;
+        full += punt_lcores[lcore_id].full;
+    }
+
+    CLI_PRINT(cli, "punted %"PRIu64" over rate %"PRIu64" ring full %"PRIu64, punted, limited, full);
+
+    for (port = 0; port < MAX_PORT_NUM; port++) {
+        if (!punt_port(port)) {
+            continue;
+        }
+
+        st = &punt_port_stats[port];
+        rte_ether_format_addr(ea, sizeof(ea), &punt_cfg[port].mac);
+        CLI_PRINT(cli, "port %u %s %s to kernel %"PRIu64" failed %"PRIu64" from kernel %"PRIu64" failed %"PRIu64,
+            port, punt_cfg[port].iface, ea, st->to_kernel, st->to_kernel_fail, st->from_kernel, st->from_kernel_fail);
+    }
+    return 0;
+}
+
+/** Addresses the kernel answers ARP and neighbor solicitations for,
+ * comma separated
+ * */
+static int
+punt_addrs_parse(punt_port_t *pp, const char *s)
+{
+    char buf[1024], *tok, *save = NULL;
+
+    snprintf(buf, sizeof(buf), "%s", s);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (pp->ip_num < PUNT_ADDR_MAX && inet_pton(AF_INET, tok, &pp->ips[pp->ip_num]) == 1) {
+            pp->ip_num ++;
+        } else if (pp->ip6_num < PUNT_ADDR_MAX && inet_pton(AF_INET6, tok, pp->ip6s[pp->ip6_num]) == 1) {
+            pp->ip6_num ++;
+        } else {
+            printf("invalid punt address %s, or more than %u\n", tok, PUNT_ADDR_MAX);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/** A virtio-user port on vhost-net, the kernel sees it as a tap
+ * */
+static int
+punt_port_start(config_t *c, uint16_t port, struct rte_eth_dev_owner *owner)
+{
+    punt_port_t *pp = &punt_cfg[port];
+    struct rte_eth_conf port_conf;
+    char name[RTE_ETH_NAME_MAX_LEN], args[256], ea[RTE_ETHER_ADDR_FMT_SIZE];
+    uint16_t vport;
+    int ret;
+
+    snprintf(name, sizeof(name), "virtio_user%u", port);
+    rte_ether_format_addr(ea, sizeof(ea), &pp->mac);
+    snprintf(args, sizeof(args), "%s,path=/dev/vhost-net,queues=1,queue_size=%u,iface=%s,mac=%s",
+        name, PUNT_RING_SIZE, pp->iface, ea);
+
+    ret = rte_dev_probe(args);
+    if (ret < 0) {
+        printf("probe %s failed\n", args);
+        return -1;
+    }
+
+    if (rte_eth_dev_get_port_by_name(name, &vport)) {
+        printf("no port %s\n", name);
+        return -1;
+    }
+
+    /** owned ports are left out of RTE_ETH_FOREACH_DEV, so of the RX
+     * lcore and of interface_reta_update()
+     * */
+    ret = rte_eth_dev_owner_set(vport, owner);
+    if (ret < 0) {
+        printf("set owner of %s failed\n", name);
+        return -1;
+    }
+
+    memset(&port_conf, 0, sizeof(port_conf));
+    ret = rte_eth_dev_configure(vport, 1, 1, &port_conf);
+    if (ret < 0) {
+        printf("rte eth dev configure %s failed\n", name);
+        return -1;
+    }
+
+    ret = rte_eth_rx_queue_setup(vport, 0, PUNT_RING_SIZE, rte_eth_dev_socket_id(vport), NULL, c->pktmbuf_pool);
+    if (ret < 0) {
+        printf("rte eth rx queue setup %s failed\n", name);
+        return -1;
+    }
+
+    ret = rte_eth_tx_queue_setup(vport, 0, PUNT_RING_SIZE, rte_eth_dev_socket_id(vport), NULL);
+    if (ret < 0) {
+        printf("rte eth tx queue setup %s failed\n", name);
+        return -1;
+    }
+
+    ret = rte_eth_dev_start(vport);
+    if (ret < 0) {
+        printf("rte eth dev start %s failed\n", name);
+        return -1;
+    }
+
+    punt_ports[port] = vport;
+    printf("port %u punts to %s, %s\n", port, pp->iface, ea);
+    return 0;
+}
+
+static int
+punt_json_load(config_t *c)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    struct rte_eth_dev_owner owner;
+    json_object *jr = NULL, *ja, *jo, *jv;
+    uint64_t rate = PUNT_RATE, burst = PUNT_BURST;
+    uint16_t port;
+    int i, num, ret = 0;
+
+    jr = JR(CONFIG_PATH, "punt.json");
+    if (!jr) {
+        printf("no punt.json, punt disabled\n");
+        return 0;
+    }
+
+    /** the vhost-net of the running process can not be shared
+     * */
+    if (hot_takeover()) {
+        printf("punt disabled on takeover\n");
+        goto done;
+    }
+
+    jv = JV(jr, "rate");
+    if (jv) {
+        rate = JV_I(jv);
+    }
+
+    jv = JV(jr, "burst");
+    if (jv) {
+        burst = JV_I(jv);
+    }
+
+    if (!rate || !burst) {
+        printf("invalid punt rate or burst\n");
+        ret = -1;
+        goto done;
+    }
+
+    punt_cost = rte_get_timer_hz() / rate;
+    punt_span = punt_cost * burst;
+
+    memset(&owner, 0, sizeof(owner));
+    snprintf(owner.name, sizeof(owner.name), "%s", PUNT_OWNER);
+    if (rte_eth_dev_owner_new(&owner.id)) {
+        printf("new port owner failed\n");
+        ret = -1;
+        goto done;
+    }
+
+    num = JA(jr, "ports", &ja);
+    for (i = 0; i < num; i++) {
+        jo = JO(ja, i);
+
+        jv = JV(jo, "id");
+        port = jv ? JV_I(jv) : UINT16_MAX;
+        if (port >= itfc->port_num || punt_port(port) || itfc->ports[port].type == PORT_TYPE_NONE) {
+            printf("invalid punt port %d\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        jv = JV(jo, "iface");
+        if (!jv) {
+            printf("parse iface of punt port %u failed\n", port);
+            ret = -1;
+            goto done;
+        }
+        snprintf(punt_cfg[port].iface, sizeof(punt_cfg[port].iface), "%s", JV_S(jv));
+
+        /** replies of the kernel carry the MAC of the port by default
+         * */
+        memcpy(&punt_cfg[port].mac, itfc->ports[port].hwaddr, RTE_ETHER_ADDR_LEN);
+        jv = JV(jo, "mac");
+        if (jv && rte_ether_unformat_addr(JV_S(jv), &punt_cfg[port].mac)) {
+            printf("invalid punt mac %s\n", JV_S(jv));
+            ret = -1;
+            goto done;
+        }
+
+        jv = JV(jo, "addrs");
+        if (jv && punt_addrs_parse(&punt_cfg[port], JV_S(jv))) {
+            ret = -1;
+            goto done;
+        }
+
+        if (punt_port_start(c, port, &owner)) {
+            ret = -1;
+            goto done;
+        }
+        punt_enabled = 1;
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int punt_init(void *config)
+{
+    config_t *c = config;
+    char name[RTE_RING_NAMESIZE];
+    unsigned int lcore_id;
+
+    if (punt_json_load(c)) {
+        printf("punt json load failed\n");
+        return -1;
+    }
+
+    if (!punt_enabled) {
+        return 0;
+    }
+
+    /** the management core punts neighbor answers, every lcore gets a ring
+     * */
+    RTE_LCORE_FOREACH(lcore_id) {
+        punt_rings[lcore_id] = rte_ring_create(hot_object(HOT_RING, name, sizeof(name), "punt_%u", lcore_id),
+            PUNT_RING_SIZE, rte_lcore_to_socket_id(lcore_id), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        if (!punt_rings[lcore_id]) {
+            printf("create punt ring %s failed\n", name);
+            return -1;
+        }
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "punt", punt_show, "exception path to the kernel");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
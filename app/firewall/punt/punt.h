@@ -0,0 +1,70 @@
+#ifndef _M_PUNT_H_
+#define _M_PUNT_H_
+
+#include <rte_mbuf.h>
+
+#include "../module.h"
+#include "../interface/interface.h"
+
+/** Exception path to the Linux kernel
+ *
+ * punt.json, optional, gives ports a kernel interface, a virtio-user
+ * port on /dev/vhost-net with the MAC of the port unless "mac" is set:
+ *
+ *   {"rate": "1000", "burst": "64",
+ *    "ports": [{"id": "0", "iface": "fw0", "addrs": "192.168.1.10,2001:db8::10"},
+ *              {"id": "2", "iface": "fw2"}]}
+ *
+ * Packets for the kernel are PORT_LOCAL after PREROUTING and go to
+ * MOD_HOOK_LOCALIN instead of FORWARD, after acl and nat like any other:
+ *
+ *   - on vwire and bridge ports, frames to the MAC of the interface,
+ *     and ARP requests and neighbor solicitations for one of "addrs"
+ *   - on routed ports, what the route module finds local and does not
+ *     answer itself, and ARP replies and neighbor advertisements, once
+ *     learned, so the kernel resolves its own neighbors too
+ *
+ * Each lcore punts into a ring of its own, at most "rate" packets per
+ * second with bursts of "burst", the rest is dropped and counted, so a
+ * flood to the box can not take the lcore from forwarding. The TX lcore
+ * writes the rings to the kernel in bursts and reads what the kernel
+ * sends, which passes MOD_HOOK_LOCALOUT then goes out of the port as if
+ * a worker of queue 0 sent it.
+ *
+ * The kernel interfaces are set up, addresses included, by the admin.
+ * A takeover, see hot.h, runs without them.
+ * */
+
+#define PUNT_RING_SIZE      1024
+#define PUNT_ADDR_MAX       8
+#define PUNT_RATE           1000        /** packets per second per lcore */
+#define PUNT_BURST          64
+#define PUNT_OWNER          "fw_punt"   /** owner of the virtio-user ports */
+
+/** Virtio-user port of each port, UINT16_MAX for none
+ * */
+extern uint16_t punt_ports[MAX_PORT_NUM];
+
+static inline int
+punt_port(uint16_t port)
+{
+    return port < MAX_PORT_NUM && punt_ports[port] != UINT16_MAX;
+}
+
+/** Mark packets of vwire and bridge ports for the kernel PORT_LOCAL,
+ * routed ports are left to the route module
+ * */
+void punt_classify_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+/** Hand a packet over to the kernel, freed over the rate or if the ring
+ * is full
+ * */
+void punt_local(struct rte_mbuf *mbuf);
+
+int punt_init(void *config);
+mod_ret_t punt_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+
+#endif
+
+// file format utf-8
+// ident using space
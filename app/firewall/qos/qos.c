@@ -0,0 +1,469 @@
+#include <inttypes.h>
+
+#include <rte_common.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_sched.h>
+#include <rte_hash_crc.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../interface/interface.h"
+#include "../latency/latency.h"
+
+#include "qos.h"
+
+#define QOS_SUBPORT_MAX     MAX_TENANT_NUM
+
+typedef struct {
+    uint8_t subports[MAX_TENANT_NUM];   /** subport of each tenant */
+    uint8_t subport_num;                /** configured, padding excluded */
+    uint8_t by_dst;                     /** pipe by destination address */
+    uint32_t pipe_mask;
+    uint64_t rate;                      /** bytes per second */
+    uint16_t pending_head;
+    uint16_t pending_num;
+    struct rte_mbuf *pending[QOS_BURST];    /** dequeued, not taken by the device yet */
+    uint64_t sent;
+} qos_port_t;
+
+struct rte_sched_port *qos_ports[MAX_PORT_NUM];
+
+static qos_port_t qos_port_state[MAX_PORT_NUM];
+static interface_config_t *qos_itfc;
+
+/** traffic class of each DSCP
+ * */
+static uint8_t qos_dscp[64];
+
+MODULE_DECLARE(qos) = {
+    .name = "qos",
+    .id = MOD_ID_QOS,
+    .enabled = true,
+    .log = true,
+    .init = qos_init,
+    .proc = NULL,
+    .conf = NULL,
+    .tick = NULL,
+    .priv = NULL
+};
+
+static uint32_t
+qos_classify(qos_port_t *qp, struct rte_mbuf *mbuf, uint32_t *subport, uint32_t *pipe, uint32_t *queue)
+{
+    packet_t *p = rte_mbuf_to_priv(mbuf);
+    struct rte_ipv4_hdr *ip4;
+    struct rte_ipv6_hdr *ip6;
+    uint32_t h, ports, tc = RTE_SCHED_TRAFFIC_CLASS_BE;
+
+    *subport = 0;
+    *pipe = 0;
+    *queue = 0;
+
+    if (!p) {
+        return tc;
+    }
+
+    if (p->iport < qos_itfc->port_num) {
+        *subport = qp->subports[qos_itfc->ports[p->iport].tenant];
+    }
+
+    if (!p->l3_off) {
+        return tc;
+    }
+
+    if (p->is_v4) {
+        h = rte_hash_crc_4byte(qp->by_dst ? p->tuple.v4.dip : p->tuple.v4.sip, 0);
+        ip4 = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv4_hdr *, p->l3_off);
+        tc = qos_dscp[ip4->type_of_service >> 2];
+        ports = (uint32_t)p->tuple.v4.sp << 16 | p->tuple.v4.dp;
+    } else {
+        h = rte_hash_crc(qp->by_dst ? p->tuple.v6.dip : p->tuple.v6.sip, sizeof(p->tuple.v6.sip), 0);
+        ip6 = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv6_hdr *, p->l3_off);
+        tc = qos_dscp[(rte_be_to_cpu_32(ip6->vtc_flow) >> 22) & 0x3f];
+        ports = (uint32_t)p->tuple.v6.sp << 16 | p->tuple.v6.dp;
+    }
+
+    *pipe = h & qp->pipe_mask;
+
+    if (p->qos_tc) {
+        tc = p->qos_tc - 1;
+    }
+
+    /** flows of a subscriber spread over the best effort queues
+     * */
+    if (tc == RTE_SCHED_TRAFFIC_CLASS_BE) {
+        *queue = rte_hash_crc_4byte(ports, h) & (RTE_SCHED_BE_QUEUES_PER_PIPE - 1);
+    }
+
+    return tc;
+}
+
+void qos_enqueue(uint16_t port, struct rte_mbuf **pkts, uint16_t n)
+{
+    struct rte_sched_port *sched = qos_ports[port];
+    qos_port_t *qp = &qos_port_state[port];
+    uint32_t subport, pipe, queue, tc;
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        tc = qos_classify(qp, pkts[i], &subport, &pipe, &queue);
+        rte_sched_port_pkt_write(sched, pkts[i], subport, pipe, tc, queue, RTE_COLOR_GREEN);
+    }
+
+    /** packets over a queue size or dropped by congestion management are
+     * freed by the scheduler and counted in its stats
+     * */
+    rte_sched_port_enqueue(sched, pkts, n);
+}
+
+void qos_send(uint16_t port, uint16_t queueid)
+{
+    qos_port_t *qp = &qos_port_state[port];
+    uint16_t sent;
+    int n;
+
+    /** the device was full last time, hold the scheduler back until it
+     * takes the rest
+     * */
+    if (qp->pending_num) {
+        sent = rte_eth_tx_burst(port, queueid, &qp->pending[qp->pending_head], qp->pending_num);
+        qp->pending_head += sent;
+        qp->pending_num -= sent;
+        qp->sent += sent;
+        if (qp->pending_num) {
+            return;
+        }
+    }
+
+    n = rte_sched_port_dequeue(qos_ports[port], qp->pending, QOS_BURST);
+    if (n <= 0) {
+        return;
+    }
+
+    latency_account(qp->pending, n, port);
+
+    sent = rte_eth_tx_burst(port, queueid, qp->pending, n);
+    qp->sent += sent;
+    qp->pending_head = sent;
+    qp->pending_num = n - sent;
+}
+
+static int
+qos_dscp_load(json_object *jr)
+{
+    json_object *ja, *jo, *jv;
+    int i, num, dscp, tc;
+
+    /** class selectors by default, CS7 to 5 and CS0 to best effort
+     * */
+    for (i = 0; i < 64; i++) {
+        qos_dscp[i] = RTE_SCHED_TRAFFIC_CLASS_BE - (i >> 3);
+    }
+
+    num = JA(jr, "dscp", &ja);
+    for (i = 0; i < num; i++) {
+        jo = JO(ja, i);
+        jv = JV(jo, "dscp");
+        dscp = jv ? JV_I(jv) : -1;
+        jv = JV(jo, "tc");
+        tc = jv ? JV_I(jv) : -1;
+        if (dscp < 0 || dscp >= 64 || tc < 0 || tc >= QOS_TC_NUM) {
+            printf("invalid dscp map %d of qos.json\n", i);
+            return -1;
+        }
+
+        qos_dscp[dscp] = tc;
+    }
+
+    return 0;
+}
+
+static struct rte_sched_port *
+qos_port_create(uint16_t portid, uint64_t rate, uint32_t pipes, uint32_t subport_num,
+    struct rte_sched_subport_profile_params *profiles, struct rte_sched_pipe_params *pipe_profiles)
+{
+    struct rte_sched_subport_params sp;
+    struct rte_sched_port_params pp;
+    struct rte_sched_port *sched;
+    char name[32];
+    uint32_t i, k, n, pipe, tc;
+
+    snprintf(name, sizeof(name), "qos_port_%u", portid);
+
+    /** lib/sched wants a power of 2 of subports, the padding is never
+     * used and gets one pipe only
+     * */
+    memset(&pp, 0, sizeof(pp));
+    pp.name = name;
+    pp.socket = rte_eth_dev_socket_id(portid) < 0 ? 0 : rte_eth_dev_socket_id(portid);
+    pp.rate = rate;
+    pp.mtu = RTE_ETHER_MAX_LEN;
+    pp.frame_overhead = RTE_SCHED_FRAME_OVERHEAD_DEFAULT;
+    pp.n_subports_per_port = rte_align32pow2(subport_num);
+    pp.subport_profiles = profiles;
+    pp.n_subport_profiles = subport_num;
+    pp.n_max_subport_profiles = subport_num;
+    pp.n_pipes_per_subport = pipes;
+
+    sched = rte_sched_port_config(&pp);
+    if (!sched) {
+        return NULL;
+    }
+
+    for (i = 0; i < pp.n_subports_per_port; i++) {
+        k = i < subport_num ? i : 0;
+        n = i < subport_num ? pipes : 1;
+
+        memset(&sp, 0, sizeof(sp));
+        sp.n_pipes_per_subport_enabled = n;
+        for (tc = 0; tc < QOS_TC_NUM; tc++) {
+            sp.qsize[tc] = QOS_QSIZE;
+        }
+        sp.pipe_profiles = &pipe_profiles[k];
+        sp.n_pipe_profiles = 1;
+        sp.n_max_pipe_profiles = 1;
+
+        if (rte_sched_subport_config(sched, i, &sp, k)) {
+            printf("config subport %u of port %u failed\n", i, portid);
+            goto err;
+        }
+
+        for (pipe = 0; pipe < n; pipe++) {
+            if (rte_sched_pipe_config(sched, i, pipe, 0)) {
+                printf("config pipe %u of subport %u port %u failed\n", pipe, i, portid);
+                goto err;
+            }
+        }
+    }
+
+    return sched;
+
+err:
+    rte_sched_port_free(sched);
+    return NULL;
+}
+
+static int
+qos_port_load(json_object *jo, uint16_t *port)
+{
+    struct rte_sched_subport_profile_params profiles[QOS_SUBPORT_MAX];
+    struct rte_sched_pipe_params pipe_profiles[QOS_SUBPORT_MAX];
+    struct rte_eth_link link;
+    json_object *jv, *js, *jso;
+    qos_port_t *qp;
+    uint64_t rate, sp_rate, pipe_rate;
+    uint32_t pipes;
+    int i, k, subport_num, tenant;
+
+    #define QOS_JV(o, item) \
+        jv = JV(o, item); \
+        if (!jv) { \
+            printf("parse %s failed\n", item); \
+            return -1; \
+        }
+
+    QOS_JV(jo, "id");
+    *port = JV_I(jv);
+    if (*port >= qos_itfc->port_num || qos_ports[*port]) {
+        printf("qos port %u is not a free port\n", *port);
+        return -1;
+    }
+    qp = &qos_port_state[*port];
+
+    /** the link speed unless given
+     * */
+    jv = JV(jo, "rate");
+    if (jv) {
+        rate = (uint64_t)JV_I(jv) * 125000;
+    } else {
+        memset(&link, 0, sizeof(link));
+        rte_eth_link_get_nowait(*port, &link);
+        rate = (uint64_t)link.link_speed * 125000;
+    }
+
+    if (!rate) {
+        printf("qos port %u has no rate\n", *port);
+        return -1;
+    }
+
+    jv = JV(jo, "pipes");
+    pipes = jv ? (uint32_t)JV_I(jv) : 256;
+    if (!pipes || pipes > QOS_PIPE_MAX || !rte_is_power_of_2(pipes)) {
+        printf("pipes of qos port %u must be a power of 2 up to %u\n", *port, QOS_PIPE_MAX);
+        return -1;
+    }
+
+    jv = JV(jo, "pipe_key");
+    qp->by_dst = jv && !strcmp(JV_S(jv), "dip");
+    qp->pipe_mask = pipes - 1;
+    qp->rate = rate;
+
+    subport_num = JA(jo, "subports", &js);
+    if (subport_num <= 0 || subport_num > QOS_SUBPORT_MAX) {
+        printf("qos port %u takes 1 to %u subports\n", *port, QOS_SUBPORT_MAX);
+        return -1;
+    }
+
+    memset(profiles, 0, sizeof(profiles));
+    memset(pipe_profiles, 0, sizeof(pipe_profiles));
+    memset(qp->subports, 0, sizeof(qp->subports));
+
+    for (i = 0; i < subport_num; i++) {
+        jso = JO(js, i);
+
+        QOS_JV(jso, "tenant");
+        tenant = JV_I(jv);
+        if (tenant < 0 || tenant >= MAX_TENANT_NUM) {
+            printf("tenant of subport %d of qos port %u must be below %u\n", i, *port, MAX_TENANT_NUM);
+            return -1;
+        }
+        qp->subports[tenant] = i;
+
+        jv = JV(jso, "rate");
+        sp_rate = jv ? (uint64_t)JV_I(jv) * 125000 : rate;
+        jv = JV(jso, "pipe_rate");
+        pipe_rate = jv ? (uint64_t)JV_I(jv) * 125000 : sp_rate;
+        if (!sp_rate || sp_rate > rate || !pipe_rate || pipe_rate > sp_rate) {
+            printf("rates of subport %d of qos port %u over the port\n", i, *port);
+            return -1;
+        }
+
+        profiles[i].tb_rate = sp_rate;
+        profiles[i].tb_size = 1000000;
+        profiles[i].tc_period = 10;
+
+        pipe_profiles[i].tb_rate = pipe_rate;
+        pipe_profiles[i].tb_size = 1000000;
+        pipe_profiles[i].tc_period = 40;
+        pipe_profiles[i].tc_ov_weight = 1;
+
+        /** strict priority between classes, each may take the whole rate
+         * */
+        for (k = 0; k < QOS_TC_NUM; k++) {
+            profiles[i].tc_rate[k] = sp_rate;
+            pipe_profiles[i].tc_rate[k] = pipe_rate;
+        }
+        for (k = 0; k < RTE_SCHED_BE_QUEUES_PER_PIPE; k++) {
+            pipe_profiles[i].wrr_weights[k] = 1;
+        }
+    }
+
+    #undef QOS_JV
+
+    qp->subport_num = subport_num;
+
+    qos_ports[*port] = qos_port_create(*port, rate, pipes, subport_num, profiles, pipe_profiles);
+    if (!qos_ports[*port]) {
+        printf("create scheduler of port %u failed\n", *port);
+        return -1;
+    }
+
+    printf("qos port %u rate %"PRIu64" Mbit/s, %d subports of %u pipes\n", *port, rate / 125000,
+        subport_num, pipes);
+    return 0;
+}
+
+static int
+qos_json_load(void)
+{
+    json_object *jr = NULL, *ja;
+    int i, port_num;
+    uint16_t port;
+    int ret = 0;
+
+    jr = JR(CONFIG_PATH, "qos.json");
+    if (!jr) {
+        printf("no qos.json, qos disabled\n");
+        return 0;
+    }
+
+    if (qos_dscp_load(jr)) {
+        ret = -1;
+        goto done;
+    }
+
+    port_num = JA(jr, "ports", &ja);
+    for (i = 0; i < port_num; i++) {
+        if (qos_port_load(JO(ja, i), &port)) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+/** Counters of the scheduler are cleared on read, so subport figures
+ * are since the last show
+ * */
+static int
+qos_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    struct rte_sched_subport_stats st;
+    uint32_t tc_ov[QOS_TC_NUM];
+    uint64_t pkts, drops;
+    qos_port_t *qp;
+    uint16_t port;
+    int i, tc;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    for (port = 0; port < MAX_PORT_NUM; port++) {
+        if (!qos_ports[port]) {
+            continue;
+        }
+
+        qp = &qos_port_state[port];
+        CLI_PRINT(cli, "port %u rate %"PRIu64" Mbit/s pipes %u sent %"PRIu64, port, qp->rate / 125000,
+            qp->pipe_mask + 1, qp->sent);
+
+        for (i = 0; i < qp->subport_num; i++) {
+            if (rte_sched_subport_read_stats(qos_ports[port], i, &st, tc_ov)) {
+                continue;
+            }
+
+            CLI_PRINT(cli, "  subport %d", i);
+            for (tc = 0; tc < QOS_TC_NUM; tc++) {
+                pkts = st.n_pkts_tc[tc];
+                drops = st.n_pkts_tc_dropped[tc] + st.n_pkts_cman_dropped[tc];
+                if (pkts || drops) {
+                    CLI_PRINT(cli, "    tc %-2d pkts %-12"PRIu64" bytes %-14"PRIu64" drops %"PRIu64,
+                        tc, pkts, st.n_bytes_tc[tc], drops);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+int qos_init(void *config)
+{
+    config_t *c = config;
+
+    qos_itfc = c->itf_cfg;
+    if (!qos_itfc) {
+        return -1;
+    }
+
+    if (qos_json_load()) {
+        printf("qos json load failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "qos", qos_show, "egress schedulers");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,60 @@
+#ifndef _M_QOS_H_
+#define _M_QOS_H_
+
+#include <rte_sched.h>
+
+#include "../module.h"
+#include "../config.h"
+
+/** Hierarchical egress scheduling on TX ports with lib/sched
+ *
+ * qos.json, optional, lists the ports to schedule, rates in Mbit/s:
+ *
+ *   {"ports": [{"id": "1", "rate": "10000", "pipes": "256", "pipe_key": "sip",
+ *       "subports": [{"tenant": "0", "rate": "6000", "pipe_rate": "100"},
+ *                    {"tenant": "1", "rate": "4000", "pipe_rate": "50"}]}],
+ *    "dscp": [{"dscp": "46", "tc": "0"}]}
+ *
+ * A subport per tenant, the one of the ingress port as for acl, shapes
+ * the tenant to its rate, so rates which sum up to the port rate give
+ * each tenant a guarantee. Tenants without a subport share the first.
+ * The pipes of a subport are subscribers, by hash of "sip" or "dip",
+ * each shaped to pipe_rate.
+ *
+ * The traffic class, 0 the highest of QOS_TC_NUM, is the "tc" of the
+ * matched acl rule, else that of the packet DSCP in "dscp", else the
+ * class selector: CS7 goes to 5 and CS0 to best effort, whose four
+ * queues are picked by flow hash.
+ *
+ * Workers are untouched: the TX lcore classifies what it dequeues from
+ * the tx rings of a port into its rte_sched_port and sends what the
+ * scheduler gives back. qos.json is read at startup only.
+ * */
+
+#define QOS_TC_NUM          RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE
+#define QOS_BURST           64
+#define QOS_PIPE_MAX        4096
+#define QOS_QSIZE           64
+
+extern struct rte_sched_port *qos_ports[MAX_PORT_NUM];
+
+static inline int
+qos_port_enabled(uint16_t port)
+{
+    return qos_ports[port] != NULL;
+}
+
+/** Classify and queue packets bound to port, on the TX lcore
+ * */
+void qos_enqueue(uint16_t port, struct rte_mbuf **pkts, uint16_t n);
+
+/** Send what the scheduler of port releases on tx queue queueid
+ * */
+void qos_send(uint16_t port, uint16_t queueid);
+
+int qos_init(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
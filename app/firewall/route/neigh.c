@@ -0,0 +1,792 @@
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_arp.h>
+#include <rte_ip.h>
+#include <rte_icmp.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+
+#include "../config.h"
+#include "../packet.h"
+#include "../cli.h"
+#include "../csum.h"
+#include "../interface/interface.h"
+#include "../hot.h"
+#include "../punt/punt.h"
+
+#include "route.h"
+#include "neigh.h"
+
+#define NEIGH_PUNT_SIZE     4096
+#define NEIGH_BURST         32
+#define NEIGH_TICK_BUDGET   NEIGH_PUNT_SIZE     /** packets per tick, a full ring */
+
+#define ND_SOLICIT          135
+#define ND_ADVERT           136
+#define ND_OPT_SRC_LLADDR   1
+#define ND_OPT_TGT_LLADDR   2
+#define ND_NA_FLAGS         0x60000000  /** solicited, override */
+#define ICMP6_ECHO_REQUEST  128
+#define ICMP6_ECHO_REPLY    129
+
+typedef struct {
+    uint8_t type;
+    uint8_t code;
+    uint16_t cksum;
+    uint32_t flags;             /** NA flags, reserved in NS */
+    uint8_t target[16];
+} __rte_packed neigh_nd_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t len;                /** in 8 bytes */
+    uint8_t mac[RTE_ETHER_ADDR_LEN];
+} __rte_packed neigh_nd_opt_t;
+
+typedef struct {
+    neigh_key_t key;
+    uint64_t mac;               /** read by workers, 0 until resolved */
+    uint64_t updated;           /** timer cycles of the last answer */
+    uint64_t probed;            /** timer cycles of the last request */
+    uint8_t probes;             /** requests since the last answer */
+    uint8_t used;
+} neigh_t;
+
+typedef struct {
+    struct rte_mbuf *mbuf;
+    neigh_key_t key;
+    uint64_t at;
+} neigh_hold_t;
+
+typedef struct {
+    uint32_t idx;
+    int32_t pos;
+    uint64_t at;
+} neigh_retired_t;
+
+typedef struct {
+    uint64_t punted;
+    uint64_t punt_full;
+} __rte_cache_aligned neigh_stats_t;
+
+static struct rte_hash *neigh_hash;
+static neigh_t *neigh_table;
+static struct rte_ring *neigh_ring;         /** punted by workers */
+static neigh_stats_t neigh_stats[RTE_MAX_LCORE];
+
+/** management core only
+ * */
+static uint32_t neigh_free[NEIGH_MAX];
+static uint32_t neigh_free_num;
+static neigh_retired_t neigh_retired[NEIGH_MAX];
+static uint32_t neigh_retired_head, neigh_retired_tail;
+static neigh_hold_t neigh_holds[NEIGH_HOLD_NUM];
+static uint64_t neigh_scanned;
+static uint64_t neigh_requests, neigh_hold_drops;
+
+void neigh_lookup_bulk(const neigh_key_t *keys, uint16_t n, uint64_t *macs)
+{
+    const void *kp[RTE_HASH_LOOKUP_BULK_MAX];
+    void *data[RTE_HASH_LOOKUP_BULK_MAX];
+    uint64_t hit;
+    uint16_t i, j, m;
+
+    for (i = 0; i < n; i += m) {
+        m = RTE_MIN(n - i, RTE_HASH_LOOKUP_BULK_MAX);
+        for (j = 0; j < m; j++) {
+            kp[j] = &keys[i + j];
+        }
+
+        hit = 0;
+        rte_hash_lookup_bulk_data(neigh_hash, kp, m, &hit, data);
+
+        for (j = 0; j < m; j++) {
+            macs[i + j] = (hit & (1ULL << j)) ?
+                __atomic_load_n(&neigh_table[(uintptr_t)data[j]].mac, __ATOMIC_RELAXED) : 0;
+        }
+    }
+}
+
+void neigh_punt(struct rte_mbuf *mbuf)
+{
+    neigh_stats_t *st = &neigh_stats[rte_lcore_id()];
+
+    if (rte_ring_mp_enqueue(neigh_ring, mbuf)) {
+        st->punt_full ++;
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    st->punted ++;
+}
+
+static void
+neigh_xmit(config_t *c, uint16_t port, struct rte_mbuf *mbuf)
+{
+    if (rte_ring_enqueue(c->tx_queues[port][0], mbuf)) {
+        rte_pktmbuf_free(mbuf);
+    }
+}
+
+static neigh_t *
+neigh_find(const neigh_key_t *key)
+{
+    void *data;
+
+    if (rte_hash_lookup_data(neigh_hash, key, &data) < 0) {
+        return NULL;
+    }
+
+    return &neigh_table[(uintptr_t)data];
+}
+
+static neigh_t *
+neigh_create(const neigh_key_t *key, uint64_t mac, uint64_t now)
+{
+    uint32_t idx;
+    neigh_t *e;
+
+    if (!neigh_free_num) {
+        return NULL;
+    }
+
+    idx = neigh_free[--neigh_free_num];
+    e = &neigh_table[idx];
+    e->key = *key;
+    e->mac = mac;
+    e->updated = now;
+    e->probed = 0;
+    e->probes = 0;
+    e->used = 1;
+
+    if (rte_hash_add_key_data(neigh_hash, key, (void *)(uintptr_t)idx)) {
+        e->used = 0;
+        neigh_free[neigh_free_num++] = idx;
+        return NULL;
+    }
+
+    return e;
+}
+
+static void
+neigh_retire(uint32_t idx, uint64_t now)
+{
+    neigh_t *e = &neigh_table[idx];
+    neigh_retired_t *r;
+
+    e->used = 0;
+
+    r = &neigh_retired[neigh_retired_tail++ % NEIGH_MAX];
+    r->idx = idx;
+    r->pos = rte_hash_del_key(neigh_hash, &e->key);
+    r->at = now;
+}
+
+static struct rte_mbuf *
+neigh_alloc(config_t *c, uint16_t len)
+{
+    struct rte_mbuf *mbuf = rte_pktmbuf_alloc(c->pktmbuf_pool);
+
+    if (mbuf && !rte_pktmbuf_append(mbuf, RTE_MAX(len, RTE_ETHER_MIN_LEN - RTE_ETHER_CRC_LEN))) {
+        rte_pktmbuf_free(mbuf);
+        return NULL;
+    }
+
+    if (mbuf) {
+        memset(rte_pktmbuf_mtod(mbuf, void *), 0, rte_pktmbuf_data_len(mbuf));
+        if (rte_mbuf_to_priv(mbuf)) {
+            memset(rte_mbuf_to_priv(mbuf), 0, sizeof(packet_t));
+        }
+    }
+
+    return mbuf;
+}
+
+static void
+neigh_nd_build(struct rte_ether_hdr *eh, const uint8_t *src, const uint8_t *dst, const uint8_t *target,
+    uint8_t type, uint32_t flags, uint8_t opt, const uint8_t *mac)
+{
+    struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eh + 1);
+    neigh_nd_t *nd = (neigh_nd_t *)(ip6 + 1);
+    neigh_nd_opt_t *o = (neigh_nd_opt_t *)(nd + 1);
+
+    eh->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6);
+
+    ip6->vtc_flow = rte_cpu_to_be_32(6 << 28);
+    ip6->payload_len = rte_cpu_to_be_16(sizeof(*nd) + sizeof(*o));
+    ip6->proto = IPPROTO_ICMPV6;
+    ip6->hop_limits = 255;
+    memcpy(ip6->src_addr, src, 16);
+    memcpy(ip6->dst_addr, dst, 16);
+
+    nd->type = type;
+    nd->code = 0;
+    nd->cksum = 0;
+    nd->flags = rte_cpu_to_be_32(flags);
+    memcpy(nd->target, target, 16);
+
+    o->type = opt;
+    o->len = 1;
+    memcpy(o->mac, mac, RTE_ETHER_ADDR_LEN);
+
+    nd->cksum = rte_ipv6_udptcp_cksum(ip6, nd);
+}
+
+/** ARP request or neighbor solicitation to the solicited-node group
+ * */
+static void
+neigh_request(config_t *c, const neigh_key_t *key)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    port_config_t *pc = &itfc->ports[key->port];
+    struct rte_ether_hdr *eh;
+    struct rte_arp_hdr *ah;
+    struct rte_mbuf *mbuf;
+    uint8_t group[16] = {0xff, 0x02, [11] = 0x01, [12] = 0xff};
+    uint32_t ip;
+
+    mbuf = neigh_alloc(c, sizeof(*eh) + (key->family == AF_INET ? sizeof(*ah) :
+        sizeof(struct rte_ipv6_hdr) + sizeof(neigh_nd_t) + sizeof(neigh_nd_opt_t)));
+    if (!mbuf) {
+        return;
+    }
+
+    eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    memcpy(&eh->src_addr, pc->hwaddr, RTE_ETHER_ADDR_LEN);
+
+    if (key->family == AF_INET) {
+        memset(&eh->dst_addr, 0xff, RTE_ETHER_ADDR_LEN);
+        eh->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP);
+
+        ah = (struct rte_arp_hdr *)(eh + 1);
+        ah->arp_hardware = rte_cpu_to_be_16(RTE_ARP_HRD_ETHER);
+        ah->arp_protocol = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+        ah->arp_hlen = RTE_ETHER_ADDR_LEN;
+        ah->arp_plen = sizeof(uint32_t);
+        ah->arp_opcode = rte_cpu_to_be_16(RTE_ARP_OP_REQUEST);
+        memcpy(&ah->arp_data.arp_sha, pc->hwaddr, RTE_ETHER_ADDR_LEN);
+        ah->arp_data.arp_sip = rte_cpu_to_be_32(pc->ip);
+        memcpy(&ip, key->addr, sizeof(ip));
+        ah->arp_data.arp_tip = ip;
+    } else {
+        memcpy(group + 13, key->addr + 13, 3);
+        eh->dst_addr.addr_bytes[0] = 0x33;
+        eh->dst_addr.addr_bytes[1] = 0x33;
+        memcpy(&eh->dst_addr.addr_bytes[2], group + 12, 4);
+        neigh_nd_build(eh, pc->ip6, group, key->addr, ND_SOLICIT, 0, ND_OPT_SRC_LLADDR, pc->hwaddr);
+    }
+
+    neigh_requests ++;
+    neigh_xmit(c, key->port, mbuf);
+}
+
+/** Send the packets held for a neighbor just resolved
+ * */
+static void
+neigh_release(config_t *c, const neigh_key_t *key, uint64_t mac)
+{
+    neigh_hold_t *h;
+    int i;
+
+    for (i = 0; i < NEIGH_HOLD_NUM; i++) {
+        h = &neigh_holds[i];
+        if (h->mbuf && !memcmp(&h->key, key, sizeof(*key))) {
+            route_rewrite(c, h->mbuf, key->port, mac);
+            neigh_xmit(c, key->port, h->mbuf);
+            h->mbuf = NULL;
+        }
+    }
+}
+
+/** Update a neighbor from an answer, create it only if asked to
+ * */
+static void
+neigh_learn(config_t *c, const neigh_key_t *key, const uint8_t *ea, int create, uint64_t now)
+{
+    uint64_t mac = 0;
+    neigh_t *e;
+
+    memcpy(&mac, ea, RTE_ETHER_ADDR_LEN);
+    if (!mac || (ea[0] & 1)) {
+        return;
+    }
+
+    e = neigh_find(key);
+    if (!e) {
+        if (!create || !neigh_create(key, mac, now)) {
+            return;
+        }
+    } else {
+        __atomic_store_n(&e->mac, mac, __ATOMIC_RELAXED);
+        e->updated = now;
+        e->probes = 0;
+    }
+
+    neigh_release(c, key, mac);
+}
+
+static void
+neigh_arp(config_t *c, struct rte_mbuf *mbuf, uint16_t port, uint64_t now)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    port_config_t *pc = &itfc->ports[port];
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_arp_hdr *ah = (struct rte_arp_hdr *)(eh + 1);
+    neigh_key_t key;
+    uint32_t ip = rte_cpu_to_be_32(pc->ip), sip;
+    int for_me;
+
+    if (rte_pktmbuf_data_len(mbuf) < sizeof(*eh) + sizeof(*ah) || !pc->ip ||
+        ah->arp_hardware != rte_cpu_to_be_16(RTE_ARP_HRD_ETHER) ||
+        ah->arp_protocol != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) ||
+        ah->arp_hlen != RTE_ETHER_ADDR_LEN || ah->arp_plen != sizeof(uint32_t)) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    for_me = ah->arp_data.arp_tip == ip;
+    sip = ah->arp_data.arp_sip;
+
+    /** a request for us creates its sender, as the answer will be used,
+     * other packets only refresh known neighbors
+     * */
+    if (sip) {
+        memset(&key, 0, sizeof(key));
+        memcpy(key.addr, &sip, sizeof(sip));
+        key.port = port;
+        key.family = AF_INET;
+        neigh_learn(c, &key, ah->arp_data.arp_sha.addr_bytes, for_me, now);
+    }
+
+    /** the kernel of the port resolves its own neighbors
+     * */
+    if (ah->arp_opcode == rte_cpu_to_be_16(RTE_ARP_OP_REPLY) && punt_port(port)) {
+        punt_local(mbuf);
+        return;
+    }
+
+    if (!for_me || ah->arp_opcode != rte_cpu_to_be_16(RTE_ARP_OP_REQUEST)) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    ah->arp_opcode = rte_cpu_to_be_16(RTE_ARP_OP_REPLY);
+    ah->arp_data.arp_tha = ah->arp_data.arp_sha;
+    ah->arp_data.arp_tip = sip;
+    memcpy(&ah->arp_data.arp_sha, pc->hwaddr, RTE_ETHER_ADDR_LEN);
+    ah->arp_data.arp_sip = ip;
+
+    eh->dst_addr = eh->src_addr;
+    memcpy(&eh->src_addr, pc->hwaddr, RTE_ETHER_ADDR_LEN);
+    neigh_xmit(c, port, mbuf);
+}
+
+/** Link layer address option of a neighbor discovery message
+ * */
+static const uint8_t *
+neigh_nd_opt(struct rte_mbuf *mbuf, neigh_nd_t *nd, uint16_t end, uint8_t type)
+{
+    uint16_t off = (uint8_t *)(nd + 1) - rte_pktmbuf_mtod(mbuf, uint8_t *);
+    neigh_nd_opt_t *o;
+
+    while (off + 2 <= end) {
+        o = rte_pktmbuf_mtod_offset(mbuf, neigh_nd_opt_t *, off);
+        if (!o->len || off + o->len * 8 > end) {
+            return NULL;
+        }
+
+        if (o->type == type && o->len == 1) {
+            return o->mac;
+        }
+
+        off += o->len * 8;
+    }
+
+    return NULL;
+}
+
+static void
+neigh_nd(config_t *c, struct rte_mbuf *mbuf, uint16_t port, uint64_t now)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    port_config_t *pc = &itfc->ports[port];
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *), *reh;
+    struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eh + 1);
+    neigh_nd_t *nd = (neigh_nd_t *)(ip6 + 1);
+    const uint8_t *lladdr;
+    uint8_t zero[16] = {0}, all_nodes[16] = {0xff, 0x02, [15] = 0x01};
+    struct rte_mbuf *reply;
+    neigh_key_t key;
+    uint16_t end;
+
+    end = RTE_MIN(rte_pktmbuf_data_len(mbuf), sizeof(*eh) + sizeof(*ip6) + rte_be_to_cpu_16(ip6->payload_len));
+    if (end < sizeof(*eh) + sizeof(*ip6) + sizeof(*nd) || ip6->hop_limits != 255 || nd->code ||
+        !memcmp(pc->ip6, zero, sizeof(zero))) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.port = port;
+    key.family = AF_INET6;
+
+    if (nd->type == ND_ADVERT) {
+        lladdr = neigh_nd_opt(mbuf, nd, end, ND_OPT_TGT_LLADDR);
+        if (lladdr) {
+            memcpy(key.addr, nd->target, sizeof(key.addr));
+            neigh_learn(c, &key, lladdr, 0, now);
+        }
+
+        if (punt_port(port)) {
+            punt_local(mbuf);
+            return;
+        }
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    if (nd->type != ND_SOLICIT || memcmp(nd->target, pc->ip6, sizeof(pc->ip6))) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    /** duplicate address detection comes from the unspecified address
+     * */
+    lladdr = neigh_nd_opt(mbuf, nd, end, ND_OPT_SRC_LLADDR);
+    if (lladdr && memcmp(ip6->src_addr, zero, sizeof(zero))) {
+        memcpy(key.addr, ip6->src_addr, sizeof(key.addr));
+        neigh_learn(c, &key, lladdr, 1, now);
+    }
+
+    reply = neigh_alloc(c, sizeof(*eh) + sizeof(*ip6) + sizeof(*nd) + sizeof(neigh_nd_opt_t));
+    if (reply) {
+        reh = rte_pktmbuf_mtod(reply, struct rte_ether_hdr *);
+        memcpy(&reh->dst_addr, lladdr ? lladdr : eh->src_addr.addr_bytes, RTE_ETHER_ADDR_LEN);
+        memcpy(&reh->src_addr, pc->hwaddr, RTE_ETHER_ADDR_LEN);
+        if (memcmp(ip6->src_addr, zero, sizeof(zero))) {
+            neigh_nd_build(reh, pc->ip6, ip6->src_addr, pc->ip6, ND_ADVERT, ND_NA_FLAGS,
+                ND_OPT_TGT_LLADDR, pc->hwaddr);
+        } else {
+            neigh_nd_build(reh, pc->ip6, all_nodes, pc->ip6, ND_ADVERT, ND_NA_FLAGS & ~0x40000000,
+                ND_OPT_TGT_LLADDR, pc->hwaddr);
+        }
+        neigh_xmit(c, port, reply);
+    }
+
+    rte_pktmbuf_free(mbuf);
+}
+
+/** Answer a ping of a port address back to where it came from
+ * */
+static void
+neigh_echo(config_t *c, struct rte_mbuf *mbuf, uint16_t port)
+{
+    interface_config_t *itfc = c->itf_cfg;
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip4 = (struct rte_ipv4_hdr *)(eh + 1);
+    struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eh + 1);
+    struct rte_icmp_hdr *icmp;
+    uint8_t addr[16];
+    uint32_t ip;
+    uint16_t from;
+
+    if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+        icmp = (struct rte_icmp_hdr *)((uint8_t *)ip4 + rte_ipv4_hdr_len(ip4));
+        if ((uint8_t *)(icmp + 1) > rte_pktmbuf_mtod(mbuf, uint8_t *) + rte_pktmbuf_data_len(mbuf)) {
+            rte_pktmbuf_free(mbuf);
+            return;
+        }
+
+        ip = ip4->src_addr;
+        ip4->src_addr = ip4->dst_addr;
+        ip4->dst_addr = ip;
+        ip4->time_to_live = 64;
+        ip4->hdr_checksum = 0;
+        ip4->hdr_checksum = rte_ipv4_cksum(ip4);
+
+        from = *(uint16_t *)&icmp->icmp_type;
+        icmp->icmp_type = RTE_IP_ICMP_ECHO_REPLY;
+        icmp->icmp_cksum = csum_replace2(icmp->icmp_cksum, from, *(uint16_t *)&icmp->icmp_type);
+    } else {
+        icmp = (struct rte_icmp_hdr *)(ip6 + 1);
+        if (rte_pktmbuf_data_len(mbuf) < sizeof(*eh) + sizeof(*ip6) + rte_be_to_cpu_16(ip6->payload_len)) {
+            rte_pktmbuf_free(mbuf);
+            return;
+        }
+
+        memcpy(addr, ip6->src_addr, sizeof(addr));
+        memcpy(ip6->src_addr, ip6->dst_addr, sizeof(addr));
+        memcpy(ip6->dst_addr, addr, sizeof(addr));
+        ip6->hop_limits = 64;
+
+        icmp->icmp_type = ICMP6_ECHO_REPLY;
+        icmp->icmp_cksum = 0;
+        icmp->icmp_cksum = rte_ipv6_udptcp_cksum(ip6, icmp);
+    }
+
+    eh->dst_addr = eh->src_addr;
+    memcpy(&eh->src_addr, itfc->ports[port].hwaddr, RTE_ETHER_ADDR_LEN);
+    neigh_xmit(c, port, mbuf);
+}
+
+static void
+neigh_hold(struct rte_mbuf *mbuf, const neigh_key_t *key, uint64_t now)
+{
+    int i;
+
+    for (i = 0; i < NEIGH_HOLD_NUM; i++) {
+        if (!neigh_holds[i].mbuf) {
+            neigh_holds[i].mbuf = mbuf;
+            neigh_holds[i].key = *key;
+            neigh_holds[i].at = now;
+            return;
+        }
+    }
+
+    neigh_hold_drops ++;
+    rte_pktmbuf_free(mbuf);
+}
+
+/** A routed packet whose neighbor was not resolved, or the address of a port
+ * */
+static void
+neigh_resolve(config_t *c, struct rte_mbuf *mbuf, uint16_t iport, uint8_t family, const uint8_t *dst,
+    uint64_t now)
+{
+    const route_nh_t *nh = route_nh_lookup(c, family, dst);
+    neigh_key_t key;
+    neigh_t *e;
+
+    if (!nh) {
+        rte_pktmbuf_free(mbuf);
+        return;
+    }
+
+    if (nh->type == ROUTE_NH_LOCAL) {
+        neigh_echo(c, mbuf, iport);
+        return;
+    }
+
+    memset(&key, 0, sizeof(key));
+    key.port = nh->port;
+    key.family = family;
+    memcpy(key.addr, nh->type == ROUTE_NH_GATEWAY ? nh->addr : dst, family == AF_INET ? 4 : 16);
+
+    /** resolved since the worker looked
+     * */
+    e = neigh_find(&key);
+    if (e && e->mac) {
+        route_rewrite(c, mbuf, key.port, e->mac);
+        neigh_xmit(c, key.port, mbuf);
+        return;
+    }
+
+    if (!e) {
+        e = neigh_create(&key, 0, now);
+        if (!e) {
+            rte_pktmbuf_free(mbuf);
+            return;
+        }
+        e->probed = now;
+        e->probes = 1;
+        neigh_request(c, &key);
+    }
+
+    neigh_hold(mbuf, &key, now);
+}
+
+static void
+neigh_input(config_t *c, struct rte_mbuf *mbuf, uint64_t now)
+{
+    packet_t *p = rte_mbuf_to_priv(mbuf);
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip4 = (struct rte_ipv4_hdr *)(eh + 1);
+    struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eh + 1);
+    uint8_t type;
+
+    if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP)) {
+        neigh_arp(c, mbuf, p->iport, now);
+    } else if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+        neigh_resolve(c, mbuf, p->iport, AF_INET, (uint8_t *)&ip4->dst_addr, now);
+    } else if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+        type = ip6->proto == IPPROTO_ICMPV6 ? ((neigh_nd_t *)(ip6 + 1))->type : 0;
+        if (type == ND_SOLICIT || type == ND_ADVERT) {
+            neigh_nd(c, mbuf, p->iport, now);
+        } else {
+            neigh_resolve(c, mbuf, p->iport, AF_INET6, ip6->dst_addr, now);
+        }
+    } else {
+        rte_pktmbuf_free(mbuf);
+    }
+}
+
+/** Probe neighbors out of date, and remove those which do not answer
+ * */
+static void
+neigh_scan(config_t *c, uint64_t now, uint64_t hz)
+{
+    neigh_t *e;
+    uint32_t i;
+
+    for (i = 0; i < NEIGH_MAX; i++) {
+        e = &neigh_table[i];
+        if (!e->used || (e->mac && now - e->updated < NEIGH_REACHABLE_SEC * hz) || now - e->probed < hz) {
+            continue;
+        }
+
+        if (e->probes >= NEIGH_PROBES) {
+            neigh_retire(i, now);
+            continue;
+        }
+
+        e->probes ++;
+        e->probed = now;
+        neigh_request(c, &e->key);
+    }
+}
+
+void neigh_tick(void *config)
+{
+    config_t *c = config;
+    struct rte_mbuf *pkts[NEIGH_BURST];
+    neigh_retired_t *r;
+    uint64_t now, hz;
+    unsigned int i, n, done = 0;
+
+    if (!neigh_hash) {
+        return;
+    }
+
+    now = rte_get_timer_cycles();
+    hz = rte_get_timer_hz();
+
+    /** a tick is 100 ms, one burst of it would leave the ring full
+     * */
+    while (done < NEIGH_TICK_BUDGET) {
+        n = rte_ring_sc_dequeue_burst(neigh_ring, (void **)pkts, NEIGH_BURST, NULL);
+        if (!n) {
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            neigh_input(c, pkts[i], now);
+        }
+        done += n;
+    }
+
+    for (i = 0; i < NEIGH_HOLD_NUM; i++) {
+        if (neigh_holds[i].mbuf && now - neigh_holds[i].at > NEIGH_HOLD_MS * hz / 1000) {
+            rte_pktmbuf_free(neigh_holds[i].mbuf);
+            neigh_holds[i].mbuf = NULL;
+            neigh_hold_drops ++;
+        }
+    }
+
+    /** no worker reads an entry a grace period after it left the hash
+     * */
+    while (neigh_retired_head != neigh_retired_tail) {
+        r = &neigh_retired[neigh_retired_head % NEIGH_MAX];
+        if (now - r->at < NEIGH_GRACE_SEC * hz) {
+            break;
+        }
+
+        if (r->pos >= 0) {
+            rte_hash_free_key_with_position(neigh_hash, r->pos);
+        }
+        neigh_free[neigh_free_num++] = r->idx;
+        neigh_retired_head ++;
+    }
+
+    if (now - neigh_scanned > hz) {
+        neigh_scanned = now;
+        neigh_scan(c, now, hz);
+    }
+}
+
+static int
+neigh_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    neigh_stats_t sum = {0};
+    uint64_t now, hz;
+    uint8_t mac[8];
+    char addr[INET6_ADDRSTRLEN];
+    neigh_t *e;
+    uint32_t i;
+    int lcore_id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    now = rte_get_timer_cycles();
+    hz = rte_get_timer_hz();
+
+    CLI_PRINT(cli, "%-40s %-6s %-18s %s", "address", "port", "mac", "age");
+    for (i = 0; i < NEIGH_MAX; i++) {
+        e = &neigh_table[i];
+        if (!e->used) {
+            continue;
+        }
+
+        inet_ntop(e->key.family, e->key.addr, addr, sizeof(addr));
+        if (!e->mac) {
+            CLI_PRINT(cli, "%-40s %-6u %-18s -", addr, e->key.port, "incomplete");
+            continue;
+        }
+
+        memcpy(mac, &e->mac, sizeof(mac));
+        CLI_PRINT(cli, "%-40s %-6u %02x:%02x:%02x:%02x:%02x:%02x  %"PRIu64"s", addr, e->key.port,
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], (now - e->updated) / hz);
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        sum.punted += neigh_stats[lcore_id].punted;
+        sum.punt_full += neigh_stats[lcore_id].punt_full;
+    }
+
+    CLI_PRINT(cli, "punted %"PRIu64" punt ring full %"PRIu64" requests %"PRIu64" hold drops %"PRIu64,
+        sum.punted, sum.punt_full, neigh_requests, neigh_hold_drops);
+    return 0;
+}
+
+int neigh_init(void *config)
+{
+    config_t *c = config;
+    struct rte_hash_parameters params = {
+        .name = "neigh_table",
+        .entries = NEIGH_MAX,
+        .key_len = sizeof(neigh_key_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = rte_socket_id(),
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF,
+    };
+    char name[RTE_HASH_NAMESIZE];
+    uint32_t i;
+
+    params.name = hot_object(HOT_HASH, name, sizeof(name), "neigh_table");
+    neigh_hash = rte_hash_create(&params);
+    neigh_table = rte_zmalloc("neigh_table", sizeof(neigh_t) * NEIGH_MAX, RTE_CACHE_LINE_SIZE);
+    neigh_ring = rte_ring_create(hot_object(HOT_RING, name, sizeof(name), "neigh_punt"), NEIGH_PUNT_SIZE, rte_socket_id(), RING_F_SC_DEQ);
+    if (!neigh_hash || !neigh_table || !neigh_ring) {
+        return -1;
+    }
+
+    for (i = 0; i < NEIGH_MAX; i++) {
+        neigh_free[neigh_free_num++] = NEIGH_MAX - 1 - i;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "neighbor", neigh_show, "arp and ndp neighbors");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
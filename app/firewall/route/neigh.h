@@ -0,0 +1,52 @@
+#ifndef _M_NEIGH_H_
+#define _M_NEIGH_H_
+
+#include <stdint.h>
+
+#include <rte_mbuf.h>
+
+/** Neighbor table of routed ports, ARP for IPv4 and NDP for IPv6
+ *
+ * Workers only read the table, a lock-free rte_hash written by the
+ * management core alone. What they can not answer is punted to the
+ * management core through one ring: ARP, neighbor solicitations and
+ * advertisements, pings of port addresses, and packets whose neighbor
+ * is not resolved yet.
+ *
+ * The management core answers requests for port addresses, learns
+ * from the answers, and holds unresolved packets until their neighbor
+ * answers or NEIGH_HOLD_MS passes. A neighbor is probed again after
+ * NEIGH_REACHABLE_SEC and removed after NEIGH_PROBES probes without an
+ * answer. Routed ports are untagged.
+ * */
+
+#define NEIGH_MAX               4096
+#define NEIGH_HOLD_NUM          256         /** packets held for resolution */
+#define NEIGH_HOLD_MS           1000
+#define NEIGH_REACHABLE_SEC     300
+#define NEIGH_PROBES            3
+#define NEIGH_GRACE_SEC         1
+
+typedef struct {
+    uint8_t addr[16];           /** network order, IPv4 in the first 4 bytes */
+    uint16_t port;
+    uint8_t family;             /** AF_INET or AF_INET6 */
+    uint8_t pad;
+} neigh_key_t;
+
+int neigh_init(void *config);
+void neigh_tick(void *config);
+
+/** Ethernet addresses of neighbors, in the low 6 bytes of macs, 0 for
+ * a neighbor not resolved
+ * */
+void neigh_lookup_bulk(const neigh_key_t *keys, uint16_t n, uint64_t *macs);
+
+/** Hand a packet over to the management core, freed if the ring is full
+ * */
+void neigh_punt(struct rte_mbuf *mbuf);
+
+#endif
+
+// file format utf-8
+// ident using space
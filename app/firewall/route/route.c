@@ -0,0 +1,693 @@
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_icmp.h>
+#include <rte_fib.h>
+#include <rte_fib6.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../csum.h"
+#include "../interface/interface.h"
+#include "../hot.h"
+#include "../punt/punt.h"
+#include "../prefix.h"
+
+#include "route.h"
+
+#define ROUTE_TBL8_NUM      (1U << 12)
+#define ROUTE6_TBL8_NUM     (1U << 14)
+
+#define ICMP6_ECHO_REQUEST  128
+#define ICMP6_ND_SOLICIT    135
+#define ICMP6_ND_ADVERT     136
+
+typedef struct {
+    uint64_t routed;
+    uint64_t no_route;
+    uint64_t ttl;
+    uint64_t punted;
+} __rte_cache_aligned route_stats_t;
+
+static route_config_t route_cfg_A, route_cfg_B;
+static route_stats_t route_stats[RTE_MAX_LCORE];
+static int route_enabled;       /** any routed port */
+
+MODULE_DECLARE(route) = {
+    .name = "route",
+    .id = MOD_ID_ROUTE,
+    .enabled = true,
+    .log = true,
+    .init = route_init,
+    .proc = route_proc,
+    .conf = route_conf,
+    .tick = route_tick,
+    .priv = NULL
+};
+
+/** L3 header of an untagged frame
+ * @return
+ *  ether type, network order, 0 if the header is short
+ * */
+static inline uint16_t
+route_l3(struct rte_mbuf *mbuf, void **l3)
+{
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    uint16_t len = rte_pktmbuf_data_len(mbuf);
+
+    *l3 = eh + 1;
+
+    if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+        return len >= sizeof(*eh) + sizeof(struct rte_ipv4_hdr) ? eh->ether_type : 0;
+    }
+
+    if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+        return len >= sizeof(*eh) + sizeof(struct rte_ipv6_hdr) ? eh->ether_type : 0;
+    }
+
+    return eh->ether_type;
+}
+
+/** ICMP or ICMPv6 type right after the IP header, -1 for other packets
+ * */
+static inline int
+route_icmp_type(struct rte_mbuf *mbuf, void *l3, uint8_t family)
+{
+    uint16_t off = (uint8_t *)l3 - rte_pktmbuf_mtod(mbuf, uint8_t *);
+    struct rte_ipv4_hdr *ip4 = l3;
+    struct rte_ipv6_hdr *ip6 = l3;
+
+    if (family == AF_INET) {
+        off += rte_ipv4_hdr_len(ip4);
+        if (ip4->next_proto_id != IPPROTO_ICMP || off >= rte_pktmbuf_data_len(mbuf)) {
+            return -1;
+        }
+    } else {
+        off += sizeof(*ip6);
+        if (ip6->proto != IPPROTO_ICMPV6 || off >= rte_pktmbuf_data_len(mbuf)) {
+            return -1;
+        }
+    }
+
+    return *rte_pktmbuf_mtod_offset(mbuf, uint8_t *, off);
+}
+
+/** Packets for a port address the management core answers: pings and
+ * neighbor discovery
+ * */
+static inline int
+route_is_control(struct rte_mbuf *mbuf, void *l3, uint8_t family)
+{
+    int type = route_icmp_type(mbuf, l3, family);
+
+    if (family == AF_INET) {
+        return type == RTE_IP_ICMP_ECHO_REQUEST;
+    }
+
+    return type == ICMP6_ECHO_REQUEST || type == ICMP6_ND_SOLICIT || type == ICMP6_ND_ADVERT;
+}
+
+static inline void
+route_next(route_config_t *rc, route_stats_t *st, struct rte_mbuf *mbuf, void *l3, uint8_t family, uint64_t nh)
+{
+    packet_t *p = rte_mbuf_to_priv(mbuf);
+    uint8_t ttl;
+
+    if (!nh) {
+        st->no_route ++;
+        p->oport = PORT_DROP;
+        return;
+    }
+
+    /** the rest of the local traffic is for the kernel, if the port has one
+     * */
+    if (rc->nhs[nh - 1].type == ROUTE_NH_LOCAL) {
+        if (route_is_control(mbuf, l3, family)) {
+            p->oport = PORT_PUNT;
+        } else {
+            p->oport = punt_port(p->iport) ? PORT_LOCAL : PORT_DROP;
+        }
+        return;
+    }
+
+    ttl = family == AF_INET ? ((struct rte_ipv4_hdr *)l3)->time_to_live : ((struct rte_ipv6_hdr *)l3)->hop_limits;
+    if (ttl <= 1) {
+        st->ttl ++;
+        p->oport = PORT_DROP;
+        return;
+    }
+
+    p->nh = nh;
+    p->oport = rc->nhs[nh - 1].port;
+}
+
+void route_lookup_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    route_config_t *rc = c->route_cfg;
+    route_stats_t *st = &route_stats[rte_lcore_id()];
+    uint32_t ips[n];
+    uint8_t ips6[n][RTE_FIB6_IPV6_ADDR_SIZE];
+    uint64_t nhs[n], nhs6[n];
+    uint16_t idx[n], idx6[n], n4 = 0, n6 = 0, i;
+    struct rte_ipv6_hdr *ip6;
+    packet_t *p;
+    uint16_t type;
+    void *l3;
+
+    if (!route_enabled) {
+        return;
+    }
+
+    /** sort out IPv4 and IPv6 for one bulk lookup each
+     * */
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!p || p->iport >= itfc->port_num || itfc->ports[p->iport].type != PORT_TYPE_ROUTED) {
+            continue;
+        }
+
+        p->nh = 0;
+        type = route_l3(mbufs[i], &l3);
+
+        if (type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+            ips[n4] = rte_be_to_cpu_32(((struct rte_ipv4_hdr *)l3)->dst_addr);
+            idx[n4++] = i;
+        } else if (type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+            ip6 = l3;
+            if (ip6->dst_addr[0] == 0xff) {
+                /** multicast is not routed, only neighbor discovery is taken
+                 * */
+                p->oport = route_is_control(mbufs[i], l3, AF_INET6) ? PORT_PUNT : PORT_DROP;
+                continue;
+            }
+            memcpy(ips6[n6], ip6->dst_addr, sizeof(ips6[n6]));
+            idx6[n6++] = i;
+        } else if (type == rte_cpu_to_be_16(RTE_ETHER_TYPE_ARP)) {
+            p->oport = PORT_PUNT;
+        } else {
+            p->oport = PORT_DROP;
+        }
+    }
+
+    if (n4) {
+        rte_fib_lookup_bulk(rc->fib, ips, nhs, n4);
+    }
+
+    if (n6) {
+        rte_fib6_lookup_bulk(rc->fib6, ips6, nhs6, n6);
+    }
+
+    for (i = 0; i < n4; i++) {
+        route_l3(mbufs[idx[i]], &l3);
+        route_next(rc, st, mbufs[idx[i]], l3, AF_INET, nhs[i]);
+    }
+
+    for (i = 0; i < n6; i++) {
+        route_l3(mbufs[idx6[i]], &l3);
+        route_next(rc, st, mbufs[idx6[i]], l3, AF_INET6, nhs6[i]);
+    }
+}
+
+void route_rewrite(void *config, struct rte_mbuf *mbuf, uint16_t port, uint64_t mac)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip4;
+    struct rte_ipv6_hdr *ip6;
+    uint16_t from;
+
+    memcpy(&eh->dst_addr, &mac, RTE_ETHER_ADDR_LEN);
+    memcpy(&eh->src_addr, itfc->ports[port].hwaddr, RTE_ETHER_ADDR_LEN);
+
+    if (eh->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+        ip4 = (struct rte_ipv4_hdr *)(eh + 1);
+        from = *(uint16_t *)&ip4->time_to_live;
+        ip4->time_to_live --;
+        ip4->hdr_checksum = csum_replace2(ip4->hdr_checksum, from, *(uint16_t *)&ip4->time_to_live);
+    } else {
+        ip6 = (struct rte_ipv6_hdr *)(eh + 1);
+        ip6->hop_limits --;
+    }
+}
+
+static inline void
+route_neigh_key(const route_nh_t *nh, void *l3, neigh_key_t *key)
+{
+    memset(key, 0, sizeof(*key));
+    key->port = nh->port;
+    key->family = nh->family;
+
+    if (nh->type == ROUTE_NH_GATEWAY) {
+        memcpy(key->addr, nh->addr, sizeof(key->addr));
+    } else if (nh->family == AF_INET) {
+        memcpy(key->addr, &((struct rte_ipv4_hdr *)l3)->dst_addr, sizeof(uint32_t));
+    } else {
+        memcpy(key->addr, ((struct rte_ipv6_hdr *)l3)->dst_addr, sizeof(key->addr));
+    }
+}
+
+void route_rewrite_burst(void *config, struct rte_mbuf **mbufs, uint16_t n)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    route_config_t *rc = c->route_cfg;
+    route_stats_t *st = &route_stats[rte_lcore_id()];
+    neigh_key_t keys[n];
+    uint64_t macs[n];
+    uint16_t idx[n], m = 0, i;
+    packet_t *p;
+    void *l3;
+
+    if (!route_enabled) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (!p || p->iport >= itfc->port_num || itfc->ports[p->iport].type != PORT_TYPE_ROUTED || !p->nh) {
+            continue;
+        }
+
+        route_l3(mbufs[i], &l3);
+        route_neigh_key(&rc->nhs[p->nh - 1], l3, &keys[m]);
+        idx[m++] = i;
+    }
+
+    if (!m) {
+        return;
+    }
+
+    neigh_lookup_bulk(keys, m, macs);
+
+    for (i = 0; i < m; i++) {
+        p = rte_mbuf_to_priv(mbufs[idx[i]]);
+        if (!macs[i]) {
+            st->punted ++;
+            p->oport = PORT_PUNT;
+            continue;
+        }
+
+        route_rewrite(c, mbufs[idx[i]], keys[i].port, macs[i]);
+        st->routed ++;
+    }
+}
+
+const route_nh_t *route_nh_lookup(void *config, uint8_t family, const uint8_t *dst)
+{
+    config_t *c = config;
+    route_config_t *rc = c->route_cfg;
+    uint8_t ip6[1][RTE_FIB6_IPV6_ADDR_SIZE];
+    uint32_t ip;
+    uint64_t nh = 0;
+
+    if (!rc) {
+        return NULL;
+    }
+
+    if (family == AF_INET) {
+        memcpy(&ip, dst, sizeof(ip));
+        ip = rte_be_to_cpu_32(ip);
+        rte_fib_lookup_bulk(rc->fib, &ip, &nh, 1);
+    } else {
+        memcpy(ip6[0], dst, sizeof(ip6[0]));
+        rte_fib6_lookup_bulk(rc->fib6, ip6, &nh, 1);
+    }
+
+    return nh ? &rc->nhs[nh - 1] : NULL;
+}
+
+mod_ret_t route_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    packet_t *p = rte_mbuf_to_priv(mbuf);
+
+    if (!route_enabled || !p || p->iport >= itfc->port_num || itfc->ports[p->iport].type != PORT_TYPE_ROUTED) {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (hook == MOD_HOOK_PREROUTING) {
+        route_lookup_burst(c, &mbuf, 1);
+    } else if (hook == MOD_HOOK_POSTROUTING) {
+        route_rewrite_burst(c, &mbuf, 1);
+    } else {
+        return MOD_RET_ACCEPT;
+    }
+
+    if (p->oport == PORT_PUNT) {
+        neigh_punt(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    if (p->oport == PORT_DROP) {
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static int
+route_add(route_config_t *rc, uint8_t family, const uint8_t *addr, uint8_t depth, const route_nh_t *nh)
+{
+    route_entry_t *r;
+    uint32_t ip;
+    uint16_t i;
+    int ret;
+
+    for (i = 0; i < rc->nh_num; i++) {
+        if (!memcmp(&rc->nhs[i], nh, sizeof(*nh))) {
+            break;
+        }
+    }
+
+    if (i == rc->nh_num) {
+        if (rc->nh_num == MAX_ROUTE_NH) {
+            printf("too many next hops, at most %u\n", MAX_ROUTE_NH);
+            return -1;
+        }
+        rc->nhs[rc->nh_num++] = *nh;
+    }
+
+    if (rc->route_num == MAX_ROUTE_NUM) {
+        printf("too many routes, at most %u\n", MAX_ROUTE_NUM);
+        return -1;
+    }
+
+    if (family == AF_INET) {
+        memcpy(&ip, addr, sizeof(ip));
+        ret = rte_fib_add(rc->fib, rte_be_to_cpu_32(ip), depth, i + 1);
+    } else {
+        ret = rte_fib6_add(rc->fib6, addr, depth, i + 1);
+    }
+
+    if (ret) {
+        printf("add route to fib failed %d\n", ret);
+        return -1;
+    }
+
+    r = &rc->routes[rc->route_num++];
+    r->family = family;
+    r->depth = depth;
+    r->nh = i + 1;
+    memcpy(r->addr, addr, sizeof(r->addr));
+    return 0;
+}
+
+/** Connected and local routes of the port addresses
+ * */
+static int
+route_port_load(interface_config_t *itfc, route_config_t *rc)
+{
+    route_nh_t nh;
+    port_config_t *pc;
+    uint8_t addr[16], zero[16] = {0};
+    uint32_t ip;
+    uint16_t i;
+
+    for (i = 0; i < itfc->port_num; i++) {
+        pc = &itfc->ports[i];
+        if (pc->type != PORT_TYPE_ROUTED) {
+            continue;
+        }
+
+        memset(&nh, 0, sizeof(nh));
+        nh.port = i;
+
+        if (pc->ip) {
+            memset(addr, 0, sizeof(addr));
+            ip = rte_cpu_to_be_32(pc->ip);
+            memcpy(addr, &ip, sizeof(ip));
+            nh.family = AF_INET;
+
+            nh.type = ROUTE_NH_CONNECTED;
+            if (route_add(rc, AF_INET, addr, pc->ip_depth, &nh)) {
+                return -1;
+            }
+            nh.type = ROUTE_NH_LOCAL;
+            if (route_add(rc, AF_INET, addr, 32, &nh)) {
+                return -1;
+            }
+        }
+
+        if (memcmp(pc->ip6, zero, sizeof(zero))) {
+            nh.family = AF_INET6;
+
+            nh.type = ROUTE_NH_CONNECTED;
+            if (route_add(rc, AF_INET6, pc->ip6, pc->ip6_depth, &nh)) {
+                return -1;
+            }
+            nh.type = ROUTE_NH_LOCAL;
+            if (route_add(rc, AF_INET6, pc->ip6, 128, &nh)) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void
+route_config_free(route_config_t *rc)
+{
+    rte_fib_free(rc->fib);
+    rte_fib6_free(rc->fib6);
+    free(rc->routes);
+    memset(rc, 0, sizeof(*rc));
+}
+
+static int
+route_json_load(config_t *c, route_config_t *rc)
+{
+    struct rte_fib_conf fib_conf = {
+        .type = RTE_FIB_DIR24_8,
+        .default_nh = 0,
+        .max_routes = MAX_ROUTE_NUM,
+        .dir24_8 = {
+            .nh_sz = RTE_FIB_DIR24_8_2B,
+            .num_tbl8 = ROUTE_TBL8_NUM,
+        },
+    };
+    struct rte_fib6_conf fib6_conf = {
+        .type = RTE_FIB6_TRIE,
+        .default_nh = 0,
+        .max_routes = MAX_ROUTE_NUM,
+        .trie = {
+            .nh_sz = RTE_FIB6_TRIE_2B,
+            .num_tbl8 = ROUTE6_TBL8_NUM,
+        },
+    };
+    const char *suffix = (rc == &route_cfg_A) ? "A" : "B";
+    json_object *jr = NULL, *ja;
+    const route_nh_t *gw_nh;
+    route_nh_t nh;
+    char name[64];
+    uint8_t family, gw_family, addr[16], depth, gw_depth;
+    int i, route_num, ret = 0;
+
+    /** the buffer was left by all workers at the last config switch
+     * */
+    route_config_free(rc);
+
+    hot_object(HOT_FIB, name, sizeof(name), "route_fib_%s", suffix);
+    rc->fib = rte_fib_create(name, rte_socket_id(), &fib_conf);
+    hot_object(HOT_FIB6, name, sizeof(name), "route_fib6_%s", suffix);
+    rc->fib6 = rte_fib6_create(name, rte_socket_id(), &fib6_conf);
+    rc->routes = calloc(MAX_ROUTE_NUM, sizeof(route_entry_t));
+    if (!rc->fib || !rc->fib6 || !rc->routes) {
+        printf("create fib failed\n");
+        return -1;
+    }
+
+    if (route_port_load(c->itf_cfg, rc)) {
+        return -1;
+    }
+
+    jr = JR(CONFIG_PATH, "route.json");
+    if (!jr) {
+        printf("no route.json, connected routes only\n");
+        return 0;
+    }
+
+    route_num = JA(jr, "routes", &ja);
+
+    for (i = 0; i < route_num; i++) {
+        json_object *jo = JO(ja, i), *jp, *jg;
+
+        jp = JV(jo, "prefix");
+        jg = JV(jo, "gateway");
+        if (!jp || !jg || prefix_parse(JV_S(jp), &family, addr, &depth)) {
+            printf("invalid route %d\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        memset(&nh, 0, sizeof(nh));
+        if (prefix_parse(JV_S(jg), &gw_family, nh.addr, &gw_depth) || gw_family != family) {
+            printf("invalid gateway %s of route %s\n", JV_S(jg), JV_S(jp));
+            ret = -1;
+            goto done;
+        }
+
+        /** the gateway must be on the link of a routed port
+         * */
+        gw_nh = NULL;
+        if (family == AF_INET) {
+            uint32_t ip;
+            uint64_t id = 0;
+            memcpy(&ip, nh.addr, sizeof(ip));
+            ip = rte_be_to_cpu_32(ip);
+            rte_fib_lookup_bulk(rc->fib, &ip, &id, 1);
+            gw_nh = id ? &rc->nhs[id - 1] : NULL;
+        } else {
+            uint8_t ip6[1][RTE_FIB6_IPV6_ADDR_SIZE];
+            uint64_t id = 0;
+            memcpy(ip6[0], nh.addr, sizeof(ip6[0]));
+            rte_fib6_lookup_bulk(rc->fib6, ip6, &id, 1);
+            gw_nh = id ? &rc->nhs[id - 1] : NULL;
+        }
+
+        if (!gw_nh || gw_nh->type != ROUTE_NH_CONNECTED) {
+            printf("gateway %s of route %s is on no routed port\n", JV_S(jg), JV_S(jp));
+            ret = -1;
+            goto done;
+        }
+
+        nh.type = ROUTE_NH_GATEWAY;
+        nh.family = family;
+        nh.port = gw_nh->port;
+        if (route_add(rc, family, addr, depth, &nh)) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int route_conf(void *config)
+{
+    config_t *c = config;
+    route_config_t *rc;
+
+    if (!route_enabled) {
+        return 0;
+    }
+
+    rc = (c->route_cfg == &route_cfg_A) ? &route_cfg_B : &route_cfg_A;
+    if (route_json_load(c, rc)) {
+        printf("route json load failed\n");
+        route_config_free(rc);
+        return -1;
+    }
+
+    c->route_cfg = rc;
+    return 0;
+}
+
+void route_tick(void *config)
+{
+    if (route_enabled) {
+        neigh_tick(config);
+    }
+}
+
+static int
+route_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = (config_t *)cli_get_context(cli);
+    route_config_t *rc = c->route_cfg;
+    route_stats_t sum = {0};
+    route_entry_t *r;
+    route_nh_t *nh;
+    char addr[INET6_ADDRSTRLEN], gw[INET6_ADDRSTRLEN];
+    uint32_t i;
+    int lcore_id;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!route_enabled || !rc) {
+        CLI_PRINT(cli, "route disabled");
+        return 0;
+    }
+
+    for (i = 0; i < rc->route_num; i++) {
+        r = &rc->routes[i];
+        nh = &rc->nhs[r->nh - 1];
+        inet_ntop(r->family, r->addr, addr, sizeof(addr));
+
+        switch (nh->type) {
+            case ROUTE_NH_LOCAL:
+                CLI_PRINT(cli, "%s/%u local port %u", addr, r->depth, nh->port);
+                break;
+            case ROUTE_NH_CONNECTED:
+                CLI_PRINT(cli, "%s/%u connected port %u", addr, r->depth, nh->port);
+                break;
+            default:
+                inet_ntop(nh->family, nh->addr, gw, sizeof(gw));
+                CLI_PRINT(cli, "%s/%u via %s port %u", addr, r->depth, gw, nh->port);
+                break;
+        }
+    }
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        sum.routed += route_stats[lcore_id].routed;
+        sum.no_route += route_stats[lcore_id].no_route;
+        sum.ttl += route_stats[lcore_id].ttl;
+        sum.punted += route_stats[lcore_id].punted;
+    }
+
+    CLI_PRINT(cli, "routed %"PRIu64" no route %"PRIu64" ttl expired %"PRIu64" unresolved %"PRIu64,
+        sum.routed, sum.no_route, sum.ttl, sum.punted);
+    return 0;
+}
+
+int route_init(void *config)
+{
+    config_t *c = config;
+    interface_config_t *itfc = c->itf_cfg;
+    int i;
+
+    for (i = 0; i < itfc->port_num; i++) {
+        if (itfc->ports[i].type == PORT_TYPE_ROUTED) {
+            route_enabled = 1;
+        }
+    }
+
+    if (!route_enabled) {
+        printf("no routed port, route disabled\n");
+        return 0;
+    }
+
+    if (route_conf(c)) {
+        printf("route conf failed\n");
+        return -1;
+    }
+
+    if (neigh_init(c)) {
+        printf("neigh init failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "route", route_show, "routes and statistics");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,83 @@
+#ifndef _M_ROUTE_H_
+#define _M_ROUTE_H_
+
+#include "../module.h"
+#include "neigh.h"
+
+/** Routing between PORT_TYPE_ROUTED ports
+ *
+ * A routed port has an "ip" and/or "ip6" in interface.json, each gives
+ * a connected route and a local host route. Other routes are read from
+ * route.json, the port of a gateway is the one of its connected route:
+ *
+ *   {"routes": [{"prefix": "0.0.0.0/0", "gateway": "10.0.0.254"},
+ *               {"prefix": "2001:db8:1::/48", "gateway": "2001:db8::fe"}]}
+ *
+ * Routes compile into an rte_fib and an rte_fib6, double buffered as
+ * other configs, so a reload never stalls the workers. PREROUTING looks
+ * up the destination, after DNAT, and POSTROUTING takes the neighbor,
+ * rewrites the Ethernet header and decrements the TTL, patching the IPv4
+ * checksum, as lib/node ip4_lookup and ip4_rewrite do. Graph workers run
+ * both over a whole burst with one bulk lookup each.
+ *
+ * TTL expiry and missing routes drop silently, no ICMP error is sent.
+ * */
+
+#define MAX_ROUTE_NUM       (1U << 16)
+#define MAX_ROUTE_NH        1024
+
+typedef enum {
+    ROUTE_NH_LOCAL,             /** an address of a port */
+    ROUTE_NH_CONNECTED,         /** the destination is the neighbor */
+    ROUTE_NH_GATEWAY,
+} route_nh_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t family;             /** AF_INET or AF_INET6 */
+    uint16_t port;
+    uint8_t addr[16];           /** gateway, network order */
+} route_nh_t;
+
+typedef struct {
+    uint8_t family;
+    uint8_t depth;
+    uint16_t nh;
+    uint8_t addr[16];           /** network order */
+} route_entry_t;
+
+typedef struct {
+    struct rte_fib *fib;
+    struct rte_fib6 *fib6;
+    route_entry_t *routes;
+    uint32_t route_num;
+    uint16_t nh_num;
+    route_nh_t nhs[MAX_ROUTE_NH];   /** next hop n is nhs[n - 1], 0 for no route */
+} route_config_t;
+
+/** Look up the routed port packets of mbufs and set p->nh and p->oport.
+ * Packets for the management core are PORT_PUNT, to be given to
+ * neigh_punt() by the caller, packets without a route or TTL PORT_DROP.
+ * */
+void route_lookup_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+/** Rewrite the packets looked up by route_lookup_burst for their next
+ * hop, those of unresolved neighbors become PORT_PUNT
+ * */
+void route_rewrite_burst(void *config, struct rte_mbuf **mbufs, uint16_t n);
+
+/** For the management core: the next hop of a destination, NULL if no
+ * route, and the rewrite once its neighbor is known
+ * */
+const route_nh_t *route_nh_lookup(void *config, uint8_t family, const uint8_t *dst);
+void route_rewrite(void *config, struct rte_mbuf *mbuf, uint16_t port, uint64_t mac);
+
+int route_init(void *config);
+mod_ret_t route_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int route_conf(void *config);
+void route_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_ring.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../worker.h"
+#include "../interface/interface.h"
+
+#include "scale.h"
+
+typedef enum {
+    SCALE_REQ_NONE,
+    SCALE_REQ_PARK,
+    SCALE_REQ_UNPARK,
+} scale_req_t;
+
+MODULE_DECLARE(scale) = {
+    .name = "scale",
+    .id = MOD_ID_SCALE,
+    .enabled = true,
+    .log = true,
+    .init = scale_init,
+    .proc = NULL,
+    .conf = NULL,
+    .tick = scale_tick,
+    .priv = NULL
+};
+
+static volatile int scale_auto;
+static unsigned int scale_min = 1;
+static unsigned int scale_high = SCALE_HIGH;
+static unsigned int scale_low = SCALE_LOW;
+static uint64_t scale_period;
+
+/** Set by the cli, served by the management core, so a command never
+ * races the autoscaler
+ * */
+static volatile uint8_t scale_reqs[MAX_WORKER_NUM];
+
+static uint64_t scale_until;
+static uint64_t scale_sum;
+static uint64_t scale_samples;
+static uint64_t scale_parks;
+static uint64_t scale_unparks;
+
+/** Rx ring occupancy of the active workers, in percent
+ * */
+static unsigned int
+scale_occupancy(config_t *c)
+{
+    unsigned int used = 0, size = 0;
+    int i;
+
+    for (i = 0; i < c->worker_num; i++) {
+        if (worker_states[i] == WORKER_ACTIVE) {
+            used += rte_ring_count(c->rx_queues[i]);
+            size += rte_ring_get_capacity(c->rx_queues[i]);
+        }
+    }
+
+    return size ? used * 100 / size : 0;
+}
+
+static void
+scale_park(config_t *c, int q)
+{
+    if (worker_park(c, q)) {
+        printf("worker queue %d park failed\n", q);
+        return;
+    }
+
+    scale_parks ++;
+    printf("worker queue %d parked, %u active\n", q, worker_active_num(c));
+}
+
+static void
+scale_unpark(config_t *c, int q)
+{
+    if (worker_unpark(c, q)) {
+        printf("worker queue %d unpark failed\n", q);
+        return;
+    }
+
+    scale_unparks ++;
+    printf("worker queue %d unparked, %u active\n", q, worker_active_num(c));
+}
+
+/** One step per period, parks the highest active queue and unparks the
+ * lowest parked one
+ * */
+static void
+scale_auto_tick(config_t *c, uint64_t now)
+{
+    unsigned int occupancy;
+    int i;
+
+    scale_sum += scale_occupancy(c);
+    scale_samples ++;
+
+    if (now < scale_until) {
+        return;
+    }
+
+    occupancy = scale_sum / scale_samples;
+    scale_sum = 0;
+    scale_samples = 0;
+    scale_until = now + scale_period;
+
+    if (occupancy > scale_high) {
+        for (i = 0; i < c->worker_num; i++) {
+            if (worker_states[i] == WORKER_PARKED) {
+                scale_unpark(c, i);
+                return;
+            }
+        }
+    } else if (occupancy < scale_low && worker_active_num(c) > scale_min) {
+        for (i = c->worker_num - 1; i >= 0; i--) {
+            if (worker_states[i] == WORKER_ACTIVE) {
+                scale_park(c, i);
+                return;
+            }
+        }
+    }
+}
+
+void scale_tick(void *config)
+{
+    config_t *c = config;
+    int i;
+
+    for (i = 0; i < c->worker_num; i++) {
+        switch (scale_reqs[i]) {
+            case SCALE_REQ_PARK:
+                scale_park(c, i);
+                break;
+            case SCALE_REQ_UNPARK:
+                scale_unpark(c, i);
+                break;
+            default:
+                continue;
+        }
+        scale_reqs[i] = SCALE_REQ_NONE;
+    }
+
+    if (scale_auto) {
+        scale_auto_tick(c, rte_get_timer_cycles());
+    }
+}
+
+/** Worker queue of the lcore given to a command, -1 if not a worker
+ * */
+static int
+scale_queue(struct cli_def *cli, config_t *c)
+{
+    const char *opt;
+    unsigned int lcore_id;
+
+    opt = CLI_OPT_V(cli, "lcore");
+    if (!opt) {
+        return -1;
+    }
+
+    lcore_id = atoi(opt);
+    if (lcore_id >= RTE_MAX_LCORE || !rte_lcore_is_enabled(lcore_id) || !worker_lcore(c, lcore_id)) {
+        CLI_PRINT(cli, "lcore %u runs no worker", lcore_id);
+        return -1;
+    }
+
+    return lcore_id % c->worker_num;
+}
+
+static int
+scale_request(struct cli_def *cli, scale_req_t req)
+{
+    config_t *c = cli_get_context(cli);
+    int q;
+
+    q = scale_queue(cli, c);
+    if (q < 0) {
+        return -1;
+    }
+
+    /** the command overrides the autoscaler until 'worker auto 1'
+     * */
+    scale_auto = 0;
+    scale_reqs[q] = req;
+    CLI_PRINT(cli, "ok!");
+    return 0;
+}
+
+static int
+scale_park_cmd(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    return scale_request(cli, SCALE_REQ_PARK);
+}
+
+static int
+scale_unpark_cmd(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    return scale_request(cli, SCALE_REQ_UNPARK);
+}
+
+static int
+scale_auto_cmd(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    const char *opt;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    opt = CLI_OPT_V(cli, "on");
+    if (!opt) {
+        return -1;
+    }
+
+    scale_auto = !!atoi(opt);
+    CLI_PRINT(cli, "ok!");
+    return 0;
+}
+
+static int
+scale_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    static const char *states[] = {"active", "parking", "parked"};
+    config_t *c = cli_get_context(cli);
+    unsigned int lcore_id, q;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    CLI_PRINT(cli, "auto %s min %u high %u%% low %u%% period %"PRIu64"s",
+        scale_auto ? "on" : "off", scale_min, scale_high, scale_low, scale_period / rte_get_timer_hz());
+    CLI_PRINT(cli, "active %u of %d occupancy %u%% parks %"PRIu64" unparks %"PRIu64,
+        worker_active_num(c), c->worker_num, scale_occupancy(c), scale_parks, scale_unparks);
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        if (!worker_lcore(c, lcore_id)) {
+            continue;
+        }
+
+        q = lcore_id % c->worker_num;
+        CLI_PRINT(cli, "lcore %u queue %u %s rx ring %u via queue %u", lcore_id, q,
+            states[worker_states[q]], rte_ring_count(c->rx_queues[q]), worker_rx_map[q]);
+    }
+    return 0;
+}
+
+static int
+scale_json_load(config_t *c)
+{
+    json_object *jr = NULL, *jv;
+    unsigned int period = SCALE_PERIOD;
+    int ret = 0;
+
+    scale_period = (uint64_t)period * rte_get_timer_hz();
+
+    jr = JR(CONFIG_PATH, "scale.json");
+    if (!jr) {
+        printf("no scale.json, autoscaler off\n");
+        return 0;
+    }
+
+    jv = JV(jr, "min");
+    if (jv) {
+        scale_min = JV_I(jv);
+    }
+
+    jv = JV(jr, "high");
+    if (jv) {
+        scale_high = JV_I(jv);
+    }
+
+    jv = JV(jr, "low");
+    if (jv) {
+        scale_low = JV_I(jv);
+    }
+
+    jv = JV(jr, "period");
+    if (jv) {
+        period = JV_I(jv);
+    }
+
+    if (!scale_min || (int)scale_min > c->worker_num || scale_low >= scale_high || scale_high > 100 || !period) {
+        printf("invalid scale.json, need 0 < min <= %d, low < high <= 100, period > 0\n", c->worker_num);
+        ret = -1;
+        goto done;
+    }
+
+    jv = JV(jr, "auto");
+    scale_auto = jv && JV_I(jv);
+    scale_period = (uint64_t)period * rte_get_timer_hz();
+    scale_until = rte_get_timer_cycles() + scale_period;
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int scale_init(void *config)
+{
+    config_t *c = config;
+
+    if (scale_json_load(c)) {
+        printf("scale json load failed\n");
+        return -1;
+    }
+
+    /** workers of a takeover start active, the RETA may still be the one
+     * of a process with some parked
+     * */
+    if (hot_takeover() && interface_reta_update(c)) {
+        printf("worker reta update failed\n");
+    }
+
+    if (c->cli_def) {
+        struct cli_command *cmd, *sub;
+
+        CLI_CMD_C(c->cli_def, c->cli_show, "worker", scale_show, "worker lcores and their rx rings");
+        cmd = CLI_CMD_C(c->cli_def, NULL, "worker", NULL, "worker lcores");
+        sub = CLI_CMD_C(c->cli_def, cmd, "park", scale_park_cmd, "stop a worker, its rx queue goes to the others");
+        CLI_OPT_A(sub, "lcore", "lcore id of the worker");
+        sub = CLI_CMD_C(c->cli_def, cmd, "unpark", scale_unpark_cmd, "start a parked worker again");
+        CLI_OPT_A(sub, "lcore", "lcore id of the worker");
+        sub = CLI_CMD_C(c->cli_def, cmd, "auto", scale_auto_cmd, "autoscaler of scale.json on or off");
+        CLI_OPT_A(sub, "on", "1 or 0");
+    }
+
+    printf("worker autoscaler %s, %d workers\n", scale_auto ? "on" : "off", c->worker_num);
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,33 @@
+#ifndef _M_SCALE_H_
+#define _M_SCALE_H_
+
+#include "../module.h"
+
+/** Runtime worker scaling
+ *
+ * A parked worker lcore sleeps, its rx ring is fed to an active worker
+ * by the RX lcore and the RSS RETA of the ports leaves out its queue,
+ * see worker_park(). Workers are parked and unparked by
+ * 'worker park lcore <id>' and 'worker unpark lcore <id>', or by the
+ * autoscaler of scale.json, optional:
+ *
+ *   {"auto": "1", "min": "1", "high": "50", "low": "5", "period": "10"}
+ *
+ * Every period seconds it averages the rx ring occupancy of the active
+ * workers, in percent of the ring size, over the samples of each tick.
+ * Above high a parked worker is unparked, below low an active one is
+ * parked, never less than min. One step per period keeps it from
+ * flapping.
+ * */
+
+#define SCALE_HIGH          50
+#define SCALE_LOW           5
+#define SCALE_PERIOD        10
+
+int scale_init(void *config);
+void scale_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
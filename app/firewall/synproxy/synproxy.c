@@ -0,0 +1,774 @@
+#include <inttypes.h>
+#include <netinet/in.h>
+
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_random.h>
+#include <rte_malloc.h>
+#include <rte_mempool.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../csum.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../worker.h"
+
+#include "synproxy.h"
+
+#define TCP_FLAGS_MASK (RTE_TCP_SYN_FLAG | RTE_TCP_ACK_FLAG | RTE_TCP_RST_FLAG | RTE_TCP_FIN_FLAG)
+
+/** cookie layout: [31..8] keyed hash, [7..3] time slot, [2..0] mss index
+ * */
+#define COOKIE_SLOT_SHIFT   6       /** 64s per time slot */
+#define COOKIE_SLOT_MASK    0x1f
+#define COOKIE_MSS_MASK     0x07
+
+enum {
+    SESSION_SYN_SENT,       /** cookie validated, syn sent to server */
+    SESSION_ESTABLISHED,    /** server answered, translating seq/ack */
+    SESSION_CLOSING,        /** fin or rst seen */
+};
+
+typedef struct {
+    uint32_t cip;
+    uint32_t sip;
+    uint16_t cport;
+    uint16_t sport;
+} synproxy_key_t;
+
+typedef struct {
+    synproxy_key_t key;
+    uint32_t client_isn;
+    uint32_t cookie;
+    uint32_t delta;         /** server isn - cookie */
+    uint16_t mss;
+    uint16_t window;
+    volatile uint8_t state;
+    volatile uint64_t last_seen;
+} synproxy_session_t;
+
+typedef struct {
+    uint64_t syn;
+    uint64_t cookie_sent;
+    uint64_t ack_valid;
+    uint64_t ack_invalid;
+    uint64_t rate_drop;
+    uint64_t no_session;
+    uint64_t session_full;
+    uint64_t established;
+} synproxy_stats_t;
+
+typedef struct {
+    uint32_t ip;
+    uint32_t estimate;
+} synproxy_offender_t;
+
+typedef struct {
+    uint16_t sketch[SYNPROXY_SKETCH_ROWS][SYNPROXY_SKETCH_COLS];
+    uint64_t epoch;         /** sketch is cleared when tsc passes it */
+    synproxy_offender_t offenders[SYNPROXY_TOP_OFFENDERS];
+    synproxy_stats_t stats;
+} __rte_cache_aligned synproxy_lcore_t;
+
+static const uint16_t synproxy_mss_table[COOKIE_MSS_MASK + 1] = {
+    216, 536, 1200, 1220, 1380, 1440, 1452, 1460,
+};
+
+static synproxy_config_t synproxy_cfg_A, synproxy_cfg_B;
+static synproxy_lcore_t *synproxy_lcores[RTE_MAX_LCORE];
+static struct rte_hash *synproxy_sessions;
+static struct rte_mempool *synproxy_pool;
+static uint32_t synproxy_secret[2];
+static uint64_t synproxy_hz;
+
+/** sessions deleted from hash, freed once workers passed token
+ * */
+static int32_t synproxy_pending_pos[SYNPROXY_AGE_BATCH];
+static synproxy_session_t *synproxy_pending_sess[SYNPROXY_AGE_BATCH];
+static uint32_t synproxy_pending_num;
+static uint64_t synproxy_pending_token;
+
+MODULE_DECLARE(synproxy) = {
+    .name = "synproxy",
+    .id = MOD_ID_SYNPROXY,
+    .enabled = true,
+    .log = true,
+    .init = synproxy_init,
+    .proc = synproxy_proc,
+    .conf = synproxy_conf,
+    .tick = synproxy_tick,
+    .priv = NULL
+};
+
+static inline int
+synproxy_port_protected(synproxy_config_t *spc, uint16_t port)
+{
+    port = rte_be_to_cpu_16(port);
+    return spc->port_map[port >> 3] & (1 << (port & 7));
+}
+
+static inline uint32_t
+synproxy_slot(void)
+{
+    return (uint32_t)((rte_get_timer_cycles() / synproxy_hz) >> COOKIE_SLOT_SHIFT);
+}
+
+static inline uint32_t
+synproxy_cookie_hash(uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp, uint32_t isn, uint32_t slot)
+{
+    uint32_t h;
+
+    h = rte_hash_crc_4byte(sip, synproxy_secret[0]);
+    h = rte_hash_crc_4byte(dip, h);
+    h = rte_hash_crc_4byte(((uint32_t)sp << 16) | dp, h);
+    h = rte_hash_crc_4byte(isn, h);
+    return rte_hash_crc_4byte(slot, h ^ synproxy_secret[1]);
+}
+
+static inline uint32_t
+synproxy_cookie_make(uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp, uint32_t isn, uint8_t mss_idx)
+{
+    uint32_t slot = synproxy_slot();
+
+    return (synproxy_cookie_hash(sip, dip, sp, dp, isn, slot) & ~0xffU) |
+        ((slot & COOKIE_SLOT_MASK) << 3) | (mss_idx & COOKIE_MSS_MASK);
+}
+
+/** @return mss index on success, -1 for an invalid or expired cookie
+ * */
+static inline int
+synproxy_cookie_check(uint32_t cookie, uint32_t sip, uint32_t dip, uint16_t sp, uint16_t dp, uint32_t isn)
+{
+    uint32_t now = synproxy_slot();
+    uint32_t slot = now - ((now - (cookie >> 3)) & COOKIE_SLOT_MASK);
+
+    if (now - slot > 1) {
+        return -1;
+    }
+
+    if ((synproxy_cookie_hash(sip, dip, sp, dp, isn, slot) ^ cookie) & ~0xffU) {
+        return -1;
+    }
+
+    return cookie & COOKIE_MSS_MASK;
+}
+
+/** Count one syn of source ip, @return estimated syn count in this second
+ * */
+static inline uint32_t
+synproxy_sketch_update(synproxy_lcore_t *lc, uint32_t ip)
+{
+    uint64_t now = rte_get_timer_cycles();
+    uint32_t i, col, est = UINT16_MAX;
+
+    if (unlikely(now >= lc->epoch)) {
+        memset(lc->sketch, 0, sizeof(lc->sketch));
+        lc->epoch = now + synproxy_hz;
+    }
+
+    for (i = 0; i < SYNPROXY_SKETCH_ROWS; i++) {
+        col = rte_hash_crc_4byte(ip, synproxy_secret[0] + i) & (SYNPROXY_SKETCH_COLS - 1);
+        if (lc->sketch[i][col] < UINT16_MAX) {
+            lc->sketch[i][col] ++;
+        }
+        est = RTE_MIN(est, (uint32_t)lc->sketch[i][col]);
+    }
+
+    return est;
+}
+
+static void
+synproxy_offender_record(synproxy_lcore_t *lc, uint32_t ip, uint32_t est)
+{
+    synproxy_offender_t *o, *min = &lc->offenders[0];
+    int i;
+
+    for (i = 0; i < SYNPROXY_TOP_OFFENDERS; i++) {
+        o = &lc->offenders[i];
+        if (o->ip == ip) {
+            o->estimate = RTE_MAX(o->estimate, est);
+            return;
+        }
+        if (o->estimate < min->estimate) {
+            min = o;
+        }
+    }
+
+    if (est > min->estimate) {
+        min->ip = ip;
+        min->estimate = est;
+    }
+}
+
+static uint16_t
+synproxy_mss_parse(const struct rte_tcp_hdr *th)
+{
+    const uint8_t *opt = (const uint8_t *)(th + 1);
+    int len = ((th->data_off >> 4) << 2) - sizeof(*th);
+    int i = 0;
+
+    while (i < len) {
+        if (opt[i] == 0) {
+            break;
+        }
+
+        if (opt[i] == 1) {
+            i ++;
+            continue;
+        }
+
+        if (i + 1 >= len || opt[i + 1] < 2) {
+            break;
+        }
+
+        if (opt[i] == 2 && opt[i + 1] == 4 && i + 4 <= len) {
+            return (opt[i + 2] << 8) | opt[i + 3];
+        }
+
+        i += opt[i + 1];
+    }
+
+    return 536;
+}
+
+static inline void
+synproxy_swap(struct rte_mbuf *mbuf, struct rte_ipv4_hdr *ip, struct rte_tcp_hdr *th)
+{
+    struct rte_ether_hdr *eh = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    struct rte_ether_addr ea;
+    uint32_t a;
+    uint16_t port;
+
+    rte_ether_addr_copy(&eh->src_addr, &ea);
+    rte_ether_addr_copy(&eh->dst_addr, &eh->src_addr);
+    rte_ether_addr_copy(&ea, &eh->dst_addr);
+
+    a = ip->src_addr;
+    ip->src_addr = ip->dst_addr;
+    ip->dst_addr = a;
+
+    port = th->src_port;
+    th->src_port = th->dst_port;
+    th->dst_port = port;
+}
+
+/** Rebuild a tcp header of its own, with an mss option if mss is not 0,
+ * drop any payload, and fix length and checksums
+ * */
+static int
+synproxy_build(struct rte_mbuf *mbuf, packet_t *p, struct rte_ipv4_hdr *ip, struct rte_tcp_hdr *th,
+    uint32_t seq, uint32_t ack, uint8_t flags, uint16_t window, uint16_t mss)
+{
+    uint16_t hlen = sizeof(*th) + (mss ? 4 : 0);
+    uint32_t len = p->l4_off + hlen;
+    uint32_t cur = rte_pktmbuf_pkt_len(mbuf);
+
+    if (cur > len) {
+        if (rte_pktmbuf_trim(mbuf, cur - len)) {
+            return -1;
+        }
+    } else if (cur < len) {
+        if (!rte_pktmbuf_append(mbuf, len - cur)) {
+            return -1;
+        }
+    }
+
+    th->sent_seq = rte_cpu_to_be_32(seq);
+    th->recv_ack = rte_cpu_to_be_32(ack);
+    th->data_off = (hlen >> 2) << 4;
+    th->tcp_flags = flags;
+    th->rx_win = rte_cpu_to_be_16(window);
+    th->tcp_urp = 0;
+
+    if (mss) {
+        uint8_t *opt = (uint8_t *)(th + 1);
+        opt[0] = 2;
+        opt[1] = 4;
+        opt[2] = mss >> 8;
+        opt[3] = mss & 0xff;
+    }
+
+    ip->total_length = rte_cpu_to_be_16(len - p->l3_off);
+    ip->packet_id = 0;
+    ip->fragment_offset = rte_cpu_to_be_16(RTE_IPV4_HDR_DF_FLAG);
+    ip->time_to_live = 64;
+    ip->hdr_checksum = 0;
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+
+    th->cksum = 0;
+    th->cksum = rte_ipv4_udptcp_cksum(ip, th);
+
+    p->tcp_flags = flags;
+    return 0;
+}
+
+static mod_ret_t
+synproxy_drop(struct rte_mbuf *mbuf)
+{
+    rte_pktmbuf_free(mbuf);
+    return MOD_RET_STOLEN;
+}
+
+/** Client syn, answer with a cookie on behalf of the server
+ * */
+static mod_ret_t
+synproxy_syn(synproxy_config_t *spc, synproxy_lcore_t *lc, struct rte_mbuf *mbuf, packet_t *p,
+    struct rte_ipv4_hdr *ip, struct rte_tcp_hdr *th)
+{
+    uint32_t est, isn, cookie;
+    uint16_t mss;
+    uint8_t mss_idx;
+
+    lc->stats.syn ++;
+
+    if (spc->syn_limit) {
+        est = synproxy_sketch_update(lc, ip->src_addr);
+        if (unlikely(est > spc->syn_limit)) {
+            lc->stats.rate_drop ++;
+            synproxy_offender_record(lc, ip->src_addr, est);
+            return synproxy_drop(mbuf);
+        }
+    }
+
+    mss = synproxy_mss_parse(th);
+    for (mss_idx = COOKIE_MSS_MASK; mss_idx > 0; mss_idx --) {
+        if (synproxy_mss_table[mss_idx] <= mss) {
+            break;
+        }
+    }
+
+    isn = rte_be_to_cpu_32(th->sent_seq);
+    cookie = synproxy_cookie_make(ip->src_addr, ip->dst_addr, th->src_port, th->dst_port, isn, mss_idx);
+
+    synproxy_swap(mbuf, ip, th);
+    if (synproxy_build(mbuf, p, ip, th, cookie, isn + 1, RTE_TCP_SYN_FLAG | RTE_TCP_ACK_FLAG,
+            UINT16_MAX, synproxy_mss_table[mss_idx])) {
+        return synproxy_drop(mbuf);
+    }
+
+    p->oport = p->iport;
+    lc->stats.cookie_sent ++;
+    return MOD_RET_ACCEPT;
+}
+
+/** Client ack without session, validate cookie then open to server
+ * */
+static mod_ret_t
+synproxy_ack(synproxy_lcore_t *lc, struct rte_mbuf *mbuf, packet_t *p,
+    struct rte_ipv4_hdr *ip, struct rte_tcp_hdr *th, synproxy_key_t *key)
+{
+    synproxy_session_t *s;
+    uint32_t isn, cookie;
+    int mss_idx;
+
+    isn = rte_be_to_cpu_32(th->sent_seq) - 1;
+    cookie = rte_be_to_cpu_32(th->recv_ack) - 1;
+
+    mss_idx = synproxy_cookie_check(cookie, ip->src_addr, ip->dst_addr, th->src_port, th->dst_port, isn);
+    if (mss_idx < 0) {
+        lc->stats.ack_invalid ++;
+        return synproxy_drop(mbuf);
+    }
+
+    if (rte_mempool_get(synproxy_pool, (void **)&s)) {
+        lc->stats.session_full ++;
+        return synproxy_drop(mbuf);
+    }
+
+    s->key = *key;
+    s->client_isn = isn;
+    s->cookie = cookie;
+    s->delta = 0;
+    s->mss = synproxy_mss_table[mss_idx];
+    s->window = rte_be_to_cpu_16(th->rx_win);
+    s->state = SESSION_SYN_SENT;
+    s->last_seen = rte_get_timer_cycles();
+
+    if (rte_hash_add_key_data(synproxy_sessions, key, s)) {
+        rte_mempool_put(synproxy_pool, s);
+        lc->stats.session_full ++;
+        return synproxy_drop(mbuf);
+    }
+
+    if (synproxy_build(mbuf, p, ip, th, isn, 0, RTE_TCP_SYN_FLAG, s->window, s->mss)) {
+        return synproxy_drop(mbuf);
+    }
+
+    lc->stats.ack_valid ++;
+    return MOD_RET_ACCEPT;
+}
+
+/** Server syn-ack, complete the server side handshake
+ * */
+static mod_ret_t
+synproxy_syn_ack(synproxy_lcore_t *lc, struct rte_mbuf *mbuf, packet_t *p,
+    struct rte_ipv4_hdr *ip, struct rte_tcp_hdr *th, synproxy_session_t *s)
+{
+    uint32_t server_isn = rte_be_to_cpu_32(th->sent_seq);
+
+    if (rte_be_to_cpu_32(th->recv_ack) != s->client_isn + 1) {
+        return synproxy_drop(mbuf);
+    }
+
+    s->delta = server_isn - s->cookie;
+
+    synproxy_swap(mbuf, ip, th);
+    if (synproxy_build(mbuf, p, ip, th, s->client_isn + 1, server_isn + 1, RTE_TCP_ACK_FLAG, s->window, 0)) {
+        return synproxy_drop(mbuf);
+    }
+
+    /** publish delta before state, the reverse direction may be
+     * handled by another worker
+     * */
+    rte_smp_wmb();
+    s->state = SESSION_ESTABLISHED;
+    s->last_seen = rte_get_timer_cycles();
+
+    p->oport = p->iport;
+    lc->stats.established ++;
+    return MOD_RET_ACCEPT;
+}
+
+static mod_ret_t
+synproxy_proc_forward(config_t *config, struct rte_mbuf *mbuf)
+{
+    synproxy_config_t *spc = config->synproxy_cfg;
+    synproxy_lcore_t *lc;
+    synproxy_session_t *s;
+    synproxy_key_t key;
+    struct rte_ipv4_hdr *ip;
+    struct rte_tcp_hdr *th;
+    packet_t *p;
+    uint32_t v;
+    uint8_t flags;
+
+    if (!spc || !spc->port_num) {
+        return MOD_RET_ACCEPT;
+    }
+
+    p = rte_mbuf_to_priv(mbuf);
+    if (!p || !p->is_v4 || p->tuple.v4.proto != IPPROTO_TCP || !p->l4_off) {
+        return MOD_RET_ACCEPT;
+    }
+
+    lc = synproxy_lcores[rte_lcore_id()];
+    ip = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv4_hdr *, p->l3_off);
+    th = rte_pktmbuf_mtod_offset(mbuf, struct rte_tcp_hdr *, p->l4_off);
+    flags = p->tcp_flags & TCP_FLAGS_MASK;
+
+    /** client to server
+     * */
+    if (synproxy_port_protected(spc, th->dst_port)) {
+        if (flags == RTE_TCP_SYN_FLAG) {
+            return synproxy_syn(spc, lc, mbuf, p, ip, th);
+        }
+
+        key.cip = ip->src_addr;
+        key.sip = ip->dst_addr;
+        key.cport = th->src_port;
+        key.sport = th->dst_port;
+
+        if (rte_hash_lookup_data(synproxy_sessions, &key, (void **)&s) < 0) {
+            if (flags == RTE_TCP_ACK_FLAG) {
+                return synproxy_ack(lc, mbuf, p, ip, th, &key);
+            }
+            lc->stats.no_session ++;
+            return synproxy_drop(mbuf);
+        }
+
+        if (s->state == SESSION_SYN_SENT) {
+            /** client data before server answered, client will retransmit
+             * */
+            return synproxy_drop(mbuf);
+        }
+
+        rte_smp_rmb();
+        if (flags & RTE_TCP_ACK_FLAG) {
+            v = rte_cpu_to_be_32(rte_be_to_cpu_32(th->recv_ack) + s->delta);
+            th->cksum = csum_replace4(th->cksum, th->recv_ack, v);
+            th->recv_ack = v;
+        }
+
+        if (flags & (RTE_TCP_RST_FLAG | RTE_TCP_FIN_FLAG)) {
+            s->state = SESSION_CLOSING;
+        }
+        s->last_seen = rte_get_timer_cycles();
+        return MOD_RET_ACCEPT;
+    }
+
+    /** server to client
+     * */
+    if (synproxy_port_protected(spc, th->src_port)) {
+        key.cip = ip->dst_addr;
+        key.sip = ip->src_addr;
+        key.cport = th->dst_port;
+        key.sport = th->src_port;
+
+        if (rte_hash_lookup_data(synproxy_sessions, &key, (void **)&s) < 0) {
+            return MOD_RET_ACCEPT;
+        }
+
+        if (s->state == SESSION_SYN_SENT) {
+            if (flags == (RTE_TCP_SYN_FLAG | RTE_TCP_ACK_FLAG)) {
+                return synproxy_syn_ack(lc, mbuf, p, ip, th, s);
+            }
+            return synproxy_drop(mbuf);
+        }
+
+        rte_smp_rmb();
+        v = rte_cpu_to_be_32(rte_be_to_cpu_32(th->sent_seq) - s->delta);
+        th->cksum = csum_replace4(th->cksum, th->sent_seq, v);
+        th->sent_seq = v;
+
+        if (flags & (RTE_TCP_RST_FLAG | RTE_TCP_FIN_FLAG)) {
+            s->state = SESSION_CLOSING;
+        }
+        s->last_seen = rte_get_timer_cycles();
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+mod_ret_t synproxy_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    if (hook == MOD_HOOK_FORWARD) {
+        return synproxy_proc_forward(config, mbuf);
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static int
+synproxy_json_load(synproxy_config_t *spc)
+{
+    json_object *jr = NULL, *ja, *jv;
+    int i, port_num, port;
+    int ret = 0;
+
+    memset(spc, 0, sizeof(*spc));
+
+    jr = JR(CONFIG_PATH, "synproxy.json");
+    if (!jr) {
+        printf("no synproxy.json, synproxy disabled\n");
+        return 0;
+    }
+
+    port_num = JA(jr, "ports", &ja);
+    if (port_num == -1) {
+        printf("no ports found\n");
+        ret = -1;
+        goto done;
+    }
+
+    for (i = 0; i < port_num; i++) {
+        port = JV_I(JO(ja, i));
+        if (port <= 0 || port > UINT16_MAX) {
+            printf("invalid synproxy port %d\n", port);
+            ret = -1;
+            goto done;
+        }
+        spc->port_map[port >> 3] |= 1 << (port & 7);
+        spc->port_num ++;
+    }
+
+    jv = JV(jr, "syn_limit");
+    spc->syn_limit = jv ? JV_I(jv) : 0;
+
+    jv = JV(jr, "timeout");
+    spc->timeout = jv ? JV_I(jv) : 300;
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int synproxy_conf(void *config)
+{
+    config_t *c = config;
+    synproxy_config_t *spc;
+
+    spc = (c->synproxy_cfg == &synproxy_cfg_A) ? &synproxy_cfg_B : &synproxy_cfg_A;
+    if (synproxy_json_load(spc)) {
+        printf("synproxy json load failed\n");
+        return -1;
+    }
+
+    c->synproxy_cfg = spc;
+    return 0;
+}
+
+void synproxy_tick(void *config)
+{
+    config_t *c = config;
+    synproxy_config_t *spc = c->synproxy_cfg;
+    synproxy_session_t *s;
+    const void *key;
+    void *data;
+    uint64_t now, idle, closing;
+    uint32_t iter = 0, i;
+    int32_t pos;
+
+    if (!synproxy_sessions) {
+        return;
+    }
+
+    if (synproxy_pending_num) {
+        if (!rte_rcu_qsbr_check(worker_qsv, synproxy_pending_token, false)) {
+            return;
+        }
+
+        for (i = 0; i < synproxy_pending_num; i++) {
+            rte_hash_free_key_with_position(synproxy_sessions, synproxy_pending_pos[i]);
+            rte_mempool_put(synproxy_pool, synproxy_pending_sess[i]);
+        }
+        synproxy_pending_num = 0;
+    }
+
+    now = rte_get_timer_cycles();
+    idle = (uint64_t)(spc ? spc->timeout : 300) * synproxy_hz;
+    closing = 10 * synproxy_hz;
+
+    while (synproxy_pending_num < SYNPROXY_AGE_BATCH &&
+            rte_hash_iterate(synproxy_sessions, &key, &data, &iter) >= 0) {
+        s = data;
+
+        if (now - s->last_seen < idle &&
+            !(s->state != SESSION_ESTABLISHED && now - s->last_seen >= closing)) {
+            continue;
+        }
+
+        pos = rte_hash_del_key(synproxy_sessions, key);
+        if (pos < 0) {
+            continue;
+        }
+
+        synproxy_pending_pos[synproxy_pending_num] = pos;
+        synproxy_pending_sess[synproxy_pending_num] = s;
+        synproxy_pending_num ++;
+    }
+
+    if (synproxy_pending_num) {
+        synproxy_pending_token = rte_rcu_qsbr_start(worker_qsv);
+    }
+}
+
+static int
+synproxy_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    config_t *c = cli_get_context(cli);
+    synproxy_config_t *spc = c->synproxy_cfg;
+    synproxy_stats_t sum;
+    synproxy_lcore_t *lc;
+    unsigned int lcore_id;
+    int i;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (spc) {
+        CLI_PRINT(cli, "protected ports %u syn limit %u timeout %u",
+            spc->port_num, spc->syn_limit, spc->timeout);
+    }
+
+    memset(&sum, 0, sizeof(sum));
+
+    RTE_LCORE_FOREACH(lcore_id) {
+        lc = synproxy_lcores[lcore_id];
+        if (!lc) {
+            continue;
+        }
+
+        sum.syn += lc->stats.syn;
+        sum.cookie_sent += lc->stats.cookie_sent;
+        sum.ack_valid += lc->stats.ack_valid;
+        sum.ack_invalid += lc->stats.ack_invalid;
+        sum.rate_drop += lc->stats.rate_drop;
+        sum.no_session += lc->stats.no_session;
+        sum.session_full += lc->stats.session_full;
+        sum.established += lc->stats.established;
+
+        for (i = 0; i < SYNPROXY_TOP_OFFENDERS; i++) {
+            if (lc->offenders[i].estimate) {
+                CLI_PRINT(cli, "offender lcore %u %u.%u.%u.%u syn/s %u", lcore_id,
+                    lc->offenders[i].ip & 0xff, (lc->offenders[i].ip >> 8) & 0xff,
+                    (lc->offenders[i].ip >> 16) & 0xff, lc->offenders[i].ip >> 24,
+                    lc->offenders[i].estimate);
+            }
+        }
+    }
+
+    CLI_PRINT(cli, "syn          %"PRIu64, sum.syn);
+    CLI_PRINT(cli, "cookie sent  %"PRIu64, sum.cookie_sent);
+    CLI_PRINT(cli, "ack valid    %"PRIu64, sum.ack_valid);
+    CLI_PRINT(cli, "ack invalid  %"PRIu64, sum.ack_invalid);
+    CLI_PRINT(cli, "rate drop    %"PRIu64, sum.rate_drop);
+    CLI_PRINT(cli, "no session   %"PRIu64, sum.no_session);
+    CLI_PRINT(cli, "session full %"PRIu64, sum.session_full);
+    CLI_PRINT(cli, "established  %"PRIu64, sum.established);
+    CLI_PRINT(cli, "sessions     %d", rte_hash_count(synproxy_sessions));
+    return 0;
+}
+
+int synproxy_init(void *config)
+{
+    config_t *c = config;
+    struct rte_hash_parameters hash_params = {
+        .name = "synproxy_sessions",
+        .entries = SYNPROXY_MAX_SESSIONS,
+        .key_len = sizeof(synproxy_key_t),
+        .hash_func = rte_hash_crc,
+        .hash_func_init_val = 0,
+        .socket_id = rte_socket_id(),
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF | RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD,
+    };
+    char name[RTE_HASH_NAMESIZE];
+    unsigned int lcore_id;
+
+    if (synproxy_conf(c)) {
+        printf("synproxy conf failed\n");
+        return -1;
+    }
+
+    synproxy_hz = rte_get_timer_hz();
+    synproxy_secret[0] = (uint32_t)rte_rand();
+    synproxy_secret[1] = (uint32_t)rte_rand();
+
+    hash_params.name = hot_object(HOT_HASH, name, sizeof(name), "synproxy_sessions");
+    synproxy_sessions = rte_hash_create(&hash_params);
+    if (!synproxy_sessions) {
+        printf("create synproxy session hash failed\n");
+        return -1;
+    }
+
+    synproxy_pool = rte_mempool_create(hot_object(HOT_MEMPOOL, name, sizeof(name), "synproxy_pool"), SYNPROXY_MAX_SESSIONS - 1,
+        sizeof(synproxy_session_t), 256, 0, NULL, NULL, NULL, NULL, rte_socket_id(), 0);
+    if (!synproxy_pool) {
+        printf("create synproxy session pool failed\n");
+        return -1;
+    }
+
+    RTE_LCORE_FOREACH_WORKER(lcore_id) {
+        synproxy_lcores[lcore_id] = rte_zmalloc_socket("synproxy_lcore", sizeof(synproxy_lcore_t),
+            RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore_id));
+        if (!synproxy_lcores[lcore_id]) {
+            printf("alloc synproxy lcore data failed\n");
+            return -1;
+        }
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "synproxy", synproxy_show, "syn proxy statistics");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,42 @@
+#ifndef _M_SYNPROXY_H_
+#define _M_SYNPROXY_H_
+
+#include "../module.h"
+
+/** SYN proxy for protected TCP ports, IPv4 only
+ *
+ *   client                firewall                 server
+ *     |---- SYN ------------>|                        |
+ *     |<--- SYN-ACK(cookie) -|                        |
+ *     |---- ACK ------------>| cookie valid           |
+ *     |                      |---- SYN -------------->|
+ *     |                      |<--- SYN-ACK -----------|
+ *     |                      |---- ACK -------------->|
+ *     |<======== seq/ack translated by delta ========>|
+ *
+ * SYNs never touch a table, only the per-source count-min sketch,
+ * so a flood costs two hashes and a header rewrite per packet.
+ * */
+
+#define SYNPROXY_MAX_SESSIONS   (1U << 20)
+#define SYNPROXY_SKETCH_ROWS    4
+#define SYNPROXY_SKETCH_COLS    4096
+#define SYNPROXY_TOP_OFFENDERS  8
+#define SYNPROXY_AGE_BATCH      4096
+
+typedef struct {
+    uint8_t port_map[65536 / 8];    /** protected dst ports, host order bitmap */
+    uint16_t port_num;
+    uint32_t syn_limit;             /** syn per source per second on each worker, 0 for no limit */
+    uint32_t timeout;               /** session idle timeout in seconds */
+} synproxy_config_t;
+
+int synproxy_init(void *config);
+mod_ret_t synproxy_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int synproxy_conf(void *config);
+void synproxy_tick(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
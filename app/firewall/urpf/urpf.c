@@ -0,0 +1,372 @@
+#include <inttypes.h>
+#include <arpa/inet.h>
+
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_ptype.h>
+#include <rte_fib.h>
+#include <rte_fib6.h>
+
+#include "../config.h"
+#include "../module.h"
+#include "../packet.h"
+#include "../json.h"
+#include "../cli.h"
+#include "../hot.h"
+#include "../prefix.h"
+#include "../route/route.h"
+
+#include "urpf.h"
+
+typedef struct {
+    uint64_t checked[MAX_PORT_NUM];
+    uint64_t no_route[MAX_PORT_NUM];
+    uint64_t wrong_port[MAX_PORT_NUM];
+} __rte_cache_aligned urpf_stats_t;
+
+static urpf_config_t urpf_cfg_A, urpf_cfg_B;
+static urpf_stats_t urpf_stats[RTE_MAX_LCORE];
+static int urpf_enabled;
+
+MODULE_DECLARE(urpf) = {
+    .name = "urpf",
+    .id = MOD_ID_URPF,
+    .enabled = true,
+    .log = true,
+    .init = urpf_init,
+    .proc = urpf_proc,
+    .conf = urpf_conf,
+    .tick = NULL,
+    .priv = NULL
+};
+
+static inline void
+urpf_verdict(urpf_config_t *uc, urpf_stats_t *st, uint16_t port, uint64_t nh, uint8_t *drop)
+{
+    st->checked[port] ++;
+
+    if (!nh) {
+        st->no_route[port] ++;
+        *drop = 1;
+        return;
+    }
+
+    if (uc->modes[port] == URPF_MODE_STRICT && nh - 1 != port) {
+        st->wrong_port[port] ++;
+        *drop = 1;
+    }
+}
+
+void urpf_check_burst(void *config, struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop)
+{
+    config_t *c = config;
+    urpf_config_t *uc = c->urpf_cfg;
+    urpf_stats_t *st = &urpf_stats[rte_lcore_id()];
+    uint32_t ips[n];
+    uint8_t ips6[n][RTE_FIB6_IPV6_ADDR_SIZE];
+    uint64_t nhs[n], nhs6[n];
+    uint16_t idx[n], idx6[n], n4 = 0, n6 = 0, i;
+    packet_t *p;
+
+    if (!urpf_enabled || !uc) {
+        return;
+    }
+
+    /** sort out IPv4 and IPv6 for one bulk lookup each
+     * */
+    for (i = 0; i < n; i++) {
+        p = rte_mbuf_to_priv(mbufs[i]);
+        if (drop[i] || !p || p->iport >= MAX_PORT_NUM || !uc->modes[p->iport] ||
+            (p->ptype & RTE_PTYPE_TUNNEL_MASK)) {
+            continue;
+        }
+
+        if (RTE_ETH_IS_IPV4_HDR(p->ptype)) {
+            ips[n4] = rte_be_to_cpu_32(p->tuple.v4.sip);
+            idx[n4++] = i;
+        } else if (RTE_ETH_IS_IPV6_HDR(p->ptype)) {
+            memcpy(ips6[n6], p->tuple.v6.sip, sizeof(ips6[n6]));
+            idx6[n6++] = i;
+        }
+    }
+
+    if (n4) {
+        rte_fib_lookup_bulk(uc->fib, ips, nhs, n4);
+    }
+
+    if (n6) {
+        rte_fib6_lookup_bulk(uc->fib6, ips6, nhs6, n6);
+    }
+
+    for (i = 0; i < n4; i++) {
+        p = rte_mbuf_to_priv(mbufs[idx[i]]);
+        urpf_verdict(uc, st, p->iport, nhs[i], &drop[idx[i]]);
+    }
+
+    for (i = 0; i < n6; i++) {
+        p = rte_mbuf_to_priv(mbufs[idx6[i]]);
+        urpf_verdict(uc, st, p->iport, nhs6[i], &drop[idx6[i]]);
+    }
+}
+
+mod_ret_t urpf_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook)
+{
+    uint8_t drop = 0;
+
+    if (hook != MOD_HOOK_INGRESS || !urpf_enabled) {
+        return MOD_RET_ACCEPT;
+    }
+
+    urpf_check_burst(config, &mbuf, 1, &drop);
+    if (drop) {
+        rte_pktmbuf_free(mbuf);
+        return MOD_RET_STOLEN;
+    }
+
+    return MOD_RET_ACCEPT;
+}
+
+static int
+urpf_add(urpf_config_t *uc, uint8_t family, const uint8_t *addr, uint8_t depth, uint16_t port, int allow_default)
+{
+    uint32_t ip;
+    int ret;
+
+    if (!depth && !allow_default) {
+        return 0;
+    }
+
+    if (uc->route_num == URPF_MAX_ROUTES) {
+        printf("too many urpf routes, at most %u\n", URPF_MAX_ROUTES);
+        return -1;
+    }
+
+    if (family == AF_INET) {
+        memcpy(&ip, addr, sizeof(ip));
+        ret = rte_fib_add(uc->fib, rte_be_to_cpu_32(ip), depth, port + 1);
+    } else {
+        ret = rte_fib6_add(uc->fib6, addr, depth, port + 1);
+    }
+
+    if (ret) {
+        printf("add urpf route failed %d\n", ret);
+        return -1;
+    }
+
+    uc->route_num ++;
+    return 0;
+}
+
+static void
+urpf_config_free(urpf_config_t *uc)
+{
+    rte_fib_free(uc->fib);
+    rte_fib6_free(uc->fib6);
+    memset(uc, 0, sizeof(*uc));
+}
+
+static int
+urpf_json_load(config_t *c, urpf_config_t *uc)
+{
+    struct rte_fib_conf fib_conf = {
+        .type = RTE_FIB_DIR24_8,
+        .default_nh = 0,
+        .max_routes = URPF_MAX_ROUTES,
+        .dir24_8 = {
+            .nh_sz = RTE_FIB_DIR24_8_1B,
+            .num_tbl8 = URPF_TBL8_NUM,
+        },
+    };
+    struct rte_fib6_conf fib6_conf = {
+        .type = RTE_FIB6_TRIE,
+        .default_nh = 0,
+        .max_routes = URPF_MAX_ROUTES,
+        .trie = {
+            .nh_sz = RTE_FIB6_TRIE_2B,
+            .num_tbl8 = URPF6_TBL8_NUM,
+        },
+    };
+    const char *suffix = (uc == &urpf_cfg_A) ? "A" : "B";
+    interface_config_t *itfc = c->itf_cfg;
+    route_config_t *rc = c->route_cfg;
+    json_object *jr = NULL, *ja, *jo, *jv;
+    route_entry_t *r;
+    char name[64];
+    const char *mode;
+    uint8_t family, addr[16], depth;
+    uint16_t port;
+    int i, num, allow_default, ret = 0;
+    uint32_t k;
+
+    /** the buffer was left by all workers at the last config switch
+     * */
+    urpf_config_free(uc);
+
+    jr = JR(CONFIG_PATH, "urpf.json");
+    if (!jr) {
+        printf("no urpf.json\n");
+        return -1;
+    }
+
+    hot_object(HOT_FIB, name, sizeof(name), "urpf_fib_%s", suffix);
+    uc->fib = rte_fib_create(name, rte_socket_id(), &fib_conf);
+    hot_object(HOT_FIB6, name, sizeof(name), "urpf_fib6_%s", suffix);
+    uc->fib6 = rte_fib6_create(name, rte_socket_id(), &fib6_conf);
+    if (!uc->fib || !uc->fib6) {
+        printf("create urpf fib failed\n");
+        ret = -1;
+        goto done;
+    }
+
+    num = JA(jr, "ports", &ja);
+    for (i = 0; i < num; i++) {
+        jo = JO(ja, i);
+
+        jv = JV(jo, "id");
+        port = jv ? JV_I(jv) : UINT16_MAX;
+        if (port >= itfc->port_num) {
+            printf("invalid urpf port %d\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        jv = JV(jo, "mode");
+        mode = jv ? JV_S(jv) : "";
+        if (!strcmp(mode, "strict")) {
+            uc->modes[port] = URPF_MODE_STRICT;
+        } else if (!strcmp(mode, "loose")) {
+            uc->modes[port] = URPF_MODE_LOOSE;
+        } else {
+            printf("urpf mode of port %u is strict or loose\n", port);
+            ret = -1;
+            goto done;
+        }
+    }
+
+    jv = JV(jr, "allow_default");
+    allow_default = jv && JV_I(jv);
+
+    num = JA(jr, "routes", &ja);
+    for (i = 0; i < num; i++) {
+        jo = JO(ja, i);
+
+        jv = JV(jo, "prefix");
+        if (!jv || prefix_parse(JV_S(jv), &family, addr, &depth)) {
+            printf("invalid urpf route %d\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        jv = JV(jo, "port");
+        port = jv ? JV_I(jv) : UINT16_MAX;
+        if (port >= itfc->port_num) {
+            printf("invalid port of urpf route %d\n", i);
+            ret = -1;
+            goto done;
+        }
+
+        if (urpf_add(uc, family, addr, depth, port, allow_default)) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+    /** the route module switched to the same config already
+     * */
+    for (k = 0; rc && k < rc->route_num; k++) {
+        r = &rc->routes[k];
+        if (urpf_add(uc, r->family, r->addr, r->depth, rc->nhs[r->nh - 1].port, allow_default)) {
+            ret = -1;
+            goto done;
+        }
+    }
+
+done:
+    if (jr) JR_FREE(jr);
+    return ret;
+}
+
+int urpf_conf(void *config)
+{
+    config_t *c = config;
+    urpf_config_t *uc;
+
+    if (!urpf_enabled) {
+        return 0;
+    }
+
+    uc = (c->urpf_cfg == &urpf_cfg_A) ? &urpf_cfg_B : &urpf_cfg_A;
+    if (urpf_json_load(c, uc)) {
+        printf("urpf json load failed\n");
+        urpf_config_free(uc);
+        return -1;
+    }
+
+    c->urpf_cfg = uc;
+    return 0;
+}
+
+static int
+urpf_show(struct cli_def *cli, const char *command, char *argv[], int argc)
+{
+    static const char *modes[] = {"none", "strict", "loose"};
+    config_t *c = (config_t *)cli_get_context(cli);
+    urpf_config_t *uc = c->urpf_cfg;
+    uint64_t checked, no_route, wrong_port;
+    unsigned int lcore_id;
+    uint16_t port;
+
+    CLI_PRINT(cli, "command %s argv[0] %s argc %d", command, argv[0], argc);
+
+    if (!urpf_enabled || !uc) {
+        CLI_PRINT(cli, "urpf disabled");
+        return 0;
+    }
+
+    CLI_PRINT(cli, "routes %u", uc->route_num);
+
+    for (port = 0; port < MAX_PORT_NUM; port++) {
+        if (!uc->modes[port]) {
+            continue;
+        }
+
+        checked = no_route = wrong_port = 0;
+        RTE_LCORE_FOREACH(lcore_id) {
+            checked += urpf_stats[lcore_id].checked[port];
+            no_route += urpf_stats[lcore_id].no_route[port];
+            wrong_port += urpf_stats[lcore_id].wrong_port[port];
+        }
+
+        CLI_PRINT(cli, "port %u %s checked %"PRIu64" no route %"PRIu64" wrong port %"PRIu64,
+            port, modes[uc->modes[port]], checked, no_route, wrong_port);
+    }
+    return 0;
+}
+
+int urpf_init(void *config)
+{
+    config_t *c = config;
+    json_object *jr;
+
+    jr = JR(CONFIG_PATH, "urpf.json");
+    if (!jr) {
+        printf("no urpf.json, urpf disabled\n");
+        return 0;
+    }
+    JR_FREE(jr);
+
+    urpf_enabled = 1;
+    if (urpf_conf(c)) {
+        printf("urpf conf failed\n");
+        return -1;
+    }
+
+    if (c->cli_def) {
+        CLI_CMD_C(c->cli_def, c->cli_show, "urpf", urpf_show, "reverse path check of source addresses");
+    }
+
+    return 0;
+}
+
+// file format utf-8
+// ident using space
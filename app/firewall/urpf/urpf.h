@@ -0,0 +1,60 @@
+#ifndef _M_URPF_H_
+#define _M_URPF_H_
+
+#include <rte_mbuf.h>
+
+#include "../module.h"
+#include "../interface/interface.h"
+
+/** Unicast reverse path forwarding, RFC 3704
+ *
+ * urpf.json, optional, sets the mode of ports and the source prefixes
+ * expected behind vwire and bridge ports, which have no routes:
+ *
+ *   {"ports": [{"id": "0", "mode": "strict"}, {"id": "2", "mode": "loose"}],
+ *    "routes": [{"prefix": "10.0.0.0/8", "port": "0"},
+ *               {"prefix": "2001:db8::/32", "port": "2"}],
+ *    "allow_default": "0"}
+ *
+ * The routes of route.json and of routed ports are added as they are.
+ * All compile into an rte_fib and an rte_fib6 whose next hop is the
+ * port plus 1, double buffered as other configs. At INGRESS the source
+ * addresses of a burst are looked up in one bulk lookup per family:
+ *
+ *   strict   the route of the source must leave by the ingress port
+ *   loose    there must be a route to the source at all
+ *
+ * A default route only counts with "allow_default". Tunnels are not
+ * checked, the decoder keeps the inner addresses of them.
+ * */
+
+#define URPF_MAX_ROUTES     (1U << 17)
+#define URPF_TBL8_NUM       (1U << 12)
+#define URPF6_TBL8_NUM      (1U << 14)
+
+typedef enum {
+    URPF_MODE_NONE,
+    URPF_MODE_STRICT,
+    URPF_MODE_LOOSE,
+} urpf_mode_t;
+
+typedef struct {
+    struct rte_fib *fib;
+    struct rte_fib6 *fib6;
+    uint8_t modes[MAX_PORT_NUM];    /** urpf_mode_t */
+    uint32_t route_num;
+} urpf_config_t;
+
+/** Set drop for the packets of mbufs failing the check of their
+ * ingress port, those already set are skipped
+ * */
+void urpf_check_burst(void *config, struct rte_mbuf **mbufs, uint16_t n, uint8_t *drop);
+
+int urpf_init(void *config);
+mod_ret_t urpf_proc(void *config, struct rte_mbuf *mbuf, mod_hook_t hook);
+int urpf_conf(void *config);
+
+#endif
+
+// file format utf-8
+// ident using space
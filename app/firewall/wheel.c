@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+
+#include "wheel.h"
+
+#define WHEEL_EXPIRED       WHEEL_HEADS     /** id of the expired list */
+
+wheel_t *wheel_create(const wheel_conf_t *conf)
+{
+    wheel_t *w;
+    uint32_t i;
+
+    if (!conf->entries || !conf->cb || !conf->num || conf->num > UINT32_MAX - WHEEL_HEADS - 1 ||
+        conf->size < sizeof(wheel_node_t) || conf->offset > conf->size - sizeof(wheel_node_t)) {
+        printf("invalid wheel of %u entries\n", conf->num);
+        return NULL;
+    }
+
+    w = rte_zmalloc_socket("wheel", sizeof(*w), RTE_CACHE_LINE_SIZE, conf->socket);
+    if (!w) {
+        return NULL;
+    }
+
+    w->nodes = (uint8_t *)conf->entries + conf->offset;
+    w->size = conf->size;
+    w->num = conf->num;
+    w->shift = rte_log2_u64(RTE_MAX(conf->tick, 1ULL));
+    w->start = rte_get_timer_cycles();
+    w->cb = conf->cb;
+    w->arg = conf->arg;
+
+    for (i = 1; i <= WHEEL_HEADS; i++) {
+        w->heads[i - 1].next = i;
+        w->heads[i - 1].prev = i;
+    }
+
+    return w;
+}
+
+void wheel_free(wheel_t *w)
+{
+    rte_free(w);
+}
+
+/** Move the timers of a slot of a higher level down, each to the
+ * level its expiry is now within
+ * */
+static void
+wheel_cascade(wheel_t *w, uint32_t level)
+{
+    wheel_node_t *head, *n;
+    uint32_t hid, id;
+
+    hid = level * WHEEL_SLOTS + ((w->now >> (level * WHEEL_BITS)) & WHEEL_MASK) + 1;
+    head = &w->heads[hid - 1];
+
+    while ((id = head->next) != hid) {
+        n = wheel_node(w, id);
+        wheel_unlink(w, n);
+        wheel_link(w, id, n);
+        w->cascaded ++;
+    }
+}
+
+/** Move the slot of the tick to run to the expired list, which is
+ * empty whenever this is called
+ * */
+static void
+wheel_splice(wheel_t *w)
+{
+    wheel_node_t *head, *expired = &w->heads[WHEEL_EXPIRED - 1];
+    uint32_t hid;
+
+    hid = (w->now & WHEEL_MASK) + 1;
+    head = &w->heads[hid - 1];
+    if (head->next == hid) {
+        return;
+    }
+
+    expired->next = head->next;
+    expired->prev = head->prev;
+    wheel_node(w, head->next)->prev = WHEEL_EXPIRED;
+    wheel_node(w, head->prev)->next = WHEEL_EXPIRED;
+    head->next = hid;
+    head->prev = hid;
+}
+
+/** Call back the expired list in bursts, within budget
+ * */
+static uint32_t
+wheel_drain(wheel_t *w, uint32_t budget)
+{
+    wheel_node_t *expired = &w->heads[WHEEL_EXPIRED - 1];
+    uint32_t idx[WHEEL_BURST], id, done = 0;
+    uint16_t n;
+
+    while (done < budget && expired->next != WHEEL_EXPIRED) {
+        n = 0;
+        while (n < WHEEL_BURST && done + n < budget && (id = expired->next) != WHEEL_EXPIRED) {
+            wheel_unlink(w, wheel_node(w, id));
+            idx[n++] = id - WHEEL_HEADS - 1;
+        }
+
+        w->armed -= n;
+        w->expired += n;
+        done += n;
+        w->cb(w->arg, idx, n);
+    }
+
+    return done;
+}
+
+uint32_t wheel_run(wheel_t *w, uint64_t cycles, uint32_t budget)
+{
+    uint32_t target, level, done, ticks = 0;
+
+    target = (uint32_t)((cycles - w->start) >> w->shift);
+
+    done = wheel_drain(w, budget);
+
+    /** nothing armed, no tick needs to be visited
+     * */
+    if (!w->armed && done < budget) {
+        w->now = target + 1;
+        return done;
+    }
+
+    while (done < budget && ticks++ < WHEEL_RUN_TICKS && (int32_t)(target - w->now) >= 0) {
+        for (level = 1; level < WHEEL_LEVELS; level++) {
+            if ((w->now >> ((level - 1) * WHEEL_BITS)) & WHEEL_MASK) {
+                break;
+            }
+            wheel_cascade(w, level);
+        }
+
+        wheel_splice(w);
+        w->now ++;
+        done += wheel_drain(w, budget - done);
+    }
+
+    return done;
+}
+
+// file format utf-8
+// ident using space
@@ -0,0 +1,192 @@
+#ifndef _M_WHEEL_H_
+#define _M_WHEEL_H_
+
+/** Hierarchical timing wheel for aging large tables on one lcore
+ *
+ * WHEEL_LEVELS wheels of WHEEL_SLOTS slots each, level l covering
+ * ticks of WHEEL_SLOTS^l, in the way of Varghese and Lauck. A timer
+ * is linked into the slot of the lowest level its expiry falls into,
+ * the slots of a higher level are cascaded down when the level below
+ * wraps, so arm, cancel and expiry are O(1) and a timer is moved at
+ * most WHEEL_LEVELS - 1 times whatever the number of timers.
+ *
+ * Timers are not allocated, a wheel_node_t of 12 bytes lives inside
+ * each entry of the table aged, and nodes link each other by index
+ * into that table, a zeroed node is not armed. Expired entries are
+ * handed to the callback in bursts of up to WHEEL_BURST indices.
+ *
+ * Entries are meant to be refreshed lazily: a packet only stores its
+ * last seen time in the entry, the timer is armed once for the first
+ * deadline, and the callback arms it again for the remaining time if
+ * the entry was seen meanwhile. A wheel belongs to one lcore, nothing
+ * is atomic.
+ * */
+
+#include <stdint.h>
+
+#define WHEEL_BITS          8
+#define WHEEL_SLOTS         (1U << WHEEL_BITS)
+#define WHEEL_MASK          (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS        4
+#define WHEEL_HEADS         (WHEEL_LEVELS * WHEEL_SLOTS + 1)    /** the last one is the expired list */
+#define WHEEL_MAX_TICKS     (1U << 31)                          /** timers further out expire then */
+#define WHEEL_BURST         64
+#define WHEEL_RUN_TICKS     (WHEEL_SLOTS * 4)                   /** most ticks visited by a run */
+
+typedef struct {
+    uint32_t next;              /** 0 while not armed */
+    uint32_t prev;
+    uint32_t expire;            /** tick */
+} wheel_node_t;
+
+/** Called with indices of expired entries, whose timers are no longer
+ * armed; the callback may arm them again or cancel other timers
+ * */
+typedef void (*wheel_expire_cb)(void *arg, const uint32_t *idx, uint16_t n);
+
+typedef struct {
+    void *entries;              /** first entry of the table aged */
+    uint32_t size;              /** bytes from one entry to the next */
+    uint32_t offset;            /** of the wheel_node_t inside an entry */
+    uint32_t num;               /** entries */
+    uint64_t tick;              /** timer cycles, rounded up to a power of two */
+    wheel_expire_cb cb;
+    void *arg;
+    int socket;
+} wheel_conf_t;
+
+typedef struct {
+    uint8_t *nodes;             /** node of entry 0 */
+    uint32_t size;
+    uint32_t num;
+    uint32_t now;               /** next tick to run */
+    uint32_t shift;             /** log2 of cycles per tick */
+    uint64_t start;             /** timer cycles of tick 0 */
+    uint32_t armed;
+    uint64_t expired;
+    uint64_t cascaded;
+    wheel_expire_cb cb;
+    void *arg;
+    wheel_node_t heads[WHEEL_HEADS];
+} wheel_t;
+
+/** Node ids, 0 is none, then the slot heads, then the entries
+ * */
+static inline wheel_node_t *
+wheel_node(wheel_t *w, uint32_t id)
+{
+    if (id <= WHEEL_HEADS) {
+        return &w->heads[id - 1];
+    }
+
+    return (wheel_node_t *)(w->nodes + (uint64_t)(id - WHEEL_HEADS - 1) * w->size);
+}
+
+/** Tick of a deadline in timer cycles, rounded up so a timer never
+ * expires before its deadline
+ * */
+static inline uint32_t
+wheel_tick(const wheel_t *w, uint64_t cycles)
+{
+    return (uint32_t)((cycles - w->start + (1ULL << w->shift) - 1) >> w->shift);
+}
+
+static inline int
+wheel_armed(wheel_t *w, uint32_t idx)
+{
+    return wheel_node(w, idx + WHEEL_HEADS + 1)->next != 0;
+}
+
+/** Link a node into the slot of its expiry, relative to the next tick
+ * to run; expiries in the past go to that tick
+ * */
+static inline void
+wheel_link(wheel_t *w, uint32_t id, wheel_node_t *n)
+{
+    wheel_node_t *head, *tail;
+    uint32_t delta, level, hid;
+
+    delta = n->expire - w->now;
+    if ((int32_t)delta < 0) {
+        n->expire = w->now;
+        delta = 0;
+    } else if (delta >= WHEEL_MAX_TICKS) {
+        delta = WHEEL_MAX_TICKS - 1;
+        n->expire = w->now + delta;
+    }
+
+    level = delta ? (31 - __builtin_clz(delta)) / WHEEL_BITS : 0;
+    hid = level * WHEEL_SLOTS + ((n->expire >> (level * WHEEL_BITS)) & WHEEL_MASK) + 1;
+
+    head = &w->heads[hid - 1];
+    tail = wheel_node(w, head->prev);
+    n->next = hid;
+    n->prev = head->prev;
+    tail->next = id;
+    head->prev = id;
+}
+
+static inline void
+wheel_unlink(wheel_t *w, wheel_node_t *n)
+{
+    wheel_node(w, n->prev)->next = n->next;
+    wheel_node(w, n->next)->prev = n->prev;
+    n->next = 0;
+    n->prev = 0;
+}
+
+/** Arm or re-arm the timer of entry idx
+ * @param cycles
+ *  deadline in timer cycles
+ * */
+static inline void
+wheel_arm(wheel_t *w, uint32_t idx, uint64_t cycles)
+{
+    uint32_t id = idx + WHEEL_HEADS + 1;
+    wheel_node_t *n = wheel_node(w, id);
+
+    if (n->next) {
+        wheel_unlink(w, n);
+    } else {
+        w->armed ++;
+    }
+
+    n->expire = wheel_tick(w, cycles);
+    wheel_link(w, id, n);
+}
+
+/** Cancel the timer of entry idx, nothing if not armed
+ * */
+static inline void
+wheel_cancel(wheel_t *w, uint32_t idx)
+{
+    wheel_node_t *n = wheel_node(w, idx + WHEEL_HEADS + 1);
+
+    if (n->next) {
+        wheel_unlink(w, n);
+        w->armed --;
+    }
+}
+
+/** Create a wheel for the entries of conf, no timer armed
+ * @return
+ *  the wheel, NULL for a failure
+ * */
+wheel_t *wheel_create(const wheel_conf_t *conf);
+
+void wheel_free(wheel_t *w);
+
+/** Run the ticks up to the time given and call back what expired,
+ * at most WHEEL_RUN_TICKS of them: a wheel left behind, by a parked
+ * lcore say, catches up over the next runs instead of in one
+ * @param budget
+ *  most expired entries to call back, the rest waits for the next run
+ * @return
+ *  number of entries called back
+ * */
+uint32_t wheel_run(wheel_t *w, uint64_t cycles, uint32_t budget);
+
+#endif
+
+// file format utf-8
+// ident using space
@@ -3,12 +3,20 @@
 
 #include <rte_lcore.h>
 #include <rte_ring.h>
+#include <rte_cycles.h>
 #include <rte_mbuf.h>
+#include <rte_malloc.h>
+#include <rte_graph_worker.h>
 
 #include "worker.h"
 #include "config.h"
 #include "module.h"
 #include "packet.h"
+#include "hot.h"
+#include "graph/graph.h"
+#include "interface/interface.h"
+#include "interface/bridge.h"
+#include "ipsec/ipsec.h"
 
 /** Mbuf flow between RX, WORKER, TX:
  * ===========================================================
@@ -22,18 +30,47 @@
  *   v---queue2-------------^          >-----> port2-queue2
  * ...
  * ===========================================================
+ *
+ * The queues outlive a hot restart, a takeover finds them by name
+ * with what the old process left in them.
  * */
 
+volatile uint8_t worker_states[MAX_WORKER_NUM];
+volatile uint8_t worker_rx_map[MAX_WORKER_NUM] = {0, 1, 2, 3, 4, 5, 6, 7};
+volatile uint32_t worker_epoch;
+volatile uint32_t worker_epoch_seen;
+struct rte_rcu_qsbr *worker_qsv;
+
+static struct rte_ring *
+worker_ring(const char *name, unsigned int count)
+{
+    if (hot_takeover()) {
+        return rte_ring_lookup(name);
+    }
+
+    return rte_ring_create(name, count, rte_socket_id(), 0);
+}
+
 int worker_init(config_t *config)
 {
     char qname[128];
+    size_t size;
     int i, j;
+
+    /** per process, the lcores of a takeover register afresh
+     * */
+    size = rte_rcu_qsbr_get_memsize(RTE_MAX_LCORE);
+    worker_qsv = rte_zmalloc("worker_qsv", size, RTE_CACHE_LINE_SIZE);
+    if (!worker_qsv || rte_rcu_qsbr_init(worker_qsv, RTE_MAX_LCORE)) {
+        printf("worker qsbr init failed\n");
+        return -1;
+    }
     
     for (i = 0; i < config->worker_num; i++) {
         memset(qname, 0, 128);
         sprintf(qname, "%s-%d", "worker-rx-queue", i);
 
-        config->rx_queues[i] = rte_ring_create(qname, 1024 * config->port_num, rte_socket_id(), 0);
+        config->rx_queues[i] = worker_ring(qname, 1024 * config->port_num);
         if (!config->rx_queues[i]) {
             goto error;
         }
@@ -44,7 +81,7 @@ int worker_init(config_t *config)
             memset(qname, 0, 128);
             sprintf(qname, "%s-%d-%d", "worker-tx-queue", i, j);
 
-            config->tx_queues[i][j] = rte_ring_create(qname, 1024, rte_socket_id(), 0);
+            config->tx_queues[i][j] = worker_ring(qname, 1024);
             if (!config->tx_queues[i][j]) {
                 goto error;
             }
@@ -54,6 +91,12 @@ int worker_init(config_t *config)
     return 0;
 
 error:
+    /** the running process still uses what a takeover found
+     * */
+    if (hot_takeover()) {
+        return -1;
+    }
+
     for (i = 0; i < config->worker_num; i++) {
         if (config->rx_queues[i]) {
             rte_ring_free(config->rx_queues[i]);
@@ -71,6 +114,151 @@ int worker_init(config_t *config)
     return -1;
 }
 
+int worker_lcore(config_t *config, unsigned int lcore_id)
+{
+    int id = lcore_id;
+
+    if (!rte_lcore_is_enabled(lcore_id)) {
+        return 0;
+    }
+
+    if (id == config->mgt_core || id == config->rx_core ||
+        id == config->tx_core || id == config->rtx_core) {
+        return 0;
+    }
+
+    return 1;
+}
+
+unsigned int worker_active_num(config_t *config)
+{
+    unsigned int n = 0;
+    int i;
+
+    for (i = 0; i < config->worker_num; i++) {
+        if (worker_states[i] == WORKER_ACTIVE) n ++;
+    }
+
+    return n;
+}
+
+/** Point the rx queue of each worker not active, nor the one being
+ * parked, to an active one, and wait until the RX lcore polls with the
+ * new mapping, so nothing is put in a ring after its worker found it
+ * empty
+ * */
+static int
+worker_remap(config_t *config, int parking)
+{
+    uint8_t active[MAX_WORKER_NUM];
+    unsigned int n = 0, k = 0;
+    uint64_t deadline;
+    int i;
+
+    for (i = 0; i < config->worker_num; i++) {
+        if (worker_states[i] == WORKER_ACTIVE && i != parking) active[n++] = i;
+    }
+
+    if (!n) {
+        return -1;
+    }
+
+    for (i = 0; i < config->worker_num; i++) {
+        worker_rx_map[i] = (worker_states[i] == WORKER_ACTIVE && i != parking) ? i : active[k++ % n];
+    }
+
+    rte_smp_wmb();
+    worker_epoch ++;
+
+    deadline = rte_get_timer_cycles() + rte_get_timer_hz() / 10;
+    while (worker_epoch_seen != worker_epoch) {
+        if (rte_get_timer_cycles() > deadline) {
+            printf("rx lcore did not ack worker mapping %u\n", worker_epoch);
+            return -1;
+        }
+        rte_pause();
+    }
+
+    return 0;
+}
+
+int worker_park(config_t *config, unsigned int queueid)
+{
+    if (queueid >= (unsigned int)config->worker_num || worker_states[queueid] != WORKER_ACTIVE) {
+        return -1;
+    }
+
+    if (worker_active_num(config) <= 1) {
+        return -1;
+    }
+
+    /** the worker only parks once the RX lcore took the mapping
+     * without it and its ring is empty
+     * */
+    if (worker_remap(config, queueid)) {
+        worker_remap(config, -1);
+        return -1;
+    }
+
+    worker_states[queueid] = WORKER_PARKING;
+    interface_reta_update(config);
+    return 0;
+}
+
+int worker_unpark(config_t *config, unsigned int queueid)
+{
+    if (queueid >= (unsigned int)config->worker_num || worker_states[queueid] == WORKER_ACTIVE) {
+        return -1;
+    }
+
+    worker_states[queueid] = WORKER_ACTIVE;
+    worker_remap(config, -1);
+    interface_reta_update(config);
+    return 0;
+}
+
+/** Whether the worker of queueid skips this round, a parking worker
+ * goes on until its ring is empty and its crypto ops are back
+ * */
+static int
+worker_parked(config_t *config, unsigned int queueid)
+{
+    if (worker_states[queueid] == WORKER_PARKING) {
+        if (worker_epoch_seen != worker_epoch || rte_ring_count(config->rx_queues[queueid]) ||
+            ipsec_poll(config)) {
+            return 0;
+        }
+        worker_states[queueid] = WORKER_PARKED;
+    }
+
+    rte_delay_us_sleep(1000);
+    return 1;
+}
+
+/** Packets for the kernel, PORT_LOCAL once PREROUTING is done, go to
+ * LOCALIN and end there, the others skip the local hooks, see punt.h
+ * */
+static inline int
+worker_hook_next(struct rte_mbuf *mbuf, int hook)
+{
+    packet_t *p;
+
+    if (hook == MOD_HOOK_PREROUTING) {
+        p = rte_mbuf_to_priv(mbuf);
+        return (p && p->oport == PORT_LOCAL) ? MOD_HOOK_LOCALIN : MOD_HOOK_FORWARD;
+    }
+
+    if (hook == MOD_HOOK_POSTROUTING) {
+        return MOD_HOOK_EGRESS;
+    }
+
+    if (hook == MOD_HOOK_LOCALIN) {
+        return MOD_HOOK_EGRESS + 1;
+    }
+
+    return hook + 1;
+}
+
 int RX(__rte_unused config_t *config)
 {
     modules_proc(config, NULL, MOD_HOOK_RECV);
@@ -97,12 +285,21 @@ int WORKER(config_t *config)
     int ret, hook, portid, queueid;
 
     queueid = rte_lcore_id() % config->worker_num;
+    if (unlikely(worker_states[queueid] != WORKER_ACTIVE) && worker_parked(config, queueid)) {
+        return 0;
+    }
+
+    if (config->graph_mode) {
+        return GRAPH_WORKER(config);
+    }
+
     ret = rte_ring_dequeue(config->rx_queues[queueid], (void **)&mbuf);
     if (ret || !mbuf) {
+        modules_proc(config, NULL, MOD_HOOK_IDLE);
         return 0;
     }
 
-    for (hook = MOD_HOOK_INGRESS; hook <= MOD_HOOK_EGRESS; hook ++) {
+    for (hook = MOD_HOOK_INGRESS; hook <= MOD_HOOK_EGRESS; hook = worker_hook_next(mbuf, hook)) {
         if (modules_proc(config, mbuf, hook)) {
             return 0;
         }
@@ -115,6 +312,16 @@ int WORKER(config_t *config)
     }
     portid = p->oport;
 
+    if (portid == PORT_FLOOD) {
+        bridge_flood(config, &mbuf, 1, queueid);
+        return 0;
+    }
+
+    if (portid >= config->port_num) {
+        rte_pktmbuf_free(mbuf);
+        return -1;
+    }
+
     ret = rte_ring_enqueue(config->tx_queues[portid][queueid], mbuf);
     if (ret) {
         rte_pktmbuf_free(mbuf);
@@ -124,6 +331,19 @@ int WORKER(config_t *config)
     return 0;
 }
 
+int GRAPH_WORKER(__rte_unused config_t *config)
+{
+    struct rte_graph *graph;
+
+    graph = graph_get(rte_lcore_id());
+    if (!graph) {
+        return -1;
+    }
+
+    rte_graph_walk(graph);
+    return 0;
+}
+
 int RTX_WORKER(config_t *config)
 {
     RX(config);
@@ -1,15 +1,76 @@
 #ifndef _M_WORKER__H_
 #define _M_WORKER__H_
 
+#include <rte_rcu_qsbr.h>
+
 #include "config.h"
 
+/** Worker lcores can be parked at runtime and their rx queue served by
+ * the others, states and rx ring mapping are indexed by worker queue,
+ * lcore_id % worker_num
+ * */
+typedef enum {
+    WORKER_ACTIVE,
+    WORKER_PARKING,         /** no longer fed, draining its rx ring */
+    WORKER_PARKED,
+} worker_state_t;
+
+extern volatile uint8_t worker_states[MAX_WORKER_NUM];
+extern volatile uint8_t worker_rx_map[MAX_WORKER_NUM];
+extern volatile uint32_t worker_epoch;
+extern volatile uint32_t worker_epoch_seen;
+
+/** Ring of the worker serving rx queue queueid
+ * */
+static inline void *
+worker_rx_ring(config_t *config, unsigned int queueid)
+{
+    return config->rx_queues[worker_rx_map[queueid]];
+}
+
+/** Called by the RX lcore before each poll, the mapping it reads from
+ * now on is the one of worker_epoch
+ * */
+static inline void
+worker_rx_ack(void)
+{
+    if (worker_epoch_seen != worker_epoch) {
+        worker_epoch_seen = worker_epoch;
+        rte_smp_rmb();
+    }
+}
+
+/** Readers of the lock free hashes, every lcore of main_loop() goes
+ * quiescent once per pass. A position freed right after its key is
+ * deleted may be reused under a worker still matching the key, so a
+ * writer deletes, takes rte_rcu_qsbr_start() and frees the positions
+ * and entries once rte_rcu_qsbr_check() of that token passes.
+ * */
+extern struct rte_rcu_qsbr *worker_qsv;
+
 int worker_init(config_t *config);
 
+/** Whether given lcore runs WORKER(), see main_loop()
+ * */
+int worker_lcore(config_t *config, unsigned int lcore_id);
+
+/** Stop feeding a worker, it parks once its ring is empty, management
+ * core only
+ * */
+int worker_park(config_t *config, unsigned int queueid);
+
+/** Feed a parked worker again, management core only
+ * */
+int worker_unpark(config_t *config, unsigned int queueid);
+
+unsigned int worker_active_num(config_t *config);
+
 int RX(__rte_unused config_t *config);
 int TX(__rte_unused config_t *config);
 int RTX(config_t *config);
 int WORKER(config_t *config);
 int RTX_WORKER(config_t *config);
+int GRAPH_WORKER(__rte_unused config_t *config);
 
 #endif
 
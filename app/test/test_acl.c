@@ -25,6 +25,7 @@ test_acl(void)
 #include <rte_common.h>
 
 #include "test_acl.h"
+#include "../firewall/acl/group.h"
 
 #define	BIT_SIZEOF(x) (sizeof(x) * CHAR_BIT)
 
@@ -595,6 +596,266 @@ test_build_ports_range(void)
 	return ret;
 }
 
+/*
+ * A rule given with several prefixes is added as one rte_acl rule per
+ * prefix, all with the userdata of the rule. Check that the userdata
+ * returned for the rule added after such a set identifies that rule,
+ * while rte_acl_rule_data() still looks rules up by position.
+ */
+static int
+test_expanded_rules(void)
+{
+#define EXPANDED_RULE(ud, prio, addr) { \
+	.data = { \
+		.userdata = (ud), \
+		.category_mask = ACL_ALLOW_MASK, \
+		.priority = (prio), \
+	}, \
+	.dst_addr = (addr), \
+	.dst_mask_len = 16, \
+	.src_port_low = 0, \
+	.src_port_high = UINT16_MAX, \
+	.dst_port_low = 0, \
+	.dst_port_high = UINT16_MAX, \
+}
+
+	static const struct rte_acl_ipv4vlan_rule test_rules[] = {
+		/* rule 10 over 10.1.0.0/16, 10.3.0.0/16 and 10.5.0.0/16 */
+		EXPANDED_RULE(1, 10, RTE_IPV4(10, 1, 0, 0)),
+		EXPANDED_RULE(1, 10, RTE_IPV4(10, 3, 0, 0)),
+		EXPANDED_RULE(1, 10, RTE_IPV4(10, 5, 0, 0)),
+		/* rule 20 over 192.168.0.0/16 */
+		EXPANDED_RULE(2, 20, RTE_IPV4(192, 168, 0, 0)),
+	};
+
+#undef EXPANDED_RULE
+
+	/* rule ids of acl.json, indexed by userdata - 1 */
+	static const uint32_t rule_id[] = { 10, 20 };
+
+	static struct ipv4_7tuple test_data[] = {
+		{
+			.proto = 6,
+			.ip_src = RTE_IPV4(1, 1, 1, 1),
+			.ip_dst = RTE_IPV4(10, 5, 0, 1),
+			.port_dst = 80,
+			.allow = 1,
+		},
+		{
+			.proto = 6,
+			.ip_src = RTE_IPV4(1, 1, 1, 1),
+			.ip_dst = RTE_IPV4(192, 168, 7, 1),
+			.port_dst = 80,
+			.allow = 2,
+		},
+		{
+			.proto = 17,
+			.ip_src = RTE_IPV4(1, 1, 1, 1),
+			.ip_dst = RTE_IPV4(10, 2, 0, 1),
+			.port_dst = 53,
+			.allow = 0,
+		},
+	};
+
+	static const uint32_t expected_id[] = { 10, 20, 0 };
+
+	struct rte_acl_ctx *acx;
+	struct rte_acl_rule_data *rd;
+	int32_t ret;
+	uint32_t i, id;
+	uint32_t results[RTE_DIM(test_data)];
+	const uint8_t *data[RTE_DIM(test_data)];
+
+	acx = rte_acl_create(&acl_param);
+	if (acx == NULL) {
+		printf("Line %i: Error creating ACL context!\n", __LINE__);
+		return -1;
+	}
+
+	ret = test_classify_buid(acx, test_rules, RTE_DIM(test_rules));
+	if (ret != 0) {
+		printf("Line %i: Adding rules to ACL context failed!\n",
+			__LINE__);
+		rte_acl_free(acx);
+		return ret;
+	}
+
+	/* swap all bytes in the data to network order */
+	bswap_test_data(test_data, RTE_DIM(test_data), 1);
+
+	/* store pointers to test data */
+	for (i = 0; i != RTE_DIM(test_data); i++)
+		data[i] = (uint8_t *)&test_data[i];
+
+	ret = rte_acl_classify(acx, data, results, RTE_DIM(data), 1);
+	if (ret != 0) {
+		printf("Line %i: classify failed!\n", __LINE__);
+		goto err;
+	}
+
+	for (i = 0; i != RTE_DIM(results); i++) {
+		if (results[i] != test_data[i].allow) {
+			printf("Line %i: Error in allow results at %u "
+				"(expected %"PRIu32" got %"PRIu32")!\n",
+				__LINE__, i, test_data[i].allow, results[i]);
+			ret = -EINVAL;
+			goto err;
+		}
+
+		id = (results[i] == 0) ? 0 : rule_id[results[i] - 1];
+		if (id != expected_id[i]) {
+			printf("Line %i: Error in rule id at %u "
+				"(expected %"PRIu32" got %"PRIu32")!\n",
+				__LINE__, i, expected_id[i], id);
+			ret = -EINVAL;
+			goto err;
+		}
+	}
+
+	/* the second rule added is the second prefix of rule 10 */
+	rd = rte_acl_rule_data(acx, test_data[1].allow);
+	if (rd == NULL || rd->userdata != 1 || rd->priority != 10) {
+		printf("Line %i: rte_acl_rule_data() is not by position!\n",
+			__LINE__);
+		ret = -EINVAL;
+	}
+
+err:
+	bswap_test_data(test_data, RTE_DIM(test_data), 0);
+
+	rte_acl_free(acx);
+	return ret;
+}
+
+/*
+ * Sets of the firewall acl.json, see app/firewall/acl/group.h: group
+ * members merge into the fewest prefixes and port ranges, and a rule
+ * expands to the cross product of its sets, sip outermost.
+ */
+RTE_ACL_RULE_DEF(acl_group_rule, ACL_FIELD_DP + 1);
+
+static int
+test_group_rules(void)
+{
+	static const char * const lan[] = {
+		"10.0.0.0/25", "10.0.0.128/25", "10.0.1.0/24",
+	};
+	static const char * const web[] = {
+		"80", "81", "443", "8000-8080", "8080-8443",
+	};
+	static const char * const nested[] = { "@lan" };
+
+	/* sip, dip, sp, dp of every expanded rule, in order */
+	static const struct {
+		uint32_t sip;
+		uint32_t sip_depth;
+		uint16_t dp_lo;
+		uint16_t dp_hi;
+	} expected[] = {
+		{ RTE_IPV4(10, 0, 0, 0), 23, 80, 81 },
+		{ RTE_IPV4(10, 0, 0, 0), 23, 443, 443 },
+		{ RTE_IPV4(10, 0, 0, 0), 23, 8000, 8443 },
+		{ RTE_IPV4(10, 0, 2, 0), 24, 80, 81 },
+		{ RTE_IPV4(10, 0, 2, 0), 24, 443, 443 },
+		{ RTE_IPV4(10, 0, 2, 0), 24, 8000, 8443 },
+	};
+
+	struct acl_group_rule base, rules[RTE_DIM(expected)];
+	acl_prefix_t sips[4], dips[4];
+	acl_range_t sps[4], dps[4];
+	acl_groups_t *g;
+	acl_sets_t sets;
+	uint32_t i, n;
+	int ret = -1;
+
+	g = calloc(1, sizeof(*g));
+	if (g == NULL) {
+		printf("Line %i: Error allocating groups!\n", __LINE__);
+		return -1;
+	}
+
+	if (acl_group_add(g, 1, "lan", lan, RTE_DIM(lan)) != 0 ||
+			acl_group_add(g, 0, "web", web, RTE_DIM(web)) != 0 ||
+			acl_groups_normalize(g) != 0) {
+		printf("Line %i: Error adding groups!\n", __LINE__);
+		goto err;
+	}
+
+	if (g->addrs[0].num != 1 || g->ports[0].num != 3) {
+		printf("Line %i: Groups not normalized "
+			"(%"PRIu32" prefixes, %"PRIu32" ranges)!\n",
+			__LINE__, g->addrs[0].num, g->ports[0].num);
+		goto err;
+	}
+
+	/* members can not name groups, sets can not name unknown ones */
+	if (acl_group_add(g, 1, "nested", nested, RTE_DIM(nested)) == 0 ||
+			acl_addr_set(g, "@none", sips, RTE_DIM(sips)) >= 0) {
+		printf("Line %i: Invalid group reference accepted!\n",
+			__LINE__);
+		goto err;
+	}
+
+	memset(&sets, 0, sizeof(sets));
+	sets.sips = sips;
+	sets.dips = dips;
+	sets.sps = sps;
+	sets.dps = dps;
+	sets.nsip = acl_addr_set(g, "@lan, 10.0.2.0/24", sips, RTE_DIM(sips));
+	sets.ndip = acl_addr_set(g, "192.168.1.0/24, 192.168.1.7",
+		dips, RTE_DIM(dips));
+	sets.nsp = acl_port_set(g, "any", sps, RTE_DIM(sps));
+	sets.ndp = acl_port_set(g, "@web", dps, RTE_DIM(dps));
+
+	if (sets.nsip != 2 || sets.ndip != 1 || sets.nsp != 1 ||
+			sets.ndp != 3) {
+		printf("Line %i: Error in set sizes %d %d %d %d!\n",
+			__LINE__, sets.nsip, sets.ndip, sets.nsp, sets.ndp);
+		goto err;
+	}
+
+	memset(&base, 0, sizeof(base));
+	base.data.userdata = 1;
+	base.data.category_mask = 1;
+	base.data.priority = 10;
+
+	n = acl_rule_expand(&sets, (const struct rte_acl_rule *)&base,
+		sizeof(base), rules);
+	if (n != RTE_DIM(expected)) {
+		printf("Line %i: Rule expanded to %"PRIu32" rules!\n",
+			__LINE__, n);
+		goto err;
+	}
+
+	for (i = 0; i != n; i++) {
+		if (rules[i].field[ACL_FIELD_SIP].value.u32 != expected[i].sip ||
+				rules[i].field[ACL_FIELD_SIP].mask_range.u32 !=
+					expected[i].sip_depth ||
+				rules[i].field[ACL_FIELD_DIP].value.u32 !=
+					RTE_IPV4(192, 168, 1, 0) ||
+				rules[i].field[ACL_FIELD_DIP].mask_range.u32 != 24 ||
+				rules[i].field[ACL_FIELD_SP].value.u16 != 0 ||
+				rules[i].field[ACL_FIELD_SP].mask_range.u16 !=
+					UINT16_MAX ||
+				rules[i].field[ACL_FIELD_DP].value.u16 !=
+					expected[i].dp_lo ||
+				rules[i].field[ACL_FIELD_DP].mask_range.u16 !=
+					expected[i].dp_hi ||
+				rules[i].data.userdata != 1 ||
+				rules[i].data.priority != 10) {
+			printf("Line %i: Error in expanded rule %u!\n",
+				__LINE__, i);
+			goto err;
+		}
+	}
+
+	ret = 0;
+err:
+	acl_groups_free(g);
+	free(g);
+	return ret;
+}
+
 static void
 convert_rule(const struct rte_acl_ipv4vlan_rule *ri,
 	struct acl_ipv4vlan_rule *ro)
@@ -1743,6 +2004,10 @@ test_acl(void)
 		return -1;
 	if (test_build_ports_range() < 0)
 		return -1;
+	if (test_expanded_rules() < 0)
+		return -1;
+	if (test_group_rules() < 0)
+		return -1;
 	if (test_convert() < 0)
 		return -1;
 	if (test_u32_range() < 0)
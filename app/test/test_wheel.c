@@ -0,0 +1,242 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <rte_common.h>
+#include <rte_memory.h>
+
+#include "test.h"
+#include "../firewall/wheel.h"
+
+#define WHEEL_TEST_ENTRIES 16
+
+struct wheel_test_entry {
+	uint32_t data;
+	wheel_node_t timer;
+};
+
+static struct wheel_test_entry entries[WHEEL_TEST_ENTRIES];
+static uint32_t expired[WHEEL_TEST_ENTRIES];
+static uint32_t expired_num;
+
+static void
+wheel_test_expire(__rte_unused void *arg, const uint32_t *idx, uint16_t n)
+{
+	uint16_t i;
+
+	for (i = 0; i != n; i++) {
+		if (expired_num < RTE_DIM(expired))
+			expired[expired_num] = idx[i];
+		expired_num++;
+	}
+}
+
+/* one tick per timer cycle, counted from the start of the wheel */
+static wheel_t *
+wheel_test_create(void)
+{
+	wheel_conf_t conf = {
+		.entries = entries,
+		.size = sizeof(entries[0]),
+		.offset = offsetof(struct wheel_test_entry, timer),
+		.num = RTE_DIM(entries),
+		.tick = 1,
+		.cb = wheel_test_expire,
+		.socket = SOCKET_ID_ANY,
+	};
+
+	memset(entries, 0, sizeof(entries));
+	expired_num = 0;
+	return wheel_create(&conf);
+}
+
+static uint64_t
+wheel_test_cycles(const wheel_t *w, uint32_t tick)
+{
+	return w->start + tick;
+}
+
+/* run up to tick, a run visits at most WHEEL_RUN_TICKS ticks */
+static uint32_t
+wheel_test_run(wheel_t *w, uint32_t tick)
+{
+	uint32_t done = 0;
+
+	while ((int32_t)(tick - w->now) >= 0)
+		done += wheel_run(w, wheel_test_cycles(w, tick), UINT32_MAX);
+
+	return done;
+}
+
+static int
+test_wheel_arm_cancel(void)
+{
+	wheel_t *w;
+	int ret = TEST_FAILED;
+
+	w = wheel_test_create();
+	if (w == NULL) {
+		printf("Line %i: Error creating wheel!\n", __LINE__);
+		return TEST_FAILED;
+	}
+
+	wheel_arm(w, 3, wheel_test_cycles(w, 10));
+	wheel_cancel(w, 3);
+	if (wheel_armed(w, 3) || w->armed != 0) {
+		printf("Line %i: Timer still armed after cancel!\n", __LINE__);
+		goto err;
+	}
+
+	/* cancel of a timer not armed is nothing */
+	wheel_cancel(w, 3);
+
+	wheel_arm(w, 3, wheel_test_cycles(w, 20));
+	wheel_arm(w, 3, wheel_test_cycles(w, 30));
+	if (!wheel_armed(w, 3) || w->armed != 1) {
+		printf("Line %i: Timer not armed once!\n", __LINE__);
+		goto err;
+	}
+
+	if (wheel_test_run(w, 29) != 0 || expired_num != 0) {
+		printf("Line %i: Timer expired before its deadline!\n",
+			__LINE__);
+		goto err;
+	}
+
+	if (wheel_test_run(w, 30) != 1 || expired_num != 1 ||
+			expired[0] != 3 || wheel_armed(w, 3) || w->armed != 0) {
+		printf("Line %i: Timer did not expire at its deadline!\n",
+			__LINE__);
+		goto err;
+	}
+
+	ret = TEST_SUCCESS;
+err:
+	wheel_free(w);
+	return ret;
+}
+
+/*
+ * Timers reaching into the next levels from just before a level 0
+ * wrap, each has to go off at its tick, after cascading.
+ */
+static int
+test_wheel_levels(void)
+{
+	static const uint32_t deltas[] = {
+		0xff, 0x100, 0x101, 0xffff, 0x10000, 0x10001, 0xffffff,
+	};
+	const uint32_t now = 0x1ff;
+	wheel_t *w;
+	uint32_t i, expire;
+
+	for (i = 0; i != RTE_DIM(deltas); i++) {
+		w = wheel_test_create();
+		if (w == NULL) {
+			printf("Line %i: Error creating wheel!\n", __LINE__);
+			return TEST_FAILED;
+		}
+
+		/* nothing armed, the wheel moves straight to now */
+		wheel_test_run(w, now - 1);
+
+		expire = now + deltas[i];
+		wheel_arm(w, i, wheel_test_cycles(w, expire));
+
+		wheel_test_run(w, expire - 1);
+		if (expired_num != 0) {
+			printf("Line %i: Timer of delta %#x expired early!\n",
+				__LINE__, deltas[i]);
+			wheel_free(w);
+			return TEST_FAILED;
+		}
+
+		wheel_test_run(w, expire);
+		wheel_free(w);
+		if (expired_num != 1 || expired[0] != i) {
+			printf("Line %i: Timer of delta %#x did not expire!\n",
+				__LINE__, deltas[i]);
+			return TEST_FAILED;
+		}
+	}
+
+	return TEST_SUCCESS;
+}
+
+/*
+ * A budget cuts the expired list, the rest is called back by the
+ * next runs in order, and a run after a long pause visits a bounded
+ * number of ticks.
+ */
+static int
+test_wheel_budget(void)
+{
+	wheel_t *w;
+	uint32_t i, n;
+	int ret = TEST_FAILED;
+
+	w = wheel_test_create();
+	if (w == NULL) {
+		printf("Line %i: Error creating wheel!\n", __LINE__);
+		return TEST_FAILED;
+	}
+
+	for (i = 0; i != 10; i++)
+		wheel_arm(w, i, wheel_test_cycles(w, 5));
+
+	n = wheel_run(w, wheel_test_cycles(w, 5), 4);
+	if (n != 4 || expired_num != 4 || w->armed != 6) {
+		printf("Line %i: Budget not kept, %u called back!\n",
+			__LINE__, n);
+		goto err;
+	}
+
+	n = wheel_run(w, wheel_test_cycles(w, 5), 4);
+	n += wheel_run(w, wheel_test_cycles(w, 5), 4);
+	if (n != 6 || expired_num != 10 || w->armed != 0) {
+		printf("Line %i: Rest of the list not called back!\n",
+			__LINE__);
+		goto err;
+	}
+
+	for (i = 0; i != 10; i++) {
+		if (expired[i] != i) {
+			printf("Line %i: Entry %u called back out of order!\n",
+				__LINE__, i);
+			goto err;
+		}
+	}
+
+	/* one timer far out keeps the wheel walking, ticks are bounded */
+	wheel_arm(w, 0, wheel_test_cycles(w, 1U << 30));
+	i = w->now;
+	wheel_run(w, wheel_test_cycles(w, 1U << 29), UINT32_MAX);
+	if (w->now - i > WHEEL_RUN_TICKS) {
+		printf("Line %i: Run visited %u ticks!\n", __LINE__,
+			w->now - i);
+		goto err;
+	}
+
+	ret = TEST_SUCCESS;
+err:
+	wheel_free(w);
+	return ret;
+}
+
+static int
+test_wheel(void)
+{
+	if (test_wheel_arm_cancel() != TEST_SUCCESS)
+		return TEST_FAILED;
+	if (test_wheel_levels() != TEST_SUCCESS)
+		return TEST_FAILED;
+	if (test_wheel_budget() != TEST_SUCCESS)
+		return TEST_FAILED;
+
+	return TEST_SUCCESS;
+}
+
+REGISTER_TEST_COMMAND(wheel_autotest, test_wheel);
@@ -0,0 +1,33 @@
+# benchmark IPsec tunnels on net_null ports with a software crypto PMD, no NIC or traffic generator needed
+
+#! /bin/bash
+
+# set variable
+WORK_PATH=`pwd`
+CONFIG_PATH=/tmp/firewall-ipsec
+LOG_FILE=/tmp/firewall-ipsec.log
+CRYPTO=${CRYPTO:-"crypto_aesni_mb"}
+EAL_ARGS=${EAL_ARGS:-"-n 4 --no-pci --vdev net_null0,no-rx=1 --vdev net_null1,no-rx=1"}
+LAYOUTS=${LAYOUTS:-"0-1 0-3 0-7"}
+
+source ${WORK_PATH}/run.sh
+
+# perf traffic and rules, the tunnel encrypts what goes to 192.168.0.0/17
+mkdir -p ${CONFIG_PATH}
+cp ${WORK_PATH}/app/config/perf/*.json ${CONFIG_PATH}
+cp ${WORK_PATH}/app/config/ipsec/ipsec.json ${CONFIG_PATH}
+
+# crypto_null has no aes, the tunnel goes without crypto then
+if [ "${CRYPTO}" = "crypto_null" ]; then
+    sed -i 's/"aes-gcm"/"null", "auth": "null"/' ${CONFIG_PATH}/ipsec.json
+fi
+
+# one run per core layout and worker mode, the PMD has a queue pair per worker
+for lcores in ${LAYOUTS}; do
+    for mode in "" "--graph"; do
+        echo "-------------------- lcores ${lcores} ${CRYPTO} ${mode} --------------------"
+        dpdk-firewall -l ${lcores} ${EAL_ARGS} --vdev ${CRYPTO},max_nb_queue_pairs=8 \
+            -- --config ${CONFIG_PATH} --log ${LOG_FILE} --perf ${mode} \
+            | sed -n '/==== perf report/,$p'
+    done
+done
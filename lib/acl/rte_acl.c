@@ -561,6 +561,13 @@ _rte_acl_dump(const struct rte_acl_ctx *ctx, char *buffer)
 	sprintf(buffer + strlen(buffer), "  num_rules=%"PRIu32"\n", ctx->num_rules);
 	sprintf(buffer + strlen(buffer), "  num_categories=%"PRIu32"\n", ctx->num_categories);
 	sprintf(buffer + strlen(buffer), "  num_tries=%"PRIu32"\n", ctx->num_tries);
+	sprintf(buffer + strlen(buffer), "  mem_sz=%zu\n", ctx->mem_sz);
+}
+
+size_t
+_rte_acl_mem_size(const struct rte_acl_ctx *ctx)
+{
+	return ctx ? ctx->mem_sz : 0;
 }
 
 /*
@@ -352,6 +352,12 @@ rte_acl_dump(const struct rte_acl_ctx *ctx);
 void
 _rte_acl_dump(const struct rte_acl_ctx *ctx, char *buffer);
 
+/**
+ * Bytes of runtime structures of a built ACL context, 0 before build.
+ */
+size_t
+_rte_acl_mem_size(const struct rte_acl_ctx *ctx);
+
 /**
  * Dump all ACL context structures to the console.
  */
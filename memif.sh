@@ -0,0 +1,40 @@
+# benchmark the firewall chained over zero-copy memif to a peer dpdk app, no NIC needed
+
+#! /bin/bash
+
+# set variable
+WORK_PATH=`pwd`
+CONFIG_PATH=/tmp/firewall-memif
+LOG_FILE=/tmp/firewall-memif.log
+PEER_LOG=/tmp/firewall-memif-peer.log
+SOCKET=/run/memif-fw.sock
+LCORES=${LCORES:-"0-3"}
+PEER_LCORES=${PEER_LCORES:-"4-5"}
+
+source ${WORK_PATH}/run.sh
+
+# perf traffic and rules, memif ports
+mkdir -p ${CONFIG_PATH}
+cp ${WORK_PATH}/app/config/perf/*.json ${CONFIG_PATH}
+cp ${WORK_PATH}/app/config/memif/interface.json ${CONFIG_PATH}
+
+# one run per worker mode, the peer serves both memif ports and counts what it receives
+for mode in "" "--graph"; do
+    echo "-------------------- lcores ${LCORES} ${mode} --------------------"
+    dpdk-testpmd -l ${PEER_LCORES} -n 4 --no-pci --file-prefix memif-peer \
+        --vdev net_memif0,role=server,socket=${SOCKET},id=0 \
+        --vdev net_memif1,role=server,socket=${SOCKET},id=1 \
+        -- --forward-mode=rxonly --auto-start > ${PEER_LOG} 2>&1 &
+    peer=$!
+    sleep 2
+
+    # zero copy hands the peer the mbuf pool, it must be in single files
+    dpdk-firewall -l ${LCORES} -n 4 --no-pci --single-file-segments --file-prefix memif-fw \
+        -- --config ${CONFIG_PATH} --log ${LOG_FILE} --perf ${mode} \
+        | sed -n '/==== perf report/,$p'
+
+    kill -INT ${peer}
+    wait ${peer}
+    echo "peer received"
+    grep -A2 "Accumulated forward statistics" ${PEER_LOG} | grep "RX-packets"
+done
@@ -0,0 +1,21 @@
+# benchmark the firewall on net_null ports, no NIC or traffic generator needed
+
+#! /bin/bash
+
+# set variable
+WORK_PATH=`pwd`
+CONFIG_PATH=${WORK_PATH}/app/config/perf
+LOG_FILE=/tmp/firewall-perf.log
+EAL_ARGS=${EAL_ARGS:-"-n 4 --no-pci --vdev net_null0,no-rx=1 --vdev net_null1,no-rx=1"}
+LAYOUTS=${LAYOUTS:-"0-1 0-3 0-7"}
+
+source ${WORK_PATH}/run.sh
+
+# one run per core layout and worker mode, perf.json in CONFIG_PATH sets the traffic
+for lcores in ${LAYOUTS}; do
+    for mode in "" "--graph"; do
+        echo "-------------------- lcores ${lcores} ${mode} --------------------"
+        dpdk-firewall -l ${lcores} ${EAL_ARGS} -- --config ${CONFIG_PATH} --log ${LOG_FILE} --perf ${mode} \
+            | sed -n '/==== perf report/,$p'
+    done
+done